@@ -8,9 +8,26 @@ export const useChatStore = defineStore('chat', () => {
   const isConnected = ref(false)
   const pollingTimeout = ref<number | null>(null)
   const lastTimestamp = ref<number>(0)
+  const lastSeq = ref<number>(0) // 已收到的最新消息序列号，作为轮询游标
+  const oldestSeq = ref<number>(0) // 已加载的最老消息序列号，作为加载更早消息的游标
+  const hasMoreHistory = ref(false) // 服务器上是否还有更早的消息
+  const isLoadingHistory = ref(false)
+  const pageSize = 50 // 每页加载的历史消息数量
+  const maxMessages = ref(100) // 列表保留的消息数量，加载更早的消息后相应增加
   const pollingDelay = 3000 // 轮询间隔，默认3秒
+  const longPollWait = 25000 // 长轮询等待时间，服务器在此期间有新消息时立即返回
   const reconnectAttempts = ref(0)
   const maxReconnectAttempts = 5
+  const maxWarmingRetries = 10 // 服务器启动时加载历史期间的最大重试次数
+  const isPushConnected = ref(false) // WebSocket推送通道是否可用
+  const wsRetryDelay = 10000 // 推送通道断开后重连间隔，期间退回轮询
+  const wsHeartbeatInterval = 20000 // 推送通道心跳间隔：服务器只按收到的数据判断连接是否活跃，连接满时先关闭最久没有数据的连接
+  const maxSendAttempts = 3 // 发送消息的最多尝试次数
+  const sendTimeout = 8000 // 单次发送的超时时间
+  const sendRetryDelay = 1000 // 重试间隔，按尝试次数递增
+  let socket: WebSocket | null = null
+  let wsRetryTimeout: number | null = null
+  let wsHeartbeat: number | null = null
 
   // 初始化轮询
   const initializePolling = async () => {
@@ -22,38 +39,212 @@ export const useChatStore = defineStore('chat', () => {
     // 重置重连计数
     reconnectAttempts.value = 0
 
-    // 设置初始时间戳为一个较早的时间，确保能获取到所有消息
-    // 使用UTC时间戳，更符合服务器使用的time(NULL)
+    // 重置游标，确保能获取到所有消息
     lastTimestamp.value = 0
+    lastSeq.value = 0
 
-    // 先获取初始消息列表
-    const success = await fetchMessages()
+    // 先获取最新的一页消息，更早的消息在滚动到顶部时再加载
+    const success = await fetchLatestPage()
 
     if (success) {
-      // 开始轮询
+      // 开始轮询，推送通道建立后轮询自动停止
       isConnected.value = true
       scheduleNextPoll()
       console.log('轮询已启动')
+      connectWebSocket()
     }
 
     return success
   }
 
-  // 调度下一次轮询
-  const scheduleNextPoll = () => {
+  // 调度下一次轮询（长轮询）
+  const scheduleNextPoll = (delay: number = pollingDelay) => {
     pollingTimeout.value = window.setTimeout(async () => {
-      await fetchMessages()
+      pollingTimeout.value = null
+      // 推送通道可用时不再轮询
+      if (isPushConnected.value) {
+        return
+      }
+      const startedAt = Date.now()
+      const seqBefore = lastSeq.value
+      await fetchMessages(longPollWait)
       // 只有在连接状态时才继续轮询
+      if (isConnected.value && !isPushConnected.value) {
+        // 收到新消息或已经等待了足够久时立即发起下一次；
+        // 服务器不支持长轮询（立即返回空结果）时保持原来的轮询间隔
+        const elapsed = Date.now() - startedAt
+        const gotMessages = lastSeq.value !== seqBefore
+        scheduleNextPoll(gotMessages || elapsed >= pollingDelay ? 0 : pollingDelay - elapsed)
+      }
+    }, delay)
+  }
+
+  // 建立WebSocket推送通道，失败或断开时退回轮询
+  const connectWebSocket = () => {
+    if (socket || typeof WebSocket === 'undefined') {
+      return
+    }
+    wsRetryTimeout = null
+
+    const protocol = window.location.protocol === 'https:' ? 'wss:' : 'ws:'
+    const ws = new WebSocket(`${protocol}//${window.location.host}/api/chat/ws`)
+    socket = ws
+
+    ws.onopen = () => {
+      isPushConnected.value = true
+      isConnected.value = true
+      reconnectAttempts.value = 0
+      if (pollingTimeout.value) {
+        clearTimeout(pollingTimeout.value)
+        pollingTimeout.value = null
+      }
+      console.log('推送通道已连接')
+      wsHeartbeat = window.setInterval(() => {
+        if (ws.readyState === WebSocket.OPEN) {
+          ws.send('ping')
+        }
+      }, wsHeartbeatInterval)
+      // 补齐建立连接期间可能错过的消息
+      fetchMessages()
+    }
+
+    ws.onmessage = (event: MessageEvent) => {
+      try {
+        handleMessagesResponse(JSON.parse(event.data))
+      } catch (error) {
+        console.error('解析推送消息失败:', error)
+      }
+    }
+
+    ws.onclose = () => {
+      const wasPushConnected = isPushConnected.value
+      if (wsHeartbeat) {
+        clearInterval(wsHeartbeat)
+        wsHeartbeat = null
+      }
+      socket = null
+      isPushConnected.value = false
+      if (wasPushConnected) {
+        console.log('推送通道已断开，退回轮询')
+      }
+      // 仍处于连接状态时恢复轮询，并稍后重试推送通道
       if (isConnected.value) {
-        scheduleNextPoll()
+        if (!pollingTimeout.value) {
+          scheduleNextPoll()
+        }
+        wsRetryTimeout = window.setTimeout(connectWebSocket, wsRetryDelay)
+      }
+    }
+  }
+
+  // 处理消息响应（轮询和推送通道格式相同）
+  const handleMessagesResponse = (data: any) => {
+    if (data.has_new_messages && data.messages && data.messages.length > 0) {
+      // 添加新消息到列表
+      for (const message of data.messages) {
+        addMessage(message)
+      }
+
+      // 更新客户端时间戳为最新一条消息的时间戳
+      const lastMessage = data.messages[data.messages.length - 1];
+      if (lastMessage && lastMessage.timestamp) {
+        lastTimestamp.value = lastMessage.timestamp;
+      }
+    }
+
+    // 服务器返回的最新序列号作为下一次轮询的游标
+    if (typeof data.last_seq === 'number' && data.last_seq > lastSeq.value) {
+      lastSeq.value = data.last_seq
+    }
+  }
+
+  // 获取一页历史消息，before为0时获取最新的一页
+  const fetchPage = async (before: number) => {
+    const beforeParam = before > 0 ? `before=${before}&` : ''
+    let response = await fetch(`/api/chat/messages?${beforeParam}limit=${pageSize}`)
+    // 服务器刚启动、历史还在加载（或暂时繁忙）时返回503，按Retry-After稍后重试，不算连接失败
+    for (let attempt = 0; response.status === 503 && attempt < maxWarmingRetries; attempt++) {
+      const retryAfter = Number(response.headers.get('Retry-After')) || 1
+      await new Promise(resolve => window.setTimeout(resolve, retryAfter * 1000))
+      response = await fetch(`/api/chat/messages?${beforeParam}limit=${pageSize}`)
+    }
+    if (!response.ok) {
+      console.error('获取历史消息失败:', response.status)
+      return null
+    }
+    return await response.json()
+  }
+
+  // 获取最新的一页消息，并以其last_seq作为之后轮询的游标
+  const fetchLatestPage = async () => {
+    try {
+      const data = await fetchPage(0)
+      if (!data) {
+        handleConnectionError()
+        return false
+      }
+
+      reconnectAttempts.value = 0
+      isConnected.value = true
+
+      // 不支持分页的旧服务器返回全部消息，按普通轮询响应处理
+      if (typeof data.has_more !== 'boolean') {
+        handleMessagesResponse(data)
+        return true
+      }
+
+      for (const message of data.messages || []) {
+        addMessage(message)
       }
-    }, pollingDelay)
+      oldestSeq.value = data.oldest_seq || 0
+      hasMoreHistory.value = data.has_more
+      if (typeof data.last_seq === 'number' && data.last_seq > lastSeq.value) {
+        lastSeq.value = data.last_seq
+      }
+      return true
+    } catch (error) {
+      console.error('获取消息失败:', error)
+      handleConnectionError()
+      return false
+    }
   }
 
-  // 获取消息
-  const fetchMessages = async () => {
+  // 加载更早的一页消息，返回新加载的消息数量
+  const loadOlderMessages = async () => {
+    if (!hasMoreHistory.value || isLoadingHistory.value || oldestSeq.value <= 1) {
+      return 0
+    }
+
+    isLoadingHistory.value = true
     try {
-      const response = await fetch(`/api/chat/messages?since_timestamp=${lastTimestamp.value}`)
+      const data = await fetchPage(oldestSeq.value)
+      if (!data || typeof data.has_more !== 'boolean') {
+        return 0
+      }
+
+      const older = (data.messages || []).filter(
+        (message: ChatMessage) => !messages.value.some(m => m.seq === message.seq)
+      )
+      messages.value.unshift(...older)
+      maxMessages.value += older.length
+      if (data.oldest_seq) {
+        oldestSeq.value = data.oldest_seq
+      }
+      hasMoreHistory.value = data.has_more
+      return older.length
+    } catch (error) {
+      console.error('加载更早的消息失败:', error)
+      return 0
+    } finally {
+      isLoadingHistory.value = false
+    }
+  }
+
+  // 获取消息，waitMs大于0时服务器在没有新消息时挂起请求直到有新消息或超时
+  const fetchMessages = async (waitMs: number = 0) => {
+    try {
+      const waitParam = waitMs > 0 ? `&wait_ms=${waitMs}` : ''
+      const response = await fetch(`/api/chat/messages?since_seq=${lastSeq.value}${waitParam}`)
 
       if (!response.ok) {
         console.error('获取消息失败:', response.status)
@@ -72,18 +263,7 @@ export const useChatStore = defineStore('chat', () => {
       }
 
       // 处理新消息
-      if (data.has_new_messages && data.messages && data.messages.length > 0) {
-        // 添加新消息到列表
-        for (const message of data.messages) {
-          addMessage(message)
-        }
-
-        // 更新客户端时间戳为最新一条消息的时间戳
-        const lastMessage = data.messages[data.messages.length - 1];
-        if (lastMessage && lastMessage.timestamp) {
-          lastTimestamp.value = lastMessage.timestamp;
-        }
-      }
+      handleMessagesResponse(data)
       return true
     } catch (error) {
       console.error('轮询消息失败:', error)
@@ -109,6 +289,15 @@ export const useChatStore = defineStore('chat', () => {
 
   // 停止轮询
   const stopPolling = () => {
+    if (wsRetryTimeout) {
+      clearTimeout(wsRetryTimeout)
+      wsRetryTimeout = null
+    }
+    if (socket) {
+      isConnected.value = false
+      socket.close()
+      socket = null
+    }
     if (pollingTimeout.value) {
       clearTimeout(pollingTimeout.value)
       pollingTimeout.value = null
@@ -118,58 +307,95 @@ export const useChatStore = defineStore('chat', () => {
   }
 
   const addMessage = (message: ChatMessage) => {
-    // 消息去重：检查是否已存在相同UUID和时间戳的消息
+    // 消息去重：优先按序列号，旧服务器按UUID和时间戳
     const isDuplicate = messages.value.some(
-      m => m.uuid === message.uuid && m.timestamp === message.timestamp
+      m => message.seq !== undefined
+        ? m.seq === message.seq
+        : m.uuid === message.uuid && m.timestamp === message.timestamp
     )
 
     if (!isDuplicate) {
       messages.value.push(message)
 
-      // 限制消息数量为100条
-      if (messages.value.length > 100) {
+      // 限制消息数量，移除的老消息可以重新加载
+      if (messages.value.length > maxMessages.value) {
         messages.value.shift()
+        const oldest = messages.value[0]
+        if (oldest && oldest.seq !== undefined) {
+          oldestSeq.value = oldest.seq
+          hasMoreHistory.value = true
+        }
       }
     }
   }
 
+  // 客户端消息ID：重试时保持不变，服务器据此识别重复提交。
+  // 通过http访问时crypto.randomUUID不可用，用getRandomValues生成
+  const newClientId = () =>
+    Array.from(crypto.getRandomValues(new Uint8Array(16)), b => b.toString(16).padStart(2, '0')).join('')
+
   const sendMessage = async (content: string) => {
     const userStore = useUserStore()
     if (!userStore.user) return false
 
-    try {
-      // 获取当前UTC时间戳
-      const currentTimestamp = Math.floor(Date.now() / 1000)
-
-      const response = await fetch('/api/chat/message', {
-        method: 'POST',
-        headers: {
-          'Content-Type': 'application/json'
-        },
-        body: JSON.stringify({
-          uuid: userStore.user.uuid,
-          username: userStore.user.username,
-          message: content,
-          timestamp: currentTimestamp // 添加时间戳字段
+    // 获取当前UTC时间戳，重试时不变
+    const currentTimestamp = Math.floor(Date.now() / 1000)
+    const body = JSON.stringify({
+      uuid: userStore.user.uuid,
+      username: userStore.user.username,
+      message: content,
+      timestamp: currentTimestamp, // 添加时间戳字段
+      client_id: newClientId()
+    })
+
+    // 超时、网络错误和503时用同一个client_id重试，服务器已收到的不会重复写入
+    for (let attempt = 0; attempt < maxSendAttempts; attempt++) {
+      if (attempt > 0) {
+        await new Promise(resolve => setTimeout(resolve, sendRetryDelay * attempt))
+      }
+      const controller = new AbortController()
+      const timer = setTimeout(() => controller.abort(), sendTimeout)
+      try {
+        const response = await fetch('/api/chat/message', {
+          method: 'POST',
+          headers: {
+            'Content-Type': 'application/json'
+          },
+          body,
+          signal: controller.signal
         })
-      })
 
-      if (response.ok) {
-        // 发送成功后立即获取新消息，不等待下一次轮询
-        await fetchMessages()
-        return true
+        if (response.ok) {
+          // 推送通道会送达新消息；否则立即获取，不等待下一次轮询
+          if (!isPushConnected.value) {
+            await fetchMessages()
+          }
+          return true
+        }
+        if (response.status === 429) {
+          console.warn('发送过于频繁，请在', response.headers.get('Retry-After'), '秒后重试')
+          return false
+        }
+        if (response.status !== 503) {
+          return false
+        }
+      } catch (error) {
+        console.error('发送消息失败:', error)
+      } finally {
+        clearTimeout(timer)
       }
-      return false
-    } catch (error) {
-      console.error('发送消息失败:', error)
-      return false
     }
+    return false
   }
 
   return {
     messages,
     isConnected,
+    isPushConnected,
+    hasMoreHistory,
+    isLoadingHistory,
     initializePolling,
+    loadOlderMessages,
     stopPolling,
     sendMessage
   }
@@ -0,0 +1,419 @@
+/**
+ * 主机上的微基准测试
+ *
+ * 覆盖请求体解析、写入存储、流式输出消息列表、日志编码和追加，以及经过模拟httpd的完整请求。
+ * 每项先逐步加倍迭代次数直到单轮耗时超过下限，取三轮中最快的一轮，输出每次操作的纳秒数。
+ * HTTP两项包含替身层的线程切换开销，只适合与自身的历史结果比较。用法：
+ *   chat_host_bench [--quick] [--save FILE] [--baseline FILE] [--tolerance PCT] [名称子串...]
+ * --save把结果写成"名称 纳秒"的文本，--baseline读入这样的文件，
+ * 任何一项比基线慢超过tolerance（默认15%）时以非零状态退出
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "chat_json.h"
+#include "chat_log.h"
+#include "chat_parser.h"
+#include "chat_pool.h"
+#include "chat_server.h"
+#include "chat_storage.h"
+#include "host_shim.h"
+
+#define BENCH_MAX_RESULTS 32
+#define BENCH_ROUNDS 3
+#define BENCH_TEST_UUID "123e4567-e89b-12d3-a456-426614174000"
+
+typedef struct {
+    const char *name;
+    void (*setup)(void);           // 可为NULL，计时前调用一次
+    void (*run)(long iterations);  // 执行iterations次被测操作
+} bench_t;
+
+typedef struct {
+    char name[48];
+    double ns_per_op;
+} bench_result_t;
+
+static httpd_handle_t server = NULL;
+static bool server_started = false;
+static char scratch[CHAT_JSON_SCRATCH_SIZE];
+static volatile size_t sink; // 防止编译器优化掉被测代码的结果
+
+static const char single_body[] =
+    "{\"uuid\":\"" BENCH_TEST_UUID "\",\"username\":\"alice\","
+    "\"message\":\"hello \\u4f60\\u597d, this is a typical chat message\",\"timestamp\":1700000000}";
+static char batch_body[4096];
+static size_t batch_len = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static esp_err_t count_flush(void *ctx, const char *data, size_t len) {
+    sink += len;
+    return ESP_OK;
+}
+
+static void fill_message(chat_message_t *message, int i) {
+    memset(message, 0, sizeof(*message));
+    message->seq = (uint32_t)i + 1;
+    message->timestamp = 1700000000u + (uint32_t)i;
+    strlcpy(message->uuid, BENCH_TEST_UUID, sizeof(message->uuid));
+    strlcpy(message->username, "alice", sizeof(message->username));
+    snprintf(message->message, sizeof(message->message), "benchmark message number %d with some text", i);
+}
+
+/* ---- 请求体解析 ---- */
+
+static void setup_batch(void) {
+    batch_len = (size_t)snprintf(batch_body, sizeof(batch_body), "[");
+    for (int i = 0; i < 16; i++) {
+        batch_len += (size_t)snprintf(batch_body + batch_len, sizeof(batch_body) - batch_len, "%s%s",
+                                      i > 0 ? "," : "", single_body);
+    }
+    batch_len += (size_t)snprintf(batch_body + batch_len, sizeof(batch_body) - batch_len, "]");
+}
+
+static void run_parse_single(long iterations) {
+    char buf[sizeof(single_body)];
+    for (long i = 0; i < iterations; i++) {
+        // 解析会原地改写缓冲区，每次重新复制，与服务器每次接收请求体相同
+        memcpy(buf, single_body, sizeof(single_body));
+        chat_parser_t parser;
+        chat_parsed_message_t parsed;
+        chat_parser_init(&parser, buf, sizeof(single_body) - 1);
+        if (chat_parser_message(&parser, &parsed) != ESP_OK || chat_parser_finish(&parser) != ESP_OK) {
+            abort();
+        }
+        sink += parsed.message_len;
+    }
+}
+
+static void run_parse_batch(long iterations) {
+    char buf[sizeof(batch_body)];
+    for (long i = 0; i < iterations; i++) {
+        memcpy(buf, batch_body, batch_len + 1);
+        chat_parser_t parser;
+        chat_parser_init(&parser, buf, batch_len);
+        int count = 0;
+        while (chat_parser_next_item(&parser) == ESP_OK) {
+            chat_parsed_message_t parsed;
+            if (chat_parser_message(&parser, &parsed) != ESP_OK) {
+                abort();
+            }
+            count++;
+        }
+        if (count != 16) {
+            abort();
+        }
+        sink += (size_t)count;
+    }
+}
+
+/* ---- 日志编码和追加 ---- */
+
+static void run_log_encode(long iterations) {
+    chat_message_t message;
+    uint8_t record[CHAT_LOG_MESSAGE_MAX_LEN];
+    fill_message(&message, 42);
+    for (long i = 0; i < iterations; i++) {
+        sink += chat_log_encode_message(&message, record);
+    }
+}
+
+static void run_log_decode(long iterations) {
+    chat_message_t message;
+    uint8_t record[CHAT_LOG_MESSAGE_MAX_LEN];
+    fill_message(&message, 42);
+    size_t len = chat_log_encode_message(&message, record);
+    for (long i = 0; i < iterations; i++) {
+        if (!chat_log_decode_message(record, len, &message)) {
+            abort();
+        }
+        sink += message.seq;
+    }
+}
+
+static void setup_log_append(void) {
+    host_flash_reset(true);
+    if (chat_pool_init() != ESP_OK || chat_log_open() != ESP_OK) {
+        abort();
+    }
+}
+
+static void run_log_append(long iterations) {
+    static int next = 0;
+    chat_message_t message;
+    for (long i = 0; i < iterations; i++) {
+        fill_message(&message, next++);
+        if (chat_log_append(&message) != ESP_OK) {
+            abort();
+        }
+    }
+}
+
+/* ---- 存储层和HTTP ---- */
+
+/**
+ * @brief 启动存储层和模拟httpd，并把默认房间填满，后面的测试都在稳定状态下进行
+ */
+static void setup_server(void) {
+    if (server_started) {
+        return;
+    }
+    host_flash_reset(true);
+    host_nvs_reset();
+    if (chat_server_init() != ESP_OK || host_httpd_start(&server) != ESP_OK ||
+        register_chat_uri_handlers(server) != ESP_OK) {
+        abort();
+    }
+    while (!chat_storage_history_ready()) {
+        vTaskDelay(1);
+    }
+    for (int i = 0; i < MAX_MESSAGES; i++) {
+        char text[MAX_MESSAGE_LENGTH];
+        snprintf(text, sizeof(text), "warm-up message %d", i);
+        chat_storage_add_message(BENCH_TEST_UUID, i % 2 ? "alice" : "bob", text);
+    }
+    server_started = true;
+}
+
+static void run_storage_add(long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        if (chat_storage_add_message(BENCH_TEST_UUID, "alice", "steady state message") != ESP_OK) {
+            abort();
+        }
+    }
+}
+
+static void run_write_messages(long iterations, chat_format_t format) {
+    chat_messages_query_t query = {
+        .mode = CHAT_QUERY_SINCE_SEQ,
+        .seq = 0,
+        .format = format,
+        .room = CHAT_ROOM_LOBBY,
+    };
+    for (long i = 0; i < iterations; i++) {
+        chat_json_writer_t writer;
+        chat_json_writer_init(&writer, scratch, sizeof(scratch), count_flush, NULL);
+        if (chat_storage_write_messages(&query, &writer, NULL) != ESP_OK || chat_json_flush(&writer) != ESP_OK) {
+            abort();
+        }
+    }
+}
+
+static void run_write_json(long iterations) {
+    run_write_messages(iterations, CHAT_FORMAT_JSON);
+}
+
+static void run_write_cbor(long iterations) {
+    run_write_messages(iterations, CHAT_FORMAT_CBOR);
+}
+
+static void run_http_post(long iterations) {
+    host_http_request_t request = {
+        .method = HTTP_POST,
+        .uri = "/api/chat/message",
+        .headers = {{"Content-Type", "application/json"}},
+        .body = single_body,
+        .body_len = sizeof(single_body) - 1,
+    };
+    for (long i = 0; i < iterations; i++) {
+        host_http_response_t response;
+        host_httpd_request(server, &request, &response);
+        if (response.status[0] != '2') {
+            fprintf(stderr, "POST failed: %s %s\n", response.status, response.body);
+            abort();
+        }
+        host_http_response_free(&response);
+    }
+}
+
+static void run_http_get(long iterations) {
+    char uri[64];
+    uint32_t since = chat_storage_get_last_seq();
+    snprintf(uri, sizeof(uri), "/api/chat/messages?since_seq=%lu", (unsigned long)(since > 10 ? since - 10 : 0));
+    host_http_request_t request = {
+        .method = HTTP_GET,
+        .uri = uri,
+    };
+    for (long i = 0; i < iterations; i++) {
+        host_http_response_t response;
+        host_httpd_request(server, &request, &response);
+        if (strncmp(response.status, "200", 3) != 0) {
+            fprintf(stderr, "GET failed: %s\n", response.status);
+            abort();
+        }
+        sink += response.body_len;
+        host_http_response_free(&response);
+    }
+}
+
+static const bench_t benches[] = {
+    {"parse_single", NULL, run_parse_single},
+    {"parse_batch16", setup_batch, run_parse_batch},
+    {"log_encode", NULL, run_log_encode},
+    {"log_decode", NULL, run_log_decode},
+    {"log_append", setup_log_append, run_log_append},
+    {"storage_add", setup_server, run_storage_add},
+    {"write_messages_json", setup_server, run_write_json},
+    {"write_messages_cbor", setup_server, run_write_cbor},
+    {"http_post_message", setup_server, run_http_post},
+    {"http_get_since_seq", setup_server, run_http_get},
+};
+
+/**
+ * @brief 测量一项基准
+ *
+ * @param min_ns 单轮耗时下限
+ * @param rounds 测量轮数，取最快的一轮
+ * @return double 每次操作的纳秒数
+ */
+static double measure(const bench_t *bench, uint64_t min_ns, int rounds, long *out_iterations) {
+    long iterations = 1;
+    uint64_t elapsed = 0;
+    for (;;) {
+        uint64_t start = now_ns();
+        bench->run(iterations);
+        elapsed = now_ns() - start;
+        if (elapsed >= min_ns || iterations >= (1L << 28)) {
+            break;
+        }
+        iterations *= 2;
+    }
+    double best = (double)elapsed / (double)iterations;
+    for (int r = 1; r < rounds; r++) {
+        uint64_t start = now_ns();
+        bench->run(iterations);
+        double ns = (double)(now_ns() - start) / (double)iterations;
+        if (ns < best) {
+            best = ns;
+        }
+    }
+    *out_iterations = iterations;
+    return best;
+}
+
+static int load_baseline(const char *path, bench_result_t *results, int max) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "cannot open baseline %s\n", path);
+        exit(2);
+    }
+    int count = 0;
+    while (count < max && fscanf(f, "%47s %lf", results[count].name, &results[count].ns_per_op) == 2) {
+        count++;
+    }
+    fclose(f);
+    return count;
+}
+
+static bool selected(const char *name, char **filters, int filter_count) {
+    if (filter_count == 0) {
+        return true;
+    }
+    for (int i = 0; i < filter_count; i++) {
+        if (strstr(name, filters[i]) != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv) {
+    bool quick = false;
+    const char *save_path = NULL;
+    const char *baseline_path = NULL;
+    double tolerance = 15.0;
+    char *filters[16];
+    int filter_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = strtod(argv[++i], NULL);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [--quick] [--save FILE] [--baseline FILE] [--tolerance PCT] [name...]\n",
+                    argv[0]);
+            return 2;
+        } else if (filter_count < (int)(sizeof(filters) / sizeof(filters[0]))) {
+            filters[filter_count++] = argv[i];
+        }
+    }
+
+    // storage_add写入速度远超持久化任务，淘汰未保存消息的警告是预期的
+    host_log_level = ESP_LOG_ERROR;
+    host_random_seed(1);
+
+    bench_result_t baseline[BENCH_MAX_RESULTS];
+    int baseline_count = baseline_path != NULL ? load_baseline(baseline_path, baseline, BENCH_MAX_RESULTS) : 0;
+    bench_result_t results[BENCH_MAX_RESULTS];
+    int result_count = 0;
+    int regressions = 0;
+
+    // 快速模式只验证每项都能跑通，供ctest使用
+    uint64_t min_ns = quick ? 2000000ull : 200000000ull;
+    int rounds = quick ? 1 : BENCH_ROUNDS;
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        const bench_t *bench = &benches[i];
+        if (!selected(bench->name, filters, filter_count)) {
+            continue;
+        }
+        if (bench->setup != NULL) {
+            bench->setup();
+        }
+        long iterations = 0;
+        double ns = measure(bench, min_ns, rounds, &iterations);
+        printf("%-24s %12.1f ns/op %10ld iterations", bench->name, ns, iterations);
+
+        for (int b = 0; b < baseline_count; b++) {
+            if (strcmp(baseline[b].name, bench->name) == 0 && baseline[b].ns_per_op > 0) {
+                double change = (ns / baseline[b].ns_per_op - 1.0) * 100.0;
+                bool regressed = change > tolerance;
+                printf("  %+6.1f%%%s", change, regressed ? "  REGRESSION" : "");
+                regressions += regressed;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+
+        strlcpy(results[result_count].name, bench->name, sizeof(results[result_count].name));
+        results[result_count].ns_per_op = ns;
+        result_count++;
+    }
+
+    if (save_path != NULL) {
+        FILE *f = fopen(save_path, "w");
+        if (f == NULL) {
+            fprintf(stderr, "cannot write %s\n", save_path);
+            return 2;
+        }
+        for (int i = 0; i < result_count; i++) {
+            fprintf(f, "%s %.1f\n", results[i].name, results[i].ns_per_op);
+        }
+        fclose(f);
+    }
+
+    if (server_started) {
+        host_httpd_stop(server);
+        chat_storage_deinit();
+    }
+    if (regressions > 0) {
+        printf("%d benchmark(s) slower than baseline by more than %.0f%%\n", regressions, tolerance);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+# 把ESP-IDF的sdkconfig转换成sdkconfig.h，主机构建与固件使用同一份配置
+#
+# CONFIG_X=y写成1，字符串和数字原样保留，"is not set"的选项不定义（#if中视为0）
+
+function(chat_host_generate_sdkconfig sdkconfig output)
+    if(NOT EXISTS "${sdkconfig}")
+        message(FATAL_ERROR "sdkconfig not found: ${sdkconfig}")
+    endif()
+    set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS "${sdkconfig}")
+
+    file(STRINGS "${sdkconfig}" lines REGEX "^CONFIG_[A-Za-z0-9_]+=")
+    set(content "/* 由${sdkconfig}生成，不要手动修改 */\n#pragma once\n\n")
+    foreach(line IN LISTS lines)
+        string(REGEX MATCH "^(CONFIG_[A-Za-z0-9_]+)=(.*)$" _ "${line}")
+        set(name "${CMAKE_MATCH_1}")
+        set(value "${CMAKE_MATCH_2}")
+        if(value STREQUAL "y")
+            set(value 1)
+        elseif(value STREQUAL "n" OR value STREQUAL "")
+            continue()
+        endif()
+        string(APPEND content "#define ${name} ${value}\n")
+    endforeach()
+
+    # 内容不变时不改写，避免每次配置都触发全量重新编译
+    if(EXISTS "${output}")
+        file(READ "${output}" previous)
+    endif()
+    if(NOT previous STREQUAL content)
+        file(WRITE "${output}" "${content}")
+    endif()
+endfunction()
@@ -0,0 +1,216 @@
+/**
+ * 没有libFuzzer时的模糊测试驱动
+ *
+ * 参数与libFuzzer兼容的子集：-runs=N、-seed=N、-max_len=N，其余参数是语料文件或目录。
+ * 先逐个回放语料，再对随机选取的语料做简单变异（翻转、覆盖、插入、删除、拼接）直到用完次数。
+ * 发现的问题由AddressSanitizer和UBSan终止进程报告，ctest据此判定失败
+ */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+__attribute__((weak)) int LLVMFuzzerInitialize(int *argc, char ***argv);
+
+#define DRIVER_MAX_INPUTS 1024
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} input_t;
+
+static input_t corpus[DRIVER_MAX_INPUTS];
+static int corpus_count = 0;
+static uint64_t rng_state = 1;
+
+static uint32_t rng(void) {
+    rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(rng_state >> 33);
+}
+
+static void load_file(const char *path) {
+    if (corpus_count == DRIVER_MAX_INPUTS) {
+        return;
+    }
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? (size_t)size : 1);
+    if (data != NULL && fread(data, 1, (size_t)size, f) == (size_t)size) {
+        corpus[corpus_count].data = data;
+        corpus[corpus_count].size = (size_t)size;
+        corpus_count++;
+    } else {
+        free(data);
+    }
+    fclose(f);
+}
+
+static void load_path(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "cannot stat %s\n", path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        load_file(path);
+        return;
+    }
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char child[4096];
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        load_file(child);
+    }
+    closedir(dir);
+}
+
+/**
+ * @brief 对输入做1到4次随机变异
+ *
+ * @return size_t 变异后的长度，不超过max_len
+ */
+static size_t mutate(uint8_t *buf, size_t size, size_t max_len) {
+    static const char *const tokens[] = {
+        "\"", "\\", "\\u", "\\ud83d", "{", "}", "[", "]", ",", ":", "null", "true", "1e999", "-0",
+        "\"uuid\"", "\"username\"", "\"message\"", "\"timestamp\"", "\"messages\"", "|", "\xff", "\0",
+    };
+    int rounds = 1 + (int)(rng() % 4);
+    for (int r = 0; r < rounds; r++) {
+        size_t pos = size > 0 ? rng() % size : 0;
+        switch (rng() % 7) {
+        case 0:
+            if (size > 0) {
+                buf[pos] ^= (uint8_t)(1u << (rng() % 8));
+            }
+            break;
+        case 1:
+            if (size > 0) {
+                buf[pos] = (uint8_t)rng();
+            }
+            break;
+        case 2:
+            if (size < max_len) {
+                memmove(buf + pos + 1, buf + pos, size - pos);
+                buf[pos] = (uint8_t)rng();
+                size++;
+            }
+            break;
+        case 3:
+            if (size > 0) {
+                size_t len = 1 + rng() % (size - pos);
+                memmove(buf + pos, buf + pos + len, size - pos - len);
+                size -= len;
+            }
+            break;
+        case 4: {
+            const char *token = tokens[rng() % (sizeof(tokens) / sizeof(tokens[0]))];
+            size_t len = token[0] != '\0' ? strlen(token) : 1;
+            if (size + len <= max_len) {
+                memmove(buf + pos + len, buf + pos, size - pos);
+                memcpy(buf + pos, token, len);
+                size += len;
+            }
+            break;
+        }
+        case 5:
+            if (size > 0) {
+                size_t len = 1 + rng() % (size - pos);
+                if (size + len <= max_len) {
+                    // 后移之后原位置和新位置各有一份，相当于重复这一段
+                    memmove(buf + pos + len, buf + pos, size - pos);
+                    size += len;
+                }
+            }
+            break;
+        default:
+            if (corpus_count > 0) {
+                const input_t *other = &corpus[rng() % corpus_count];
+                if (other->size > 0) {
+                    size_t from = rng() % other->size;
+                    size_t len = 1 + rng() % (other->size - from);
+                    if (pos + len > max_len) {
+                        len = max_len - pos;
+                    }
+                    memcpy(buf + pos, other->data + from, len);
+                    if (pos + len > size) {
+                        size = pos + len;
+                    }
+                }
+            }
+            break;
+        }
+    }
+    return size;
+}
+
+int main(int argc, char **argv) {
+    long runs = 10000;
+    size_t max_len = 4096;
+    unsigned long seed = 1;
+
+    if (LLVMFuzzerInitialize != NULL) {
+        LLVMFuzzerInitialize(&argc, &argv);
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-runs=", 6) == 0) {
+            runs = strtol(argv[i] + 6, NULL, 10);
+        } else if (strncmp(argv[i], "-seed=", 6) == 0) {
+            seed = strtoul(argv[i] + 6, NULL, 10);
+        } else if (strncmp(argv[i], "-max_len=", 9) == 0) {
+            max_len = strtoul(argv[i] + 9, NULL, 10);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "ignoring option %s\n", argv[i]);
+        } else {
+            load_path(argv[i]);
+        }
+    }
+    rng_state = seed;
+
+    for (int i = 0; i < corpus_count; i++) {
+        LLVMFuzzerTestOneInput(corpus[i].data, corpus[i].size);
+    }
+
+    uint8_t *buf = malloc(max_len + 1);
+    if (buf == NULL) {
+        return 1;
+    }
+    long done = 0;
+    for (; done < runs; done++) {
+        size_t size = 0;
+        if (corpus_count > 0) {
+            const input_t *in = &corpus[rng() % corpus_count];
+            size = in->size < max_len ? in->size : max_len;
+            memcpy(buf, in->data, size);
+        }
+        size = mutate(buf, size, max_len);
+        // 复制到恰好大小的缓冲区，越界读取能被AddressSanitizer发现
+        uint8_t *exact = malloc(size > 0 ? size : 1);
+        memcpy(exact, buf, size);
+        LLVMFuzzerTestOneInput(exact, size);
+        free(exact);
+    }
+    free(buf);
+    printf("Done %ld runs on %d corpus inputs (seed %lu)\n", done, corpus_count, seed);
+
+    for (int i = 0; i < corpus_count; i++) {
+        free(corpus[i].data);
+    }
+    return 0;
+}
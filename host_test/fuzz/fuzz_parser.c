@@ -0,0 +1,126 @@
+/**
+ * POST请求体解析器的模糊测试
+ *
+ * 每个输入按服务器的方式（复制到恰好len+1字节的缓冲区，末尾补'\0'）分别交给
+ * JSON和CBOR解析器，各走一遍单条消息和批量数组两条路径。
+ * 除了由AddressSanitizer发现越界，还检查解析成功时输出的字符串都落在缓冲区内且长度一致
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "chat_cbor.h"
+#include "chat_parser.h"
+#include "chat_storage.h"
+
+/**
+ * @brief 检查解析出的字符串位于[buf, end)之内，以'\0'结尾且长度与报告的一致
+ */
+static void check_string(const char *str, size_t len, const uint8_t *buf, const uint8_t *end) {
+    if (str == NULL) {
+        abort();
+    }
+    const uint8_t *p = (const uint8_t *)str;
+    if (p < buf || p + len >= end || p[len] != '\0' || strlen(str) > len) {
+        abort();
+    }
+}
+
+static uint8_t *copy_body(const uint8_t *data, size_t size) {
+    uint8_t *buf = malloc(size + 1);
+    if (buf == NULL) {
+        abort();
+    }
+    memcpy(buf, data, size);
+    buf[size] = '\0';
+    return buf;
+}
+
+static void check_json_message(const chat_parsed_message_t *parsed, const uint8_t *buf, size_t size) {
+    const uint8_t *end = buf + size + 1;
+    check_string(parsed->fields.uuid, parsed->uuid_len, buf, end);
+    check_string(parsed->fields.username, parsed->username_len, buf, end);
+    check_string(parsed->fields.message, parsed->message_len, buf, end);
+}
+
+static void check_cbor_message(const chat_cbor_message_t *parsed, const uint8_t *buf, size_t size) {
+    const uint8_t *end = buf + size + 1;
+    if (parsed->fields.uuid_bin != NULL) {
+        if (parsed->fields.uuid_bin < buf || parsed->fields.uuid_bin + CHAT_UUID_BIN_LENGTH > end) {
+            abort();
+        }
+    } else {
+        check_string(parsed->fields.uuid, parsed->uuid_len, buf, end);
+    }
+    check_string(parsed->fields.username, parsed->username_len, buf, end);
+    check_string(parsed->fields.message, parsed->message_len, buf, end);
+}
+
+static void fuzz_json(const uint8_t *data, size_t size) {
+    uint8_t *buf = copy_body(data, size);
+    chat_parser_t parser;
+    chat_parsed_message_t parsed;
+    chat_parser_init(&parser, (char *)buf, size);
+    if (chat_parser_message(&parser, &parsed) == ESP_OK) {
+        check_json_message(&parsed, buf, size);
+        chat_parser_finish(&parser);
+    }
+    free(buf);
+
+    // 与chat_server.c中批量处理函数相同的循环
+    buf = copy_body(data, size);
+    chat_parser_init(&parser, (char *)buf, size);
+    int count = 0;
+    esp_err_t err;
+    while ((err = chat_parser_next_item(&parser)) == ESP_OK && count < CHAT_MAX_BATCH_MESSAGES) {
+        err = chat_parser_message(&parser, &parsed);
+        if (err == ESP_ERR_INVALID_ARG) {
+            break;
+        }
+        if (err == ESP_OK) {
+            check_json_message(&parsed, buf, size);
+        }
+        count++;
+    }
+    free(buf);
+}
+
+static void fuzz_cbor(const uint8_t *data, size_t size) {
+    uint8_t *buf = copy_body(data, size);
+    chat_cbor_parser_t parser;
+    chat_cbor_message_t parsed;
+    chat_cbor_parser_init(&parser, buf, size);
+    if (chat_cbor_parse_message(&parser, &parsed) == ESP_OK) {
+        check_cbor_message(&parsed, buf, size);
+        chat_cbor_finish(&parser);
+    }
+    free(buf);
+
+    buf = copy_body(data, size);
+    chat_cbor_parser_init(&parser, buf, size);
+    int count = 0;
+    esp_err_t err;
+    while ((err = chat_cbor_next_item(&parser)) == ESP_OK && count < CHAT_MAX_BATCH_MESSAGES) {
+        err = chat_cbor_parse_message(&parser, &parsed);
+        if (err == ESP_ERR_INVALID_ARG) {
+            break;
+        }
+        if (err == ESP_OK) {
+            check_cbor_message(&parsed, buf, size);
+        }
+        count++;
+    }
+    free(buf);
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv) {
+    host_log_level = ESP_LOG_NONE;
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    fuzz_json(data, size);
+    fuzz_cbor(data, size);
+    return 0;
+}
@@ -0,0 +1,234 @@
+/**
+ * 启动时加载历史的模糊测试
+ *
+ * 输入的第一个字节选择历史来源，其余字节作为该来源的内容：
+ *   0 NVS二进制blob（msg_blob），没有日志分区
+ *   1 旧格式逐条字符串（msg_0、msg_1……），按'\n'分割，没有日志分区
+ *   2 NVS房间名列表（rooms），日志分区为空
+ *   3 chatlog分区的原始内容，从分区开头写入
+ *   4 在一份正常写出的日志上异或：后两个字节是偏移（小端，按已用长度取模），其余字节异或到该位置
+ * 每个输入都完整走一遍chat_storage_init、等待后台加载完成、读取全部房间的消息、
+ * 写入一条新消息和chat_storage_deinit（会把新消息追加到可能已损坏的日志中）
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "chat_json.h"
+#include "chat_pool.h"
+#include "chat_storage.h"
+#include "host_shim.h"
+
+#define LOAD_TIMEOUT_MS 5000 // 加载历史的最长时间，超过视为卡死
+
+enum {
+    MODE_NVS_BLOB,
+    MODE_LEGACY,
+    MODE_ROOMS,
+    MODE_FLASH_RAW,
+    MODE_FLASH_PATCH,
+    MODE_COUNT
+};
+
+static uint8_t *snapshot_flash = NULL; // 正常写出的日志
+static size_t snapshot_used = 0;       // 日志已用长度（最后一个非0xff字节之后按扇区取整）
+static uint8_t *snapshot_rooms = NULL; // 与日志对应的房间名列表
+static size_t snapshot_rooms_size = 0;
+
+static esp_err_t discard_flush(void *ctx, const char *data, size_t len) {
+    *(size_t *)ctx += len;
+    return ESP_OK;
+}
+
+static void wait_history_ready(void) {
+    for (int waited = 0; !chat_storage_history_ready(); waited++) {
+        if (waited * portTICK_PERIOD_MS > LOAD_TIMEOUT_MS) {
+            fprintf(stderr, "history load did not finish\n");
+            abort();
+        }
+        vTaskDelay(1);
+    }
+}
+
+static void nvs_write(const char *key, const void *value, size_t len) {
+    nvs_handle_t handle;
+    ESP_ERROR_CHECK(nvs_open("chat", NVS_READWRITE, &handle));
+    ESP_ERROR_CHECK(nvs_set_blob(handle, key, value, len));
+    nvs_close(handle);
+}
+
+/**
+ * @brief 写入旧格式历史：每行一条消息，msg_count为行数
+ */
+static void nvs_write_legacy(const uint8_t *data, size_t size) {
+    nvs_handle_t handle;
+    ESP_ERROR_CHECK(nvs_open("chat", NVS_READWRITE, &handle));
+    int32_t count = 0;
+    size_t start = 0;
+    while (start <= size && count < NVS_MAX_SAVED_MESSAGES) {
+        const uint8_t *nl = memchr(data + start, '\n', size - start);
+        size_t end = nl != NULL ? (size_t)(nl - data) : size;
+        char key[16];
+        char *value = malloc(end - start + 1);
+        memcpy(value, data + start, end - start);
+        value[end - start] = '\0';
+        snprintf(key, sizeof(key), "%s%d", NVS_MSG_KEY_PREFIX, (int)count);
+        ESP_ERROR_CHECK(nvs_set_str(handle, key, value));
+        free(value);
+        count++;
+        start = end + 1;
+    }
+    ESP_ERROR_CHECK(nvs_set_i32(handle, NVS_MSG_COUNT_KEY, count));
+    // 奇数条时同时写入序列号，覆盖有和没有msg_seq的两种旧版本
+    if (count % 2 == 1) {
+        ESP_ERROR_CHECK(nvs_set_u32(handle, NVS_MSG_SEQ_KEY, (uint32_t)count * 7));
+    }
+    nvs_close(handle);
+}
+
+/**
+ * @brief 读出全部房间的消息和房间列表，再写入一条新消息
+ */
+static void exercise_storage(void) {
+    static char scratch[CHAT_JSON_SCRATCH_SIZE];
+    size_t total = 0;
+    chat_json_writer_t writer;
+
+    chat_json_writer_init(&writer, scratch, sizeof(scratch), discard_flush, &total);
+    chat_storage_write_rooms_json(&writer);
+    chat_json_flush(&writer);
+
+    for (int room = 0; room < CHAT_MAX_ROOMS; room++) {
+        for (int format = CHAT_FORMAT_JSON; format <= CHAT_FORMAT_CBOR; format++) {
+            chat_messages_query_t query = {
+                .mode = CHAT_QUERY_SINCE_SEQ,
+                .format = (chat_format_t)format,
+                .room = room,
+            };
+            chat_json_writer_init(&writer, scratch, sizeof(scratch), discard_flush, &total);
+            if (chat_storage_write_messages(&query, &writer, NULL) == ESP_OK) {
+                chat_json_flush(&writer);
+            }
+
+            query.mode = CHAT_QUERY_BEFORE_SEQ;
+            query.seq = chat_storage_get_room_last_seq(room) / 2 + 1;
+            query.limit = 5;
+            chat_json_writer_init(&writer, scratch, sizeof(scratch), discard_flush, &total);
+            if (chat_storage_write_messages(&query, &writer, NULL) == ESP_OK) {
+                chat_json_flush(&writer);
+            }
+        }
+    }
+
+    chat_storage_add_message("123e4567-e89b-12d3-a456-426614174000", "fuzz", "after load");
+}
+
+/**
+ * @brief 写出一份包含多个房间、跨越扇区的正常日志，作为MODE_FLASH_PATCH的底稿
+ */
+static void build_snapshot(void) {
+    uint8_t *flash = host_flash_reset(true);
+    host_nvs_reset();
+    ESP_ERROR_CHECK(chat_pool_init());
+    ESP_ERROR_CHECK(chat_storage_init());
+    wait_history_ready();
+
+    static const char *const room_names[] = {"dev", "random"};
+    int rooms[2] = {CHAT_ROOM_LOBBY, CHAT_ROOM_LOBBY};
+    for (int i = 0; i < 2; i++) {
+        ESP_ERROR_CHECK(chat_storage_find_room(room_names[i], true, &rooms[i]));
+    }
+    for (int i = 0; i < 120; i++) {
+        char uuid[MAX_UUID_LENGTH];
+        char text[MAX_MESSAGE_LENGTH];
+        snprintf(uuid, sizeof(uuid), "123e4567-e89b-12d3-a456-%012d", i);
+        // 长度不一的消息，让记录跨越扇区边界
+        snprintf(text, sizeof(text), "message %d %.*s", i, (i * 37) % 120,
+                 "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz"
+                 "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijkl");
+        chat_message_input_t input = {
+            .uuid = uuid,
+            .username = i % 3 == 0 ? "alice" : "bob",
+            .message = text,
+            .timestamp = 1700000000u + (uint32_t)i,
+        };
+        chat_add_result_t result;
+        int room = i % 4 == 0 ? rooms[i % 8 == 0 ? 0 : 1] : CHAT_ROOM_LOBBY;
+        chat_storage_add_room_messages(room, &input, 1, &result);
+    }
+    chat_storage_deinit();
+
+    size_t size = host_flash_size();
+    snapshot_flash = malloc(size);
+    memcpy(snapshot_flash, flash, size);
+    size_t used = size;
+    while (used > 0 && snapshot_flash[used - 1] == 0xff) {
+        used--;
+    }
+    snapshot_used = (used + 4095) / 4096 * 4096;
+
+    nvs_handle_t handle;
+    ESP_ERROR_CHECK(nvs_open("chat", NVS_READONLY, &handle));
+    if (nvs_get_blob(handle, NVS_ROOMS_KEY, NULL, &snapshot_rooms_size) == ESP_OK) {
+        snapshot_rooms = malloc(snapshot_rooms_size);
+        nvs_get_blob(handle, NVS_ROOMS_KEY, snapshot_rooms, &snapshot_rooms_size);
+    }
+    nvs_close(handle);
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv) {
+    host_log_level = ESP_LOG_NONE;
+    host_random_seed(1);
+    build_snapshot();
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    int mode = data[0] % MODE_COUNT;
+    data++;
+    size--;
+
+    host_nvs_reset();
+    uint8_t *flash = host_flash_reset(mode >= MODE_ROOMS);
+    switch (mode) {
+    case MODE_NVS_BLOB:
+        nvs_write(NVS_MSG_BLOB_KEY, data, size);
+        break;
+    case MODE_LEGACY:
+        nvs_write_legacy(data, size);
+        break;
+    case MODE_ROOMS:
+        nvs_write(NVS_ROOMS_KEY, data, size);
+        break;
+    case MODE_FLASH_RAW:
+        memcpy(flash, data, size < host_flash_size() ? size : host_flash_size());
+        break;
+    default:
+        memcpy(flash, snapshot_flash, host_flash_size());
+        if (snapshot_rooms != NULL) {
+            nvs_write(NVS_ROOMS_KEY, snapshot_rooms, snapshot_rooms_size);
+        }
+        if (size >= 2 && snapshot_used > 0) {
+            size_t offset = (data[0] | (size_t)data[1] << 8) * 4 % snapshot_used;
+            for (size_t i = 2; i < size && offset + i - 2 < snapshot_used; i++) {
+                flash[offset + i - 2] ^= data[i];
+            }
+        }
+        break;
+    }
+
+    ESP_ERROR_CHECK(chat_pool_init());
+    ESP_ERROR_CHECK(chat_storage_init());
+    wait_history_ready();
+    exercise_storage();
+    chat_storage_deinit();
+    return 0;
+}
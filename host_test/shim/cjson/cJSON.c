@@ -0,0 +1,340 @@
+/**
+ * cJSON解析接口的最小实现
+ *
+ * 语义与cJSON 1.7一致：键名比较不区分大小写，整数值饱和到int范围，
+ * 嵌套深度不超过CJSON_NESTING_LIMIT。只在没有ESP-IDF源码时用于主机构建
+ */
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "cJSON.h"
+
+typedef struct {
+    const char *pos;
+    const char *end;
+    int depth;
+} parse_ctx_t;
+
+static cJSON *parse_value(parse_ctx_t *ctx);
+
+static void skip_ws(parse_ctx_t *ctx) {
+    while (ctx->pos < ctx->end && (unsigned char)*ctx->pos <= ' ') {
+        ctx->pos++;
+    }
+}
+
+static cJSON *new_item(int type) {
+    cJSON *item = calloc(1, sizeof(*item));
+    if (item != NULL) {
+        item->type = type;
+    }
+    return item;
+}
+
+static int hex4(const char *p, unsigned *out) {
+    unsigned v = 0;
+    for (int i = 0; i < 4; i++) {
+        int c = (unsigned char)p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') {
+            v |= (unsigned)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            v |= (unsigned)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            v |= (unsigned)(c - 'A' + 10);
+        } else {
+            return 0;
+        }
+    }
+    *out = v;
+    return 1;
+}
+
+static size_t utf8_encode(unsigned cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/**
+ * @brief 解析字符串，ctx->pos位于开头的引号
+ *
+ * @return char* 反转义后的字符串，格式错误时返回NULL
+ */
+static char *parse_string(parse_ctx_t *ctx) {
+    const char *p = ctx->pos + 1;
+    // 反转义后不会比原文更长
+    const char *close = p;
+    while (close < ctx->end && *close != '"') {
+        if (*close == '\\') {
+            close++;
+        }
+        close++;
+    }
+    if (close >= ctx->end) {
+        return NULL;
+    }
+    char *out = malloc((size_t)(close - p) + 1);
+    if (out == NULL) {
+        return NULL;
+    }
+    size_t n = 0;
+    while (p < close) {
+        if (*p != '\\') {
+            out[n++] = *p++;
+            continue;
+        }
+        p++;
+        switch (*p) {
+        case 'b': out[n++] = '\b'; p++; break;
+        case 'f': out[n++] = '\f'; p++; break;
+        case 'n': out[n++] = '\n'; p++; break;
+        case 'r': out[n++] = '\r'; p++; break;
+        case 't': out[n++] = '\t'; p++; break;
+        case '"': case '\\': case '/': out[n++] = *p++; break;
+        case 'u': {
+            unsigned cp;
+            if (close - p < 5 || !hex4(p + 1, &cp)) {
+                goto fail;
+            }
+            p += 5;
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                unsigned low;
+                if (close - p < 6 || p[0] != '\\' || p[1] != 'u' || !hex4(p + 2, &low) ||
+                    low < 0xDC00 || low > 0xDFFF) {
+                    goto fail;
+                }
+                p += 6;
+                cp = 0x10000 + (((cp & 0x3FF) << 10) | (low & 0x3FF));
+            } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                goto fail;
+            }
+            n += utf8_encode(cp, out + n);
+            break;
+        }
+        default:
+            goto fail;
+        }
+    }
+    out[n] = '\0';
+    ctx->pos = close + 1;
+    return out;
+
+fail:
+    free(out);
+    return NULL;
+}
+
+static cJSON *parse_number(parse_ctx_t *ctx) {
+    char buf[64];
+    size_t len = 0;
+    while (ctx->pos + len < ctx->end && len < sizeof(buf) - 1 &&
+           strchr("0123456789+-.eE", ctx->pos[len]) != NULL) {
+        len++;
+    }
+    memcpy(buf, ctx->pos, len);
+    buf[len] = '\0';
+    char *end = NULL;
+    double value = strtod(buf, &end);
+    if (end == buf) {
+        return NULL;
+    }
+    cJSON *item = new_item(cJSON_Number);
+    if (item == NULL) {
+        return NULL;
+    }
+    item->valuedouble = value;
+    if (value >= INT_MAX) {
+        item->valueint = INT_MAX;
+    } else if (value <= (double)INT_MIN) {
+        item->valueint = INT_MIN;
+    } else {
+        item->valueint = (int)value;
+    }
+    ctx->pos += end - buf;
+    return item;
+}
+
+static int append_child(cJSON *parent, cJSON **tail, cJSON *child) {
+    if (*tail == NULL) {
+        parent->child = child;
+    } else {
+        (*tail)->next = child;
+        child->prev = *tail;
+    }
+    *tail = child;
+    return 1;
+}
+
+static cJSON *parse_container(parse_ctx_t *ctx, int type) {
+    char close = type == cJSON_Object ? '}' : ']';
+    if (++ctx->depth > CJSON_NESTING_LIMIT) {
+        return NULL;
+    }
+    cJSON *item = new_item(type);
+    if (item == NULL) {
+        return NULL;
+    }
+    ctx->pos++;
+    skip_ws(ctx);
+    cJSON *tail = NULL;
+    if (ctx->pos < ctx->end && *ctx->pos == close) {
+        ctx->pos++;
+        ctx->depth--;
+        return item;
+    }
+    for (;;) {
+        char *key = NULL;
+        if (type == cJSON_Object) {
+            skip_ws(ctx);
+            if (ctx->pos >= ctx->end || *ctx->pos != '"' || (key = parse_string(ctx)) == NULL) {
+                goto fail;
+            }
+            skip_ws(ctx);
+            if (ctx->pos >= ctx->end || *ctx->pos != ':') {
+                free(key);
+                goto fail;
+            }
+            ctx->pos++;
+        }
+        cJSON *child = parse_value(ctx);
+        if (child == NULL) {
+            free(key);
+            goto fail;
+        }
+        child->string = key;
+        append_child(item, &tail, child);
+        skip_ws(ctx);
+        if (ctx->pos < ctx->end && *ctx->pos == ',') {
+            ctx->pos++;
+            continue;
+        }
+        if (ctx->pos < ctx->end && *ctx->pos == close) {
+            ctx->pos++;
+            ctx->depth--;
+            return item;
+        }
+        goto fail;
+    }
+
+fail:
+    cJSON_Delete(item);
+    return NULL;
+}
+
+static cJSON *parse_value(parse_ctx_t *ctx) {
+    skip_ws(ctx);
+    if (ctx->pos >= ctx->end) {
+        return NULL;
+    }
+    size_t left = (size_t)(ctx->end - ctx->pos);
+    switch (*ctx->pos) {
+    case '{':
+        return parse_container(ctx, cJSON_Object);
+    case '[':
+        return parse_container(ctx, cJSON_Array);
+    case '"': {
+        char *s = parse_string(ctx);
+        cJSON *item = s != NULL ? new_item(cJSON_String) : NULL;
+        if (item == NULL) {
+            free(s);
+            return NULL;
+        }
+        item->valuestring = s;
+        return item;
+    }
+    case 't':
+        if (left >= 4 && strncmp(ctx->pos, "true", 4) == 0) {
+            ctx->pos += 4;
+            cJSON *item = new_item(cJSON_True);
+            if (item != NULL) {
+                item->valueint = 1;
+            }
+            return item;
+        }
+        return NULL;
+    case 'f':
+        if (left >= 5 && strncmp(ctx->pos, "false", 5) == 0) {
+            ctx->pos += 5;
+            return new_item(cJSON_False);
+        }
+        return NULL;
+    case 'n':
+        if (left >= 4 && strncmp(ctx->pos, "null", 4) == 0) {
+            ctx->pos += 4;
+            return new_item(cJSON_NULL);
+        }
+        return NULL;
+    default:
+        if (*ctx->pos == '-' || isdigit((unsigned char)*ctx->pos)) {
+            return parse_number(ctx);
+        }
+        return NULL;
+    }
+}
+
+cJSON *cJSON_ParseWithLength(const char *value, size_t buffer_length) {
+    if (value == NULL) {
+        return NULL;
+    }
+    parse_ctx_t ctx = {
+        .pos = value,
+        .end = value + buffer_length
+    };
+    return parse_value(&ctx);
+}
+
+cJSON *cJSON_Parse(const char *value) {
+    return value != NULL ? cJSON_ParseWithLength(value, strlen(value)) : NULL;
+}
+
+void cJSON_Delete(cJSON *item) {
+    while (item != NULL) {
+        cJSON *next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string) {
+    if (object == NULL || string == NULL) {
+        return NULL;
+    }
+    for (cJSON *child = object->child; child != NULL; child = child->next) {
+        if (child->string != NULL && strcasecmp(child->string, string) == 0) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+cJSON_bool cJSON_IsString(const cJSON *item) {
+    return item != NULL && (item->type & 0xFF) == cJSON_String;
+}
+
+cJSON_bool cJSON_IsNumber(const cJSON *item) {
+    return item != NULL && (item->type & 0xFF) == cJSON_Number;
+}
@@ -0,0 +1,35 @@
+/* 主机构建找不到ESP-IDF自带的cJSON时使用的最小实现，只有存储层读取旧格式NVS记录用到的解析接口 */
+#pragma once
+
+#include <stddef.h>
+
+#define cJSON_Invalid (0)
+#define cJSON_False (1 << 0)
+#define cJSON_True (1 << 1)
+#define cJSON_NULL (1 << 2)
+#define cJSON_Number (1 << 3)
+#define cJSON_String (1 << 4)
+#define cJSON_Array (1 << 5)
+#define cJSON_Object (1 << 6)
+
+#define CJSON_NESTING_LIMIT 1000
+
+typedef struct cJSON {
+    struct cJSON *next;
+    struct cJSON *prev;
+    struct cJSON *child;
+    int type;
+    char *valuestring;
+    int valueint;
+    double valuedouble;
+    char *string;
+} cJSON;
+
+typedef int cJSON_bool;
+
+cJSON *cJSON_Parse(const char *value);
+cJSON *cJSON_ParseWithLength(const char *value, size_t buffer_length);
+void cJSON_Delete(cJSON *item);
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string);
+cJSON_bool cJSON_IsString(const cJSON *item);
+cJSON_bool cJSON_IsNumber(const cJSON *item);
@@ -0,0 +1,6 @@
+/* 主机替身：esp_attr.h，内存段属性在主机上没有意义 */
+#pragma once
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define EXT_RAM_BSS_ATTR
@@ -0,0 +1,8 @@
+/* 主机替身：esp_random.h，伪随机数，主机上可用host_random_seed固定序列 */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+uint32_t esp_random(void);
+void esp_fill_random(void *buf, size_t len);
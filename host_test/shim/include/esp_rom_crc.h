@@ -0,0 +1,6 @@
+/* 主机替身：esp_rom_crc.h，与ROM中的CRC32（小端）结果一致 */
+#pragma once
+
+#include <stdint.h>
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
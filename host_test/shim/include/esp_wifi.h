@@ -0,0 +1,12 @@
+/* 主机替身：esp_wifi.h，只有功耗调节器用到的省电模式接口 */
+#pragma once
+
+#include "esp_err.h"
+
+typedef enum {
+    WIFI_PS_NONE,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM
+} wifi_ps_type_t;
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
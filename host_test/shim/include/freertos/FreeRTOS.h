@@ -0,0 +1,35 @@
+/* 主机替身：FreeRTOS.h，任务和同步原语由POSIX线程实现，时钟节拍与sdkconfig的CONFIG_FREERTOS_HZ一致 */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+#ifdef CONFIG_FREERTOS_HZ
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#else
+#define configTICK_RATE_HZ 100
+#endif
+#define configMAX_PRIORITIES 25
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+#define pdTICKS_TO_MS(ticks) ((TickType_t)(((uint64_t)(ticks) * 1000U) / configTICK_RATE_HZ))
+
+#define tskNO_AFFINITY ((BaseType_t)0x7FFFFFFF)
+#ifdef CONFIG_FREERTOS_NUMBER_OF_CORES
+#define portNUM_PROCESSORS CONFIG_FREERTOS_NUMBER_OF_CORES
+#else
+#define portNUM_PROCESSORS 1
+#endif
@@ -0,0 +1,10 @@
+/* 主机构建时强制包含：补上newlib有而glibc较老版本没有的函数 */
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+#ifndef CHAT_HOST_HAVE_STRLCPY
+size_t strlcpy(char *dst, const char *src, size_t size);
+size_t strlcat(char *dst, const char *src, size_t size);
+#endif
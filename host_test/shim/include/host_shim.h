@@ -0,0 +1,113 @@
+/* 主机构建的控制接口：重置模拟的NVS和闪存、在内存中发起HTTP请求，供基准测试和模糊测试使用 */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define HOST_HTTP_MAX_HEADERS 8 // 请求和响应各自最多的头部数量
+
+/* 一个HTTP头部 */
+typedef struct {
+    const char *name;
+    const char *value;
+} host_http_header_t;
+
+/* 内存中构造的请求 */
+typedef struct {
+    httpd_method_t method;
+    const char *uri;                                    // 可以带查询串
+    host_http_header_t headers[HOST_HTTP_MAX_HEADERS];  // 以name为NULL结束
+    const char *body;                                   // 请求体，可以为NULL
+    size_t body_len;                                    // 请求体长度
+} host_http_request_t;
+
+/* 处理函数写出的响应 */
+typedef struct {
+    char status[32];                                    // 状态行，默认"200 OK"
+    char content_type[64];                              // Content-Type
+    char header_names[HOST_HTTP_MAX_HEADERS][32];       // 响应头名称
+    char header_values[HOST_HTTP_MAX_HEADERS][128];     // 响应头取值
+    int header_count;                                   // 响应头数量
+    char *body;                                         // 响应体，以'\0'结尾，用host_http_response_free释放
+    size_t body_len;                                    // 响应体长度
+    size_t body_cap;                                    // body缓冲区大小
+    int chunks;                                         // 分块发送的次数（不含结束块）
+} host_http_response_t;
+
+/**
+ * @brief 清空模拟的NVS
+ */
+void host_nvs_reset(void);
+
+/**
+ * @brief 重置模拟的chatlog分区
+ *
+ * @param present false时esp_partition_find_first找不到分区，存储层退回只用NVS
+ * @return uint8_t* 分区内容（全部为0xff），可以直接写入测试数据
+ */
+uint8_t *host_flash_reset(bool present);
+
+/**
+ * @brief 读取模拟分区的大小
+ *
+ * @return size_t 分区大小(字节)
+ */
+size_t host_flash_size(void);
+
+/**
+ * @brief 固定esp_random的伪随机序列，便于复现
+ *
+ * @param seed 种子
+ */
+void host_random_seed(uint32_t seed);
+
+/**
+ * @brief 启动模拟的httpd任务
+ *
+ * 处理函数和httpd_queue_work提交的工作都在这个任务中依次执行，与真实的httpd一样
+ *
+ * @param out 输出参数，服务器句柄，可用于register_chat_uri_handlers
+ * @return ESP_OK 成功
+ * @return ESP_ERR_NO_MEM 内存不足
+ */
+esp_err_t host_httpd_start(httpd_handle_t *out);
+
+/**
+ * @brief 停止模拟的httpd任务，之前注册的处理函数全部失效
+ *
+ * @param server 服务器句柄
+ */
+void host_httpd_stop(httpd_handle_t server);
+
+/**
+ * @brief 发起一个请求并等待响应完成
+ *
+ * 异步请求（长轮询）等到httpd_req_async_handler_complete之后才返回
+ *
+ * @param server 服务器句柄
+ * @param request 请求
+ * @param response 输出参数，响应；调用者用host_http_response_free释放
+ * @return esp_err_t 处理函数的返回值
+ * @return ESP_ERR_NOT_FOUND 没有匹配的处理函数
+ */
+esp_err_t host_httpd_request(httpd_handle_t server, const host_http_request_t *request,
+                             host_http_response_t *response);
+
+/**
+ * @brief 读取响应头
+ *
+ * @param response 响应
+ * @param name 头部名称，不区分大小写
+ * @return const char* 取值，不存在时返回NULL
+ */
+const char *host_http_response_header(const host_http_response_t *response, const char *name);
+
+/**
+ * @brief 释放响应体
+ *
+ * @param response 响应
+ */
+void host_http_response_free(host_http_response_t *response);
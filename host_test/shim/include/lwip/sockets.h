@@ -0,0 +1,9 @@
+/* 主机替身：lwip/sockets.h，直接使用系统的BSD套接字头文件 */
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
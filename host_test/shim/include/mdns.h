@@ -0,0 +1,6 @@
+/* 主机替身：mdns.h，只有功耗调节器更新TXT记录用到的接口 */
+#pragma once
+
+#include "esp_err.h"
+
+esp_err_t mdns_service_txt_item_set(const char *service_type, const char *proto, const char *key, const char *value);
@@ -0,0 +1,7 @@
+/* 主机替身：nvs_flash.h */
+#pragma once
+
+#include "nvs.h"
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
@@ -0,0 +1,478 @@
+/**
+ * esp_http_server主机替身
+ *
+ * 没有套接字：host_httpd_request把内存中构造的请求交给模拟的httpd任务，
+ * 处理函数写出的状态、头部和响应体记录在host_http_response_t中。
+ * 处理函数和httpd_queue_work提交的工作在同一个线程中依次执行，
+ * 与真实httpd的单任务模型一致，推送和长轮询的并发假设在主机上同样成立
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "host_shim.h"
+
+#define HOST_HTTPD_MAX_HANDLERS 16
+
+static const char *HTTPD_TAG = "host-httpd";
+
+typedef struct host_work {
+    httpd_work_fn_t fn;
+    void *arg;
+    struct host_work *next;
+} host_work_t;
+
+typedef struct host_httpd {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    host_work_t *head;
+    host_work_t *tail;
+    bool running;
+    httpd_uri_t handlers[HOST_HTTPD_MAX_HANDLERS];
+    int handler_count;
+} host_httpd_t;
+
+/* 一次请求的状态，httpd_req_t.aux指向它 */
+typedef struct {
+    host_httpd_t *server;
+    const host_http_request_t *in;
+    const httpd_uri_t *route;
+    const char *query;              // '?'之后的查询串，没有时为NULL
+    size_t recv_offset;             // 已被httpd_req_recv读走的请求体长度
+    host_http_response_t *out;
+    bool async;                     // 处理函数转为异步请求
+    bool finished;                  // 响应已完成
+    bool handler_done;              // 处理函数已返回，异步请求可能先于它完成
+    esp_err_t result;               // 处理函数返回值
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    httpd_req_t req;
+} host_req_state_t;
+
+#define STATE(r) ((host_req_state_t *)(r)->aux)
+
+static void *httpd_thread(void *arg) {
+    host_httpd_t *server = arg;
+    pthread_mutex_lock(&server->lock);
+    for (;;) {
+        while (server->head == NULL && server->running) {
+            pthread_cond_wait(&server->cond, &server->lock);
+        }
+        host_work_t *work = server->head;
+        if (work == NULL) {
+            break;
+        }
+        server->head = work->next;
+        if (server->head == NULL) {
+            server->tail = NULL;
+        }
+        pthread_mutex_unlock(&server->lock);
+        work->fn(work->arg);
+        free(work);
+        pthread_mutex_lock(&server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+esp_err_t host_httpd_start(httpd_handle_t *out) {
+    host_httpd_t *server = calloc(1, sizeof(*server));
+    if (server == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->cond, NULL);
+    server->running = true;
+    if (pthread_create(&server->thread, NULL, httpd_thread, server) != 0) {
+        free(server);
+        return ESP_ERR_NO_MEM;
+    }
+    *out = server;
+    return ESP_OK;
+}
+
+void host_httpd_stop(httpd_handle_t handle) {
+    host_httpd_t *server = handle;
+    if (server == NULL) {
+        return;
+    }
+    // 已排队的工作先执行完，与httpd_stop一样不丢弃
+    pthread_mutex_lock(&server->lock);
+    server->running = false;
+    pthread_cond_signal(&server->cond);
+    pthread_mutex_unlock(&server->lock);
+    pthread_join(server->thread, NULL);
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->cond);
+    free(server);
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg) {
+    host_httpd_t *server = handle;
+    if (server == NULL || work == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    host_work_t *item = malloc(sizeof(*item));
+    if (item == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    item->fn = work;
+    item->arg = arg;
+    item->next = NULL;
+
+    pthread_mutex_lock(&server->lock);
+    if (!server->running) {
+        pthread_mutex_unlock(&server->lock);
+        free(item);
+        return ESP_FAIL;
+    }
+    if (server->tail != NULL) {
+        server->tail->next = item;
+    } else {
+        server->head = item;
+    }
+    server->tail = item;
+    pthread_cond_signal(&server->cond);
+    pthread_mutex_unlock(&server->lock);
+    return ESP_OK;
+}
+
+bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match, size_t match_upto) {
+    size_t tpl_len = strlen(uri_template);
+    if (tpl_len > 0 && uri_template[tpl_len - 1] == '*') {
+        return match_upto >= tpl_len - 1 && strncmp(uri_template, uri_to_match, tpl_len - 1) == 0;
+    }
+    return match_upto == tpl_len && strncmp(uri_template, uri_to_match, tpl_len) == 0;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+    host_httpd_t *server = handle;
+    if (server == NULL || uri_handler == NULL || uri_handler->uri == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < server->handler_count; i++) {
+        if (server->handlers[i].method == uri_handler->method &&
+            strcmp(server->handlers[i].uri, uri_handler->uri) == 0) {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (server->handler_count == HOST_HTTPD_MAX_HANDLERS) {
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    server->handlers[server->handler_count++] = *uri_handler;
+    return ESP_OK;
+}
+
+static void finish_request(host_req_state_t *state) {
+    pthread_mutex_lock(&state->lock);
+    state->finished = true;
+    pthread_cond_signal(&state->cond);
+    pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * @brief 在httpd任务中执行处理函数
+ *
+ * 同步请求结束时视为连接关闭，释放处理函数设置的会话上下文
+ */
+static void run_request(void *arg) {
+    host_req_state_t *state = arg;
+    httpd_req_t *req = &state->req;
+    state->result = state->route->handler(req);
+    bool async = state->async;
+    if (!async && req->sess_ctx != NULL && req->free_ctx != NULL) {
+        req->free_ctx(req->sess_ctx);
+    }
+    pthread_mutex_lock(&state->lock);
+    state->handler_done = true;
+    if (!async) {
+        state->finished = true;
+    }
+    pthread_cond_signal(&state->cond);
+    pthread_mutex_unlock(&state->lock);
+}
+
+esp_err_t host_httpd_request(httpd_handle_t handle, const host_http_request_t *request,
+                             host_http_response_t *response) {
+    host_httpd_t *server = handle;
+    memset(response, 0, sizeof(*response));
+    strlcpy(response->status, HTTPD_200, sizeof(response->status));
+    strlcpy(response->content_type, "text/html", sizeof(response->content_type));
+
+    const char *query = strchr(request->uri, '?');
+    size_t path_len = query != NULL ? (size_t)(query - request->uri) : strlen(request->uri);
+    const httpd_uri_t *route = NULL;
+    for (int i = 0; i < server->handler_count && route == NULL; i++) {
+        const httpd_uri_t *h = &server->handlers[i];
+        if ((int)h->method == (int)request->method && httpd_uri_match_wildcard(h->uri, request->uri, path_len)) {
+            route = h;
+        }
+    }
+    if (route == NULL) {
+        strlcpy(response->status, HTTPD_404, sizeof(response->status));
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    host_req_state_t *state = calloc(1, sizeof(*state));
+    if (state == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    state->server = server;
+    state->in = request;
+    state->route = route;
+    state->query = query != NULL ? query + 1 : NULL;
+    state->out = response;
+    pthread_mutex_init(&state->lock, NULL);
+    pthread_cond_init(&state->cond, NULL);
+    state->req.handle = server;
+    state->req.method = request->method;
+    strlcpy((char *)state->req.uri, request->uri, sizeof(state->req.uri));
+    state->req.content_len = request->body_len;
+    state->req.aux = state;
+    state->req.user_ctx = route->user_ctx;
+
+    esp_err_t err = httpd_queue_work(server, run_request, state);
+    if (err == ESP_OK) {
+        pthread_mutex_lock(&state->lock);
+        while (!state->finished || !state->handler_done) {
+            pthread_cond_wait(&state->cond, &state->lock);
+        }
+        pthread_mutex_unlock(&state->lock);
+        err = state->result;
+    }
+    pthread_mutex_destroy(&state->lock);
+    pthread_cond_destroy(&state->cond);
+    free(state);
+    return err;
+}
+
+const char *host_http_response_header(const host_http_response_t *response, const char *name) {
+    if (strcasecmp(name, "Content-Type") == 0) {
+        return response->content_type;
+    }
+    for (int i = 0; i < response->header_count; i++) {
+        if (strcasecmp(response->header_names[i], name) == 0) {
+            return response->header_values[i];
+        }
+    }
+    return NULL;
+}
+
+void host_http_response_free(host_http_response_t *response) {
+    free(response->body);
+    response->body = NULL;
+    response->body_len = 0;
+    response->body_cap = 0;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out) {
+    httpd_req_t *copy = malloc(sizeof(*copy));
+    if (copy == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, r, sizeof(*copy));
+    STATE(r)->async = true;
+    *out = copy;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r) {
+    host_req_state_t *state = STATE(r);
+    free(r);
+    finish_request(state);
+    return ESP_OK;
+}
+
+static const char *find_header(const host_http_request_t *in, const char *field) {
+    for (int i = 0; i < HOST_HTTP_MAX_HEADERS && in->headers[i].name != NULL; i++) {
+        if (strcasecmp(in->headers[i].name, field) == 0) {
+            return in->headers[i].value;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 与httpd相同的截断语义：总是以'\0'结尾，放不下时返回ESP_ERR_HTTPD_RESULT_TRUNC
+ */
+static esp_err_t copy_value(const char *src, size_t len, char *dst, size_t dst_size) {
+    if (dst_size == 0) {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    size_t n = len < dst_size - 1 ? len : dst_size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+    return n < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field) {
+    const char *value = find_header(STATE(r)->in, field);
+    return value != NULL ? strlen(value) : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size) {
+    const char *value = find_header(STATE(r)->in, field);
+    if (value == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return copy_value(value, strlen(value), val, val_size);
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r) {
+    const char *query = STATE(r)->query;
+    return query != NULL ? strlen(query) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len) {
+    const char *query = STATE(r)->query;
+    if (query == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return copy_value(query, strlen(query), buf, buf_len);
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size) {
+    size_t key_len = strlen(key);
+    const char *p = qry;
+    while (p != NULL && *p != '\0') {
+        size_t pair_len = strcspn(p, "&");
+        if (pair_len > key_len && strncmp(p, key, key_len) == 0 && p[key_len] == '=') {
+            return copy_value(p + key_len + 1, pair_len - key_len - 1, val, val_size);
+        }
+        p += pair_len;
+        if (*p == '&') {
+            p++;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len) {
+    host_req_state_t *state = STATE(r);
+    size_t remaining = state->in->body_len - state->recv_offset;
+    size_t n = buf_len < remaining ? buf_len : remaining;
+    memcpy(buf, state->in->body + state->recv_offset, n);
+    state->recv_offset += n;
+    return (int)n;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r) {
+    (void)r;
+    return -1; // 没有真实套接字，限流取不到对端地址时不限流
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+    strlcpy(STATE(r)->out->status, status, sizeof(STATE(r)->out->status));
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+    strlcpy(STATE(r)->out->content_type, type, sizeof(STATE(r)->out->content_type));
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value) {
+    host_http_response_t *out = STATE(r)->out;
+    if (out->header_count == HOST_HTTP_MAX_HEADERS) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    strlcpy(out->header_names[out->header_count], field, sizeof(out->header_names[0]));
+    strlcpy(out->header_values[out->header_count], value, sizeof(out->header_values[0]));
+    out->header_count++;
+    return ESP_OK;
+}
+
+static esp_err_t append_body(host_http_response_t *out, const char *buf, size_t len) {
+    if (out->body_len + len + 1 > out->body_cap) {
+        size_t cap = out->body_cap ? out->body_cap : 1024;
+        while (cap < out->body_len + len + 1) {
+            cap *= 2;
+        }
+        char *body = realloc(out->body, cap);
+        if (body == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        out->body = body;
+        out->body_cap = cap;
+    }
+    memcpy(out->body + out->body_len, buf, len);
+    out->body_len += len;
+    out->body[out->body_len] = '\0';
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    size_t len = buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : (size_t)buf_len;
+    return append_body(STATE(r)->out, buf != NULL ? buf : "", buf != NULL ? len : 0);
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    if (buf == NULL || buf_len == 0) {
+        return ESP_OK; // 结束块
+    }
+    size_t len = buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : (size_t)buf_len;
+    STATE(r)->out->chunks++;
+    return append_body(STATE(r)->out, buf, len);
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg) {
+    static const char *const statuses[HTTPD_ERR_CODE_MAX] = {
+        [HTTPD_500_INTERNAL_SERVER_ERROR] = "500 Internal Server Error",
+        [HTTPD_501_METHOD_NOT_IMPLEMENTED] = "501 Method Not Implemented",
+        [HTTPD_505_VERSION_NOT_SUPPORTED] = "505 Version Not Supported",
+        [HTTPD_400_BAD_REQUEST] = "400 Bad Request",
+        [HTTPD_401_UNAUTHORIZED] = "401 Unauthorized",
+        [HTTPD_403_FORBIDDEN] = "403 Forbidden",
+        [HTTPD_404_NOT_FOUND] = "404 Not Found",
+        [HTTPD_405_METHOD_NOT_ALLOWED] = "405 Method Not Allowed",
+        [HTTPD_408_REQ_TIMEOUT] = "408 Request Timeout",
+        [HTTPD_411_LENGTH_REQUIRED] = "411 Length Required",
+        [HTTPD_414_URI_TOO_LONG] = "414 URI Too Long",
+        [HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE] = "431 Request Header Fields Too Large",
+    };
+    const char *status = (error >= 0 && error < HTTPD_ERR_CODE_MAX) ? statuses[error] : NULL;
+    if (status == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "text/html");
+    return httpd_resp_send(req, msg != NULL ? msg : status, HTTPD_RESP_USE_STRLEN);
+}
+
+int httpd_send(httpd_req_t *r, const char *buf, size_t buf_len) {
+    return append_body(STATE(r)->out, buf, buf_len) == ESP_OK ? (int)buf_len : HTTPD_SOCK_ERR_FAIL;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    (void)handle;
+    (void)sockfd;
+    return ESP_OK;
+}
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags) {
+    (void)hd;
+    (void)buf;
+    (void)flags;
+    if (sockfd < 0) {
+        ESP_LOGD(HTTPD_TAG, "Dropping %u bytes for fd %d", (unsigned)buf_len, sockfd);
+    }
+    return (int)buf_len;
+}
+
+#if CONFIG_HTTPD_WS_SUPPORT
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len) {
+    (void)req;
+    (void)pkt;
+    (void)max_len;
+    return ESP_FAIL; // 内存请求没有WebSocket帧
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt) {
+    return httpd_send(req, (const char *)pkt->payload, pkt->len) >= 0 ? ESP_OK : ESP_FAIL;
+}
+#endif /* CONFIG_HTTPD_WS_SUPPORT */
@@ -0,0 +1,69 @@
+/**
+ * Wi-Fi、电源管理和mDNS的主机替身
+ *
+ * 主机上没有射频和调频，这些接口只返回成功，让功耗调节器照常切换档位
+ */
+
+#include <stdlib.h>
+#include "esp_wifi.h"
+#include "esp_pm.h"
+#include "mdns.h"
+
+struct esp_pm_lock {
+    esp_pm_lock_type_t type;
+    int count;
+};
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type) {
+    (void)type;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_configure(const void *config) {
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name, esp_pm_lock_handle_t *out_handle) {
+    (void)arg;
+    (void)name;
+    esp_pm_lock_handle_t lock = calloc(1, sizeof(*lock));
+    if (lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    lock->type = lock_type;
+    *out_handle = lock;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+    __atomic_add_fetch(&handle->count, 1, __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+    if (__atomic_sub_fetch(&handle->count, 1, __ATOMIC_RELAXED) < 0) {
+        __atomic_add_fetch(&handle->count, 1, __ATOMIC_RELAXED);
+        return ESP_ERR_INVALID_STATE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t handle) {
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->count != 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t mdns_service_txt_item_set(const char *service_type, const char *proto, const char *key, const char *value) {
+    (void)service_type;
+    (void)proto;
+    (void)key;
+    (void)value;
+    return ESP_OK;
+}
@@ -0,0 +1,102 @@
+/**
+ * esp_partition主机替身
+ *
+ * 提供一个256KB的chatlog分区（与partitions_example.csv一致），内容放在内存中。
+ * 写入只能把位从1改成0，擦除按4KB扇区对齐，与NOR闪存的行为相同，
+ * 这样日志格式对未擦除、写坏的扇区的处理也能在主机上验证
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_partition.h"
+#include "host_shim.h"
+
+#define HOST_FLASH_SIZE (256 * 1024)
+#define HOST_FLASH_SECTOR_SIZE 4096
+
+static const esp_partition_t chatlog_partition = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = (esp_partition_subtype_t)0x40,
+    .address = 0x310000,
+    .size = HOST_FLASH_SIZE,
+    .erase_size = HOST_FLASH_SECTOR_SIZE,
+    .label = "chatlog"
+};
+
+static uint8_t flash[HOST_FLASH_SIZE];
+static bool flash_present = true;
+static bool flash_initialized = false;
+
+uint8_t *host_flash_reset(bool present) {
+    memset(flash, 0xff, sizeof(flash));
+    flash_present = present;
+    flash_initialized = true;
+    return flash;
+}
+
+size_t host_flash_size(void) {
+    return sizeof(flash);
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+    if (!flash_initialized) {
+        host_flash_reset(true);
+    }
+    if (!flash_present || (type != ESP_PARTITION_TYPE_ANY && type != chatlog_partition.type) ||
+        (subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != chatlog_partition.subtype) ||
+        (label != NULL && strcmp(label, chatlog_partition.label) != 0)) {
+        return NULL;
+    }
+    return &chatlog_partition;
+}
+
+static bool in_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    return partition == &chatlog_partition && offset <= partition->size && size <= partition->size - offset;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+    if (!in_range(partition, src_offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, flash + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size) {
+    if (!in_range(partition, dst_offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const uint8_t *bytes = src;
+    for (size_t i = 0; i < size; i++) {
+        flash[dst_offset + i] &= bytes[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    if (offset % HOST_FLASH_SECTOR_SIZE != 0 || size % HOST_FLASH_SECTOR_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!in_range(partition, offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memset(flash + offset, 0xff, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle) {
+    (void)memory;
+    if (!in_range(partition, offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *out_ptr = flash + offset;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle) {
+    (void)handle;
+}
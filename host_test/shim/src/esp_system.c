@@ -0,0 +1,150 @@
+/**
+ * ESP-IDF杂项接口的主机替身：错误名、日志、随机数、堆和ROM CRC
+ */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "esp_rom_crc.h"
+
+#define HOST_HEAP_SIZE (320 * 1024) // 堆统计接口报告的大小，与ESP32的内部RAM相当
+
+esp_log_level_t host_log_level = ESP_LOG_INFO;
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t random_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t random_state = 0x853c49e6748fea9bULL;
+
+#ifndef CHAT_HOST_HAVE_STRLCPY
+size_t strlcpy(char *dst, const char *src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+
+size_t strlcat(char *dst, const char *src, size_t size) {
+    size_t dst_len = strnlen(dst, size);
+    if (dst_len == size) {
+        return size + strlen(src);
+    }
+    return dst_len + strlcpy(dst + dst_len, src, size - dst_len);
+}
+#endif
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_NOT_FINISHED: return "ESP_ERR_NOT_FINISHED";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+void host_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    static const char letters[] = "NEWIDV";
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&log_lock);
+    printf("%c (%s) ", letters[level], tag);
+    vprintf(format, args);
+    putchar('\n');
+    pthread_mutex_unlock(&log_lock);
+    va_end(args);
+}
+
+void host_random_seed(uint32_t seed) {
+    pthread_mutex_lock(&random_lock);
+    random_state = ((uint64_t)seed << 32) | (seed ^ 0x9e3779b9u);
+    pthread_mutex_unlock(&random_lock);
+}
+
+/* xorshift64*，足够产生UUID和抖动，不用于安全用途 */
+uint32_t esp_random(void) {
+    pthread_mutex_lock(&random_lock);
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    uint64_t value = random_state * 0x2545f4914f6cdd1dULL;
+    pthread_mutex_unlock(&random_lock);
+    return (uint32_t)(value >> 32);
+}
+
+void esp_fill_random(void *buf, size_t len) {
+    uint8_t *p = buf;
+    while (len > 0) {
+        uint32_t word = esp_random();
+        size_t n = len < sizeof(word) ? len : sizeof(word);
+        memcpy(p, &word, n);
+        p += n;
+        len -= n;
+    }
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+    (void)caps;
+    return malloc(size);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    (void)caps;
+    return calloc(n, size);
+}
+
+void *heap_caps_malloc_prefer(size_t size, size_t num, ...) {
+    (void)num;
+    return malloc(size);
+}
+
+void heap_caps_free(void *ptr) {
+    free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return (caps & MALLOC_CAP_SPIRAM) ? 0 : HOST_HEAP_SIZE;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return heap_caps_get_free_size(caps);
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return heap_caps_get_free_size(caps) / 2;
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return HOST_HEAP_SIZE;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return HOST_HEAP_SIZE;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
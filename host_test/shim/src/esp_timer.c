@@ -0,0 +1,172 @@
+/**
+ * esp_timer主机替身
+ *
+ * 与ESP_TIMER_TASK派发方式相同：所有回调在同一个定时器线程中按到期顺序依次执行
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include "esp_timer.h"
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    int64_t expiry_us;      // 下次到期时刻，0表示未启动
+    uint64_t period_us;     // 周期，0表示单次
+    struct esp_timer *next; // 已启动定时器链表
+};
+
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_cond;
+static pthread_once_t timer_once = PTHREAD_ONCE_INIT;
+static struct esp_timer *armed = NULL;
+
+int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void unlink_timer(struct esp_timer *timer) {
+    for (struct esp_timer **p = &armed; *p != NULL; p = &(*p)->next) {
+        if (*p == timer) {
+            *p = timer->next;
+            break;
+        }
+    }
+    timer->next = NULL;
+    timer->expiry_us = 0;
+}
+
+static void *timer_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&timer_lock);
+    for (;;) {
+        struct esp_timer *due = NULL;
+        for (struct esp_timer *t = armed; t != NULL; t = t->next) {
+            if (due == NULL || t->expiry_us < due->expiry_us) {
+                due = t;
+            }
+        }
+        int64_t now = esp_timer_get_time();
+        if (due == NULL) {
+            pthread_cond_wait(&timer_cond, &timer_lock);
+            continue;
+        }
+        if (due->expiry_us > now) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            int64_t ns = deadline.tv_nsec + (due->expiry_us - now) * 1000;
+            deadline.tv_sec += ns / 1000000000;
+            deadline.tv_nsec = ns % 1000000000;
+            pthread_cond_timedwait(&timer_cond, &timer_lock, &deadline);
+            continue;
+        }
+
+        esp_timer_cb_t callback = due->callback;
+        void *cb_arg = due->arg;
+        if (due->period_us > 0) {
+            due->expiry_us += (int64_t)due->period_us;
+            if (due->expiry_us < now) {
+                due->expiry_us = now + (int64_t)due->period_us;
+            }
+        } else {
+            unlink_timer(due);
+        }
+        // 回调可能重新启动或停止定时器，执行期间不持有锁
+        pthread_mutex_unlock(&timer_lock);
+        callback(cb_arg);
+        pthread_mutex_lock(&timer_lock);
+    }
+    return NULL;
+}
+
+static void timer_thread_start(void) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, timer_thread, NULL) == 0) {
+        pthread_detach(thread);
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+    if (create_args == NULL || create_args->callback == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_once(&timer_once, timer_thread_start);
+    struct esp_timer *timer = calloc(1, sizeof(*timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us) {
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timer_lock);
+    if (timer->expiry_us != 0) {
+        pthread_mutex_unlock(&timer_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->expiry_us = esp_timer_get_time() + (int64_t)timeout_us;
+    if (timer->expiry_us == 0) {
+        timer->expiry_us = 1;
+    }
+    timer->period_us = period_us;
+    timer->next = armed;
+    armed = timer;
+    pthread_cond_signal(&timer_cond);
+    pthread_mutex_unlock(&timer_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return timer_start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timer_lock);
+    esp_err_t err = timer->expiry_us != 0 ? ESP_OK : ESP_ERR_INVALID_STATE;
+    unlink_timer(timer);
+    pthread_mutex_unlock(&timer_lock);
+    return err;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timer_lock);
+    bool active = timer->expiry_us != 0;
+    pthread_mutex_unlock(&timer_lock);
+    if (active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    pthread_mutex_lock(&timer_lock);
+    bool active = timer != NULL && timer->expiry_us != 0;
+    pthread_mutex_unlock(&timer_lock);
+    return active;
+}
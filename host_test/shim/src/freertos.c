@@ -0,0 +1,330 @@
+/**
+ * FreeRTOS主机替身
+ *
+ * 任务是分离的POSIX线程，信号量和队列由互斥锁加条件变量实现。
+ * 不模拟优先级和核心绑定：主机上更关心逻辑和格式，而不是调度
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+
+struct host_semaphore {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max_count;
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t waiting;
+    uint8_t *items;
+};
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t code;
+    void *parameters;
+    struct host_semaphore notify;   // 任务通知值
+};
+
+static __thread struct host_task *current_task = NULL;
+
+/**
+ * @brief 把节拍数换算成绝对截止时间
+ */
+static struct timespec ticks_to_deadline(TickType_t ticks) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t ns = (uint64_t)ts.tv_nsec + (uint64_t)ticks * (1000000000ULL / configTICK_RATE_HZ);
+    ts.tv_sec += (time_t)(ns / 1000000000ULL);
+    ts.tv_nsec = (long)(ns % 1000000000ULL);
+    return ts;
+}
+
+/**
+ * @brief 在条件变量上等待，直到谓词满足或超时
+ *
+ * @return true 谓词满足
+ */
+#define WAIT_UNTIL(cond_var, lock, ticks, predicate) ({                             \
+        struct timespec deadline_ = ticks_to_deadline(ticks);                       \
+        int rc_ = 0;                                                                \
+        while (!(predicate) && rc_ != ETIMEDOUT) {                                  \
+            if ((ticks) == 0) {                                                     \
+                rc_ = ETIMEDOUT;                                                    \
+            } else if ((ticks) == portMAX_DELAY) {                                  \
+                pthread_cond_wait((cond_var), (lock));                              \
+            } else {                                                                \
+                rc_ = pthread_cond_timedwait((cond_var), (lock), &deadline_);       \
+            }                                                                       \
+        }                                                                           \
+        (predicate);                                                                \
+    })
+
+static void semaphore_init(struct host_semaphore *sem, UBaseType_t max_count, UBaseType_t initial_count) {
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    sem->max_count = max_count;
+    sem->count = initial_count;
+}
+
+static SemaphoreHandle_t semaphore_create(UBaseType_t max_count, UBaseType_t initial_count) {
+    SemaphoreHandle_t sem = calloc(1, sizeof(*sem));
+    if (sem != NULL) {
+        semaphore_init(sem, max_count, initial_count);
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return semaphore_create(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return semaphore_create(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+    return semaphore_create(max_count, initial_count);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait) {
+    pthread_mutex_lock(&sem->lock);
+    bool taken = WAIT_UNTIL(&sem->cond, &sem->lock, ticks_to_wait, sem->count > 0);
+    if (taken) {
+        sem->count--;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return taken ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    pthread_mutex_lock(&sem->lock);
+    bool given = sem->count < sem->max_count;
+    if (given) {
+        sem->count++;
+        pthread_cond_signal(&sem->cond);
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return given ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t sem) {
+    pthread_mutex_lock(&sem->lock);
+    UBaseType_t count = sem->count;
+    pthread_mutex_unlock(&sem->lock);
+    return count;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    if (sem == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->cond);
+    free(sem);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    QueueHandle_t queue = calloc(1, sizeof(*queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->items = malloc((size_t)length * item_size);
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+    pthread_mutex_lock(&queue->lock);
+    bool space = WAIT_UNTIL(&queue->cond, &queue->lock, ticks_to_wait, queue->waiting < queue->length);
+    if (space) {
+        UBaseType_t tail = (queue->head + queue->waiting) % queue->length;
+        memcpy(queue->items + (size_t)tail * queue->item_size, item, queue->item_size);
+        queue->waiting++;
+        pthread_cond_broadcast(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return space ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait) {
+    pthread_mutex_lock(&queue->lock);
+    bool ready = WAIT_UNTIL(&queue->cond, &queue->lock, ticks_to_wait, queue->waiting > 0);
+    if (ready) {
+        memcpy(buffer, queue->items + (size_t)queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->waiting--;
+        pthread_cond_broadcast(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ready ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t waiting = queue->waiting;
+    pthread_mutex_unlock(&queue->lock);
+    return waiting;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t spaces = queue->length - queue->waiting;
+    pthread_mutex_unlock(&queue->lock);
+    return spaces;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (queue == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->cond);
+    free(queue->items);
+    free(queue);
+}
+
+/**
+ * @brief 当前线程对应的任务，主线程等不是由xTaskCreate创建的线程在第一次用到时补建
+ */
+static struct host_task *this_task(void) {
+    if (current_task == NULL) {
+        current_task = calloc(1, sizeof(*current_task));
+        if (current_task == NULL) {
+            abort();
+        }
+        current_task->thread = pthread_self();
+        semaphore_init(&current_task->notify, UINT32_MAX, 0);
+    }
+    return current_task;
+}
+
+static void task_free(struct host_task *task) {
+    pthread_mutex_destroy(&task->notify.lock);
+    pthread_cond_destroy(&task->notify.cond);
+    free(task);
+}
+
+static void *task_entry(void *arg) {
+    current_task = arg;
+    current_task->code(current_task->parameters);
+    task_free(current_task);
+    current_task = NULL;
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+                                   void *parameters, UBaseType_t priority, TaskHandle_t *created_task,
+                                   BaseType_t core_id) {
+    (void)name;
+    (void)stack_depth;
+    (void)priority;
+    (void)core_id;
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->code = task_code;
+    task->parameters = parameters;
+    semaphore_init(&task->notify, UINT32_MAX, 0);
+    if (created_task != NULL) {
+        *created_task = task;
+    }
+    if (pthread_create(&task->thread, NULL, task_entry, task) != 0) {
+        free(task);
+        if (created_task != NULL) {
+            *created_task = NULL;
+        }
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+                       void *parameters, UBaseType_t priority, TaskHandle_t *created_task) {
+    return xTaskCreatePinnedToCore(task_code, name, stack_depth, parameters, priority, created_task,
+                                   tskNO_AFFINITY);
+}
+
+/**
+ * 只支持任务删除自己（vTaskDelete(NULL)），存储层就是这样用的。
+ * 与FreeRTOS一样，删除之后句柄失效，不能再给它发通知
+ */
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL || task == current_task) {
+        task_free(current_task);
+        current_task = NULL;
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec ts = {
+        .tv_sec = ticks / configTICK_RATE_HZ,
+        .tv_nsec = (long)(ticks % configTICK_RATE_HZ) * (1000000000L / configTICK_RATE_HZ)
+    };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / (1000000 / configTICK_RATE_HZ));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return this_task();
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    struct host_semaphore *notify = &task->notify;
+    pthread_mutex_lock(&notify->lock);
+    notify->count++;
+    pthread_cond_signal(&notify->cond);
+    pthread_mutex_unlock(&notify->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    struct host_semaphore *notify = &this_task()->notify;
+    pthread_mutex_lock(&notify->lock);
+    WAIT_UNTIL(&notify->cond, &notify->lock, ticks_to_wait, notify->count > 0);
+    uint32_t value = notify->count;
+    if (clear_on_exit) {
+        notify->count = 0;
+    } else if (value > 0) {
+        notify->count--;
+    }
+    pthread_mutex_unlock(&notify->lock);
+    return value;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    (void)task;
+    return 0;
+}
+
+BaseType_t xPortGetCoreID(void) {
+    return 0;
+}
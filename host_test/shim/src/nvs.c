@@ -0,0 +1,240 @@
+/**
+ * NVS主机替身
+ *
+ * 内存中的键值链表，按命名空间和键名查找。与真实NVS一样检查键名长度和取值类型，
+ * 不模拟分区容量和写入磨损
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "host_shim.h"
+
+#define HOST_NVS_MAX_NAMESPACES 8
+
+typedef enum {
+    NVS_ENTRY_I32,
+    NVS_ENTRY_U32,
+    NVS_ENTRY_STR,
+    NVS_ENTRY_BLOB
+} nvs_entry_type_t;
+
+typedef struct nvs_entry {
+    nvs_handle_t ns;                    // 命名空间编号（即句柄）
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    nvs_entry_type_t type;
+    size_t length;
+    struct nvs_entry *next;
+    uint8_t value[];
+} nvs_entry_t;
+
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static char namespaces[HOST_NVS_MAX_NAMESPACES][NVS_KEY_NAME_MAX_SIZE];
+static int namespace_count = 0;
+static nvs_entry_t *entries = NULL;
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    host_nvs_reset();
+    return ESP_OK;
+}
+
+void host_nvs_reset(void) {
+    pthread_mutex_lock(&nvs_lock);
+    while (entries != NULL) {
+        nvs_entry_t *next = entries->next;
+        free(entries);
+        entries = next;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    (void)open_mode;
+    if (namespace_name == NULL || strlen(namespace_name) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t err = ESP_OK;
+    int i = 0;
+    while (i < namespace_count && strcmp(namespaces[i], namespace_name) != 0) {
+        i++;
+    }
+    if (i == namespace_count) {
+        if (namespace_count == HOST_NVS_MAX_NAMESPACES) {
+            err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        } else {
+            strlcpy(namespaces[namespace_count++], namespace_name, NVS_KEY_NAME_MAX_SIZE);
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    if (err == ESP_OK) {
+        *out_handle = (nvs_handle_t)(i + 1);
+    }
+    return err;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    (void)handle;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    (void)handle;
+    return ESP_OK;
+}
+
+/**
+ * @brief 查找键对应的条目，调用者持有nvs_lock
+ *
+ * @return nvs_entry_t** 指向条目的链表指针，不存在时指向的是NULL
+ */
+static nvs_entry_t **find_entry(nvs_handle_t handle, const char *key) {
+    nvs_entry_t **p = &entries;
+    while (*p != NULL && ((*p)->ns != handle || strcmp((*p)->key, key) != 0)) {
+        p = &(*p)->next;
+    }
+    return p;
+}
+
+static esp_err_t check_key(nvs_handle_t handle, const char *key) {
+    if (handle == 0 || handle > (nvs_handle_t)namespace_count) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (key == NULL || key[0] == '\0') {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t set_entry(nvs_handle_t handle, const char *key, nvs_entry_type_t type,
+                           const void *value, size_t length) {
+    esp_err_t err = check_key(handle, key);
+    if (err != ESP_OK) {
+        return err;
+    }
+    nvs_entry_t *entry = malloc(sizeof(*entry) + length);
+    if (entry == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    entry->ns = handle;
+    strlcpy(entry->key, key, sizeof(entry->key));
+    entry->type = type;
+    entry->length = length;
+    memcpy(entry->value, value, length);
+
+    pthread_mutex_lock(&nvs_lock);
+    nvs_entry_t **p = find_entry(handle, key);
+    if (*p != NULL) {
+        nvs_entry_t *old = *p;
+        entry->next = old->next;
+        *p = entry;
+        free(old);
+    } else {
+        entry->next = NULL;
+        *p = entry;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+/**
+ * 与NVS一样：out_value为NULL时只返回长度，缓冲区不够时返回ESP_ERR_NVS_INVALID_LENGTH
+ */
+static esp_err_t get_entry(nvs_handle_t handle, const char *key, nvs_entry_type_t type,
+                           void *out_value, size_t *length) {
+    esp_err_t err = check_key(handle, key);
+    if (err != ESP_OK) {
+        return err;
+    }
+    pthread_mutex_lock(&nvs_lock);
+    nvs_entry_t *entry = *find_entry(handle, key);
+    if (entry == NULL || entry->type != type) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (out_value == NULL) {
+        *length = entry->length;
+    } else if (*length < entry->length) {
+        *length = entry->length;
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(out_value, entry->value, entry->length);
+        *length = entry->length;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char *key, int32_t value) {
+    return set_entry(handle, key, NVS_ENTRY_I32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char *key, int32_t *out_value) {
+    size_t length = sizeof(*out_value);
+    return get_entry(handle, key, NVS_ENTRY_I32, out_value, &length);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return set_entry(handle, key, NVS_ENTRY_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value) {
+    size_t length = sizeof(*out_value);
+    return get_entry(handle, key, NVS_ENTRY_U32, out_value, &length);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    return set_entry(handle, key, NVS_ENTRY_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length) {
+    return get_entry(handle, key, NVS_ENTRY_STR, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    return set_entry(handle, key, NVS_ENTRY_BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    return get_entry(handle, key, NVS_ENTRY_BLOB, out_value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    esp_err_t err = check_key(handle, key);
+    if (err != ESP_OK) {
+        return err;
+    }
+    pthread_mutex_lock(&nvs_lock);
+    nvs_entry_t **p = find_entry(handle, key);
+    nvs_entry_t *entry = *p;
+    if (entry != NULL) {
+        *p = entry->next;
+        free(entry);
+    } else {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    pthread_mutex_lock(&nvs_lock);
+    nvs_entry_t **p = &entries;
+    while (*p != NULL) {
+        if ((*p)->ns == handle) {
+            nvs_entry_t *entry = *p;
+            *p = entry->next;
+            free(entry);
+        } else {
+            p = &(*p)->next;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
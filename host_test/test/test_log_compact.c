@@ -0,0 +1,161 @@
+/**
+ * 日志整理的回归测试
+ *
+ * 默认房间的消息多次写满日志分区，分区绕回时很久没有新消息的房间的历史必须保留下来；
+ * 重启前内存中的历史重启后全部回放出来，序列号与内容一致
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "chat_json.h"
+#include "chat_pool.h"
+#include "chat_storage.h"
+#include "host_shim.h"
+
+#define TEST_UUID "123e4567-e89b-12d3-a456-426614174000"
+#define QUIET_MESSAGES 3      // 安静房间中的消息数量
+#define REBOOTS 12            // 重启次数，每次之间写入一批默认房间的消息
+#define BATCH_MESSAGES 400    // 每批写入的消息数量，约占分区的三分之一
+#define LOAD_TIMEOUT_MS 5000  // 加载历史的最长时间，超过视为卡死
+
+static char output[512 * 1024];
+static size_t output_len = 0;
+static int failures = 0;
+
+static esp_err_t collect_flush(void *ctx, const char *data, size_t len) {
+    if (output_len + len >= sizeof(output)) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(output + output_len, data, len);
+    output_len += len;
+    output[output_len] = '\0';
+    return ESP_OK;
+}
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+static void boot(void) {
+    ESP_ERROR_CHECK(chat_storage_init());
+    for (int waited = 0; !chat_storage_history_ready(); waited++) {
+        if (waited * portTICK_PERIOD_MS > LOAD_TIMEOUT_MS) {
+            fprintf(stderr, "history load did not finish\n");
+            abort();
+        }
+        vTaskDelay(1);
+    }
+}
+
+/**
+ * @brief 读出房间的全部消息，输出为JSON
+ */
+static void query_room(int room) {
+    static char scratch[CHAT_JSON_SCRATCH_SIZE];
+    chat_messages_query_t query = {
+        .mode = CHAT_QUERY_SINCE_SEQ,
+        .seq = 0,
+        .format = CHAT_FORMAT_JSON,
+        .room = room,
+    };
+    chat_json_writer_t writer;
+    output_len = 0;
+    output[0] = '\0';
+    chat_json_writer_init(&writer, scratch, sizeof(scratch), collect_flush, NULL);
+    ESP_ERROR_CHECK(chat_storage_write_messages(&query, &writer, NULL));
+    ESP_ERROR_CHECK(chat_json_flush(&writer));
+}
+
+/**
+ * @brief 检查输出中每条消息的序列号都与内容"<prefix><seq> ..."一致，返回消息数量
+ */
+static int check_labels(const char *prefix, uint32_t *first, uint32_t *last) {
+    int count = 0;
+    char needle[32];
+    int needle_len = snprintf(needle, sizeof(needle), "\"message\":\"%s", prefix);
+    for (const char *p = output; (p = strstr(p, needle)) != NULL; p += needle_len) {
+        uint32_t content_seq = (uint32_t)strtoul(p + needle_len, NULL, 10);
+        const char *seq_field = strstr(p, "\"seq\":");
+        uint32_t seq = seq_field ? (uint32_t)strtoul(seq_field + 6, NULL, 10) : 0;
+        CHECK(seq == content_seq, "message %s%" PRIu32 " reported as seq %" PRIu32, prefix, content_seq, seq);
+        if (count == 0) {
+            *first = seq;
+        }
+        *last = seq;
+        count++;
+    }
+    return count;
+}
+
+int main(void) {
+    host_log_level = ESP_LOG_ERROR;
+    host_random_seed(1);
+    host_flash_reset(true);
+    host_nvs_reset();
+    ESP_ERROR_CHECK(chat_pool_init());
+
+    boot();
+    int quiet;
+    ESP_ERROR_CHECK(chat_storage_find_room("quiet", true, &quiet));
+    for (int i = 1; i <= QUIET_MESSAGES; i++) {
+        char text[MAX_MESSAGE_LENGTH];
+        snprintf(text, sizeof(text), "q%d", i);
+        chat_message_input_t input = { TEST_UUID, "carol", text, 0 };
+        chat_add_result_t result;
+        ESP_ERROR_CHECK(chat_storage_add_room_messages(quiet, &input, 1, &result));
+    }
+
+    // 接近最长的消息，默认房间的消息多次绕回整个分区
+    char filler[MAX_MESSAGE_LENGTH - 16];
+    memset(filler, 'x', sizeof(filler) - 1);
+    filler[sizeof(filler) - 1] = '\0';
+    for (int reboot = 0; reboot < REBOOTS; reboot++) {
+        for (int i = 0; i < BATCH_MESSAGES; i++) {
+            char text[MAX_MESSAGE_LENGTH];
+            snprintf(text, sizeof(text), "m%" PRIu32 " %s", chat_storage_get_last_seq() + 1, filler);
+            ESP_ERROR_CHECK(chat_storage_add_message(TEST_UUID, "alice", text));
+        }
+        uint32_t saved_last = chat_storage_get_last_seq();
+        uint32_t first = 0, last = 0;
+        query_room(CHAT_ROOM_LOBBY);
+        int in_memory = check_labels("m", &first, &last);
+        uint32_t saved_first = first;
+        chat_storage_deinit();
+        boot();
+        CHECK(chat_storage_get_last_seq() == saved_last, "reboot %d: last seq %" PRIu32 ", expected %" PRIu32,
+              reboot, chat_storage_get_last_seq(), saved_last);
+
+        // 重启前内存中的历史全部回放出来
+        query_room(CHAT_ROOM_LOBBY);
+        int count = check_labels("m", &first, &last);
+        CHECK(count == in_memory && first == saved_first && last == saved_last,
+              "reboot %d: lobby has %d messages %" PRIu32 "-%" PRIu32 ", had %d from %" PRIu32,
+              reboot, count, first, last, in_memory, saved_first);
+
+        ESP_ERROR_CHECK(chat_storage_find_room("quiet", false, &quiet));
+        query_room(quiet);
+        count = check_labels("q", &first, &last);
+        CHECK(count == QUIET_MESSAGES && first == 1 && last == QUIET_MESSAGES,
+              "reboot %d: quiet room has %d messages %" PRIu32 "-%" PRIu32, reboot, count, first, last);
+    }
+
+    chat_storage_deinit();
+    chat_pool_deinit();
+
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("log compaction ok\n");
+    return 0;
+}
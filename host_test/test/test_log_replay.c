@@ -0,0 +1,219 @@
+/**
+ * 日志回放的回归测试
+ *
+ * 日志中的序列号可能有空缺（保存前就被淘汰的消息不会写入日志，损坏的扇区在回放时被跳过）。
+ * 序列号由环形位置推算，回放后每条消息报告的序列号必须与日志中记录的一致。
+ * 没有日志分区时的NVS blob同样如此，损坏的记录之后的部分不能让之前的消息错位
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "chat_json.h"
+#include "chat_log.h"
+#include "chat_pool.h"
+#include "chat_storage.h"
+#include "host_shim.h"
+
+#define TEST_UUID "123e4567-e89b-12d3-a456-426614174000"
+#define LOAD_TIMEOUT_MS 5000 // 加载历史的最长时间，超过视为卡死
+
+static char output[16384];
+static size_t output_len = 0;
+static int failures = 0;
+
+static esp_err_t collect_flush(void *ctx, const char *data, size_t len) {
+    if (output_len + len >= sizeof(output)) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(output + output_len, data, len);
+    output_len += len;
+    output[output_len] = '\0';
+    return ESP_OK;
+}
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+static void wait_history_ready(void) {
+    for (int waited = 0; !chat_storage_history_ready(); waited++) {
+        if (waited * portTICK_PERIOD_MS > LOAD_TIMEOUT_MS) {
+            fprintf(stderr, "history load did not finish\n");
+            abort();
+        }
+        vTaskDelay(1);
+    }
+}
+
+/**
+ * @brief 直接向日志写入一条默认房间的消息
+ */
+static void log_message(uint32_t seq) {
+    chat_message_t message = {
+        .timestamp = 1700000000u + seq,
+        .seq = seq,
+        .room = CHAT_ROOM_LOBBY,
+    };
+    strlcpy(message.uuid, TEST_UUID, sizeof(message.uuid));
+    strlcpy(message.username, "alice", sizeof(message.username));
+    snprintf(message.message, sizeof(message.message), "logged %" PRIu32, seq);
+    ESP_ERROR_CHECK(chat_log_append(&message));
+}
+
+/**
+ * @brief 把一条默认房间的消息编码追加到NVS blob，返回新的长度
+ */
+static size_t blob_message(uint8_t *blob, size_t len, uint32_t seq) {
+    chat_message_t message = {
+        .timestamp = 1700000000u + seq,
+        .seq = seq,
+        .room = CHAT_ROOM_LOBBY,
+    };
+    strlcpy(message.uuid, TEST_UUID, sizeof(message.uuid));
+    strlcpy(message.username, "alice", sizeof(message.username));
+    snprintf(message.message, sizeof(message.message), "logged %" PRIu32, seq);
+    size_t record_len = chat_log_encode_message(&message, blob + len + 1);
+    blob[len] = (uint8_t)record_len;
+    return len + 1 + record_len;
+}
+
+/**
+ * @brief 写入NVS blob：消息1-3，4-6在保存前被淘汰，之后是7-8，最后一条记录9损坏
+ */
+static void write_nvs_blob(void) {
+    static uint8_t blob[2048];
+    // 与chat_storage.c中的blob头一致：版本、消息数量、最新序列号
+    uint16_t version = 1, count = 6;
+    uint32_t last_seq = 9;
+    memcpy(blob, &version, sizeof(version));
+    memcpy(blob + 2, &count, sizeof(count));
+    memcpy(blob + 4, &last_seq, sizeof(last_seq));
+    size_t len = 8;
+    for (uint32_t seq = 1; seq <= 3; seq++) {
+        len = blob_message(blob, len, seq);
+    }
+    for (uint32_t seq = 7; seq <= 8; seq++) {
+        len = blob_message(blob, len, seq);
+    }
+    // 长度超出blob末尾
+    blob[len++] = 200;
+
+    nvs_handle_t handle;
+    ESP_ERROR_CHECK(nvs_open("chat", NVS_READWRITE, &handle));
+    ESP_ERROR_CHECK(nvs_set_blob(handle, NVS_MSG_BLOB_KEY, blob, len));
+    ESP_ERROR_CHECK(nvs_commit(handle));
+    nvs_close(handle);
+}
+
+/**
+ * @brief 按查询读出默认房间的消息，输出为JSON
+ */
+static void query_messages(chat_query_mode_t mode, uint32_t seq, int limit) {
+    static char scratch[CHAT_JSON_SCRATCH_SIZE];
+    chat_messages_query_t query = {
+        .mode = mode,
+        .seq = seq,
+        .limit = limit,
+        .format = CHAT_FORMAT_JSON,
+        .room = CHAT_ROOM_LOBBY,
+    };
+    chat_json_writer_t writer;
+    output_len = 0;
+    output[0] = '\0';
+    chat_json_writer_init(&writer, scratch, sizeof(scratch), collect_flush, NULL);
+    ESP_ERROR_CHECK(chat_storage_write_messages(&query, &writer, NULL));
+    ESP_ERROR_CHECK(chat_json_flush(&writer));
+}
+
+/**
+ * @brief 输出中是否有内容为"logged <logged>"、序列号为seq的消息
+ */
+static bool has_message(uint32_t logged, uint32_t seq) {
+    char needle[64];
+    snprintf(needle, sizeof(needle), "\"logged %" PRIu32 "\"", logged);
+    const char *p = strstr(output, needle);
+    if (p == NULL) {
+        return false;
+    }
+    // 消息对象中seq在message字段之后
+    const char *seq_field = strstr(p, "\"seq\":");
+    return seq_field != NULL && strtoul(seq_field + 6, NULL, 10) == seq;
+}
+
+int main(void) {
+    host_log_level = ESP_LOG_ERROR;
+    host_random_seed(1);
+    host_flash_reset(true);
+    host_nvs_reset();
+
+    // 1-5正常保存，6-9在保存前被淘汰，之后是10-12
+    ESP_ERROR_CHECK(chat_pool_init());
+    ESP_ERROR_CHECK(chat_log_open());
+    for (uint32_t seq = 1; seq <= 5; seq++) {
+        log_message(seq);
+    }
+    for (uint32_t seq = 10; seq <= 12; seq++) {
+        log_message(seq);
+    }
+
+    ESP_ERROR_CHECK(chat_storage_init());
+    wait_history_ready();
+    CHECK(chat_storage_get_last_seq() == 12, "last seq %" PRIu32, chat_storage_get_last_seq());
+
+    query_messages(CHAT_QUERY_SINCE_SEQ, 0, 0);
+    for (uint32_t seq = 10; seq <= 12; seq++) {
+        CHECK(has_message(seq, seq), "message %" PRIu32 " reported with wrong seq: %s", seq, output);
+    }
+    // 空缺之前的消息无法与序列号对应，不能以错位的序列号出现
+    for (uint32_t seq = 1; seq <= 5; seq++) {
+        char needle[32];
+        snprintf(needle, sizeof(needle), "\"logged %" PRIu32 "\"", seq);
+        CHECK(strstr(output, needle) == NULL, "message %" PRIu32 " from before the gap still listed", seq);
+    }
+
+    query_messages(CHAT_QUERY_SINCE_SEQ, 10, 0);
+    CHECK(!has_message(10, 10) && has_message(11, 11) && has_message(12, 12), "since_seq=10: %s", output);
+
+    query_messages(CHAT_QUERY_BEFORE_SEQ, 12, 5);
+    CHECK(has_message(10, 10) && has_message(11, 11) && !has_message(12, 12), "before=12: %s", output);
+
+    // 重启后的新消息接着日志中的序列号编号
+    ESP_ERROR_CHECK(chat_storage_add_message(TEST_UUID, "bob", "after reboot"));
+    CHECK(chat_storage_get_last_seq() == 13, "new message got seq %" PRIu32, chat_storage_get_last_seq());
+
+    chat_storage_deinit();
+
+    // 没有日志分区，从NVS blob加载
+    host_flash_reset(false);
+    host_nvs_reset();
+    write_nvs_blob();
+    ESP_ERROR_CHECK(chat_storage_init());
+    wait_history_ready();
+    CHECK(chat_storage_get_last_seq() == 8, "NVS blob: last seq %" PRIu32, chat_storage_get_last_seq());
+    query_messages(CHAT_QUERY_SINCE_SEQ, 0, 0);
+    CHECK(has_message(7, 7) && has_message(8, 8), "NVS blob: messages reported with wrong seq: %s", output);
+    for (uint32_t seq = 1; seq <= 3; seq++) {
+        char needle[32];
+        snprintf(needle, sizeof(needle), "\"logged %" PRIu32 "\"", seq);
+        CHECK(strstr(output, needle) == NULL, "NVS blob: message %" PRIu32 " from before the gap still listed", seq);
+    }
+    chat_storage_deinit();
+
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("log replay ok\n");
+    return 0;
+}
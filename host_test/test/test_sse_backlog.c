@@ -0,0 +1,120 @@
+/**
+ * SSE断点续传补发的回归测试
+ *
+ * 补发在httpd任务中阻塞发送，大小由客户端的游标决定。无论游标落后太多（Last-Event-ID: 0）
+ * 还是超前于服务器（伪造的游标，或重启丢失了未保存的消息），都只能补发最新的一页
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "chat_push.h"
+#include "chat_server.h"
+#include "chat_storage.h"
+#include "host_shim.h"
+
+#define TEST_UUID "123e4567-e89b-12d3-a456-426614174000"
+#define TEST_MESSAGES (CHAT_PAGE_MAX_MESSAGES + 20) // 比一页多，游标为0时必须截断
+#define LOAD_TIMEOUT_MS 5000 // 加载历史的最长时间，超过视为卡死
+
+static httpd_handle_t server;
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+static void wait_history_ready(void) {
+    for (int waited = 0; !chat_storage_history_ready(); waited++) {
+        if (waited * portTICK_PERIOD_MS > LOAD_TIMEOUT_MS) {
+            fprintf(stderr, "history load did not finish\n");
+            abort();
+        }
+        vTaskDelay(1);
+    }
+}
+
+/**
+ * @brief 带Last-Event-ID连接SSE端点，返回补发的消息数量，first_seq输出其中最老的序列号
+ */
+static int connect_with_cursor(const char *last_event_id, uint32_t *first_seq) {
+    host_http_request_t request = {
+        .method = HTTP_GET,
+        .uri = CHAT_PUSH_SSE_URI,
+        .headers = {{"Last-Event-ID", last_event_id}},
+    };
+    host_http_response_t response;
+    host_httpd_request(server, &request, &response);
+
+    int count = 0;
+    *first_seq = 0;
+    for (const char *p = response.body; p != NULL && (p = strstr(p, "\"seq\":")) != NULL; p++) {
+        uint32_t seq = (uint32_t)strtoul(p + 6, NULL, 10);
+        if (count == 0 || seq < *first_seq) {
+            *first_seq = seq;
+        }
+        count++;
+    }
+    host_http_response_free(&response);
+    return count;
+}
+
+int main(void) {
+    host_log_level = ESP_LOG_ERROR;
+    host_random_seed(1);
+    host_flash_reset(true);
+    host_nvs_reset();
+
+    if (chat_server_init() != ESP_OK || host_httpd_start(&server) != ESP_OK ||
+        register_chat_uri_handlers(server) != ESP_OK) {
+        fprintf(stderr, "failed to start server\n");
+        return 1;
+    }
+    wait_history_ready();
+    for (int i = 0; i < TEST_MESSAGES; i++) {
+        ESP_ERROR_CHECK(chat_storage_add_message(TEST_UUID, "alice", "backlog"));
+    }
+    uint32_t last_seq = chat_storage_get_last_seq();
+    uint32_t page_first = last_seq - CHAT_PAGE_MAX_MESSAGES + 1;
+    uint32_t first_seq;
+
+    // 游标落后太多：只补发最新的一页
+    int count = connect_with_cursor("0", &first_seq);
+    CHECK(count == CHAT_PAGE_MAX_MESSAGES && first_seq == page_first,
+          "Last-Event-ID 0: %d messages from seq %" PRIu32, count, first_seq);
+
+    // 游标超前于服务器：存储层会从头重新同步，补发同样限制在一页
+    count = connect_with_cursor("4294967295", &first_seq);
+    CHECK(count == CHAT_PAGE_MAX_MESSAGES && first_seq == page_first,
+          "cursor ahead: %d messages from seq %" PRIu32, count, first_seq);
+
+    // 一页以内的缺口完整补发
+    char cursor[16];
+    snprintf(cursor, sizeof(cursor), "%" PRIu32, last_seq - 5);
+    count = connect_with_cursor(cursor, &first_seq);
+    CHECK(count == 5 && first_seq == last_seq - 4, "small gap: %d messages from seq %" PRIu32, count, first_seq);
+
+    // 已是最新时不补发
+    snprintf(cursor, sizeof(cursor), "%" PRIu32, last_seq);
+    count = connect_with_cursor(cursor, &first_seq);
+    CHECK(count == 0, "up to date: %d messages", count);
+
+    host_httpd_stop(server);
+    chat_storage_deinit();
+
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("sse backlog ok\n");
+    return 0;
+}
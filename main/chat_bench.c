@@ -0,0 +1,262 @@
+/*
+ * 聊天存储层设备端压测实现
+ * 主要功能：
+ * 1. 在两个核心上运行多个写入和读取任务，模拟多个客户端同时发消息和轮询
+ * 2. 统计吞吐量、单次调用耗时（写入耗时反映chat_mutex争用）
+ * 3. 输出堆内存和任务栈的最低水位，用于验证存储或传输层改动
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_heap_caps.h"
+#include "chat_json.h"
+#include "chat_storage.h"
+#include "chat_bench.h"
+
+#if CONFIG_CHAT_BENCH
+
+static const char *BENCH_TAG = "chat-bench"; // 日志标签
+
+#define BENCH_TASK_STACK_SIZE 4096   // 压测任务栈大小
+#define BENCH_TASK_PRIORITY 4        // 压测任务优先级，低于httpd任务
+#define BENCH_YIELD_US 20000         // 连续运行超过该时间后让出一个tick，避免空闲任务看门狗超时
+#define BENCH_FULL_READ_INTERVAL 16  // 读取任务每隔多少次读取一次全部历史（模拟新打开的页面）
+#define BENCH_MAX_LAG 8              // 读取任务落后最新消息的最大条数
+
+// 单个压测任务的统计
+typedef struct {
+    int id;                 // 任务编号
+    uint32_t ops;           // 完成的调用次数
+    uint32_t errors;        // 失败的调用次数
+    uint64_t bytes;         // 读取任务输出的字节数
+    uint64_t total_us;      // 调用耗时总和
+    uint32_t max_us;        // 单次调用最大耗时
+    UBaseType_t stack_free; // 任务栈最低剩余(字节)，任务未启动时为0
+} bench_worker_t;
+
+static bench_worker_t writers[CHAT_BENCH_WRITERS];
+static bench_worker_t readers[CHAT_BENCH_READERS];
+static SemaphoreHandle_t bench_done = NULL; // 每个任务结束时释放一次
+static int64_t bench_deadline = 0;
+
+/**
+ * @brief 记录一次调用耗时
+ *
+ * @param worker 任务统计
+ * @param elapsed_us 耗时(微秒)
+ */
+static void record_op(bench_worker_t *worker, int64_t elapsed_us) {
+    worker->ops++;
+    worker->total_us += (uint64_t)elapsed_us;
+    if (elapsed_us > worker->max_us) {
+        worker->max_us = (uint32_t)elapsed_us;
+    }
+}
+
+/**
+ * @brief 连续运行一段时间后让出CPU
+ *
+ * @param last_yield 输入输出参数，上次让出的时刻
+ */
+static void maybe_yield(int64_t *last_yield) {
+    int64_t now = esp_timer_get_time();
+    if (now - *last_yield >= BENCH_YIELD_US) {
+        vTaskDelay(1);
+        *last_yield = esp_timer_get_time();
+    }
+}
+
+/**
+ * @brief 读取任务的刷新回调，只统计字节数
+ *
+ * @param ctx 任务统计
+ * @param data 输出数据（丢弃）
+ * @param len 数据长度
+ * @return ESP_OK
+ */
+static esp_err_t discard_flush(void *ctx, const char *data, size_t len) {
+    ((bench_worker_t *)ctx)->bytes += len;
+    return ESP_OK;
+}
+
+/**
+ * @brief 写入任务：不断添加长度不一的消息
+ *
+ * @param pvParameters 任务统计
+ */
+static void bench_writer_task(void *pvParameters) {
+    bench_worker_t *worker = (bench_worker_t *)pvParameters;
+    char uuid[MAX_UUID_LENGTH];
+    char username[MAX_USERNAME_LENGTH];
+    char message[MAX_MESSAGE_LENGTH];
+    snprintf(uuid, sizeof(uuid), "%08x-0000-4000-8000-%012x", (unsigned)worker->id, (unsigned)esp_random());
+    snprintf(username, sizeof(username), "bench-%d", worker->id);
+
+    int64_t last_yield = esp_timer_get_time();
+    while (esp_timer_get_time() < bench_deadline) {
+        int len = snprintf(message, sizeof(message), "bench %d #%" PRIu32 " ", worker->id, worker->ops);
+        int target = 16 + (int)(esp_random() % (MAX_MESSAGE_LENGTH - 17));
+        for (; len < target; len++) {
+            message[len] = 'a' + len % 26;
+        }
+        message[len] = '\0';
+
+        int64_t start = esp_timer_get_time();
+        esp_err_t err = chat_storage_add_message(uuid, username, message);
+        record_op(worker, esp_timer_get_time() - start);
+        if (err != ESP_OK) {
+            worker->errors++;
+        }
+        maybe_yield(&last_yield);
+    }
+
+    worker->stack_free = uxTaskGetStackHighWaterMark(NULL);
+    xSemaphoreGive(bench_done);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief 读取任务：模拟轮询的客户端，读取最新的几条消息，偶尔读取全部历史
+ *
+ * @param pvParameters 任务统计
+ */
+static void bench_reader_task(void *pvParameters) {
+    bench_worker_t *worker = (bench_worker_t *)pvParameters;
+    char *scratch = malloc(CHAT_JSON_SCRATCH_SIZE);
+    if (scratch == NULL) {
+        ESP_LOGE(BENCH_TAG, "Reader %d: no memory for scratch buffer", worker->id);
+        worker->errors++;
+        xSemaphoreGive(bench_done);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    int64_t last_yield = esp_timer_get_time();
+    while (esp_timer_get_time() < bench_deadline) {
+        uint32_t last_seq = chat_storage_get_last_seq();
+        uint32_t lag = esp_random() % BENCH_MAX_LAG;
+        uint32_t since_seq = (worker->ops % BENCH_FULL_READ_INTERVAL == 0 || last_seq < lag) ? 0 : last_seq - lag;
+
+        chat_json_writer_t writer;
+        bool has_new_messages = false;
+        chat_json_writer_init(&writer, scratch, CHAT_JSON_SCRATCH_SIZE, discard_flush, worker);
+        int64_t start = esp_timer_get_time();
+        esp_err_t err = chat_storage_write_messages_since_seq_json(since_seq, &writer, &has_new_messages);
+        if (err == ESP_OK) {
+            err = chat_json_flush(&writer);
+        }
+        record_op(worker, esp_timer_get_time() - start);
+        if (err != ESP_OK) {
+            worker->errors++;
+        }
+        maybe_yield(&last_yield);
+    }
+
+    free(scratch);
+    worker->stack_free = uxTaskGetStackHighWaterMark(NULL);
+    xSemaphoreGive(bench_done);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief 汇总并输出一组任务的统计
+ *
+ * @param kind 任务类型名称
+ * @param workers 任务统计
+ * @param count 任务数量
+ * @param elapsed_us 压测实际持续时间
+ */
+static void report_workers(const char *kind, const bench_worker_t *workers, int count, int64_t elapsed_us) {
+    uint64_t ops = 0, errors = 0, bytes = 0, total_us = 0;
+    uint32_t max_us = 0;
+    UBaseType_t stack_free = UINT32_MAX;
+    for (int i = 0; i < count; i++) {
+        ops += workers[i].ops;
+        errors += workers[i].errors;
+        bytes += workers[i].bytes;
+        total_us += workers[i].total_us;
+        if (workers[i].max_us > max_us) {
+            max_us = workers[i].max_us;
+        }
+        if (workers[i].stack_free > 0 && workers[i].stack_free < stack_free) {
+            stack_free = workers[i].stack_free;
+        }
+    }
+
+    uint64_t per_sec = elapsed_us > 0 ? ops * 1000000 / (uint64_t)elapsed_us : 0;
+    uint64_t kb_per_sec = elapsed_us > 0 ? bytes * 1000000 / 1024 / (uint64_t)elapsed_us : 0;
+    ESP_LOGI(BENCH_TAG, "%d %s: %" PRIu64 " ops (%" PRIu64 "/s), %" PRIu64 " errors, avg %" PRIu64 " us, max %" PRIu32
+             " us, %" PRIu64 " KB/s, min stack free %u bytes",
+             count, kind, ops, per_sec, errors, ops ? total_us / ops : 0, max_us, kb_per_sec,
+             (unsigned)stack_free);
+}
+
+/**
+ * @brief 在设备上压测聊天存储层
+ */
+esp_err_t chat_bench_run(void) {
+    // 历史在后台加载，完成前写入会被拒绝
+    while (!chat_storage_history_ready()) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    bench_done = xSemaphoreCreateCounting(CHAT_BENCH_WRITERS + CHAT_BENCH_READERS, 0);
+    if (bench_done == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    uint32_t seq_before = chat_storage_get_last_seq();
+    ESP_LOGI(BENCH_TAG, "Starting: %d writers, %d readers, %d ms, %u bytes free",
+             CHAT_BENCH_WRITERS, CHAT_BENCH_READERS, CHAT_BENCH_DURATION_MS, (unsigned)heap_before);
+
+    int64_t start = esp_timer_get_time();
+    bench_deadline = start + (int64_t)CHAT_BENCH_DURATION_MS * 1000;
+
+    // 写入和读取任务交替分配到各个核心
+    int started = 0;
+    char name[16];
+    for (int i = 0; i < CHAT_BENCH_WRITERS + CHAT_BENCH_READERS; i++) {
+        bool is_writer = i < CHAT_BENCH_WRITERS;
+        bench_worker_t *worker = is_writer ? &writers[i] : &readers[i - CHAT_BENCH_WRITERS];
+        memset(worker, 0, sizeof(*worker));
+        worker->id = is_writer ? i : i - CHAT_BENCH_WRITERS;
+        snprintf(name, sizeof(name), "bench_%c%d", is_writer ? 'w' : 'r', worker->id);
+        if (xTaskCreatePinnedToCore(is_writer ? bench_writer_task : bench_reader_task, name,
+                                    BENCH_TASK_STACK_SIZE, worker, BENCH_TASK_PRIORITY, NULL,
+                                    i % portNUM_PROCESSORS) != pdPASS) {
+            ESP_LOGE(BENCH_TAG, "Failed to create %s", name);
+            worker->errors++;
+            continue;
+        }
+        started++;
+    }
+
+    for (int i = 0; i < started; i++) {
+        xSemaphoreTake(bench_done, portMAX_DELAY);
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start;
+
+    report_workers("writers", writers, CHAT_BENCH_WRITERS, elapsed_us);
+    report_workers("readers", readers, CHAT_BENCH_READERS, elapsed_us);
+    ESP_LOGI(BENCH_TAG, "Done in %" PRId64 " ms: %" PRIu32 " messages added, heap free %u -> %u bytes, "
+             "minimum ever %u bytes, largest block %u bytes",
+             elapsed_us / 1000, chat_storage_get_last_seq() - seq_before, (unsigned)heap_before,
+             (unsigned)heap_caps_get_free_size(MALLOC_CAP_DEFAULT),
+             (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT),
+             (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+
+    vSemaphoreDelete(bench_done);
+    bench_done = NULL;
+    return started == CHAT_BENCH_WRITERS + CHAT_BENCH_READERS ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+#endif /* CONFIG_CHAT_BENCH */
@@ -0,0 +1,26 @@
+#ifndef _CHAT_BENCH_H_
+#define _CHAT_BENCH_H_
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+#define CHAT_BENCH_WRITERS CONFIG_CHAT_BENCH_WRITERS         // 写入任务数量
+#define CHAT_BENCH_READERS CONFIG_CHAT_BENCH_READERS         // 读取任务数量
+#define CHAT_BENCH_DURATION_MS CONFIG_CHAT_BENCH_DURATION_MS // 压测持续时间
+
+/**
+ * @brief 在设备上压测聊天存储层
+ *
+ * 在两个核心上交替创建写入任务（chat_storage_add_message）和读取任务
+ * （chat_storage_write_messages_since_seq_json，模拟轮询的客户端），
+ * 持续CHAT_BENCH_DURATION_MS后在日志中输出吞吐量、单次调用的平均和最大耗时
+ * （写入耗时包含等待chat_mutex的时间）以及堆和任务栈的最低水位。
+ * 压测写入的消息会和普通消息一样保存到历史中，只应在测试设备上使用。
+ * 需在chat_server_init之后调用，阻塞到压测结束
+ *
+ * @return ESP_OK 压测完成
+ * @return ESP_ERR_NO_MEM 创建任务失败
+ */
+esp_err_t chat_bench_run(void);
+
+#endif /* _CHAT_BENCH_H_ */
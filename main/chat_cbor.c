@@ -0,0 +1,426 @@
+/*
+ * 紧凑二进制(CBOR, RFC 8949)消息格式实现
+ * 主要功能：
+ * 1. 通过与JSON相同的流式输出器写入CBOR数据项，消息列表可同样分块发送
+ * 2. 消息使用无符号整数键，UUID为16字节字节串，省去重复的键名和UUID文本
+ * 3. 在接收缓冲区中原地解析提交的消息映射，文本串就地加'\0'，整个过程零堆分配
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include "chat_cbor.h"
+
+#define CBOR_SIMPLE 7            // 主类型7：简单值、浮点数和break
+#define CBOR_TAG 6               // 主类型6：标签
+#define CBOR_NEGATIVE 1          // 主类型1：负整数
+#define CBOR_AI_INDEFINITE 31    // 附加信息：不定长
+#define CBOR_BREAK 0xFF          // 不定长数据项的结束标记
+#define CBOR_FALSE 0xF4
+#define CBOR_TRUE 0xF5
+
+/**
+ * @brief 写入数据项头部（主类型和长度/数值）
+ */
+esp_err_t chat_cbor_write_head(chat_json_writer_t *writer, uint8_t major, uint32_t value) {
+    uint8_t head[CHAT_CBOR_HEAD_MAX_LEN];
+    size_t len;
+    major <<= 5;
+    if (value < 24) {
+        head[0] = major | (uint8_t)value;
+        len = 1;
+    } else if (value <= 0xFF) {
+        head[0] = major | 24;
+        head[1] = (uint8_t)value;
+        len = 2;
+    } else if (value <= 0xFFFF) {
+        head[0] = major | 25;
+        head[1] = (uint8_t)(value >> 8);
+        head[2] = (uint8_t)value;
+        len = 3;
+    } else {
+        head[0] = major | 26;
+        head[1] = (uint8_t)(value >> 24);
+        head[2] = (uint8_t)(value >> 16);
+        head[3] = (uint8_t)(value >> 8);
+        head[4] = (uint8_t)value;
+        len = 5;
+    }
+    return chat_json_write_raw(writer, (const char *)head, len);
+}
+
+/**
+ * @brief 写入布尔值
+ */
+esp_err_t chat_cbor_write_bool(chat_json_writer_t *writer, bool value) {
+    char c = (char)(value ? CBOR_TRUE : CBOR_FALSE);
+    return chat_json_write_raw(writer, &c, 1);
+}
+
+/**
+ * @brief 写入字节串或文本串
+ */
+esp_err_t chat_cbor_write_string(chat_json_writer_t *writer, uint8_t major, const void *data, size_t len) {
+    chat_cbor_write_head(writer, major, (uint32_t)len);
+    return chat_json_write_raw(writer, (const char *)data, len);
+}
+
+/**
+ * @brief 开始不定长数组
+ */
+esp_err_t chat_cbor_write_array_start(chat_json_writer_t *writer) {
+    char c = (char)((CHAT_CBOR_ARRAY << 5) | CBOR_AI_INDEFINITE);
+    return chat_json_write_raw(writer, &c, 1);
+}
+
+/**
+ * @brief 结束不定长数组
+ */
+esp_err_t chat_cbor_write_break(chat_json_writer_t *writer) {
+    char c = (char)CBOR_BREAK;
+    return chat_json_write_raw(writer, &c, 1);
+}
+
+/**
+ * @brief 初始化解析器
+ */
+void chat_cbor_parser_init(chat_cbor_parser_t *parser, uint8_t *buf, size_t len) {
+    parser->pos = buf;
+    parser->end = buf + len;
+    parser->in_array = false;
+    parser->indefinite = false;
+    parser->remaining = 0;
+}
+
+/**
+ * @brief 读取数据项头部
+ *
+ * 64位的数值饱和到UINT32_MAX；作为长度时一定超出缓冲区，由调用者按格式错误处理
+ *
+ * @param parser 解析器，成功时位于头部之后
+ * @param major 输出参数，主类型
+ * @param ai 输出参数，附加信息（区分简单值、浮点数和不定长）
+ * @param value 输出参数，数值或长度
+ * @return true 读取成功
+ * @return false 数据不完整或附加信息非法
+ */
+static bool read_head(chat_cbor_parser_t *parser, uint8_t *major, uint8_t *ai, uint32_t *value) {
+    if (parser->pos >= parser->end) {
+        return false;
+    }
+    uint8_t initial = *parser->pos++;
+    *major = initial >> 5;
+    *ai = initial & 0x1F;
+    if (*ai < 24) {
+        *value = *ai;
+        return true;
+    }
+    if (*ai == CBOR_AI_INDEFINITE) {
+        *value = 0;
+        // 整数和标签没有不定长形式；主类型7的31即break
+        return *major != CHAT_CBOR_UINT && *major != CBOR_NEGATIVE && *major != CBOR_TAG;
+    }
+    if (*ai > 27) {
+        return false;
+    }
+
+    size_t n = (size_t)1 << (*ai - 24); // 1、2、4、8字节
+    if ((size_t)(parser->end - parser->pos) < n) {
+        return false;
+    }
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++) {
+        v = (v << 8) | *parser->pos++;
+    }
+    *value = v > UINT32_MAX ? UINT32_MAX : (uint32_t)v;
+    return true;
+}
+
+/**
+ * @brief 跳过一个数据项（含嵌套内容）
+ *
+ * @param parser 解析器
+ * @param depth 当前嵌套深度
+ * @return true 跳过成功
+ * @return false 格式错误或嵌套过深
+ */
+static bool skip_item(chat_cbor_parser_t *parser, int depth) {
+    if (depth > CHAT_CBOR_MAX_DEPTH) {
+        return false;
+    }
+
+    uint8_t major, ai;
+    uint32_t value;
+    if (!read_head(parser, &major, &ai, &value)) {
+        return false;
+    }
+
+    switch (major) {
+    case CHAT_CBOR_UINT:
+    case CBOR_NEGATIVE:
+        return true;
+    case CHAT_CBOR_BYTES:
+    case CHAT_CBOR_TEXT:
+        if (ai == CBOR_AI_INDEFINITE) {
+            // 分段字符串：若干同类型的定长分段，直到break
+            while (parser->pos < parser->end && *parser->pos != CBOR_BREAK) {
+                if ((*parser->pos >> 5) != major || (*parser->pos & 0x1F) == CBOR_AI_INDEFINITE ||
+                    !skip_item(parser, depth + 1)) {
+                    return false;
+                }
+            }
+            if (parser->pos >= parser->end) {
+                return false;
+            }
+            parser->pos++;
+            return true;
+        }
+        if ((size_t)(parser->end - parser->pos) < value) {
+            return false;
+        }
+        parser->pos += value;
+        return true;
+    case CHAT_CBOR_ARRAY:
+    case CHAT_CBOR_MAP:
+        if (ai == CBOR_AI_INDEFINITE) {
+            while (parser->pos < parser->end && *parser->pos != CBOR_BREAK) {
+                if (!skip_item(parser, depth + 1) ||
+                    (major == CHAT_CBOR_MAP && !skip_item(parser, depth + 1))) {
+                    return false;
+                }
+            }
+            if (parser->pos >= parser->end) {
+                return false;
+            }
+            parser->pos++;
+            return true;
+        }
+        for (uint32_t i = 0; i < value; i++) {
+            if (!skip_item(parser, depth + 1) ||
+                (major == CHAT_CBOR_MAP && !skip_item(parser, depth + 1))) {
+                return false;
+            }
+        }
+        return true;
+    case CBOR_TAG:
+        return skip_item(parser, depth + 1);
+    default:
+        // 简单值和浮点数：read_head已读取全部内容；单独出现的break不合法
+        return ai != CBOR_AI_INDEFINITE;
+    }
+}
+
+/**
+ * @brief 原地读取一个定长文本串
+ *
+ * 内容前移到头部所在位置，并在末尾添加'\0'，头部至少一个字节，不会越过该数据项
+ *
+ * @param parser 解析器
+ * @param out 输出参数，指向缓冲区中的字符串
+ * @param out_len 输出参数，字符串长度
+ * @param type_error 输出参数，类型不是文本串或内容含有'\0'时置为true
+ * @return true 格式正确（类型错误时也已跳过该数据项）
+ * @return false 格式错误
+ */
+static bool read_text(chat_cbor_parser_t *parser, const char **out, size_t *out_len, bool *type_error) {
+    uint8_t *head = parser->pos;
+    uint8_t major, ai;
+    uint32_t len;
+    if (!read_head(parser, &major, &ai, &len)) {
+        return false;
+    }
+    if (major != CHAT_CBOR_TEXT || ai == CBOR_AI_INDEFINITE) {
+        *type_error = true;
+        parser->pos = head;
+        return skip_item(parser, 0);
+    }
+    if ((size_t)(parser->end - parser->pos) < len) {
+        return false;
+    }
+
+    uint8_t *data = parser->pos;
+    parser->pos += len;
+    if (memchr(data, '\0', len) != NULL) {
+        *type_error = true;
+        return true;
+    }
+    memmove(head, data, len);
+    head[len] = '\0';
+    *out = (const char *)head;
+    *out_len = len;
+    return true;
+}
+
+/**
+ * @brief 读取UUID：16字节字节串，或36字符的文本
+ *
+ * @return true 格式正确（类型错误时也已跳过该数据项）
+ */
+static bool read_uuid(chat_cbor_parser_t *parser, chat_cbor_message_t *out, bool *type_error) {
+    if (parser->pos < parser->end && (*parser->pos >> 5) == CHAT_CBOR_TEXT) {
+        out->fields.uuid_bin = NULL;
+        return read_text(parser, &out->fields.uuid, &out->uuid_len, type_error);
+    }
+
+    uint8_t *head = parser->pos;
+    uint8_t major, ai;
+    uint32_t len;
+    if (!read_head(parser, &major, &ai, &len)) {
+        return false;
+    }
+    if (major != CHAT_CBOR_BYTES || ai == CBOR_AI_INDEFINITE || len != CHAT_UUID_BIN_LENGTH) {
+        *type_error = true;
+        parser->pos = head;
+        return skip_item(parser, 0);
+    }
+    if ((size_t)(parser->end - parser->pos) < len) {
+        return false;
+    }
+    out->fields.uuid_bin = parser->pos;
+    out->fields.uuid = NULL;
+    out->uuid_len = 0;
+    parser->pos += len;
+    return true;
+}
+
+/**
+ * @brief 读取时间戳：无符号整数，负数按0处理
+ *
+ * @return true 格式正确（类型错误时也已跳过该数据项）
+ */
+static bool read_timestamp(chat_cbor_parser_t *parser, uint32_t *out, bool *type_error) {
+    uint8_t *head = parser->pos;
+    uint8_t major, ai;
+    uint32_t value;
+    if (!read_head(parser, &major, &ai, &value)) {
+        return false;
+    }
+    if (major == CHAT_CBOR_UINT) {
+        *out = value;
+        return true;
+    }
+    if (major == CBOR_NEGATIVE) {
+        *out = 0;
+        return true;
+    }
+    *type_error = true;
+    parser->pos = head;
+    return skip_item(parser, 0);
+}
+
+/**
+ * @brief 解析一个消息映射
+ */
+esp_err_t chat_cbor_parse_message(chat_cbor_parser_t *parser, chat_cbor_message_t *out) {
+    memset(out, 0, sizeof(*out));
+
+    uint8_t *start = parser->pos;
+    uint8_t major, ai;
+    uint32_t count;
+    if (!read_head(parser, &major, &ai, &count)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (major != CHAT_CBOR_MAP) {
+        // 不是映射：跳过该元素，批量提交中只影响这一条
+        parser->pos = start;
+        return skip_item(parser, 0) ? ESP_ERR_NOT_FOUND : ESP_ERR_INVALID_ARG;
+    }
+
+    bool indefinite = ai == CBOR_AI_INDEFINITE;
+    bool type_error = false;
+    for (uint32_t i = 0; indefinite || i < count; i++) {
+        if (indefinite) {
+            if (parser->pos >= parser->end) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (*parser->pos == CBOR_BREAK) {
+                parser->pos++;
+                break;
+            }
+        }
+
+        // 只识别无符号整数键，其他键连同值一起跳过
+        uint8_t *key_start = parser->pos;
+        uint8_t key_major, key_ai;
+        uint32_t key;
+        if (!read_head(parser, &key_major, &key_ai, &key)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (key_major != CHAT_CBOR_UINT) {
+            parser->pos = key_start;
+            if (!skip_item(parser, 1)) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            key = UINT32_MAX;
+        }
+
+        bool ok;
+        switch (key) {
+        case CHAT_CBOR_KEY_UUID:
+            ok = read_uuid(parser, out, &type_error);
+            break;
+        case CHAT_CBOR_KEY_USERNAME:
+            ok = read_text(parser, &out->fields.username, &out->username_len, &type_error);
+            break;
+        case CHAT_CBOR_KEY_MESSAGE:
+            ok = read_text(parser, &out->fields.message, &out->message_len, &type_error);
+            break;
+        case CHAT_CBOR_KEY_TIMESTAMP:
+            ok = read_timestamp(parser, &out->fields.timestamp, &type_error);
+            break;
+        case CHAT_CBOR_KEY_CLIENT_ID:
+            ok = read_text(parser, &out->fields.client_id, &out->client_id_len, &type_error);
+            break;
+        default:
+            ok = skip_item(parser, 1);
+            break;
+        }
+        if (!ok) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    if (type_error || (!out->fields.uuid && !out->fields.uuid_bin) ||
+        !out->fields.username || !out->fields.message) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief 定位到批量数组的下一个元素
+ */
+esp_err_t chat_cbor_next_item(chat_cbor_parser_t *parser) {
+    if (!parser->in_array) {
+        uint8_t major, ai;
+        uint32_t count;
+        if (!read_head(parser, &major, &ai, &count) || major != CHAT_CBOR_ARRAY) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        parser->in_array = true;
+        parser->indefinite = ai == CBOR_AI_INDEFINITE;
+        parser->remaining = count;
+    }
+
+    if (parser->indefinite) {
+        if (parser->pos >= parser->end) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (*parser->pos != CBOR_BREAK) {
+            return ESP_OK;
+        }
+        parser->pos++;
+    } else if (parser->remaining > 0) {
+        parser->remaining--;
+        return ESP_OK;
+    }
+
+    // 数组已结束，之后不允许有其他内容
+    return chat_cbor_finish(parser) == ESP_OK ? ESP_ERR_NOT_FOUND : ESP_ERR_INVALID_ARG;
+}
+
+/**
+ * @brief 检查请求体已解析完毕
+ */
+esp_err_t chat_cbor_finish(chat_cbor_parser_t *parser) {
+    return parser->pos == parser->end ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
@@ -0,0 +1,146 @@
+#ifndef _CHAT_CBOR_H_
+#define _CHAT_CBOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "chat_json.h"
+#include "chat_storage.h"
+
+#define CHAT_CBOR_MIME "application/cbor" // 请求/响应使用CBOR时的Content-Type和Accept
+#define CHAT_CBOR_MAX_DEPTH 16            // 跳过未知字段时允许的最大嵌套深度
+
+/* 消息对象的键（CBOR映射中的无符号整数键） */
+#define CHAT_CBOR_KEY_UUID 1        // 16字节二进制UUID（提交时也接受36字符的文本）
+#define CHAT_CBOR_KEY_USERNAME 2    // 用户名
+#define CHAT_CBOR_KEY_MESSAGE 3     // 消息内容
+#define CHAT_CBOR_KEY_TIMESTAMP 4   // 时间戳
+#define CHAT_CBOR_KEY_SEQ 5         // 序列号
+#define CHAT_CBOR_KEY_CLIENT_ID 6   // 客户端消息ID（仅提交时使用）
+
+/* 消息列表响应对象的键，与JSON响应的字段一一对应 */
+#define CHAT_CBOR_KEY_MESSAGES 16          // messages，不定长数组
+#define CHAT_CBOR_KEY_HAS_NEW_MESSAGES 17  // has_new_messages
+#define CHAT_CBOR_KEY_LAST_SEQ 18          // last_seq
+#define CHAT_CBOR_KEY_HAS_MORE 19          // has_more（分页）
+#define CHAT_CBOR_KEY_OLDEST_SEQ 20        // oldest_seq（分页）
+
+/* CBOR主类型 */
+#define CHAT_CBOR_UINT 0
+#define CHAT_CBOR_BYTES 2
+#define CHAT_CBOR_TEXT 3
+#define CHAT_CBOR_ARRAY 4
+#define CHAT_CBOR_MAP 5
+
+/* 单个数据项头部的最大长度（1字节类型 + 4字节长度，本协议不使用64位长度） */
+#define CHAT_CBOR_HEAD_MAX_LEN 5
+
+/**
+ * @brief 写入数据项头部（主类型和长度/数值）
+ *
+ * @param writer 输出器，与JSON输出共用，可同样流式刷新
+ * @param major 主类型
+ * @param value 数值、字符串长度或元素数量
+ * @return ESP_OK 成功，其他为输出器错误码
+ */
+esp_err_t chat_cbor_write_head(chat_json_writer_t *writer, uint8_t major, uint32_t value);
+
+/**
+ * @brief 写入无符号整数
+ */
+static inline esp_err_t chat_cbor_write_uint(chat_json_writer_t *writer, uint32_t value) {
+    return chat_cbor_write_head(writer, CHAT_CBOR_UINT, value);
+}
+
+/**
+ * @brief 写入布尔值
+ */
+esp_err_t chat_cbor_write_bool(chat_json_writer_t *writer, bool value);
+
+/**
+ * @brief 写入字节串或文本串
+ *
+ * @param writer 输出器
+ * @param major CHAT_CBOR_BYTES或CHAT_CBOR_TEXT
+ * @param data 内容
+ * @param len 内容长度
+ * @return ESP_OK 成功，其他为输出器错误码
+ */
+esp_err_t chat_cbor_write_string(chat_json_writer_t *writer, uint8_t major, const void *data, size_t len);
+
+/**
+ * @brief 开始不定长数组，元素写完后调用chat_cbor_write_break
+ */
+esp_err_t chat_cbor_write_array_start(chat_json_writer_t *writer);
+
+/**
+ * @brief 结束不定长数组
+ */
+esp_err_t chat_cbor_write_break(chat_json_writer_t *writer);
+
+/* 原地解析器：在接收缓冲区中逐个读取CBOR数据项，文本串就地加'\0' */
+typedef struct {
+    uint8_t *pos;       // 当前解析位置
+    uint8_t *end;       // 缓冲区末尾
+    bool in_array;      // 已进入批量数组
+    bool indefinite;    // 批量数组为不定长数组
+    uint32_t remaining; // 定长批量数组中剩余的元素数
+} chat_cbor_parser_t;
+
+/* 解析出的一条消息，字符串指向接收缓冲区并以'\0'结尾 */
+typedef struct {
+    chat_message_input_t fields; // uuid（16字节字节串时为uuid_bin，同样指向接收缓冲区）、username、message和可选的timestamp
+    size_t uuid_len;             // 文本uuid长度，二进制时为0
+    size_t username_len;         // username长度
+    size_t message_len;          // message长度（UTF-8字节数）
+    size_t client_id_len;        // 可选的client_id长度，没有时为0
+} chat_cbor_message_t;
+
+/**
+ * @brief 初始化解析器
+ *
+ * 解析过程会改写缓冲区内容：文本串前移一个字节覆盖其头部，并在末尾添加'\0'
+ *
+ * @param parser 解析器
+ * @param buf 接收到的请求体
+ * @param len 请求体长度
+ */
+void chat_cbor_parser_init(chat_cbor_parser_t *parser, uint8_t *buf, size_t len);
+
+/**
+ * @brief 解析一个消息映射
+ *
+ * 读取CHAT_CBOR_KEY_UUID、USERNAME、MESSAGE和可选的TIMESTAMP、CLIENT_ID，其他键跳过。不分配内存。
+ * 解析成功后out中的指针在out和接收缓冲区有效期间有效
+ *
+ * @param parser 解析器，成功或ESP_ERR_NOT_FOUND时位于该映射之后
+ * @param out 输出参数，解析出的消息
+ * @return ESP_OK 解析成功
+ * @return ESP_ERR_NOT_FOUND CBOR格式正确，但不是映射或缺少必填字段、类型不对
+ * @return ESP_ERR_INVALID_ARG CBOR格式错误
+ */
+esp_err_t chat_cbor_parse_message(chat_cbor_parser_t *parser, chat_cbor_message_t *out);
+
+/**
+ * @brief 定位到批量数组的下一个元素
+ *
+ * 请求体为消息映射组成的数组（定长或不定长）
+ *
+ * @param parser 解析器
+ * @return ESP_OK 位于下一个元素的开始处
+ * @return ESP_ERR_NOT_FOUND 数组已结束
+ * @return ESP_ERR_INVALID_ARG CBOR格式错误或请求体不是数组
+ */
+esp_err_t chat_cbor_next_item(chat_cbor_parser_t *parser);
+
+/**
+ * @brief 检查请求体已解析完毕
+ *
+ * @param parser 解析器
+ * @return ESP_OK 没有剩余内容
+ * @return ESP_ERR_INVALID_ARG 还有多余内容
+ */
+esp_err_t chat_cbor_finish(chat_cbor_parser_t *parser);
+
+#endif /* _CHAT_CBOR_H_ */
@@ -0,0 +1,99 @@
+/*
+ * 重复提交识别实现
+ * 主要功能：
+ * 1. 按房间记住最近提交的客户端消息ID和分配的序列号，客户端重试时返回第一次的结果
+ * 2. 固定大小的哈希表，查找和替换都只探测常数个槽位，不分配内存
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_random.h"
+#include "chat_dedup.h"
+
+#if CONFIG_CHAT_DEDUP
+
+static const char *DEDUP_TAG = "chat-dedup"; // 日志标签
+
+// 一条最近提交的消息
+typedef struct {
+    uint64_t key;           // chat_dedup_key的结果，0表示空槽
+    uint32_t seq;           // 第一次提交时分配的序列号
+} dedup_entry_t;
+
+static dedup_entry_t tables[CHAT_MAX_ROOMS][CHAT_DEDUP_ENTRIES];
+static uint64_t hash_seed = 0; // 每次启动随机生成，客户端无法构造与别人的消息冲突的ID
+
+/**
+ * @brief 清空消息ID表
+ */
+void chat_dedup_init(void) {
+    memset(tables, 0, sizeof(tables));
+    hash_seed = (uint64_t)esp_random() << 32 | esp_random();
+    ESP_LOGI(DEDUP_TAG, "Remembering %d client message ids per room", CHAT_DEDUP_ENTRIES);
+}
+
+/**
+ * @brief 计算客户端消息ID的键（带种子的64位FNV-1a）
+ */
+uint64_t chat_dedup_key(const uint8_t uuid[CHAT_UUID_BIN_LENGTH], const char *client_id) {
+    if (client_id == NULL || client_id[0] == '\0') {
+        return 0;
+    }
+    uint64_t hash = 14695981039346656037ull ^ hash_seed;
+    for (int i = 0; i < CHAT_UUID_BIN_LENGTH; i++) {
+        hash ^= uuid[i];
+        hash *= 1099511628211ull;
+    }
+    for (const char *p = client_id; *p; p++) {
+        hash ^= (uint8_t)*p;
+        hash *= 1099511628211ull;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+static dedup_entry_t *probe(int room, uint64_t key, int i) {
+    return &tables[room][((uint32_t)(key >> 32) + i) % CHAT_DEDUP_ENTRIES];
+}
+
+/**
+ * @brief 查找之前提交过的消息
+ */
+bool chat_dedup_find(int room, uint64_t key, uint32_t *seq) {
+    if (room < 0 || room >= CHAT_MAX_ROOMS) {
+        return false;
+    }
+    for (int i = 0; i < CHAT_DEDUP_PROBES; i++) {
+        const dedup_entry_t *entry = probe(room, key, i);
+        if (entry->key == key) {
+            *seq = entry->seq;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief 记录新写入的消息
+ *
+ * 序列号在房间内单调递增，最小的就是探测范围内最早写入的一项
+ */
+void chat_dedup_insert(int room, uint64_t key, uint32_t seq) {
+    if (room < 0 || room >= CHAT_MAX_ROOMS) {
+        return;
+    }
+    dedup_entry_t *victim = NULL;
+    for (int i = 0; i < CHAT_DEDUP_PROBES; i++) {
+        dedup_entry_t *entry = probe(room, key, i);
+        if (entry->key == 0) {
+            victim = entry;
+            break;
+        }
+        if (victim == NULL || entry->seq < victim->seq) {
+            victim = entry;
+        }
+    }
+    victim->key = key;
+    victim->seq = seq;
+}
+
+#endif /* CONFIG_CHAT_DEDUP */
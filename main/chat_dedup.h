@@ -0,0 +1,65 @@
+#ifndef _CHAT_DEDUP_H_
+#define _CHAT_DEDUP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "chat_storage.h"
+
+#define CHAT_DEDUP_PROBES 4 // 哈希表每次查找最多探测的槽位数
+
+#if CONFIG_CHAT_DEDUP
+
+#define CHAT_DEDUP_ENTRIES CONFIG_CHAT_DEDUP_ENTRIES // 每个房间记住的最近客户端消息ID数量
+
+/**
+ * @brief 清空所有房间的消息ID表并生成新的哈希种子
+ */
+void chat_dedup_init(void);
+
+/**
+ * @brief 计算客户端消息ID的键
+ *
+ * 同一用户的同一ID得到相同的键，不同用户使用相同ID互不影响。
+ * 表中只保存64位的键，不保存ID本身
+ *
+ * @param uuid 发送者的二进制UUID
+ * @param client_id 客户端消息ID，为NULL或空字符串时返回0
+ * @return uint64_t 键，0表示不去重
+ */
+uint64_t chat_dedup_key(const uint8_t uuid[CHAT_UUID_BIN_LENGTH], const char *client_id);
+
+/**
+ * @brief 查找之前提交过的消息
+ *
+ * 调用者需持有该房间的互斥锁，查找和随后的chat_dedup_insert之间不会有同一房间的其他写入
+ *
+ * @param room 房间编号
+ * @param key chat_dedup_key的结果，非0
+ * @param seq 输出参数，第一次提交时分配的序列号
+ * @return true 是重复提交
+ */
+bool chat_dedup_find(int room, uint64_t key, uint32_t *seq);
+
+/**
+ * @brief 记录新写入的消息
+ *
+ * 固定大小的哈希表，探测范围内没有空槽时替换其中序列号最小（最老）的一项。
+ * 调用者需持有该房间的互斥锁
+ *
+ * @param room 房间编号
+ * @param key chat_dedup_key的结果，非0
+ * @param seq 分配的序列号
+ */
+void chat_dedup_insert(int room, uint64_t key, uint32_t seq);
+
+#else
+
+static inline void chat_dedup_init(void) {}
+static inline uint64_t chat_dedup_key(const uint8_t uuid[CHAT_UUID_BIN_LENGTH], const char *client_id) { return 0; }
+static inline bool chat_dedup_find(int room, uint64_t key, uint32_t *seq) { return false; }
+static inline void chat_dedup_insert(int room, uint64_t key, uint32_t seq) {}
+
+#endif /* CONFIG_CHAT_DEDUP */
+
+#endif /* _CHAT_DEDUP_H_ */
@@ -0,0 +1,225 @@
+/*
+ * 流式JSON输出实现
+ * 主要功能：
+ * 1. 把转义后的JSON直接写入固定暂存缓冲区，写满后通过回调刷新（如httpd_resp_send_chunk）
+ * 2. 不构建cJSON树、不生成完整响应字符串，整个输出过程零堆分配
+ * 3. 统计模式下只计算输出长度，便于按精确大小分配一次缓冲区
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include "esp_log.h"
+#include "chat_json.h"
+
+static const char *JSON_TAG = "chat-json"; // 日志标签
+
+/**
+ * @brief 初始化输出器
+ */
+void chat_json_writer_init(chat_json_writer_t *writer, char *buf, size_t size,
+                           chat_json_flush_fn_t flush, void *ctx) {
+    writer->buf = buf;
+    writer->size = buf ? size : 0;
+    writer->len = 0;
+    writer->total = 0;
+    writer->flush = flush;
+    writer->ctx = ctx;
+    writer->err = ESP_OK;
+}
+
+/**
+ * @brief 暂存缓冲区剩余空间
+ */
+size_t chat_json_writer_space(const chat_json_writer_t *writer) {
+    if (writer->buf == NULL) {
+        return SIZE_MAX;
+    }
+    return writer->size - writer->len;
+}
+
+/**
+ * @brief 刷新暂存缓冲区中剩余的数据
+ */
+esp_err_t chat_json_flush(chat_json_writer_t *writer) {
+    if (writer->err != ESP_OK || writer->buf == NULL || writer->len == 0) {
+        return writer->err;
+    }
+    if (writer->flush == NULL) {
+        // 没有刷新回调时缓冲区内容由调用者自行取用
+        return ESP_OK;
+    }
+
+    esp_err_t err = writer->flush(writer->ctx, writer->buf, writer->len);
+    if (err != ESP_OK) {
+        ESP_LOGW(JSON_TAG, "Flush failed: %s", esp_err_to_name(err));
+        writer->err = err;
+        return err;
+    }
+    writer->total += writer->len;
+    writer->len = 0;
+    return ESP_OK;
+}
+
+/**
+ * @brief 写入原始字节（不转义）
+ */
+esp_err_t chat_json_write_raw(chat_json_writer_t *writer, const char *data, size_t len) {
+    if (writer->err != ESP_OK) {
+        return writer->err;
+    }
+
+    // 统计模式：只累加长度
+    if (writer->buf == NULL) {
+        writer->len += len;
+        return ESP_OK;
+    }
+
+    while (len > 0) {
+        size_t space = writer->size - writer->len;
+        if (space == 0) {
+            if (writer->flush == NULL) {
+                writer->err = ESP_ERR_INVALID_SIZE;
+                return writer->err;
+            }
+            if (chat_json_flush(writer) != ESP_OK) {
+                return writer->err;
+            }
+            continue;
+        }
+
+        size_t n = len < space ? len : space;
+        memcpy(writer->buf + writer->len, data, n);
+        writer->len += n;
+        data += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief 写入原始C字符串（不转义）
+ */
+esp_err_t chat_json_write_str(chat_json_writer_t *writer, const char *str) {
+    return chat_json_write_raw(writer, str, strlen(str));
+}
+
+/**
+ * @brief 写入转义后的JSON字符串内容（不含引号）
+ *
+ * 连续的无需转义的字节整段写入，只有遇到特殊字符时才逐个处理
+ */
+esp_err_t chat_json_write_escaped_content(chat_json_writer_t *writer, const char *str) {
+    static const char hex[] = "0123456789abcdef";
+
+    const char *run = str;
+    for (const char *p = str; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        // 先输出之前累积的普通字节
+        chat_json_write_raw(writer, run, p - run);
+        run = p + 1;
+
+        char esc[6] = {'\\', 0, 0, 0, 0, 0};
+        size_t esc_len = 2;
+        switch (c) {
+        case '"':  esc[1] = '"';  break;
+        case '\\': esc[1] = '\\'; break;
+        case '\b': esc[1] = 'b';  break;
+        case '\f': esc[1] = 'f';  break;
+        case '\n': esc[1] = 'n';  break;
+        case '\r': esc[1] = 'r';  break;
+        case '\t': esc[1] = 't';  break;
+        default:
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 0x0F];
+            esc_len = 6;
+            break;
+        }
+        chat_json_write_raw(writer, esc, esc_len);
+    }
+    return chat_json_write_str(writer, run);
+}
+
+/**
+ * @brief 写入带引号的JSON字符串，按JSON规则转义
+ */
+esp_err_t chat_json_write_escaped(chat_json_writer_t *writer, const char *str) {
+    chat_json_write_raw(writer, "\"", 1);
+    chat_json_write_escaped_content(writer, str);
+    return chat_json_write_raw(writer, "\"", 1);
+}
+
+/**
+ * @brief 写入无符号整数
+ */
+esp_err_t chat_json_write_u32(chat_json_writer_t *writer, uint32_t value) {
+    char digits[10];
+    size_t n = 0;
+    do {
+        digits[sizeof(digits) - 1 - n] = (char)('0' + value % 10);
+        value /= 10;
+        n++;
+    } while (value > 0);
+    return chat_json_write_raw(writer, &digits[sizeof(digits) - n], n);
+}
+
+/**
+ * @brief 十六进制字符转数值
+ *
+ * @return int 0-15，非法字符返回-1
+ */
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * @brief 还原chat_json_write_escaped_content生成的转义内容
+ */
+size_t chat_json_unescape(char *dst, size_t dst_size, const char *src, size_t len) {
+    size_t out = 0;
+    if (dst_size == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < len && out + 1 < dst_size; i++) {
+        char c = src[i];
+        if (c != '\\' || i + 1 >= len) {
+            dst[out++] = c;
+            continue;
+        }
+
+        char e = src[++i];
+        switch (e) {
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case 'u':
+            // 只会出现\u00XX形式的控制字符
+            if (i + 4 < len && hex_value(src[i + 3]) >= 0 && hex_value(src[i + 4]) >= 0) {
+                c = (char)((hex_value(src[i + 3]) << 4) | hex_value(src[i + 4]));
+                i += 4;
+            } else {
+                c = 'u';
+            }
+            break;
+        default:
+            c = e; // \" \\ \/
+            break;
+        }
+        dst[out++] = c;
+    }
+
+    dst[out] = '\0';
+    return out;
+}
@@ -0,0 +1,120 @@
+#ifndef _CHAT_JSON_H_
+#define _CHAT_JSON_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define CHAT_JSON_SCRATCH_SIZE 4096 // 流式输出的暂存缓冲区大小
+
+/**
+ * @brief 暂存缓冲区写满或输出结束时的刷新回调
+ *
+ * @param ctx 回调上下文（如httpd请求对象）
+ * @param data 待输出的数据
+ * @param len 数据长度
+ * @return ESP_OK 成功，其他值会中止后续输出
+ */
+typedef esp_err_t (*chat_json_flush_fn_t)(void *ctx, const char *data, size_t len);
+
+/* 流式JSON输出器：直接写入固定暂存缓冲区，写满后通过回调刷新，不分配堆内存 */
+typedef struct {
+    char *buf;                  // 暂存缓冲区，为NULL时只统计长度
+    size_t size;                // 暂存缓冲区大小
+    size_t len;                 // 暂存缓冲区中尚未刷新的字节数（统计模式下为总长度）
+    size_t total;               // 已刷新的总字节数
+    chat_json_flush_fn_t flush; // 刷新回调，为NULL时缓冲区写满即报错
+    void *ctx;                  // 刷新回调上下文
+    esp_err_t err;              // 第一次出错的错误码，出错后所有写操作直接返回
+} chat_json_writer_t;
+
+/**
+ * @brief 初始化输出器
+ *
+ * @param writer 输出器
+ * @param buf 暂存缓冲区，传NULL进入统计模式（只计算输出长度）
+ * @param size 暂存缓冲区大小
+ * @param flush 刷新回调，可为NULL
+ * @param ctx 刷新回调上下文
+ */
+void chat_json_writer_init(chat_json_writer_t *writer, char *buf, size_t size,
+                           chat_json_flush_fn_t flush, void *ctx);
+
+/**
+ * @brief 暂存缓冲区剩余空间
+ *
+ * 调用者可据此判断能否在不触发刷新的情况下写入一段完整内容
+ * （例如持锁期间只写入内存，不做网络发送）
+ *
+ * @param writer 输出器
+ * @return size_t 剩余字节数，统计模式下为SIZE_MAX
+ */
+size_t chat_json_writer_space(const chat_json_writer_t *writer);
+
+/**
+ * @brief 写入原始字节（不转义）
+ *
+ * @param writer 输出器
+ * @param data 数据
+ * @param len 数据长度
+ * @return ESP_OK 成功，其他为刷新回调或缓冲区溢出的错误码
+ */
+esp_err_t chat_json_write_raw(chat_json_writer_t *writer, const char *data, size_t len);
+
+/**
+ * @brief 写入原始C字符串（不转义）
+ */
+esp_err_t chat_json_write_str(chat_json_writer_t *writer, const char *str);
+
+/**
+ * @brief 写入带引号的JSON字符串，按JSON规则转义
+ *
+ * 转义规则与cJSON一致：引号、反斜杠和控制字符，其余字节原样输出
+ */
+esp_err_t chat_json_write_escaped(chat_json_writer_t *writer, const char *str);
+
+/**
+ * @brief 写入转义后的JSON字符串内容（不含引号）
+ *
+ * 用于预先生成可直接拼接进JSON字符串的内容
+ */
+esp_err_t chat_json_write_escaped_content(chat_json_writer_t *writer, const char *str);
+
+/**
+ * @brief 写入无符号整数
+ */
+esp_err_t chat_json_write_u32(chat_json_writer_t *writer, uint32_t value);
+
+/**
+ * @brief 刷新暂存缓冲区中剩余的数据
+ *
+ * @param writer 输出器
+ * @return ESP_OK 成功，其他为刷新回调的错误码
+ */
+esp_err_t chat_json_flush(chat_json_writer_t *writer);
+
+/**
+ * @brief 还原转义后的JSON字符串内容
+ *
+ * 只处理chat_json_write_escaped_content会生成的转义形式
+ *
+ * @param dst 输出缓冲区，结果以'\0'结尾
+ * @param dst_size 输出缓冲区大小，超出部分截断
+ * @param src 转义后的内容（不含引号）
+ * @param len 转义后内容长度
+ * @return size_t 还原后的长度
+ */
+size_t chat_json_unescape(char *dst, size_t dst_size, const char *src, size_t len);
+
+/**
+ * @brief 计算字符串转义后（含引号）的最大长度
+ *
+ * @param max_len 原始字符串最大长度（不含终止符）
+ * @return size_t 最坏情况下转义后的长度
+ */
+static inline size_t chat_json_escaped_max_len(size_t max_len) {
+    return max_len * 6 + 2; // 最坏情况每个字节都转义为\u00XX
+}
+
+#endif /* _CHAT_JSON_H_ */
@@ -0,0 +1,562 @@
+/*
+ * ESP32聊天消息日志实现
+ * 主要功能：
+ * 1. 在独立的chatlog分区上按扇区循环追加消息记录，每条新消息只写一次闪存
+ * 2. 每个扇区带顺序号头，每条记录带CRC，掉电时最多丢失正在写入的那一条
+ * 3. 启动时把分区映射到地址空间，按房间归并各扇区，按序列号回放全部记录
+ * 4. 写满绕回时整理最老的扇区：仍在内存中的消息写回，其余擦除后继续写入
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "chat_log.h"
+#include "chat_pool.h"
+
+static const char *LOG_TAG = "chat-log"; // 日志标签
+
+#define LOG_SECTOR_MAGIC 0x474F4C43 // 扇区头魔数("CLOG")
+#define LOG_VERSION 1               // 记录格式版本
+#define LOG_RECORD_MAGIC 0xC4A7     // 记录头魔数
+#define LOG_ERASED_MAGIC 0xFFFF     // 已擦除闪存的内容，表示扇区内没有更多记录
+
+#define LOG_ALIGN(len) (((len) + 3) & ~3U) // 记录按4字节对齐
+
+/* 扇区头，扇区擦除后首先写入 */
+typedef struct {
+    uint32_t magic;                 // LOG_SECTOR_MAGIC
+    uint32_t sector_seq;            // 扇区启用顺序号，越大越新
+    uint16_t version;               // 记录格式版本
+    uint16_t reserved;              // 保留
+    uint32_t crc;                   // 前面字段的CRC32
+} log_sector_header_t;
+
+/* 记录头，后面紧跟length字节的记录内容 */
+typedef struct {
+    uint16_t magic;                 // LOG_RECORD_MAGIC
+    uint16_t length;                // 记录内容长度
+    uint32_t crc;                   // 记录内容的CRC32
+} log_record_header_t;
+
+/* 回放时一个扇区的读取位置 */
+typedef struct {
+    uint32_t sector;                // 扇区编号
+    uint32_t offset;                // 当前房间下一条记录的位置
+    uint32_t end;                   // 有效记录之后的位置
+    uint32_t seq;                   // offset处记录的序列号
+} log_cursor_t;
+
+#define LOG_MAX_SECTORS (CHAT_POOL_BUFFER_SIZE / sizeof(log_cursor_t)) // 回放游标放在一个缓冲池缓冲区中
+#define LOG_MAX_SECTOR_RECORDS /* 一个扇区最多能放下的记录数（全是最短的记录） */ \
+    ((CHAT_LOG_SECTOR_SIZE - sizeof(log_sector_header_t)) / LOG_ALIGN(sizeof(log_record_header_t) + CHAT_LOG_MESSAGE_FIXED_LEN))
+#define LOG_COMPACT_MAX_KEEP ((CHAT_LOG_SECTOR_SIZE - sizeof(log_sector_header_t)) / 2) // 整理时最多写回半个扇区
+
+_Static_assert(CHAT_LOG_SECTOR_SIZE <= CHAT_POOL_BUFFER_SIZE, "a log sector must fit in a pool buffer");
+
+static const esp_partition_t *log_partition = NULL; // 日志分区
+static uint32_t sector_count = 0;       // 分区中的扇区数
+static uint32_t active_sector = 0;      // 当前写入的扇区
+static uint32_t write_offset = 0;       // 当前扇区内的下一个写入位置
+static uint32_t next_sector_seq = 1;    // 下一个启用扇区的顺序号
+static bool has_active = false;         // 是否已有写入中的扇区
+static chat_log_retain_fn_t retain_fn = NULL; // 整理时判断记录是否保留，NULL时直接擦除
+static void *retain_ctx = NULL;               // 整理回调的上下文
+
+/**
+ * @brief 读取并校验扇区头
+ *
+ * @param sector 扇区编号
+ * @param header 输出参数，扇区头
+ * @return true 扇区头有效
+ */
+static bool read_sector_header(uint32_t sector, log_sector_header_t *header) {
+    if (esp_partition_read(log_partition, sector * CHAT_LOG_SECTOR_SIZE, header, sizeof(*header)) != ESP_OK) {
+        return false;
+    }
+    return header->magic == LOG_SECTOR_MAGIC && header->version == LOG_VERSION &&
+           header->crc == esp_rom_crc32_le(0, (const uint8_t *)header, offsetof(log_sector_header_t, crc));
+}
+
+/**
+ * @brief 把消息编码为二进制记录内容
+ *
+ * @param message 消息
+ * @param buf 输出缓冲区，至少CHAT_LOG_MESSAGE_MAX_LEN字节
+ * @return size_t 编码后的长度，UUID格式不正确时返回0
+ */
+size_t chat_log_encode_message(const chat_message_t *message, uint8_t *buf) {
+    size_t name_len = strnlen(message->username, MAX_USERNAME_LENGTH - 1);
+    size_t body_len = strnlen(message->message, MAX_MESSAGE_LENGTH - 1);
+
+    memcpy(buf, &message->seq, 4);
+    memcpy(buf + 4, &message->timestamp, 4);
+    if (chat_storage_uuid_parse(message->uuid, buf + 8) != ESP_OK) {
+        return 0;
+    }
+    buf[8 + CHAT_UUID_BIN_LENGTH] = (uint8_t)name_len;
+    buf[8 + CHAT_UUID_BIN_LENGTH + 1] = (uint8_t)body_len;
+    memcpy(buf + CHAT_LOG_MESSAGE_FIXED_LEN, message->username, name_len);
+    memcpy(buf + CHAT_LOG_MESSAGE_FIXED_LEN + name_len, message->message, body_len);
+    size_t len = CHAT_LOG_MESSAGE_FIXED_LEN + name_len + body_len;
+    // 默认房间的记录不带房间编号，与之前的日志和NVS blob格式相同
+    if (message->room != CHAT_ROOM_LOBBY) {
+        buf[len++] = message->room;
+    }
+    return len;
+}
+
+/**
+ * @brief 解码二进制记录内容
+ *
+ * @param buf 记录内容
+ * @param len 记录内容长度
+ * @param message 输出参数
+ * @return true 内容有效
+ */
+bool chat_log_decode_message(const uint8_t *buf, size_t len, chat_message_t *message) {
+    if (len < CHAT_LOG_MESSAGE_FIXED_LEN) {
+        return false;
+    }
+    uint8_t name_len = buf[8 + CHAT_UUID_BIN_LENGTH];
+    uint8_t body_len = buf[8 + CHAT_UUID_BIN_LENGTH + 1];
+    size_t base_len = CHAT_LOG_MESSAGE_FIXED_LEN + name_len + body_len;
+    if (name_len >= MAX_USERNAME_LENGTH || body_len >= MAX_MESSAGE_LENGTH ||
+        (len != base_len && len != base_len + 1)) {
+        return false;
+    }
+
+    memcpy(&message->seq, buf, 4);
+    memcpy(&message->timestamp, buf + 4, 4);
+    chat_storage_uuid_format(buf + 8, message->uuid);
+    memcpy(message->username, buf + CHAT_LOG_MESSAGE_FIXED_LEN, name_len);
+    message->username[name_len] = '\0';
+    memcpy(message->message, buf + CHAT_LOG_MESSAGE_FIXED_LEN + name_len, body_len);
+    message->message[body_len] = '\0';
+    message->room = len > base_len ? buf[base_len] : CHAT_ROOM_LOBBY;
+    return true;
+}
+
+/**
+ * @brief 读取一条记录
+ *
+ * @param sector 扇区编号
+ * @param data 扇区内容（映射地址或读取缓冲区），NULL时直接从闪存读取
+ * @param offset 记录在扇区内的位置
+ * @param verify 是否校验CRC，已经扫描过的扇区可以跳过
+ * @param message 输出参数，解码后的消息
+ * @return int 记录占用的字节数（含记录头和对齐）；0表示扇区内没有更多记录；-1表示记录损坏
+ */
+static int read_record(uint32_t sector, const uint8_t *data, uint32_t offset, bool verify,
+                       chat_message_t *message) {
+    log_record_header_t header;
+    if (offset + sizeof(header) > CHAT_LOG_SECTOR_SIZE) {
+        return 0;
+    }
+    uint32_t address = sector * CHAT_LOG_SECTOR_SIZE + offset;
+    if (data) {
+        memcpy(&header, data + offset, sizeof(header));
+    } else if (esp_partition_read(log_partition, address, &header, sizeof(header)) != ESP_OK) {
+        return -1;
+    }
+    if (header.magic == LOG_ERASED_MAGIC) {
+        return 0;
+    }
+    if (header.magic != LOG_RECORD_MAGIC || header.length > CHAT_LOG_MESSAGE_MAX_LEN ||
+        offset + sizeof(header) + header.length > CHAT_LOG_SECTOR_SIZE) {
+        return -1;
+    }
+
+    uint8_t buf[CHAT_LOG_MESSAGE_MAX_LEN];
+    const uint8_t *payload = buf;
+    if (data) {
+        payload = data + offset + sizeof(header);
+    } else if (esp_partition_read(log_partition, address + sizeof(header), buf, header.length) != ESP_OK) {
+        return -1;
+    }
+    if ((verify && header.crc != esp_rom_crc32_le(0, payload, header.length)) ||
+        !chat_log_decode_message(payload, header.length, message)) {
+        return -1;
+    }
+    return (int)LOG_ALIGN(sizeof(header) + header.length);
+}
+
+/**
+ * @brief 顺序扫描一个扇区中的记录
+ *
+ * @param sector 扇区编号
+ * @param data 扇区内容（映射地址或读取缓冲区），NULL时逐条从闪存读取
+ * @param fn 回调，可为NULL（只定位写入位置）
+ * @param ctx 回调上下文
+ * @param end_offset 输出参数，最后一条有效记录之后的位置
+ * @return true 扇区以擦除区域正常结束
+ * @return false 遇到损坏的记录（写入中途掉电）
+ */
+static bool scan_sector(uint32_t sector, const uint8_t *data, chat_log_replay_fn_t fn, void *ctx,
+                        uint32_t *end_offset) {
+    uint32_t offset = sizeof(log_sector_header_t);
+    *end_offset = offset;
+
+    chat_message_t message;
+    int len;
+    while ((len = read_record(sector, data, offset, true, &message)) > 0) {
+        if (fn) {
+            fn(&message, ctx);
+        }
+        offset += len;
+        *end_offset = offset;
+    }
+    if (len < 0) {
+        ESP_LOGW(LOG_TAG, "Corrupt record in sector %" PRIu32 " at offset %" PRIu32, sector, offset);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 打开消息日志分区
+ *
+ * @return ESP_OK 成功
+ * @return ESP_ERR_NOT_FOUND 分区表中没有chatlog分区
+ */
+esp_err_t chat_log_open(void) {
+    log_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                             CHAT_LOG_PARTITION_LABEL);
+    if (log_partition == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    sector_count = log_partition->size / CHAT_LOG_SECTOR_SIZE;
+    if (sector_count < 2) {
+        ESP_LOGE(LOG_TAG, "Partition too small (%" PRIu32 " bytes)", log_partition->size);
+        log_partition = NULL;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (sector_count > LOG_MAX_SECTORS) {
+        ESP_LOGW(LOG_TAG, "Using only the first %u of %" PRIu32 " sectors", (unsigned)LOG_MAX_SECTORS, sector_count);
+        sector_count = LOG_MAX_SECTORS;
+    }
+
+    // 找到顺序号最大的有效扇区，作为当前写入扇区
+    uint32_t newest_seq = 0;
+    has_active = false;
+    for (uint32_t i = 0; i < sector_count; i++) {
+        log_sector_header_t header;
+        if (read_sector_header(i, &header) && (!has_active || header.sector_seq > newest_seq)) {
+            newest_seq = header.sector_seq;
+            active_sector = i;
+            has_active = true;
+        }
+    }
+    next_sector_seq = newest_seq + 1;
+
+    // 最后一条记录损坏时换到新扇区写入，不在损坏的数据后面追加
+    if (has_active && !scan_sector(active_sector, NULL, NULL, NULL, &write_offset)) {
+        write_offset = CHAT_LOG_SECTOR_SIZE;
+    }
+
+    ESP_LOGI(LOG_TAG, "Opened chat log: %" PRIu32 " sectors, active sector %" PRIu32 " at offset %" PRIu32,
+             sector_count, active_sector, write_offset);
+    return ESP_OK;
+}
+
+/**
+ * @brief 日志是否可用
+ */
+bool chat_log_is_open(void) {
+    return log_partition != NULL;
+}
+
+/**
+ * @brief 设置日志整理时判断记录是否保留的回调
+ */
+void chat_log_set_retain_fn(chat_log_retain_fn_t fn, void *ctx) {
+    retain_fn = fn;
+    retain_ctx = ctx;
+}
+
+/**
+ * @brief 记录扫描到的房间
+ */
+static void mark_room(const chat_message_t *message, void *ctx) {
+    if (message->room < CHAT_MAX_ROOMS) {
+        ((bool *)ctx)[message->room] = true;
+    }
+}
+
+/**
+ * @brief 把游标移到扇区中下一条属于指定房间的记录
+ *
+ * @param cursor 游标
+ * @param data 扇区内容，NULL时从闪存读取
+ * @param room 房间编号
+ * @return true 找到记录，cursor->seq为其序列号
+ */
+static bool cursor_seek(log_cursor_t *cursor, const uint8_t *data, uint8_t room) {
+    chat_message_t message;
+    while (cursor->offset < cursor->end) {
+        int len = read_record(cursor->sector, data, cursor->offset, false, &message);
+        if (len <= 0) {
+            break;
+        }
+        if (message.room == room) {
+            cursor->seq = message.seq;
+            return true;
+        }
+        cursor->offset += len;
+    }
+    cursor->offset = cursor->end;
+    return false;
+}
+
+/**
+ * @brief 按序列号回放日志中的所有消息
+ *
+ * 先按扇区顺序号从老到新校验每个扇区，确定有效记录的范围。整理过的扇区开头是从最老扇区
+ * 搬来的记录，扇区之间不再按序列号排列，但同一扇区内每个房间的记录仍然递增，
+ * 所以逐个房间归并各扇区：每个房间的消息按序列号递增回放，不同房间之间的顺序不保证。
+ * 优先把整个分区映射到地址空间，直接从闪存缓存解析记录；映射失败时逐条从闪存读取
+ */
+esp_err_t chat_log_replay(chat_log_replay_fn_t fn, void *ctx) {
+    if (log_partition == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!has_active) {
+        return ESP_OK;
+    }
+
+    log_cursor_t *cursors = chat_pool_acquire();
+    if (!cursors) {
+        return ESP_ERR_TIMEOUT;
+    }
+    const uint8_t *mapped = NULL;
+    esp_partition_mmap_handle_t map_handle;
+    if (esp_partition_mmap(log_partition, 0, log_partition->size, ESP_PARTITION_MMAP_DATA,
+                           (const void **)&mapped, &map_handle) != ESP_OK) {
+        ESP_LOGW(LOG_TAG, "Failed to mmap chat log, reading records from flash");
+        mapped = NULL;
+    }
+#define SECTOR_DATA(sector) (mapped ? mapped + (sector) * CHAT_LOG_SECTOR_SIZE : NULL)
+
+    uint32_t used = 0;
+    bool present[CHAT_MAX_ROOMS] = {false};
+    for (uint32_t i = 1; i <= sector_count; i++) {
+        uint32_t sector = (active_sector + i) % sector_count;
+        log_sector_header_t header;
+        if (!read_sector_header(sector, &header)) {
+            continue;
+        }
+        log_cursor_t *cursor = &cursors[used++];
+        cursor->sector = sector;
+        scan_sector(sector, SECTOR_DATA(sector), mark_room, present, &cursor->end);
+    }
+
+    chat_message_t message;
+    for (int room = 0; room < CHAT_MAX_ROOMS; room++) {
+        if (!present[room]) {
+            continue;
+        }
+        for (uint32_t i = 0; i < used; i++) {
+            cursors[i].offset = sizeof(log_sector_header_t);
+            cursor_seek(&cursors[i], SECTOR_DATA(cursors[i].sector), (uint8_t)room);
+        }
+        for (;;) {
+            log_cursor_t *next = NULL;
+            for (uint32_t i = 0; i < used; i++) {
+                if (cursors[i].offset < cursors[i].end && (next == NULL || cursors[i].seq < next->seq)) {
+                    next = &cursors[i];
+                }
+            }
+            if (next == NULL) {
+                break;
+            }
+            const uint8_t *data = SECTOR_DATA(next->sector);
+            int len = read_record(next->sector, data, next->offset, false, &message);
+            if (len <= 0) {
+                next->offset = next->end;
+                continue;
+            }
+            fn(&message, ctx);
+            next->offset += len;
+            cursor_seek(next, data, (uint8_t)room);
+        }
+    }
+#undef SECTOR_DATA
+
+    if (mapped) {
+        esp_partition_munmap(map_handle);
+    }
+    chat_pool_release(cursors);
+    return ESP_OK;
+}
+
+/**
+ * @brief 把即将擦除的扇区中仍需保留的记录读到缓冲区
+ *
+ * 保留的记录按原顺序紧凑排列在缓冲区开头，可以直接写回擦除后的扇区。
+ * 需要保留的超过LOG_COMPACT_MAX_KEEP时，说明分区放不下内存中的全部历史：
+ * 先丢弃在所属房间中最老的记录（消息多的房间的旧消息），很少有新消息的房间的历史不会被挤掉；
+ * 同时保证每次擦除至少腾出半个扇区，不会每条消息都擦写一次
+ *
+ * @param sector 即将擦除的扇区
+ * @param buf CHAT_LOG_SECTOR_SIZE字节的缓冲区
+ * @return uint32_t 保留记录的总长度
+ */
+static uint32_t collect_live_records(uint32_t sector, uint8_t *buf) {
+    if (esp_partition_read(log_partition, sector * CHAT_LOG_SECTOR_SIZE, buf, CHAT_LOG_SECTOR_SIZE) != ESP_OK) {
+        return 0;
+    }
+
+    // 第一遍记下每条记录的新旧程度，两遍之间内存中的消息可能被淘汰，判断结果只取一次
+    uint32_t age[LOG_MAX_SECTOR_RECORDS];
+    uint16_t size[LOG_MAX_SECTOR_RECORDS];
+    chat_message_t message;
+    uint32_t live_len = 0;
+    int count = 0;
+    int len;
+    uint32_t offset = sizeof(log_sector_header_t);
+    while (count < LOG_MAX_SECTOR_RECORDS && (len = read_record(sector, buf, offset, true, &message)) > 0) {
+        age[count] = retain_fn(&message, retain_ctx);
+        size[count] = (uint16_t)len;
+        live_len += age[count] > 0 ? (uint32_t)len : 0;
+        count++;
+        offset += len;
+    }
+
+    int dropped = 0;
+    while (live_len > LOG_COMPACT_MAX_KEEP) {
+        int oldest = 0;
+        for (int i = 1; i < count; i++) {
+            if (age[i] > age[oldest]) {
+                oldest = i;
+            }
+        }
+        live_len -= size[oldest];
+        age[oldest] = 0;
+        dropped++;
+    }
+
+    uint32_t kept = 0;
+    offset = sizeof(log_sector_header_t);
+    for (int i = 0; i < count; i++) {
+        if (age[i] > 0) {
+            // 目标位置总在源位置之前，只会覆盖已经处理过的部分
+            memmove(buf + kept, buf + offset, size[i]);
+            kept += size[i];
+        }
+        offset += size[i];
+    }
+
+    if (dropped > 0) {
+        ESP_LOGW(LOG_TAG, "Chat log full, dropping %d records still in memory from sector %" PRIu32,
+                 dropped, sector);
+    }
+    ESP_LOGD(LOG_TAG, "Compacted sector %" PRIu32 ": kept %" PRIu32 " bytes", sector, kept);
+    return kept;
+}
+
+/**
+ * @brief 启用下一个扇区
+ *
+ * 日志绕回时下一个扇区存着最老的记录：其中仍需保留的记录（由chat_log_set_retain_fn判断）
+ * 先读到缓冲池借来的缓冲区，擦除后写回新扇区的开头，再继续追加。擦除和写回之间掉电时这些记录丢失
+ *
+ * @return ESP_OK 成功
+ * @return ESP_ERR_TIMEOUT 整理需要的缓冲区借不到，稍后重试
+ * @return 其他 闪存擦除或写入错误
+ */
+static esp_err_t advance_sector(void) {
+    uint32_t sector = has_active ? (active_sector + 1) % sector_count : 0;
+
+    uint8_t *keep = NULL;
+    uint32_t keep_len = 0;
+    log_sector_header_t old_header;
+    if (retain_fn != NULL && read_sector_header(sector, &old_header)) {
+        keep = chat_pool_acquire();
+        if (keep == NULL) {
+            return ESP_ERR_TIMEOUT;
+        }
+        keep_len = collect_live_records(sector, keep);
+    }
+
+    esp_err_t err = esp_partition_erase_range(log_partition, sector * CHAT_LOG_SECTOR_SIZE, CHAT_LOG_SECTOR_SIZE);
+    if (err != ESP_OK) {
+        ESP_LOGE(LOG_TAG, "Failed to erase sector %" PRIu32 ": %s", sector, esp_err_to_name(err));
+        chat_pool_release(keep);
+        return err;
+    }
+
+    log_sector_header_t header = {
+        .magic = LOG_SECTOR_MAGIC,
+        .sector_seq = next_sector_seq,
+        .version = LOG_VERSION,
+        .reserved = 0
+    };
+    header.crc = esp_rom_crc32_le(0, (const uint8_t *)&header, offsetof(log_sector_header_t, crc));
+    err = esp_partition_write(log_partition, sector * CHAT_LOG_SECTOR_SIZE, &header, sizeof(header));
+    if (err == ESP_OK && keep_len > 0) {
+        err = esp_partition_write(log_partition, sector * CHAT_LOG_SECTOR_SIZE + sizeof(header), keep, keep_len);
+    }
+    chat_pool_release(keep);
+    if (err != ESP_OK) {
+        ESP_LOGE(LOG_TAG, "Failed to write sector %" PRIu32 ": %s", sector, esp_err_to_name(err));
+        return err;
+    }
+
+    active_sector = sector;
+    write_offset = sizeof(header) + keep_len;
+    next_sector_seq++;
+    has_active = true;
+    ESP_LOGD(LOG_TAG, "Switched to sector %" PRIu32 " (seq %" PRIu32 ")", sector, header.sector_seq);
+    return ESP_OK;
+}
+
+/**
+ * @brief 追加一条消息到日志
+ *
+ * @param message 消息
+ * @return ESP_OK 成功，其他为错误码
+ */
+esp_err_t chat_log_append(const chat_message_t *message) {
+    if (log_partition == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // 记录头和内容一起编码，一次写入闪存
+    uint8_t buf[LOG_ALIGN(sizeof(log_record_header_t) + CHAT_LOG_MESSAGE_MAX_LEN)] = {0};
+    uint8_t *payload = buf + sizeof(log_record_header_t);
+    size_t payload_len = chat_log_encode_message(message, payload);
+    if (payload_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    log_record_header_t header = {
+        .magic = LOG_RECORD_MAGIC,
+        .length = (uint16_t)payload_len
+    };
+    header.crc = esp_rom_crc32_le(0, payload, header.length);
+    memcpy(buf, &header, sizeof(header));
+    uint32_t len = LOG_ALIGN(sizeof(header) + header.length);
+
+    // 当前扇区放不下时换到下一个扇区
+    if (!has_active || write_offset + len > CHAT_LOG_SECTOR_SIZE) {
+        esp_err_t err = advance_sector();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    esp_err_t err = esp_partition_write(log_partition, active_sector * CHAT_LOG_SECTOR_SIZE + write_offset, buf, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(LOG_TAG, "Failed to append record: %s", esp_err_to_name(err));
+        // 写入位置之后的内容已不可信，下次换扇区
+        write_offset = CHAT_LOG_SECTOR_SIZE;
+        return err;
+    }
+
+    write_offset += len;
+    return ESP_OK;
+}
@@ -0,0 +1,113 @@
+#ifndef _CHAT_LOG_H_
+#define _CHAT_LOG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "chat_storage.h"
+
+#define CHAT_LOG_PARTITION_LABEL "chatlog" // 消息日志分区标签
+#define CHAT_LOG_SECTOR_SIZE 4096          // 闪存擦除扇区大小
+
+/*
+ * 二进制消息记录：seq(4) + timestamp(4) + uuid(16) + 用户名长度(1) + 消息长度(1) + 用户名 + 消息
+ * [+ 房间编号(1)，默认房间省略]
+ */
+#define CHAT_LOG_MESSAGE_FIXED_LEN (8 + CHAT_UUID_BIN_LENGTH + 2)
+#define CHAT_LOG_MESSAGE_MAX_LEN (CHAT_LOG_MESSAGE_FIXED_LEN + MAX_USERNAME_LENGTH - 1 + MAX_MESSAGE_LENGTH - 1 + 1)
+
+/**
+ * @brief 日志回放回调
+ *
+ * @param message 按写入顺序回放的消息（仅在回调期间有效）
+ * @param ctx 回调上下文
+ */
+typedef void (*chat_log_replay_fn_t)(const chat_message_t *message, void *ctx);
+
+/**
+ * @brief 日志整理回调，判断即将擦除的记录是否仍需保留
+ *
+ * @param message 记录中的消息（仅在回调期间有效）
+ * @param ctx 回调上下文
+ * @return uint32_t 0表示可以擦除；否则保留并写回，值为记录的新旧程度（越大越旧），
+ *                  扇区放不下全部保留的记录时先丢弃最旧的
+ */
+typedef uint32_t (*chat_log_retain_fn_t)(const chat_message_t *message, void *ctx);
+
+/**
+ * @brief 打开消息日志分区
+ *
+ * 扫描各扇区头，找到最新的扇区和追加位置
+ *
+ * @return ESP_OK 成功
+ * @return ESP_ERR_NOT_FOUND 分区表中没有chatlog分区
+ * @return ESP_ERR_INVALID_SIZE 分区不足两个扇区
+ */
+esp_err_t chat_log_open(void);
+
+/**
+ * @brief 日志是否可用
+ */
+bool chat_log_is_open(void);
+
+/**
+ * @brief 设置日志整理回调
+ *
+ * 日志写满绕回时，擦除最老的扇区前用它筛选其中仍需保留的记录（如仍在内存中的消息），
+ * 擦除后写回新扇区的开头。未设置时直接擦除
+ *
+ * @param fn 回调，NULL表示不整理
+ * @param ctx 回调上下文
+ */
+void chat_log_set_retain_fn(chat_log_retain_fn_t fn, void *ctx);
+
+/**
+ * @brief 按序列号回放日志中的所有消息
+ *
+ * 同一房间的消息按序列号递增回放，不同房间之间的顺序不保证。
+ * 遇到CRC错误的记录（写入中途掉电）时跳过该扇区剩余部分。
+ * 各扇区的读取位置放在缓冲池借来的缓冲区中，调用前需已执行chat_pool_init
+ *
+ * @param fn 回放回调
+ * @param ctx 回调上下文
+ * @return ESP_OK 成功
+ * @return ESP_ERR_TIMEOUT 缓冲池已用完
+ */
+esp_err_t chat_log_replay(chat_log_replay_fn_t fn, void *ctx);
+
+/**
+ * @brief 追加一条消息到日志
+ *
+ * 只写入这一条记录；当前扇区写满时整理并擦除最老的扇区继续写入（见chat_log_set_retain_fn）。
+ * 不是线程安全的，调用者需保证同一时间只有一个写入者
+ *
+ * @param message 消息
+ * @return ESP_OK 成功
+ * @return ESP_ERR_INVALID_STATE 日志未打开
+ * @return ESP_ERR_TIMEOUT 整理扇区需要的缓冲区借不到
+ * @return 其他 闪存写入错误
+ */
+esp_err_t chat_log_append(const chat_message_t *message);
+
+/**
+ * @brief 把消息编码为二进制记录
+ *
+ * 日志分区和NVS blob共用同一种记录格式，字符串带长度前缀，不依赖分隔符
+ *
+ * @param message 消息
+ * @param buf 输出缓冲区，至少CHAT_LOG_MESSAGE_MAX_LEN字节
+ * @return size_t 编码后的长度，UUID格式不正确时返回0
+ */
+size_t chat_log_encode_message(const chat_message_t *message, uint8_t *buf);
+
+/**
+ * @brief 解码二进制记录
+ *
+ * @param buf 记录内容
+ * @param len 记录长度
+ * @param message 输出参数
+ * @return true 记录有效
+ */
+bool chat_log_decode_message(const uint8_t *buf, size_t len, chat_message_t *message);
+
+#endif /* _CHAT_LOG_H_ */
@@ -0,0 +1,249 @@
+/*
+ * ESP32聊天长轮询实现
+ * 主要功能：
+ * 1. 没有新消息时把轮询请求转为异步请求挂起，httpd任务继续处理其他请求
+ * 2. 监听存储层新消息，由长轮询任务统一发送响应
+ * 3. 每个挂起的请求有独立的超时时间，超时后返回与普通轮询相同的响应
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "esp_attr.h"
+#include "chat_json.h"
+#include "chat_storage.h"
+#include "chat_server.h"
+#include "chat_longpoll.h"
+#include "chat_tasks.h"
+
+static const char *LONGPOLL_TAG = "chat-longpoll"; // 日志标签
+
+#define LONGPOLL_TASK_STACK_SIZE 4096  // 长轮询任务栈大小
+#define LONGPOLL_TASK_PRIORITY CHAT_HTTPD_TASK_PRIORITY // 长轮询任务优先级，与httpd任务相同
+#define LONGPOLL_STOP_TIMEOUT_MS 5000  // 等待长轮询任务退出的最长时间
+
+// 挂起的长轮询请求
+typedef struct {
+    httpd_req_t *req;            // 异步请求，NULL表示空闲
+    chat_messages_query_t query; // 查询参数：房间、客户端已收到的最新序列号和响应格式
+    TickType_t deadline;         // 超时时刻
+} longpoll_waiter_t;
+
+static longpoll_waiter_t waiters[CHAT_LONGPOLL_MAX_WAITERS];
+static SemaphoreHandle_t waiters_mutex = NULL; // 保护waiters，httpd任务挂起请求，长轮询任务取出
+
+static TaskHandle_t longpoll_task_handle = NULL;
+static SemaphoreHandle_t longpoll_exit = NULL; // 长轮询任务退出信号
+static volatile bool longpoll_running = false;
+
+// 长轮询任务专用的JSON暂存缓冲区，与httpd任务的缓冲区分开，可放在PSRAM中
+static EXT_RAM_BSS_ATTR char longpoll_scratch[CHAT_JSON_SCRATCH_SIZE];
+
+/**
+ * @brief 存储层新消息回调，唤醒长轮询任务
+ *
+ * @param message 新写入的消息（未使用，响应从存储层重新读取）
+ */
+static void longpoll_on_new_message(const chat_message_t *message) {
+    TaskHandle_t task = longpoll_task_handle;
+    if (task) {
+        xTaskNotifyGive(task);
+    }
+}
+
+/**
+ * @brief 取出一个可以响应的挂起请求
+ *
+ * @param all 是否不论有无新消息、是否超时都取出（停止时使用）
+ * @param waiter 输出参数，取出的请求
+ * @return true 取出了一个请求
+ */
+static bool take_ready_waiter(bool all, longpoll_waiter_t *waiter) {
+    bool found = false;
+
+    xSemaphoreTake(waiters_mutex, portMAX_DELAY);
+    TickType_t now = xTaskGetTickCount();
+    for (int i = 0; i < CHAT_LONGPOLL_MAX_WAITERS; i++) {
+        longpoll_waiter_t *w = &waiters[i];
+        if (w->req == NULL) {
+            continue;
+        }
+        if (all || chat_storage_get_room_last_seq(w->query.room) != w->query.seq ||
+            (int32_t)(now - w->deadline) >= 0) {
+            *waiter = *w;
+            w->req = NULL;
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(waiters_mutex);
+    return found;
+}
+
+/**
+ * @brief 计算到最近一个超时时刻的等待时间
+ *
+ * @return TickType_t 等待时间，没有挂起的请求时为portMAX_DELAY
+ */
+static TickType_t next_wait_ticks(void) {
+    TickType_t wait = portMAX_DELAY;
+
+    xSemaphoreTake(waiters_mutex, portMAX_DELAY);
+    TickType_t now = xTaskGetTickCount();
+    for (int i = 0; i < CHAT_LONGPOLL_MAX_WAITERS; i++) {
+        if (waiters[i].req == NULL) {
+            continue;
+        }
+        int32_t remaining = (int32_t)(waiters[i].deadline - now);
+        TickType_t ticks = remaining > 0 ? (TickType_t)remaining : 0;
+        if (ticks < wait) {
+            wait = ticks;
+        }
+    }
+    xSemaphoreGive(waiters_mutex);
+    return wait;
+}
+
+/**
+ * @brief 响应所有可以响应的挂起请求
+ *
+ * 在锁外发送，发送期间httpd任务仍可挂起新的请求
+ *
+ * @param all 是否响应全部挂起的请求
+ */
+static void respond_ready_waiters(bool all) {
+    longpoll_waiter_t waiter;
+    while (take_ready_waiter(all, &waiter)) {
+        esp_err_t err = chat_server_send_messages(waiter.req, &waiter.query, longpoll_scratch,
+                                                  sizeof(longpoll_scratch));
+        if (err != ESP_OK) {
+            ESP_LOGW(LONGPOLL_TAG, "Failed to answer long poll: %s", esp_err_to_name(err));
+        }
+        httpd_req_async_handler_complete(waiter.req);
+    }
+}
+
+/**
+ * @brief 长轮询任务
+ *
+ * 睡眠到最近的超时时刻，或被新消息、新挂起的请求唤醒
+ *
+ * @param pvParameters 未使用
+ */
+static void longpoll_task(void *pvParameters) {
+    while (longpoll_running) {
+        ulTaskNotifyTake(pdTRUE, next_wait_ticks());
+        if (!longpoll_running) {
+            break;
+        }
+        respond_ready_waiters(false);
+    }
+
+    respond_ready_waiters(true);
+    xSemaphoreGive(longpoll_exit);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief 初始化长轮询
+ */
+esp_err_t chat_longpoll_init(void) {
+    if (CHAT_LONGPOLL_MAX_WAIT_MS == 0) {
+        ESP_LOGI(LONGPOLL_TAG, "Long polling disabled");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    memset(waiters, 0, sizeof(waiters));
+    waiters_mutex = xSemaphoreCreateMutex();
+    longpoll_exit = xSemaphoreCreateBinary();
+    if (waiters_mutex == NULL || longpoll_exit == NULL) {
+        ESP_LOGE(LONGPOLL_TAG, "Failed to create long poll semaphores");
+        chat_longpoll_deinit();
+        return ESP_ERR_NO_MEM;
+    }
+
+    longpoll_running = true;
+    // 与httpd任务在同一核心，不占用Wi-Fi和网络栈所在的核心
+    if (xTaskCreatePinnedToCore(longpoll_task, "chat_longpoll", LONGPOLL_TASK_STACK_SIZE, NULL,
+                                LONGPOLL_TASK_PRIORITY, &longpoll_task_handle, CHAT_HTTPD_TASK_CORE) != pdPASS) {
+        ESP_LOGE(LONGPOLL_TAG, "Failed to create long poll task");
+        longpoll_running = false;
+        longpoll_task_handle = NULL;
+        chat_longpoll_deinit();
+        return ESP_ERR_NO_MEM;
+    }
+
+    chat_storage_add_message_listener(longpoll_on_new_message);
+    ESP_LOGI(LONGPOLL_TAG, "Long polling enabled (max wait %d ms, %d waiters)",
+             CHAT_LONGPOLL_MAX_WAIT_MS, CHAT_LONGPOLL_MAX_WAITERS);
+    return ESP_OK;
+}
+
+/**
+ * @brief 挂起一个轮询请求，等待新消息或超时
+ */
+esp_err_t chat_longpoll_park(httpd_req_t *req, const chat_messages_query_t *query, uint32_t wait_ms) {
+    if (!longpoll_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (wait_ms > CHAT_LONGPOLL_MAX_WAIT_MS) {
+        wait_ms = CHAT_LONGPOLL_MAX_WAIT_MS;
+    }
+
+    esp_err_t err = ESP_ERR_NO_MEM;
+    xSemaphoreTake(waiters_mutex, portMAX_DELAY);
+    for (int i = 0; i < CHAT_LONGPOLL_MAX_WAITERS; i++) {
+        longpoll_waiter_t *w = &waiters[i];
+        if (w->req != NULL) {
+            continue;
+        }
+        err = httpd_req_async_handler_begin(req, &w->req);
+        if (err == ESP_OK) {
+            w->query = *query;
+            w->deadline = xTaskGetTickCount() + pdMS_TO_TICKS(wait_ms);
+        } else {
+            w->req = NULL;
+        }
+        break;
+    }
+    xSemaphoreGive(waiters_mutex);
+
+    if (err == ESP_OK) {
+        // 重新计算超时时刻；检查新消息和挂起之间到达的消息也在这里补上
+        xTaskNotifyGive(longpoll_task_handle);
+    } else if (err != ESP_ERR_NO_MEM) {
+        ESP_LOGW(LONGPOLL_TAG, "Failed to start async request: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+/**
+ * @brief 停止长轮询
+ */
+void chat_longpoll_deinit(void) {
+    chat_storage_remove_message_listener(longpoll_on_new_message);
+
+    if (longpoll_task_handle != NULL) {
+        longpoll_running = false;
+        xTaskNotifyGive(longpoll_task_handle);
+        // 任务退出前会响应所有挂起的请求
+        if (xSemaphoreTake(longpoll_exit, pdMS_TO_TICKS(LONGPOLL_STOP_TIMEOUT_MS)) != pdTRUE) {
+            ESP_LOGW(LONGPOLL_TAG, "Long poll task did not exit in time");
+        }
+        longpoll_task_handle = NULL;
+    }
+
+    if (waiters_mutex != NULL) {
+        vSemaphoreDelete(waiters_mutex);
+        waiters_mutex = NULL;
+    }
+    if (longpoll_exit != NULL) {
+        vSemaphoreDelete(longpoll_exit);
+        longpoll_exit = NULL;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef _CHAT_LONGPOLL_H_
+#define _CHAT_LONGPOLL_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "chat_storage.h"
+
+#define CHAT_LONGPOLL_MAX_WAIT_MS CONFIG_CHAT_LONG_POLL_MAX_WAIT_MS   // 单次长轮询最长等待时间，0表示禁用
+#define CHAT_LONGPOLL_MAX_WAITERS CONFIG_CHAT_LONG_POLL_MAX_WAITERS   // 同时挂起的长轮询请求数量上限
+
+/**
+ * @brief 初始化长轮询
+ *
+ * 创建长轮询任务并监听存储层的新消息
+ *
+ * @return ESP_OK 初始化成功
+ * @return ESP_ERR_NOT_SUPPORTED 长轮询已在配置中禁用
+ * @return ESP_ERR_NO_MEM 创建任务或互斥锁失败
+ */
+esp_err_t chat_longpoll_init(void);
+
+/**
+ * @brief 挂起一个轮询请求，等待新消息或超时
+ *
+ * 把请求转为异步请求后立即返回，不占用httpd任务；
+ * 新消息到达或超时后由长轮询任务发送与普通轮询相同的响应
+ *
+ * @param req HTTP请求对象，成功后不能再使用
+ * @param query 查询参数，CHAT_QUERY_SINCE_SEQ；只在所查询房间有新消息时提前响应
+ * @param wait_ms 最长等待时间，超过CHAT_LONGPOLL_MAX_WAIT_MS时截断
+ * @return ESP_OK 已挂起
+ * @return ESP_ERR_INVALID_STATE 长轮询未启用
+ * @return ESP_ERR_NO_MEM 挂起的请求已达上限，调用者应立即响应
+ * @return 其他 创建异步请求失败
+ */
+esp_err_t chat_longpoll_park(httpd_req_t *req, const chat_messages_query_t *query, uint32_t wait_ms);
+
+/**
+ * @brief 停止长轮询
+ *
+ * 立即响应所有挂起的请求，然后停止长轮询任务。需在停止httpd之前调用
+ */
+void chat_longpoll_deinit(void);
+
+#endif /* _CHAT_LONGPOLL_H_ */
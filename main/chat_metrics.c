@@ -0,0 +1,309 @@
+/*
+ * 运行指标统计实现
+ * 主要功能：
+ * 1. 统计各接口的请求数和耗时分布、chat_mutex等待时间、序列化耗时和字节数、持久化耗时和失败次数
+ * 2. 记录时只做原子加法，不加锁、不分配内存，不影响请求处理
+ * 3. 以Prometheus文本格式输出，附带堆内存状态和由直方图估算的p50/p99
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "chat_metrics.h"
+#include "chat_pool.h"
+#include "chat_power.h"
+
+#if CONFIG_CHAT_METRICS
+
+#define METRICS_LINE_SIZE 160 // 单行指标的最大长度
+
+/* 耗时直方图，桶中为非累计计数 */
+typedef struct {
+    uint32_t buckets[CHAT_METRICS_BUCKETS];
+    uint32_t count;     // 记录次数，只在快照中由各桶求和得到
+    uint64_t sum_us;    // 耗时总和(微秒)
+} metrics_histogram_t;
+
+static metrics_histogram_t request_histograms[CHAT_METRIC_ENDPOINT_COUNT];
+static metrics_histogram_t mutex_wait_histogram;
+static metrics_histogram_t serialize_histogram;
+static metrics_histogram_t persist_histogram;
+static uint64_t serialize_bytes_total = 0;
+static uint32_t persist_failures_total = 0;
+static uint32_t persist_deferred_total = 0;
+static uint32_t rate_limited_total = 0;
+static uint32_t duplicates_total = 0;
+#if CONFIG_CHAT_POWER_GOVERNOR
+static metrics_histogram_t power_histograms[CHAT_POWER_PROFILE_COUNT]; // 按请求结束时的功耗档位统计的请求耗时
+#endif
+
+// 接口名称，作为handler标签
+static const char *endpoint_names[CHAT_METRIC_ENDPOINT_COUNT] = {
+    [CHAT_METRIC_GET_MESSAGES] = "get_messages",
+    [CHAT_METRIC_POST_MESSAGE] = "post_message",
+    [CHAT_METRIC_POST_BATCH] = "post_messages_batch",
+    [CHAT_METRIC_GET_UUID] = "get_uuid",
+    [CHAT_METRIC_GET_ROOMS] = "get_rooms",
+};
+
+/**
+ * @brief 计算耗时所在的直方图桶
+ *
+ * @param us 耗时(微秒)
+ * @return int 桶编号
+ */
+static int bucket_index(uint64_t us) {
+    if (us < 64) {
+        return 0;
+    }
+    int index = 63 - __builtin_clzll(us) - 5; // [2^(i+5), 2^(i+6))
+    return index < CHAT_METRICS_BUCKETS ? index : CHAT_METRICS_BUCKETS - 1;
+}
+
+/**
+ * @brief 记录一次耗时
+ *
+ * @param histogram 直方图
+ * @param elapsed_us 耗时(微秒)，负数按0处理
+ */
+static void histogram_record(metrics_histogram_t *histogram, int64_t elapsed_us) {
+    uint64_t us = elapsed_us > 0 ? (uint64_t)elapsed_us : 0;
+    __atomic_fetch_add(&histogram->buckets[bucket_index(us)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum_us, us, __ATOMIC_RELAXED);
+}
+
+void chat_metrics_record_request(chat_metric_endpoint_t endpoint, int64_t elapsed_us) {
+    if (endpoint < CHAT_METRIC_ENDPOINT_COUNT) {
+        histogram_record(&request_histograms[endpoint], elapsed_us);
+#if CONFIG_CHAT_POWER_GOVERNOR
+        histogram_record(&power_histograms[chat_power_get_profile()], elapsed_us);
+#endif
+    }
+}
+
+void chat_metrics_record_mutex_wait(int64_t wait_us) {
+    histogram_record(&mutex_wait_histogram, wait_us);
+}
+
+void chat_metrics_record_serialize(int64_t elapsed_us, size_t bytes) {
+    histogram_record(&serialize_histogram, elapsed_us);
+    __atomic_fetch_add(&serialize_bytes_total, (uint64_t)bytes, __ATOMIC_RELAXED);
+}
+
+void chat_metrics_record_persist(int64_t elapsed_us, bool ok) {
+    histogram_record(&persist_histogram, elapsed_us);
+    if (!ok) {
+        __atomic_fetch_add(&persist_failures_total, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void chat_metrics_record_persist_deferred(void) {
+    __atomic_fetch_add(&persist_deferred_total, 1, __ATOMIC_RELAXED);
+}
+
+void chat_metrics_record_rate_limited(void) {
+    __atomic_fetch_add(&rate_limited_total, 1, __ATOMIC_RELAXED);
+}
+
+void chat_metrics_record_duplicate(void) {
+    __atomic_fetch_add(&duplicates_total, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 把微秒格式化为秒
+ *
+ * @param buf 输出缓冲区
+ * @param size 缓冲区大小
+ * @param us 微秒
+ */
+static void format_seconds(char *buf, size_t size, uint64_t us) {
+    snprintf(buf, size, "%" PRIu32 ".%06" PRIu32, (uint32_t)(us / 1000000), (uint32_t)(us % 1000000));
+}
+
+/**
+ * @brief 输出一行格式化的指标
+ *
+ * @param writer 输出器
+ * @param fmt 格式字符串
+ */
+static void write_line(chat_json_writer_t *writer, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void write_line(chat_json_writer_t *writer, const char *fmt, ...) {
+    char line[METRICS_LINE_SIZE];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (len > 0) {
+        chat_json_write_raw(writer, line, len < (int)sizeof(line) ? (size_t)len : sizeof(line) - 1);
+    }
+}
+
+/**
+ * @brief 估算分位数：返回累计计数达到该比例的桶的上限
+ *
+ * @param snapshot 直方图快照
+ * @param permille 分位数(千分比)
+ * @param buf 输出缓冲区，秒数或+Inf
+ * @param size 缓冲区大小
+ */
+static void histogram_quantile(const metrics_histogram_t *snapshot, uint32_t permille, char *buf, size_t size) {
+    uint64_t target = ((uint64_t)snapshot->count * permille + 999) / 1000;
+    uint64_t cumulative = 0;
+    for (int i = 0; i < CHAT_METRICS_BUCKETS - 1; i++) {
+        cumulative += snapshot->buckets[i];
+        if (cumulative >= target) {
+            format_seconds(buf, size, 1ULL << (i + 6));
+            return;
+        }
+    }
+    snprintf(buf, size, "+Inf");
+}
+
+/**
+ * @brief 输出一个直方图及其p50/p99
+ *
+ * @param writer 输出器
+ * @param name 指标名称
+ * @param label 标签（如handler="get_messages"），没有标签时为空字符串
+ * @param histogram 直方图
+ */
+static void write_histogram(chat_json_writer_t *writer, const char *name, const char *label,
+                            const metrics_histogram_t *histogram) {
+    // 先取快照，保证同一直方图的各行一致
+    metrics_histogram_t snapshot;
+    for (int i = 0; i < CHAT_METRICS_BUCKETS; i++) {
+        snapshot.buckets[i] = __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+    }
+    snapshot.count = 0;
+    for (int i = 0; i < CHAT_METRICS_BUCKETS; i++) {
+        snapshot.count += snapshot.buckets[i];
+    }
+    snapshot.sum_us = __atomic_load_n(&histogram->sum_us, __ATOMIC_RELAXED);
+
+    const char *sep = label[0] ? "," : "";
+    char le[24];
+    uint32_t cumulative = 0;
+    for (int i = 0; i < CHAT_METRICS_BUCKETS; i++) {
+        cumulative += snapshot.buckets[i];
+        if (i < CHAT_METRICS_BUCKETS - 1) {
+            format_seconds(le, sizeof(le), 1ULL << (i + 6));
+        } else {
+            snprintf(le, sizeof(le), "+Inf");
+        }
+        write_line(writer, "%s_bucket{%s%sle=\"%s\"} %" PRIu32 "\n", name, label, sep, le, cumulative);
+    }
+
+    // 没有标签时省略花括号
+    const char *open = label[0] ? "{" : "";
+    const char *close = label[0] ? "}" : "";
+    char value[24];
+    format_seconds(value, sizeof(value), snapshot.sum_us);
+    write_line(writer, "%s_sum%s%s%s %s\n", name, open, label, close, value);
+    write_line(writer, "%s_count%s%s%s %" PRIu32 "\n", name, open, label, close, snapshot.count);
+
+    if (snapshot.count > 0) {
+        histogram_quantile(&snapshot, 500, value, sizeof(value));
+        write_line(writer, "%s_p50%s%s%s %s\n", name, open, label, close, value);
+        histogram_quantile(&snapshot, 990, value, sizeof(value));
+        write_line(writer, "%s_p99%s%s%s %s\n", name, open, label, close, value);
+    }
+}
+
+/**
+ * @brief 以Prometheus文本格式输出所有指标
+ */
+esp_err_t chat_metrics_write_prometheus(chat_json_writer_t *writer) {
+    char label[48];
+
+    chat_json_write_str(writer, "# TYPE chat_http_request_duration_seconds histogram\n");
+    for (int i = 0; i < CHAT_METRIC_ENDPOINT_COUNT; i++) {
+        snprintf(label, sizeof(label), "handler=\"%s\"", endpoint_names[i]);
+        write_histogram(writer, "chat_http_request_duration_seconds", label, &request_histograms[i]);
+    }
+
+    chat_json_write_str(writer, "# TYPE chat_storage_mutex_wait_seconds histogram\n");
+    write_histogram(writer, "chat_storage_mutex_wait_seconds", "", &mutex_wait_histogram);
+
+    chat_json_write_str(writer, "# TYPE chat_serialize_duration_seconds histogram\n");
+    write_histogram(writer, "chat_serialize_duration_seconds", "", &serialize_histogram);
+    chat_json_write_str(writer, "# TYPE chat_serialize_bytes_total counter\n");
+    write_line(writer, "chat_serialize_bytes_total %" PRIu64 "\n",
+               __atomic_load_n(&serialize_bytes_total, __ATOMIC_RELAXED));
+
+    chat_json_write_str(writer, "# TYPE chat_persist_duration_seconds histogram\n");
+    write_histogram(writer, "chat_persist_duration_seconds", "", &persist_histogram);
+    chat_json_write_str(writer, "# TYPE chat_persist_failures_total counter\n");
+    write_line(writer, "chat_persist_failures_total %" PRIu32 "\n",
+               __atomic_load_n(&persist_failures_total, __ATOMIC_RELAXED));
+    chat_json_write_str(writer, "# TYPE chat_persist_deferred_total counter\n");
+    write_line(writer, "chat_persist_deferred_total %" PRIu32 "\n",
+               __atomic_load_n(&persist_deferred_total, __ATOMIC_RELAXED));
+
+    chat_json_write_str(writer, "# TYPE chat_rate_limited_total counter\n");
+    write_line(writer, "chat_rate_limited_total %" PRIu32 "\n",
+               __atomic_load_n(&rate_limited_total, __ATOMIC_RELAXED));
+
+    chat_json_write_str(writer, "# TYPE chat_duplicate_messages_total counter\n");
+    write_line(writer, "chat_duplicate_messages_total %" PRIu32 "\n",
+               __atomic_load_n(&duplicates_total, __ATOMIC_RELAXED));
+
+    chat_pool_stats_t pool;
+    chat_pool_get_stats(&pool);
+    chat_json_write_str(writer, "# TYPE chat_buffer_pool_size gauge\n");
+    write_line(writer, "chat_buffer_pool_size %" PRIu32 "\n", pool.count);
+    chat_json_write_str(writer, "# TYPE chat_buffer_pool_in_use gauge\n");
+    write_line(writer, "chat_buffer_pool_in_use %" PRIu32 "\n", pool.in_use);
+    chat_json_write_str(writer, "# TYPE chat_buffer_pool_peak gauge\n");
+    write_line(writer, "chat_buffer_pool_peak %" PRIu32 "\n", pool.peak);
+    chat_json_write_str(writer, "# TYPE chat_buffer_pool_waits_total counter\n");
+    write_line(writer, "chat_buffer_pool_waits_total %" PRIu32 "\n", pool.waits);
+    chat_json_write_str(writer, "# TYPE chat_buffer_pool_exhausted_total counter\n");
+    write_line(writer, "chat_buffer_pool_exhausted_total %" PRIu32 "\n", pool.exhausted);
+
+#if CONFIG_CHAT_POWER_GOVERNOR
+    chat_power_stats_t power;
+    chat_power_get_stats(&power);
+    chat_json_write_str(writer, "# TYPE chat_power_profile gauge\n");
+    for (int i = 0; i < CHAT_POWER_PROFILE_COUNT; i++) {
+        write_line(writer, "chat_power_profile{profile=\"%s\"} %d\n", chat_power_profile_name(i), power.profile == i);
+    }
+    chat_json_write_str(writer, "# TYPE chat_power_profile_switches_total counter\n");
+    write_line(writer, "chat_power_profile_switches_total %" PRIu32 "\n", power.switches);
+    chat_json_write_str(writer, "# TYPE chat_power_profile_seconds_total counter\n");
+    for (int i = 0; i < CHAT_POWER_PROFILE_COUNT; i++) {
+        char seconds[24];
+        format_seconds(seconds, sizeof(seconds), power.time_us[i]);
+        write_line(writer, "chat_power_profile_seconds_total{profile=\"%s\"} %s\n", chat_power_profile_name(i), seconds);
+    }
+    // 同一接口在不同档位下的耗时差异即降频和省电的代价
+    chat_json_write_str(writer, "# TYPE chat_power_request_duration_seconds histogram\n");
+    for (int i = 0; i < CHAT_POWER_PROFILE_COUNT; i++) {
+        snprintf(label, sizeof(label), "profile=\"%s\"", chat_power_profile_name(i));
+        write_histogram(writer, "chat_power_request_duration_seconds", label, &power_histograms[i]);
+    }
+#endif
+
+    chat_json_write_str(writer, "# TYPE chat_heap_free_bytes gauge\n");
+    write_line(writer, "chat_heap_free_bytes %u\n", (unsigned)heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+    chat_json_write_str(writer, "# TYPE chat_heap_min_free_bytes gauge\n");
+    write_line(writer, "chat_heap_min_free_bytes %u\n", (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT));
+    chat_json_write_str(writer, "# TYPE chat_heap_largest_free_block_bytes gauge\n");
+    write_line(writer, "chat_heap_largest_free_block_bytes %u\n",
+               (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+#if CONFIG_SPIRAM
+    chat_json_write_str(writer, "# TYPE chat_psram_free_bytes gauge\n");
+    write_line(writer, "chat_psram_free_bytes %u\n", (unsigned)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+#endif
+
+    char uptime[24];
+    format_seconds(uptime, sizeof(uptime), (uint64_t)esp_timer_get_time());
+    chat_json_write_str(writer, "# TYPE chat_uptime_seconds gauge\n");
+    write_line(writer, "chat_uptime_seconds %s\n", uptime);
+
+    return writer->err;
+}
+
+#endif /* CONFIG_CHAT_METRICS */
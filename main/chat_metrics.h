@@ -0,0 +1,96 @@
+#ifndef _CHAT_METRICS_H_
+#define _CHAT_METRICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "chat_json.h"
+
+#define CHAT_METRICS_BUCKETS 16      // 耗时直方图桶数，第i个桶上限为2^(i+6)微秒，最后一个桶不设上限
+#define CHAT_METRICS_URI "/api/v1/system/metrics" // Prometheus抓取地址
+
+/* 统计耗时的HTTP接口 */
+typedef enum {
+    CHAT_METRIC_GET_MESSAGES = 0,    // GET /api/chat/messages
+    CHAT_METRIC_POST_MESSAGE,        // POST /api/chat/message
+    CHAT_METRIC_POST_BATCH,          // POST /api/chat/messages:batch
+    CHAT_METRIC_GET_UUID,            // GET /api/chat/uuid
+    CHAT_METRIC_GET_ROOMS,           // GET /api/chat/rooms
+    CHAT_METRIC_ENDPOINT_COUNT
+} chat_metric_endpoint_t;
+
+#if CONFIG_CHAT_METRICS
+
+/**
+ * @brief 记录一次HTTP请求的处理耗时
+ *
+ * 只做几次原子加法，可在任意任务中调用
+ *
+ * @param endpoint 接口
+ * @param elapsed_us 处理函数耗时(微秒)
+ */
+void chat_metrics_record_request(chat_metric_endpoint_t endpoint, int64_t elapsed_us);
+
+/**
+ * @brief 记录一次等待chat_mutex的时间
+ *
+ * @param wait_us 等待时间(微秒)
+ */
+void chat_metrics_record_mutex_wait(int64_t wait_us);
+
+/**
+ * @brief 记录一次消息列表序列化
+ *
+ * @param elapsed_us 序列化并发送的耗时(微秒)
+ * @param bytes 输出的字节数
+ */
+void chat_metrics_record_serialize(int64_t elapsed_us, size_t bytes);
+
+/**
+ * @brief 记录一次聊天历史持久化
+ *
+ * @param elapsed_us 保存耗时(微秒)
+ * @param ok 是否保存成功
+ */
+void chat_metrics_record_persist(int64_t elapsed_us, bool ok);
+
+/**
+ * @brief 记录一次为避开消息突发而推迟的保存
+ */
+void chat_metrics_record_persist_deferred(void);
+
+/**
+ * @brief 记录一次因限流被拒绝的提交
+ */
+void chat_metrics_record_rate_limited(void);
+
+/**
+ * @brief 记录一次按client_id识别出的重复提交
+ */
+void chat_metrics_record_duplicate(void);
+
+/**
+ * @brief 以Prometheus文本格式输出所有指标
+ *
+ * 读取计数器时不加锁，各项之间可能相差正在进行的一两次记录
+ *
+ * @param writer 输出器
+ * @return ESP_OK 成功，其他为输出器错误码
+ */
+esp_err_t chat_metrics_write_prometheus(chat_json_writer_t *writer);
+
+#else
+
+static inline void chat_metrics_record_request(chat_metric_endpoint_t endpoint, int64_t elapsed_us) {}
+static inline void chat_metrics_record_mutex_wait(int64_t wait_us) {}
+static inline void chat_metrics_record_serialize(int64_t elapsed_us, size_t bytes) {}
+static inline void chat_metrics_record_persist(int64_t elapsed_us, bool ok) {}
+static inline void chat_metrics_record_persist_deferred(void) {}
+static inline void chat_metrics_record_rate_limited(void) {}
+static inline void chat_metrics_record_duplicate(void) {}
+
+#endif /* CONFIG_CHAT_METRICS */
+
+#endif /* _CHAT_METRICS_H_ */
@@ -0,0 +1,488 @@
+/*
+ * 消息请求体原地解析实现
+ * 主要功能：
+ * 1. 按固定格式直接从接收缓冲区读取uuid、username、message和timestamp，不构建cJSON树
+ * 2. 字符串就地反转义并添加'\0'，结果指向接收缓冲区，同时给出长度，调用者无需再次strlen
+ * 3. 未知字段按标准JSON语法跳过，批量提交逐个读取数组元素，整个过程零堆分配
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include "chat_parser.h"
+
+/**
+ * @brief 跳过空白字符
+ *
+ * @param parser 解析器
+ */
+static void skip_ws(chat_parser_t *parser) {
+    while (parser->pos < parser->end &&
+           (*parser->pos == ' ' || *parser->pos == '\t' || *parser->pos == '\n' || *parser->pos == '\r')) {
+        parser->pos++;
+    }
+}
+
+/**
+ * @brief 跳过空白后读取下一个字符
+ *
+ * @param parser 解析器
+ * @return int 下一个字符，已到末尾时为-1
+ */
+static int peek(chat_parser_t *parser) {
+    skip_ws(parser);
+    return parser->pos < parser->end ? (unsigned char)*parser->pos : -1;
+}
+
+/**
+ * @brief 跳过空白后读取指定字符
+ *
+ * @param parser 解析器
+ * @param c 期望的字符
+ * @return true 下一个字符是c，已读取
+ */
+static bool consume(chat_parser_t *parser, char c) {
+    if (peek(parser) != (unsigned char)c) {
+        return false;
+    }
+    parser->pos++;
+    return true;
+}
+
+/**
+ * @brief 读取\u转义后的4位十六进制数
+ *
+ * @param p 十六进制数起始位置
+ * @param end 缓冲区末尾
+ * @param out 输出参数，解析出的值
+ * @return true 解析成功
+ */
+static bool parse_hex4(const char *p, const char *end, uint32_t *out) {
+    if (end - p < 4) {
+        return false;
+    }
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            return false;
+        }
+    }
+    *out = value;
+    return true;
+}
+
+/**
+ * @brief 就地读取一个字符串
+ *
+ * 反转义后的内容不会比原文长，直接写回原位置并以'\0'结尾
+ * （结尾位置不晚于原来的结束引号）
+ *
+ * @param parser 解析器，位于开始引号处
+ * @param out 输出参数，反转义后的字符串，可为NULL
+ * @param out_len 输出参数，字符串长度，可为NULL
+ * @return true 解析成功
+ */
+static bool parse_string(chat_parser_t *parser, char **out, size_t *out_len) {
+    if (!consume(parser, '"')) {
+        return false;
+    }
+
+    char *start = parser->pos;
+    char *w = start;
+    const char *r = start;
+    const char *end = parser->end;
+    while (r < end && *r != '"') {
+        if (*r != '\\') {
+            *w++ = *r++;
+            continue;
+        }
+
+        if (++r >= end) {
+            return false;
+        }
+        char esc = *r++;
+        switch (esc) {
+        case '"':  *w++ = '"';  break;
+        case '\\': *w++ = '\\'; break;
+        case '/':  *w++ = '/';  break;
+        case 'b':  *w++ = '\b'; break;
+        case 'f':  *w++ = '\f'; break;
+        case 'n':  *w++ = '\n'; break;
+        case 'r':  *w++ = '\r'; break;
+        case 't':  *w++ = '\t'; break;
+        case 'u': {
+            uint32_t cp;
+            if (!parse_hex4(r, end, &cp)) {
+                return false;
+            }
+            r += 4;
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                // 高代理项后必须紧跟低代理项
+                uint32_t low;
+                if (end - r < 6 || r[0] != '\\' || r[1] != 'u' ||
+                    !parse_hex4(r + 2, end, &low) || low < 0xDC00 || low > 0xDFFF) {
+                    return false;
+                }
+                r += 6;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            } else if ((cp >= 0xDC00 && cp <= 0xDFFF) || cp == 0) {
+                // 单独的低代理项和\u0000不接受
+                return false;
+            }
+
+            // 编码为UTF-8，最长4字节，原文至少6字节，不会越过读取位置
+            if (cp < 0x80) {
+                *w++ = (char)cp;
+            } else if (cp < 0x800) {
+                *w++ = (char)(0xC0 | (cp >> 6));
+                *w++ = (char)(0x80 | (cp & 0x3F));
+            } else if (cp < 0x10000) {
+                *w++ = (char)(0xE0 | (cp >> 12));
+                *w++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+                *w++ = (char)(0x80 | (cp & 0x3F));
+            } else {
+                *w++ = (char)(0xF0 | (cp >> 18));
+                *w++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+                *w++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+                *w++ = (char)(0x80 | (cp & 0x3F));
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    if (r >= end) {
+        return false; // 缺少结束引号
+    }
+    *w = '\0';
+    parser->pos = (char *)r + 1;
+    if (out) {
+        *out = start;
+    }
+    if (out_len) {
+        *out_len = (size_t)(w - start);
+    }
+    return true;
+}
+
+/**
+ * @brief 读取一个数字，转换为时间戳
+ *
+ * 按JSON数字语法读取，小数部分截断，负数按0处理，超出范围时取上限
+ *
+ * @param parser 解析器，位于数字开始处
+ * @param out 输出参数，转换后的值，可为NULL
+ * @return true 解析成功
+ */
+static bool parse_number(chat_parser_t *parser, uint32_t *out) {
+    const char *p = parser->pos;
+    const char *end = parser->end;
+    bool negative = false;
+    uint64_t value = 0;
+    int exponent = 0;
+
+    if (p < end && *p == '-') {
+        negative = true;
+        p++;
+    }
+    if (p >= end || *p < '0' || *p > '9') {
+        return false;
+    }
+    if (*p == '0') {
+        p++;
+    } else {
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (value <= UINT32_MAX) {
+                value = value * 10 + (*p - '0');
+            } else {
+                exponent++; // 超出范围后丢弃的整数位
+            }
+            p++;
+        }
+    }
+
+    // 小数部分：计入指数，供后面的指数部分抵消
+    if (p < end && *p == '.') {
+        p++;
+        if (p >= end || *p < '0' || *p > '9') {
+            return false;
+        }
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (value <= UINT32_MAX) {
+                value = value * 10 + (*p - '0');
+                exponent--;
+            }
+            p++;
+        }
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool exp_negative = false;
+        int exp = 0;
+        if (p < end && (*p == '+' || *p == '-')) {
+            exp_negative = *p == '-';
+            p++;
+        }
+        if (p >= end || *p < '0' || *p > '9') {
+            return false;
+        }
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (exp < 1000) {
+                exp = exp * 10 + (*p - '0');
+            }
+            p++;
+        }
+        exponent += exp_negative ? -exp : exp;
+    }
+
+    for (; exponent > 0 && value != 0 && value <= UINT32_MAX; exponent--) {
+        value *= 10;
+    }
+    for (; exponent < 0 && value != 0; exponent++) {
+        value /= 10;
+    }
+
+    parser->pos = (char *)p;
+    if (out) {
+        *out = negative ? 0 : (value > UINT32_MAX ? UINT32_MAX : (uint32_t)value);
+    }
+    return true;
+}
+
+/**
+ * @brief 匹配字面量true、false或null
+ *
+ * @param parser 解析器
+ * @param literal 字面量
+ * @return true 匹配成功，已跳过
+ */
+static bool parse_literal(chat_parser_t *parser, const char *literal) {
+    size_t len = strlen(literal);
+    if ((size_t)(parser->end - parser->pos) < len || memcmp(parser->pos, literal, len) != 0) {
+        return false;
+    }
+    parser->pos += len;
+    return true;
+}
+
+/**
+ * @brief 跳过任意一个JSON值
+ *
+ * @param parser 解析器
+ * @param depth 当前嵌套深度
+ * @return true 跳过成功
+ */
+static bool skip_value(chat_parser_t *parser, int depth) {
+    if (depth > CHAT_PARSER_MAX_DEPTH) {
+        return false;
+    }
+
+    switch (peek(parser)) {
+    case '"':
+        return parse_string(parser, NULL, NULL);
+    case '{':
+        parser->pos++;
+        if (consume(parser, '}')) {
+            return true;
+        }
+        do {
+            if (!parse_string(parser, NULL, NULL) || !consume(parser, ':') ||
+                !skip_value(parser, depth + 1)) {
+                return false;
+            }
+        } while (consume(parser, ','));
+        return consume(parser, '}');
+    case '[':
+        parser->pos++;
+        if (consume(parser, ']')) {
+            return true;
+        }
+        do {
+            if (!skip_value(parser, depth + 1)) {
+                return false;
+            }
+        } while (consume(parser, ','));
+        return consume(parser, ']');
+    case 't':
+        return parse_literal(parser, "true");
+    case 'f':
+        return parse_literal(parser, "false");
+    case 'n':
+        return parse_literal(parser, "null");
+    default:
+        return parse_number(parser, NULL);
+    }
+}
+
+/**
+ * @brief 初始化解析器
+ */
+void chat_parser_init(chat_parser_t *parser, char *buf, size_t len) {
+    parser->pos = buf;
+    parser->end = buf + len;
+    parser->in_array = false;
+    parser->in_wrapper = false;
+}
+
+/**
+ * @brief 解析一个消息对象
+ */
+esp_err_t chat_parser_message(chat_parser_t *parser, chat_parsed_message_t *out) {
+    memset(out, 0, sizeof(*out));
+
+    if (peek(parser) != '{') {
+        return skip_value(parser, 0) ? ESP_ERR_NOT_FOUND : ESP_ERR_INVALID_ARG;
+    }
+    parser->pos++;
+
+    bool type_error = false;
+    if (!consume(parser, '}')) {
+        do {
+            char *key;
+            if (!parse_string(parser, &key, NULL) || !consume(parser, ':')) {
+                return ESP_ERR_INVALID_ARG;
+            }
+
+            int c = peek(parser);
+            const char **field = NULL;
+            size_t *field_len = NULL;
+            if (strcmp(key, "uuid") == 0) {
+                field = &out->fields.uuid;
+                field_len = &out->uuid_len;
+            } else if (strcmp(key, "username") == 0) {
+                field = &out->fields.username;
+                field_len = &out->username_len;
+            } else if (strcmp(key, "message") == 0) {
+                field = &out->fields.message;
+                field_len = &out->message_len;
+            } else if (strcmp(key, "client_id") == 0) {
+                // 可选，但出现时与必填字段一样必须是字符串
+                field = &out->fields.client_id;
+                field_len = &out->client_id_len;
+            }
+
+            bool ok;
+            if (field && c == '"') {
+                char *value;
+                ok = parse_string(parser, &value, field_len);
+                *field = value;
+            } else if (field) {
+                // 必填字段类型不对
+                type_error = true;
+                ok = skip_value(parser, 1);
+            } else if (strcmp(key, "timestamp") == 0 && (c == '-' || (c >= '0' && c <= '9'))) {
+                ok = parse_number(parser, &out->fields.timestamp);
+            } else {
+                // 未知字段，或timestamp不是数字（与单独缺省时相同，使用服务器时间）
+                ok = skip_value(parser, 1);
+            }
+            if (!ok) {
+                return ESP_ERR_INVALID_ARG;
+            }
+        } while (consume(parser, ','));
+
+        if (!consume(parser, '}')) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    if (type_error || !out->fields.uuid || !out->fields.username || !out->fields.message) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief 进入批量数组
+ *
+ * @param parser 解析器，位于请求体开始处
+ * @return true 已读取数组的开始括号
+ */
+static bool enter_batch_array(chat_parser_t *parser) {
+    if (consume(parser, '[')) {
+        return true;
+    }
+    if (!consume(parser, '{')) {
+        return false;
+    }
+
+    // {"messages":[...]}，跳过messages之前的字段
+    do {
+        char *key;
+        if (!parse_string(parser, &key, NULL) || !consume(parser, ':')) {
+            return false;
+        }
+        if (strcmp(key, "messages") == 0 && consume(parser, '[')) {
+            parser->in_wrapper = true;
+            return true;
+        }
+        if (!skip_value(parser, 1)) {
+            return false;
+        }
+    } while (consume(parser, ','));
+    return false;
+}
+
+/**
+ * @brief 离开批量数组，跳过包裹对象中剩余的字段
+ *
+ * @param parser 解析器，位于数组结束括号之后
+ * @return true 剩余内容格式正确
+ */
+static bool leave_batch_array(chat_parser_t *parser) {
+    if (parser->in_wrapper) {
+        while (consume(parser, ',')) {
+            if (!parse_string(parser, NULL, NULL) || !consume(parser, ':') ||
+                !skip_value(parser, 1)) {
+                return false;
+            }
+        }
+        if (!consume(parser, '}')) {
+            return false;
+        }
+    }
+    return chat_parser_finish(parser) == ESP_OK;
+}
+
+/**
+ * @brief 定位到批量数组的下一个元素
+ */
+esp_err_t chat_parser_next_item(chat_parser_t *parser) {
+    if (!parser->in_array) {
+        if (!enter_batch_array(parser)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        parser->in_array = true;
+    } else if (!consume(parser, ',')) {
+        if (!consume(parser, ']')) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        return leave_batch_array(parser) ? ESP_ERR_NOT_FOUND : ESP_ERR_INVALID_ARG;
+    } else {
+        // 逗号之后必须还有元素
+        return peek(parser) == ']' ? ESP_ERR_INVALID_ARG : ESP_OK;
+    }
+
+    // 刚进入数组
+    if (consume(parser, ']')) {
+        return leave_batch_array(parser) ? ESP_ERR_NOT_FOUND : ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief 检查请求体已解析完毕
+ */
+esp_err_t chat_parser_finish(chat_parser_t *parser) {
+    return peek(parser) == -1 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
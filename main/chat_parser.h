@@ -0,0 +1,75 @@
+#ifndef _CHAT_PARSER_H_
+#define _CHAT_PARSER_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "chat_storage.h"
+
+#define CHAT_PARSER_MAX_DEPTH 16 // 跳过未知字段时允许的最大嵌套深度
+
+/* 原地解析器：在接收缓冲区中逐个读取JSON值，字符串就地反转义 */
+typedef struct {
+    char *pos;          // 当前解析位置
+    char *end;          // 缓冲区末尾
+    bool in_array;      // 已进入批量数组
+    bool in_wrapper;    // 批量数组包裹在{"messages":[...]}中
+} chat_parser_t;
+
+/* 解析出的一条消息，字符串指向接收缓冲区并以'\0'结尾 */
+typedef struct {
+    chat_message_input_t fields; // uuid、username、message和可选的timestamp
+    size_t uuid_len;             // uuid长度
+    size_t username_len;         // username长度
+    size_t message_len;          // message长度（UTF-8字节数）
+    size_t client_id_len;        // 可选的client_id长度，没有时为0
+} chat_parsed_message_t;
+
+/**
+ * @brief 初始化解析器
+ *
+ * 解析过程会改写缓冲区内容（字符串反转义并添加'\0'）
+ *
+ * @param parser 解析器
+ * @param buf 接收到的请求体
+ * @param len 请求体长度
+ */
+void chat_parser_init(chat_parser_t *parser, char *buf, size_t len);
+
+/**
+ * @brief 解析一个消息对象
+ *
+ * 读取uuid、username、message三个字符串字段、可选的数字字段timestamp和
+ * 可选的字符串字段client_id，其他字段跳过。不分配内存
+ *
+ * @param parser 解析器，成功或ESP_ERR_NOT_FOUND时位于该对象之后
+ * @param out 输出参数，解析出的消息
+ * @return ESP_OK 解析成功
+ * @return ESP_ERR_NOT_FOUND JSON格式正确，但不是对象或缺少必填字段、类型不对
+ * @return ESP_ERR_INVALID_ARG JSON格式错误
+ */
+esp_err_t chat_parser_message(chat_parser_t *parser, chat_parsed_message_t *out);
+
+/**
+ * @brief 定位到批量数组的下一个元素
+ *
+ * 请求体可以是数组，也可以是{"messages":[...]}。
+ * 数组结束时检查剩余内容，只允许空白
+ *
+ * @param parser 解析器
+ * @return ESP_OK 位于下一个元素的开始处
+ * @return ESP_ERR_NOT_FOUND 数组已结束
+ * @return ESP_ERR_INVALID_ARG JSON格式错误或没有消息数组
+ */
+esp_err_t chat_parser_next_item(chat_parser_t *parser);
+
+/**
+ * @brief 检查请求体已解析完毕
+ *
+ * @param parser 解析器
+ * @return ESP_OK 剩余内容只有空白
+ * @return ESP_ERR_INVALID_ARG 还有多余内容
+ */
+esp_err_t chat_parser_finish(chat_parser_t *parser);
+
+#endif /* _CHAT_PARSER_H_ */
@@ -0,0 +1,153 @@
+/*
+ * 请求缓冲池实现
+ * 主要功能：
+ * 1. 启动时预分配固定数量的大缓冲区，替代处理请求时的malloc/free
+ * 2. 缓冲区用完时短暂等待，超时由调用者返回503，形成背压而不是分配失败
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "chat_pool.h"
+
+static const char *POOL_TAG = "chat-pool"; // 日志标签
+
+static void *buffers[CHAT_POOL_COUNT];       // 预分配的缓冲区
+static bool used[CHAT_POOL_COUNT];           // 缓冲区是否已借出
+static SemaphoreHandle_t available = NULL;   // 计数信号量，值为空闲缓冲区数量
+static SemaphoreHandle_t pool_mutex = NULL;  // 保护used数组
+static uint32_t in_use = 0;
+static uint32_t peak = 0;
+static uint32_t waits = 0;
+static uint32_t exhausted = 0;
+
+/**
+ * @brief 初始化缓冲池
+ */
+esp_err_t chat_pool_init(void) {
+    if (available != NULL) {
+        return ESP_OK;
+    }
+
+    for (int i = 0; i < CHAT_POOL_COUNT; i++) {
+        buffers[i] = heap_caps_malloc_prefer(CHAT_POOL_BUFFER_SIZE, 2,
+                                             MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT,
+                                             MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (buffers[i] == NULL) {
+            ESP_LOGE(POOL_TAG, "Failed to allocate buffer %d of %d bytes", i, CHAT_POOL_BUFFER_SIZE);
+            chat_pool_deinit();
+            return ESP_ERR_NO_MEM;
+        }
+        used[i] = false;
+    }
+
+    pool_mutex = xSemaphoreCreateMutex();
+    available = xSemaphoreCreateCounting(CHAT_POOL_COUNT, CHAT_POOL_COUNT);
+    if (pool_mutex == NULL || available == NULL) {
+        ESP_LOGE(POOL_TAG, "Failed to create pool semaphores");
+        chat_pool_deinit();
+        return ESP_ERR_NO_MEM;
+    }
+
+    in_use = 0;
+    peak = 0;
+    ESP_LOGI(POOL_TAG, "Buffer pool: %d x %d bytes", CHAT_POOL_COUNT, CHAT_POOL_BUFFER_SIZE);
+    return ESP_OK;
+}
+
+/**
+ * @brief 释放缓冲池
+ */
+void chat_pool_deinit(void) {
+    if (available != NULL) {
+        vSemaphoreDelete(available);
+        available = NULL;
+    }
+    if (pool_mutex != NULL) {
+        vSemaphoreDelete(pool_mutex);
+        pool_mutex = NULL;
+    }
+    for (int i = 0; i < CHAT_POOL_COUNT; i++) {
+        heap_caps_free(buffers[i]);
+        buffers[i] = NULL;
+        used[i] = false;
+    }
+    in_use = 0;
+}
+
+/**
+ * @brief 借用一个缓冲区
+ */
+void *chat_pool_acquire(void) {
+    if (available == NULL) {
+        return NULL;
+    }
+
+    // 先不等待地尝试一次，区分需要等待的借用
+    if (xSemaphoreTake(available, 0) != pdTRUE) {
+        __atomic_add_fetch(&waits, 1, __ATOMIC_RELAXED);
+        if (xSemaphoreTake(available, pdMS_TO_TICKS(CHAT_POOL_WAIT_MS)) != pdTRUE) {
+            __atomic_add_fetch(&exhausted, 1, __ATOMIC_RELAXED);
+            ESP_LOGW(POOL_TAG, "All %d buffers in use", CHAT_POOL_COUNT);
+            return NULL;
+        }
+    }
+
+    // 信号量保证至少有一个空闲缓冲区
+    void *buf = NULL;
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    for (int i = 0; i < CHAT_POOL_COUNT; i++) {
+        if (!used[i]) {
+            used[i] = true;
+            buf = buffers[i];
+            break;
+        }
+    }
+    in_use++;
+    if (in_use > peak) {
+        peak = in_use;
+    }
+    xSemaphoreGive(pool_mutex);
+    return buf;
+}
+
+/**
+ * @brief 归还缓冲区
+ */
+void chat_pool_release(void *buf) {
+    if (buf == NULL || available == NULL) {
+        return;
+    }
+
+    bool found = false;
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    for (int i = 0; i < CHAT_POOL_COUNT; i++) {
+        if (buffers[i] == buf && used[i]) {
+            used[i] = false;
+            in_use--;
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(pool_mutex);
+
+    if (!found) {
+        ESP_LOGE(POOL_TAG, "Released buffer %p does not belong to the pool", buf);
+        return;
+    }
+    xSemaphoreGive(available);
+}
+
+/**
+ * @brief 读取缓冲池使用情况
+ */
+void chat_pool_get_stats(chat_pool_stats_t *stats) {
+    stats->count = CHAT_POOL_COUNT;
+    stats->in_use = __atomic_load_n(&in_use, __ATOMIC_RELAXED);
+    stats->peak = __atomic_load_n(&peak, __ATOMIC_RELAXED);
+    stats->waits = __atomic_load_n(&waits, __ATOMIC_RELAXED);
+    stats->exhausted = __atomic_load_n(&exhausted, __ATOMIC_RELAXED);
+}
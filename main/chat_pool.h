@@ -0,0 +1,65 @@
+#ifndef _CHAT_POOL_H_
+#define _CHAT_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "chat_storage.h"
+
+#define CHAT_POOL_COUNT CONFIG_CHAT_BUFFER_POOL_COUNT   // 预分配的缓冲区数量
+#define CHAT_POOL_WAIT_MS CONFIG_CHAT_BUFFER_POOL_WAIT_MS // 缓冲区用完时最多等待的时间
+#define CHAT_POOL_BUFFER_SIZE (CHAT_MAX_BATCH_MESSAGES * 512 + 1) // 单个缓冲区大小，放得下最大的批量请求体
+
+/* 缓冲池使用情况 */
+typedef struct {
+    uint32_t count;      // 缓冲区总数
+    uint32_t in_use;     // 当前借出的数量
+    uint32_t peak;       // 启动以来同时借出的最大数量
+    uint32_t waits;      // 借用时需要等待的次数
+    uint32_t exhausted;  // 等待超时、借用失败的次数
+} chat_pool_stats_t;
+
+/**
+ * @brief 初始化缓冲池
+ *
+ * 启动时一次性分配CHAT_POOL_COUNT个CHAT_POOL_BUFFER_SIZE字节的缓冲区（优先PSRAM），
+ * 之后借用和归还都不再分配堆内存，长时间运行也不会产生碎片
+ *
+ * @return ESP_OK 成功
+ * @return ESP_ERR_NO_MEM 内存不足
+ */
+esp_err_t chat_pool_init(void);
+
+/**
+ * @brief 释放缓冲池
+ *
+ * 调用前所有缓冲区应已归还
+ */
+void chat_pool_deinit(void);
+
+/**
+ * @brief 借用一个缓冲区
+ *
+ * 全部借出时最多等待CHAT_POOL_WAIT_MS，由调用者把超时作为“服务器繁忙”返回给客户端，
+ * 而不是在堆上临时分配
+ *
+ * @return void* CHAT_POOL_BUFFER_SIZE字节的缓冲区，超时或未初始化时为NULL
+ */
+void *chat_pool_acquire(void);
+
+/**
+ * @brief 归还缓冲区
+ *
+ * @param buf chat_pool_acquire返回的缓冲区，NULL时忽略
+ */
+void chat_pool_release(void *buf);
+
+/**
+ * @brief 读取缓冲池使用情况
+ *
+ * @param stats 输出参数
+ */
+void chat_pool_get_stats(chat_pool_stats_t *stats);
+
+#endif /* _CHAT_POOL_H_ */
@@ -0,0 +1,337 @@
+/*
+ * 功耗调节器实现
+ * 主要功能：
+ * 1. 每秒统计请求和消息速率，在空闲、活跃、突发三个档位之间切换
+ * 2. 按档位设置Wi-Fi调制解调器睡眠级别，开启电源管理时用esp_pm锁控制CPU频率和浅睡眠
+ * 3. 进入和离开空闲档时更新mDNS的TXT记录并重新通告
+ */
+
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "esp_pm.h"
+#include "mdns.h"
+#include "chat_storage.h"
+#include "chat_power.h"
+
+#if CONFIG_CHAT_POWER_GOVERNOR
+
+static const char *POWER_TAG = "chat-power"; // 日志标签
+
+#define POWER_SAMPLE_MS 1000                // 统计速率的周期
+#define POWER_BURST_HOLD_MS 5000            // 速率回落后突发档至少保持的时间，避免来回切换
+#define POWER_MDNS_SERVICE "_http"          // main.c中注册的mDNS服务
+#define POWER_MDNS_PROTO "_tcp"
+#define POWER_MDNS_TXT_KEY "power"
+
+static const char *profile_names[CHAT_POWER_PROFILE_COUNT] = {
+    [CHAT_POWER_IDLE] = "idle",
+    [CHAT_POWER_ACTIVE] = "active",
+    [CHAT_POWER_BURST] = "burst",
+};
+
+static esp_timer_handle_t sample_timer = NULL;
+static SemaphoreHandle_t power_mutex = NULL; // 保护档位切换和停留时间统计
+
+static chat_power_profile_t current_profile = CHAT_POWER_ACTIVE;
+static uint32_t request_count = 0;        // 本周期的请求和消息数
+static uint32_t last_interactive_ms = 0;  // 最近一次交互的时刻，回绕后相减仍然正确
+static int64_t burst_until_us = 0;        // 突发档至少保持到的时刻
+static int64_t profile_since_us = 0;      // 进入当前档位的时刻
+static uint64_t profile_time_us[CHAT_POWER_PROFILE_COUNT];
+static uint32_t switches = 0;
+
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t cpu_max_lock = NULL;   // 突发档持有，CPU保持最高频率
+static esp_pm_lock_handle_t no_sleep_lock = NULL;  // 非空闲档持有，禁止浅睡眠
+static bool cpu_max_held = false;
+static bool no_sleep_held = false;
+#endif
+
+/**
+ * @brief 取得当前毫秒数
+ *
+ * @return uint32_t 启动以来的毫秒数，约49天回绕一次
+ */
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+#if CONFIG_PM_ENABLE
+/**
+ * @brief 按需持有或释放电源管理锁
+ *
+ * @param lock 锁
+ * @param held 当前是否持有，更新为新状态
+ * @param want 是否需要持有
+ */
+static void set_pm_lock(esp_pm_lock_handle_t lock, bool *held, bool want) {
+    if (lock == NULL || *held == want) {
+        return;
+    }
+    esp_err_t err = want ? esp_pm_lock_acquire(lock) : esp_pm_lock_release(lock);
+    if (err == ESP_OK) {
+        *held = want;
+    } else {
+        ESP_LOGW(POWER_TAG, "Failed to %s power lock: %s", want ? "acquire" : "release", esp_err_to_name(err));
+    }
+}
+#endif
+
+/**
+ * @brief 把档位对应的设置应用到Wi-Fi和CPU
+ *
+ * @param profile 档位
+ */
+static void configure_profile(chat_power_profile_t profile) {
+#if CONFIG_EXAMPLE_CONNECT_WIFI
+    static const wifi_ps_type_t ps_modes[CHAT_POWER_PROFILE_COUNT] = {
+        [CHAT_POWER_IDLE] = WIFI_PS_MAX_MODEM,
+        [CHAT_POWER_ACTIVE] = WIFI_PS_MIN_MODEM,
+        [CHAT_POWER_BURST] = WIFI_PS_NONE,
+    };
+    esp_err_t err = esp_wifi_set_ps(ps_modes[profile]);
+    if (err != ESP_OK) {
+        ESP_LOGW(POWER_TAG, "Failed to set Wi-Fi power save for %s: %s", profile_names[profile], esp_err_to_name(err));
+    }
+#endif
+
+#if CONFIG_PM_ENABLE
+    set_pm_lock(cpu_max_lock, &cpu_max_held, profile == CHAT_POWER_BURST);
+    set_pm_lock(no_sleep_lock, &no_sleep_held, profile != CHAT_POWER_IDLE);
+#endif
+}
+
+/**
+ * @brief 在mDNS的TXT记录中通告是否空闲
+ *
+ * 修改TXT记录会让mDNS重新通告服务，只在进入和离开空闲档时调用，空闲期间不再产生通告
+ *
+ * @param idle 是否空闲
+ */
+static void announce_idle(bool idle) {
+    esp_err_t err = mdns_service_txt_item_set(POWER_MDNS_SERVICE, POWER_MDNS_PROTO, POWER_MDNS_TXT_KEY,
+                                              idle ? "idle" : "active");
+    if (err != ESP_OK) {
+        ESP_LOGD(POWER_TAG, "Failed to update mDNS TXT record: %s", esp_err_to_name(err));
+    }
+}
+
+/**
+ * @brief 切换档位
+ *
+ * 调用者需持有power_mutex
+ *
+ * @param profile 目标档位
+ */
+static void switch_profile(chat_power_profile_t profile) {
+    chat_power_profile_t previous = current_profile;
+    if (profile == previous) {
+        return;
+    }
+
+    configure_profile(profile);
+    if ((profile == CHAT_POWER_IDLE) != (previous == CHAT_POWER_IDLE)) {
+        announce_idle(profile == CHAT_POWER_IDLE);
+    }
+
+    int64_t now = esp_timer_get_time();
+    profile_time_us[previous] += now - profile_since_us;
+    profile_since_us = now;
+    switches++;
+    __atomic_store_n(&current_profile, profile, __ATOMIC_RELAXED);
+    ESP_LOGD(POWER_TAG, "Power profile %s -> %s", profile_names[previous], profile_names[profile]);
+}
+
+/**
+ * @brief 周期统计回调，在esp_timer任务中运行
+ *
+ * 长时间没有交互时进入空闲档，即使轮询请求很多；否则速率达到阈值时进入突发档，
+ * 回落后保持POWER_BURST_HOLD_MS再回到活跃档
+ *
+ * @param arg 未使用
+ */
+static void power_sample_cb(void *arg) {
+    uint32_t count = __atomic_exchange_n(&request_count, 0, __ATOMIC_RELAXED);
+    uint32_t idle_ms = now_ms() - __atomic_load_n(&last_interactive_ms, __ATOMIC_RELAXED);
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(power_mutex, portMAX_DELAY);
+    chat_power_profile_t target;
+    if (idle_ms >= CHAT_POWER_IDLE_TIMEOUT_S * 1000U) {
+        target = CHAT_POWER_IDLE;
+    } else if ((uint64_t)count * 1000 >= (uint64_t)CHAT_POWER_BURST_RATE * POWER_SAMPLE_MS) {
+        burst_until_us = now + POWER_BURST_HOLD_MS * 1000LL;
+        target = CHAT_POWER_BURST;
+    } else if (now < burst_until_us) {
+        target = CHAT_POWER_BURST;
+    } else {
+        target = CHAT_POWER_ACTIVE;
+    }
+    switch_profile(target);
+    xSemaphoreGive(power_mutex);
+}
+
+/**
+ * @brief 存储层新消息回调，每条消息都算一次交互
+ *
+ * @param message 新写入的消息（未使用）
+ */
+static void power_on_new_message(const chat_message_t *message) {
+    chat_power_note_request(true);
+}
+
+/**
+ * @brief 启动功耗调节器
+ */
+esp_err_t chat_power_init(void) {
+    if (sample_timer != NULL) {
+        return ESP_OK;
+    }
+
+    power_mutex = xSemaphoreCreateMutex();
+    if (power_mutex == NULL) {
+        ESP_LOGE(POWER_TAG, "Failed to create power mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+#if CONFIG_PM_ENABLE
+    // 允许CPU在没有锁时降到晶振频率
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_XTAL_FREQ,
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#endif
+    };
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK) {
+        ESP_LOGW(POWER_TAG, "Failed to configure power management: %s", esp_err_to_name(err));
+    }
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "chat_burst", &cpu_max_lock) != ESP_OK ||
+        esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "chat_active", &no_sleep_lock) != ESP_OK) {
+        ESP_LOGW(POWER_TAG, "Failed to create power locks, CPU frequency will not follow activity");
+    }
+#endif
+
+    memset(profile_time_us, 0, sizeof(profile_time_us));
+    switches = 0;
+    request_count = 0;
+    last_interactive_ms = now_ms();
+    profile_since_us = esp_timer_get_time();
+    current_profile = CHAT_POWER_ACTIVE;
+    configure_profile(CHAT_POWER_ACTIVE);
+    announce_idle(false);
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = power_sample_cb,
+        .name = "chat_power",
+    };
+    if (esp_timer_create(&timer_args, &sample_timer) != ESP_OK ||
+        esp_timer_start_periodic(sample_timer, POWER_SAMPLE_MS * 1000ULL) != ESP_OK) {
+        ESP_LOGE(POWER_TAG, "Failed to start power sample timer");
+        chat_power_deinit();
+        return ESP_ERR_NO_MEM;
+    }
+
+    chat_storage_add_message_listener(power_on_new_message);
+    ESP_LOGI(POWER_TAG, "Power governor: idle after %d s without interaction, burst at %d requests/s",
+             CHAT_POWER_IDLE_TIMEOUT_S, CHAT_POWER_BURST_RATE);
+    return ESP_OK;
+}
+
+/**
+ * @brief 停止功耗调节器并恢复默认的省电设置
+ */
+void chat_power_deinit(void) {
+    chat_storage_remove_message_listener(power_on_new_message);
+
+    if (sample_timer != NULL) {
+        esp_timer_stop(sample_timer);
+        esp_timer_delete(sample_timer);
+        sample_timer = NULL;
+    }
+
+    if (power_mutex != NULL) {
+        // 活跃档与Wi-Fi站点模式的默认设置相同
+        xSemaphoreTake(power_mutex, portMAX_DELAY);
+        switch_profile(CHAT_POWER_ACTIVE);
+        xSemaphoreGive(power_mutex);
+    }
+
+#if CONFIG_PM_ENABLE
+    set_pm_lock(cpu_max_lock, &cpu_max_held, false);
+    set_pm_lock(no_sleep_lock, &no_sleep_held, false);
+    if (cpu_max_lock != NULL) {
+        esp_pm_lock_delete(cpu_max_lock);
+        cpu_max_lock = NULL;
+    }
+    if (no_sleep_lock != NULL) {
+        esp_pm_lock_delete(no_sleep_lock);
+        no_sleep_lock = NULL;
+    }
+#endif
+
+    if (power_mutex != NULL) {
+        vSemaphoreDelete(power_mutex);
+        power_mutex = NULL;
+    }
+}
+
+/**
+ * @brief 记录一次HTTP请求
+ */
+void chat_power_note_request(bool interactive) {
+    __atomic_add_fetch(&request_count, 1, __ATOMIC_RELAXED);
+    if (!interactive) {
+        return;
+    }
+
+    __atomic_store_n(&last_interactive_ms, now_ms(), __ATOMIC_RELAXED);
+    // 空闲档下不等下一次统计，立即唤醒，后续的推送和响应不再受最大睡眠的延迟影响
+    if (__atomic_load_n(&current_profile, __ATOMIC_RELAXED) == CHAT_POWER_IDLE && sample_timer != NULL) {
+        xSemaphoreTake(power_mutex, portMAX_DELAY);
+        if (current_profile == CHAT_POWER_IDLE) {
+            switch_profile(CHAT_POWER_ACTIVE);
+        }
+        xSemaphoreGive(power_mutex);
+    }
+}
+
+/**
+ * @brief 读取当前档位
+ */
+chat_power_profile_t chat_power_get_profile(void) {
+    return __atomic_load_n(&current_profile, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 读取档位名称
+ */
+const char *chat_power_profile_name(chat_power_profile_t profile) {
+    return profile < CHAT_POWER_PROFILE_COUNT ? profile_names[profile] : "unknown";
+}
+
+/**
+ * @brief 读取功耗调节器状态
+ */
+void chat_power_get_stats(chat_power_stats_t *stats) {
+    if (power_mutex == NULL) {
+        memset(stats, 0, sizeof(*stats));
+        stats->profile = current_profile;
+        return;
+    }
+
+    xSemaphoreTake(power_mutex, portMAX_DELAY);
+    stats->profile = current_profile;
+    stats->switches = switches;
+    memcpy(stats->time_us, profile_time_us, sizeof(stats->time_us));
+    stats->time_us[current_profile] += esp_timer_get_time() - profile_since_us;
+    xSemaphoreGive(power_mutex);
+}
+
+#endif /* CONFIG_CHAT_POWER_GOVERNOR */
@@ -0,0 +1,87 @@
+#ifndef _CHAT_POWER_H_
+#define _CHAT_POWER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+/* 功耗档位，按活跃程度从低到高排列 */
+typedef enum {
+    CHAT_POWER_IDLE = 0,   // 空闲：Wi-Fi最大调制解调器睡眠，CPU可降频和浅睡眠
+    CHAT_POWER_ACTIVE,     // 活跃：Wi-Fi最小调制解调器睡眠，CPU可降频但不浅睡眠
+    CHAT_POWER_BURST,      // 突发：关闭Wi-Fi省电，CPU锁定最高频率
+    CHAT_POWER_PROFILE_COUNT
+} chat_power_profile_t;
+
+/* 功耗调节器状态 */
+typedef struct {
+    chat_power_profile_t profile;                         // 当前档位
+    uint32_t switches;                                    // 启动以来切换档位的次数
+    uint64_t time_us[CHAT_POWER_PROFILE_COUNT];           // 各档位累计停留时间(微秒)
+} chat_power_stats_t;
+
+#if CONFIG_CHAT_POWER_GOVERNOR
+
+#define CHAT_POWER_IDLE_TIMEOUT_S CONFIG_CHAT_POWER_IDLE_TIMEOUT_S // 没有交互多久后进入空闲档
+#define CHAT_POWER_BURST_RATE CONFIG_CHAT_POWER_BURST_RATE         // 每秒请求和消息数达到该值时进入突发档
+
+/**
+ * @brief 启动功耗调节器
+ *
+ * 需在网络连接和mDNS初始化之后调用。每秒统计一次请求和消息速率，据此切换档位；
+ * 未开启CONFIG_PM_ENABLE时只调节Wi-Fi省电模式
+ *
+ * @return ESP_OK 成功
+ * @return ESP_ERR_NO_MEM 创建定时器或互斥锁失败
+ */
+esp_err_t chat_power_init(void);
+
+/**
+ * @brief 停止功耗调节器并恢复默认的省电设置
+ */
+void chat_power_deinit(void);
+
+/**
+ * @brief 记录一次HTTP请求
+ *
+ * 所有请求都计入速率；交互请求（提交消息、打开页面等）还会刷新空闲计时，
+ * 处于空闲档时立即切回活跃档。轮询和指标抓取不算交互，否则挂着的页面永远不会进入空闲档。
+ * 只做原子操作，只有从空闲档唤醒时才会加锁
+ *
+ * @param interactive 是否为用户交互
+ */
+void chat_power_note_request(bool interactive);
+
+/**
+ * @brief 读取当前档位
+ *
+ * @return chat_power_profile_t 当前档位
+ */
+chat_power_profile_t chat_power_get_profile(void);
+
+/**
+ * @brief 读取档位名称
+ *
+ * @param profile 档位
+ * @return const char* 小写名称，作为指标标签
+ */
+const char *chat_power_profile_name(chat_power_profile_t profile);
+
+/**
+ * @brief 读取功耗调节器状态
+ *
+ * @param stats 输出参数，停留时间包含当前档位到现在为止的部分
+ */
+void chat_power_get_stats(chat_power_stats_t *stats);
+
+#else
+
+static inline esp_err_t chat_power_init(void) { return ESP_ERR_NOT_SUPPORTED; }
+static inline void chat_power_deinit(void) {}
+static inline void chat_power_note_request(bool interactive) {}
+static inline chat_power_profile_t chat_power_get_profile(void) { return CHAT_POWER_BURST; }
+
+#endif /* CONFIG_CHAT_POWER_GOVERNOR */
+
+#endif /* _CHAT_POWER_H_ */
@@ -0,0 +1,816 @@
+/*
+ * ESP32聊天消息推送通道实现
+ * 主要功能：
+ * 1. 在现有httpd实例上提供WebSocket端点(/api/chat/ws)和SSE端点(/api/chat/stream)
+ * 2. 监听存储层新消息，每条消息只编码一次到带引用计数的缓冲区，排入所有订阅者的发送队列
+ * 3. 非阻塞发送，发送缓冲区满时留在队列中稍后重试；跟不上的订阅者被断开，重连后从存储补发
+ * 4. SSE客户端重连时按Last-Event-ID从存储中补发错过的消息，并定时发送心跳注释
+ * 5. 轮询接口保持不变，作为都不可用时的后备方案
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "chat_json.h"
+#include "chat_storage.h"
+#include "chat_pool.h"
+#include "chat_push.h"
+
+static const char *PUSH_TAG = "chat-push"; // 日志标签
+
+#if CONFIG_HTTPD_WS_SUPPORT || CONFIG_CHAT_SSE
+
+#define PUSH_MAX_CLIENT_FRAME 64            // 客户端上行帧最大长度（只接受心跳等短帧）
+#define PUSH_MAX_SUBSCRIBERS CONFIG_LWIP_MAX_SOCKETS // 订阅者表大小，不超过套接字总数
+#define PUSH_RETRY_MS 20                    // 有订阅者发送缓冲区已满时的重试间隔
+#define PUSH_STALL_TIMEOUT_MS 5000          // 订阅者持续无法发送超过该时间即断开
+
+// SSE事件格式："data: <JSON>\nid: <seq>\n\n"，JSON与轮询接口的响应相同
+#define SSE_DATA_PREFIX "data: "
+#define SSE_DATA_PREFIX_LEN (sizeof(SSE_DATA_PREFIX) - 1)
+#define SSE_ID_MAX_LEN 24 // "\nid: 4294967295\n\n"加结束符
+#define WS_HEADER_MAX_LEN 4 // 服务端文本帧头：FIN+opcode、长度（推送内容不超过64KB，最多2字节扩展长度）
+#define WS_CONTROL_HEADER_LEN 2 // 控制帧头：内容不超过125字节，没有扩展长度
+
+/*
+ * 一条推送内容，编码一次后由所有订阅者的队列共享。
+ * 引用计数只在httpd任务中修改：广播工作持有一个，每个排队的订阅者各持有一个
+ */
+typedef struct {
+    uint32_t refs;       // 引用计数，PUSH_PAYLOAD_STATIC表示静态内容不释放
+    const char *ws;      // 完整的WebSocket帧，NULL表示不发给WebSocket订阅者
+    size_t ws_len;       // WebSocket帧长度
+    const char *sse;     // 完整的SSE事件
+    size_t sse_len;      // SSE事件长度
+    char data[];         // [WebSocket帧][SSE事件]
+} push_payload_t;
+
+#define PUSH_PAYLOAD_STATIC UINT32_MAX
+
+typedef enum {
+    PUSH_SUB_FREE = 0,   // 空闲槽位
+    PUSH_SUB_WS,         // WebSocket订阅者
+    PUSH_SUB_SSE,        // SSE订阅者
+} push_sub_kind_t;
+
+/* 订阅者，只在httpd任务中访问（处理函数、广播工作和会话关闭回调都在httpd任务中执行） */
+typedef struct {
+    push_sub_kind_t kind;   // 订阅者类型
+    int fd;                 // 连接的套接字
+    bool closing;           // 已请求关闭，等待会话关闭回调释放槽位
+    uint8_t head;           // 队首位置
+    uint8_t count;          // 队列中的推送内容数量
+    size_t offset;          // 队首已发送的字节数
+    int64_t progress_us;    // 上次发送出数据的时间，用于识别卡住的连接
+    push_payload_t *queue[CHAT_PUSH_QUEUE_DEPTH]; // 待发送的推送内容（共享引用）
+} push_subscriber_t;
+
+static httpd_handle_t push_server = NULL; // 推送所用的HTTP服务器句柄
+static push_subscriber_t subscribers[PUSH_MAX_SUBSCRIBERS];
+static esp_timer_handle_t push_retry_timer = NULL; // 重试定时器，只负责把重试工作排入httpd任务
+
+#if CONFIG_CHAT_SSE
+static esp_timer_handle_t sse_heartbeat_timer = NULL; // 心跳定时器，只负责把发送工作排入httpd任务
+
+// 心跳注释与消息一样排队，避免插入到发送了一半的事件中间
+static push_payload_t sse_heartbeat = {
+    .refs = PUSH_PAYLOAD_STATIC,
+    .ws = NULL,
+    .sse = ": ping\n\n",
+    .sse_len = sizeof(": ping\n\n") - 1,
+};
+#endif
+
+/**
+ * @brief 释放一个推送内容引用
+ *
+ * @param payload 推送内容
+ */
+static void payload_release(push_payload_t *payload) {
+    if (payload->refs != PUSH_PAYLOAD_STATIC && --payload->refs == 0) {
+        free(payload);
+    }
+}
+
+/**
+ * @brief 关闭订阅者的连接并释放其队列
+ *
+ * 请求httpd关闭连接，槽位在会话关闭回调中释放，
+ * 避免套接字编号被新连接重用前误把新连接当作订阅者
+ *
+ * @param sub 订阅者
+ */
+static void subscriber_close(push_subscriber_t *sub) {
+    while (sub->count > 0) {
+        payload_release(sub->queue[sub->head]);
+        sub->head = (sub->head + 1) % CHAT_PUSH_QUEUE_DEPTH;
+        sub->count--;
+    }
+    sub->offset = 0;
+    sub->closing = true;
+    httpd_sess_trigger_close(push_server, sub->fd);
+}
+
+/**
+ * @brief 断开出错或跟不上的订阅者
+ *
+ * @param sub 订阅者
+ * @param reason 日志中的原因
+ */
+static void subscriber_drop(push_subscriber_t *sub, const char *reason) {
+    ESP_LOGW(PUSH_TAG, "Dropping %s subscriber fd %d: %s", sub->kind == PUSH_SUB_WS ? "WebSocket" : "SSE",
+             sub->fd, reason);
+    subscriber_close(sub);
+}
+
+/**
+ * @brief 尽量发送订阅者队列中的内容，不阻塞
+ *
+ * @param sub 订阅者
+ * @param now_us 当前时间
+ * @return true 队列中还有未发送的内容
+ */
+static bool subscriber_flush(push_subscriber_t *sub, int64_t now_us) {
+    while (sub->count > 0) {
+        push_payload_t *payload = sub->queue[sub->head];
+        const char *data = sub->kind == PUSH_SUB_WS ? payload->ws : payload->sse;
+        size_t len = sub->kind == PUSH_SUB_WS ? payload->ws_len : payload->sse_len;
+
+        int ret = httpd_socket_send(push_server, sub->fd, data + sub->offset, len - sub->offset, MSG_DONTWAIT);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT || ret == 0) {
+            // 发送缓冲区已满
+            if (now_us - sub->progress_us > (int64_t)PUSH_STALL_TIMEOUT_MS * 1000) {
+                subscriber_drop(sub, "stalled");
+                return false;
+            }
+            return true;
+        }
+        if (ret < 0) {
+            subscriber_drop(sub, "send failed");
+            return false;
+        }
+
+        sub->progress_us = now_us;
+        sub->offset += ret;
+        if (sub->offset < len) {
+            continue;
+        }
+        payload_release(payload);
+        sub->head = (sub->head + 1) % CHAT_PUSH_QUEUE_DEPTH;
+        sub->count--;
+        sub->offset = 0;
+    }
+    return false;
+}
+
+/**
+ * @brief 把推送内容排入订阅者队列并尝试发送
+ *
+ * 队列已满说明订阅者长时间跟不上，断开后客户端重连并从存储补发（SSE按Last-Event-ID，
+ * WebSocket客户端退回since_seq轮询），不影响其他订阅者
+ *
+ * @param sub 订阅者
+ * @param payload 推送内容
+ * @param now_us 当前时间
+ * @return true 队列中还有未发送的内容
+ */
+static bool subscriber_push(push_subscriber_t *sub, push_payload_t *payload, int64_t now_us) {
+    if (sub->count == 0) {
+        sub->progress_us = now_us;
+    } else if (sub->count == CHAT_PUSH_QUEUE_DEPTH) {
+        subscriber_drop(sub, "too slow");
+        return false;
+    }
+    if (payload->refs != PUSH_PAYLOAD_STATIC) {
+        payload->refs++;
+    }
+    sub->queue[(sub->head + sub->count) % CHAT_PUSH_QUEUE_DEPTH] = payload;
+    sub->count++;
+    return subscriber_flush(sub, now_us);
+}
+
+/**
+ * @brief 有未发送完的内容时启动重试定时器
+ */
+static void schedule_retry(void) {
+    if (push_retry_timer != NULL && !esp_timer_is_active(push_retry_timer)) {
+        esp_timer_start_once(push_retry_timer, PUSH_RETRY_MS * 1000);
+    }
+}
+
+/**
+ * @brief 在httpd任务中继续发送所有订阅者的积压内容
+ *
+ * @param arg 未使用
+ */
+static void push_retry_work(void *arg) {
+    if (push_server == NULL) {
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+    bool pending = false;
+    for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++) {
+        push_subscriber_t *sub = &subscribers[i];
+        if (sub->kind != PUSH_SUB_FREE && !sub->closing && sub->count > 0) {
+            pending |= subscriber_flush(sub, now_us);
+        }
+    }
+    if (pending) {
+        schedule_retry();
+    }
+}
+
+/**
+ * @brief 重试定时器回调
+ *
+ * @param arg 未使用
+ */
+static void push_retry_timer_cb(void *arg) {
+    httpd_handle_t server = push_server;
+    if (server) {
+        httpd_queue_work(server, push_retry_work, NULL);
+    }
+}
+
+/**
+ * @brief 在httpd任务中把推送内容排入所有订阅者的队列
+ *
+ * 通过httpd_queue_work调度执行，每个订阅者只增加一个引用，不复制内容，
+ * 每条消息的开销与订阅者数量无关（除了每个订阅者一次非阻塞发送）
+ *
+ * @param arg 推送内容，广播工作持有的引用在结束时释放
+ */
+static void push_broadcast_work(void *arg) {
+    push_payload_t *payload = (push_payload_t *)arg;
+
+    if (push_server) {
+        int64_t now_us = esp_timer_get_time();
+        bool pending = false;
+        for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++) {
+            push_subscriber_t *sub = &subscribers[i];
+            if (sub->kind == PUSH_SUB_FREE || sub->closing) {
+                continue;
+            }
+            if (sub->kind == PUSH_SUB_WS && payload->ws == NULL) {
+                continue;
+            }
+            pending |= subscriber_push(sub, payload, now_us);
+        }
+        if (pending) {
+            schedule_retry();
+        }
+    }
+
+    payload_release(payload);
+}
+
+/**
+ * @brief 订阅者连接关闭回调，释放槽位
+ *
+ * 作为会话上下文的释放函数，由httpd在关闭连接时调用
+ *
+ * @param ctx 订阅者槽位
+ */
+static void subscriber_closed(void *ctx) {
+    push_subscriber_t *sub = (push_subscriber_t *)ctx;
+    ESP_LOGI(PUSH_TAG, "%s client disconnected, fd=%d", sub->kind == PUSH_SUB_WS ? "WebSocket" : "SSE", sub->fd);
+    while (sub->count > 0) {
+        payload_release(sub->queue[sub->head]);
+        sub->head = (sub->head + 1) % CHAT_PUSH_QUEUE_DEPTH;
+        sub->count--;
+    }
+    memset(sub, 0, sizeof(*sub));
+    sub->fd = -1;
+}
+
+/**
+ * @brief 登记订阅者
+ *
+ * 订阅者槽位作为会话上下文，随连接关闭释放
+ *
+ * @param req 握手请求
+ * @param kind 订阅者类型
+ * @param limit 该类型订阅者的数量上限
+ * @return true 登记成功
+ */
+static bool subscriber_register(httpd_req_t *req, push_sub_kind_t kind, int limit) {
+    push_subscriber_t *slot = NULL;
+    int same_kind = 0;
+    for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++) {
+        if (subscribers[i].kind == kind) {
+            same_kind++;
+        } else if (subscribers[i].kind == PUSH_SUB_FREE && slot == NULL) {
+            slot = &subscribers[i];
+        }
+    }
+    if (slot == NULL || same_kind >= limit) {
+        return false;
+    }
+
+    memset(slot, 0, sizeof(*slot));
+    slot->kind = kind;
+    slot->fd = httpd_req_to_sockfd(req);
+    req->sess_ctx = slot;
+    req->free_ctx = subscriber_closed;
+    return true;
+}
+
+/**
+ * @brief 输出推送帧内容，格式与轮询接口响应相同
+ *
+ * @param writer 输出器
+ * @param message 新消息
+ * @return ESP_OK 成功，其他为输出器错误码
+ */
+static esp_err_t push_write_payload(chat_json_writer_t *writer, const chat_message_t *message) {
+    chat_json_write_str(writer, "{\"messages\":[");
+    chat_storage_write_message_json(message, writer);
+    chat_json_write_str(writer, "],\"has_new_messages\":true,\"last_seq\":");
+    chat_json_write_u32(writer, message->seq);
+    return chat_json_write_raw(writer, "}", 1);
+}
+
+/**
+ * @brief 存储层新消息回调
+ *
+ * 把消息序列化为与轮询接口相同格式的JSON，一次性编码成WebSocket帧和SSE事件，交给httpd任务广播。
+ * 推送通道不区分订阅的房间，只广播默认房间的消息，其他房间的客户端通过轮询接收
+ *
+ * @param message 新写入的消息
+ */
+static void push_on_new_message(const chat_message_t *message) {
+    if (push_server == NULL || message->room != CHAT_ROOM_LOBBY) {
+        return;
+    }
+
+    // 第一遍只统计长度，第二遍写入按精确大小分配的缓冲区
+    chat_json_writer_t writer;
+    chat_json_writer_init(&writer, NULL, 0, NULL, NULL);
+    push_write_payload(&writer, message);
+
+    size_t json_len = writer.len;
+    if (json_len > UINT16_MAX) {
+        ESP_LOGE(PUSH_TAG, "Push payload too large (%u bytes)", (unsigned)json_len);
+        return;
+    }
+    push_payload_t *payload = malloc(sizeof(push_payload_t) + WS_HEADER_MAX_LEN + json_len +
+                                     SSE_DATA_PREFIX_LEN + json_len + SSE_ID_MAX_LEN);
+    if (!payload) {
+        ESP_LOGE(PUSH_TAG, "Failed to allocate push payload");
+        return;
+    }
+
+    // WebSocket帧：不分片、不加掩码的文本帧
+    char *ws = payload->data;
+    size_t ws_header_len = 2;
+    ws[0] = (char)0x81;
+    if (json_len < 126) {
+        ws[1] = (char)json_len;
+    } else {
+        ws[1] = 126;
+        ws[2] = (char)(json_len >> 8);
+        ws[3] = (char)(json_len & 0xff);
+        ws_header_len = 4;
+    }
+    char *json = ws + ws_header_len;
+    chat_json_writer_init(&writer, json, json_len, NULL, NULL);
+    if (push_write_payload(&writer, message) != ESP_OK) {
+        ESP_LOGE(PUSH_TAG, "Failed to serialize push payload");
+        free(payload);
+        return;
+    }
+
+    // SSE事件复用同一份JSON
+    char *sse = json + json_len;
+    memcpy(sse, SSE_DATA_PREFIX, SSE_DATA_PREFIX_LEN);
+    memcpy(sse + SSE_DATA_PREFIX_LEN, json, json_len);
+    size_t sse_len = SSE_DATA_PREFIX_LEN + json_len;
+    sse_len += snprintf(sse + sse_len, SSE_ID_MAX_LEN, "\nid: %" PRIu32 "\n\n", message->seq);
+
+    payload->refs = 1;
+    payload->ws = ws;
+    payload->ws_len = ws_header_len + json_len;
+    payload->sse = sse;
+    payload->sse_len = sse_len;
+
+    // 发送放到httpd任务中执行，避免与请求处理并发写同一socket
+    if (httpd_queue_work(push_server, push_broadcast_work, payload) != ESP_OK) {
+        ESP_LOGW(PUSH_TAG, "Failed to queue push work");
+        free(payload);
+    }
+}
+
+#if CONFIG_HTTPD_WS_SUPPORT
+// 回复客户端关闭帧的关闭帧（不带状态码），排在积压的数据帧之后
+static push_payload_t ws_close_frame = {
+    .refs = PUSH_PAYLOAD_STATIC,
+    .ws = "\x88\x00",
+    .ws_len = WS_CONTROL_HEADER_LEN,
+    .sse = NULL,
+};
+
+/**
+ * @brief 把控制帧排入WebSocket订阅者的队列
+ *
+ * 数据帧可能只发送了一部分，控制帧直接写入套接字会夹在它中间，必须与数据帧一起排队
+ *
+ * @param sub 订阅者
+ * @param opcode 控制帧类型
+ * @param data 控制帧内容（PONG原样返回PING的内容）
+ * @param len 内容长度，不超过PUSH_MAX_CLIENT_FRAME
+ */
+static void ws_queue_control(push_subscriber_t *sub, httpd_ws_type_t opcode, const uint8_t *data, size_t len) {
+    push_payload_t *payload = malloc(sizeof(push_payload_t) + WS_CONTROL_HEADER_LEN + len);
+    if (!payload) {
+        subscriber_drop(sub, "no memory for control frame");
+        return;
+    }
+    payload->data[0] = (char)(0x80 | opcode);
+    payload->data[1] = (char)len;
+    memcpy(payload->data + WS_CONTROL_HEADER_LEN, data, len);
+    payload->refs = 1;
+    payload->ws = payload->data;
+    payload->ws_len = WS_CONTROL_HEADER_LEN + len;
+    payload->sse = NULL;
+    payload->sse_len = 0;
+    if (subscriber_push(sub, payload, esp_timer_get_time())) {
+        schedule_retry();
+    }
+    payload_release(payload);
+}
+
+/**
+ * @brief WebSocket端点处理函数
+ *
+ * 握手请求登记为订阅者；之后的上行数据帧（如心跳）读取后丢弃。
+ * 控制帧由本函数处理（handle_ws_control_frames）：httpd自动回复时直接写套接字，
+ * 可能插入到发送了一半的推送帧中间，所以PONG和关闭帧都经订阅者队列发送
+ *
+ * @param req HTTP请求对象
+ * @return ESP_OK 处理成功，其他值会关闭连接
+ */
+static esp_err_t ws_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) {
+        if (!subscriber_register(req, PUSH_SUB_WS, CHAT_WS_MAX_CLIENTS)) {
+            // 关闭连接，客户端退回轮询
+            ESP_LOGW(PUSH_TAG, "No free subscriber slot for WebSocket fd=%d", httpd_req_to_sockfd(req));
+            return ESP_FAIL;
+        }
+        ESP_LOGI(PUSH_TAG, "WebSocket client connected, fd=%d", httpd_req_to_sockfd(req));
+        return ESP_OK;
+    }
+
+    uint8_t buf[PUSH_MAX_CLIENT_FRAME];
+    httpd_ws_frame_t frame = {
+        .payload = buf
+    };
+
+    // 先读取帧头获取长度
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK) {
+        ESP_LOGW(PUSH_TAG, "Failed to receive frame header: %s", esp_err_to_name(err));
+        return err;
+    }
+    if (frame.len > sizeof(buf)) {
+        ESP_LOGW(PUSH_TAG, "Client frame too large (%u bytes)", (unsigned)frame.len);
+        return ESP_FAIL;
+    }
+    if (frame.len > 0) {
+        err = httpd_ws_recv_frame(req, &frame, sizeof(buf));
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    push_subscriber_t *sub = (push_subscriber_t *)req->sess_ctx;
+    if (sub == NULL || sub->kind != PUSH_SUB_WS || sub->closing) {
+        return ESP_OK;
+    }
+    if (frame.type == HTTPD_WS_TYPE_PING) {
+        ws_queue_control(sub, HTTPD_WS_TYPE_PONG, buf, frame.len);
+    } else if (frame.type == HTTPD_WS_TYPE_CLOSE) {
+        ESP_LOGI(PUSH_TAG, "WebSocket client closing, fd=%d", sub->fd);
+        bool pending = subscriber_push(sub, &ws_close_frame, esp_timer_get_time());
+        // 关闭帧发出后断开；仍有积压时直接断开，客户端重连后补齐
+        if (pending) {
+            subscriber_drop(sub, "closed with unsent frames");
+        } else if (!sub->closing) {
+            subscriber_close(sub);
+        }
+    }
+    return ESP_OK;
+}
+#endif /* CONFIG_HTTPD_WS_SUPPORT */
+
+#if CONFIG_CHAT_SSE
+/**
+ * @brief 在httpd任务中向SSE订阅者发送心跳注释
+ *
+ * 保持连接和中间代理不因空闲而断开，也让已断开的连接尽早发送失败被清理
+ *
+ * @param arg 未使用
+ */
+static void sse_heartbeat_work(void *arg) {
+    if (push_server == NULL) {
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+    bool pending = false;
+    for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++) {
+        push_subscriber_t *sub = &subscribers[i];
+        if (sub->kind == PUSH_SUB_SSE && !sub->closing) {
+            // 还有积压时不需要心跳，只检查是否卡住
+            pending |= sub->count > 0 ? subscriber_flush(sub, now_us) : subscriber_push(sub, &sse_heartbeat, now_us);
+        }
+    }
+    if (pending) {
+        schedule_retry();
+    }
+}
+
+/**
+ * @brief 心跳定时器回调
+ *
+ * @param arg 未使用
+ */
+static void sse_heartbeat_timer_cb(void *arg) {
+    httpd_handle_t server = push_server;
+    if (server) {
+        httpd_queue_work(server, sse_heartbeat_work, NULL);
+    }
+}
+
+/**
+ * @brief 直接向连接写入原始数据的刷新回调
+ *
+ * SSE响应没有Content-Length也不分块，连接关闭即结束，所以绕过httpd_resp_*直接发送
+ */
+static esp_err_t sse_raw_flush(void *ctx, const char *data, size_t len) {
+    int ret = httpd_send((httpd_req_t *)ctx, data, len);
+    return ret >= 0 && (size_t)ret == len ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * @brief 补发客户端断线期间错过的消息
+ *
+ * 错过的消息作为一个事件发送，内容与since_seq轮询的响应相同。补发在httpd任务中阻塞发送，
+ * 最多补发最新的CHAT_PAGE_MAX_MESSAGES条，更早的消息由客户端按before参数分页获取。
+ * id取输出前的最新序列号：输出期间到达的消息之后还会单独推送，客户端按seq去重即可
+ *
+ * @param req HTTP请求对象
+ * @param since_seq 客户端已收到的最新序列号
+ * @return ESP_OK 成功（没有错过的消息时不发送）
+ * @return ESP_ERR_TIMEOUT 缓冲池已用完
+ * @return 其他 发送失败
+ */
+static esp_err_t sse_send_backlog(httpd_req_t *req, uint32_t since_seq) {
+    uint32_t last_seq = chat_storage_get_last_seq();
+    if (last_seq == since_seq) {
+        return ESP_OK;
+    }
+    // 积压大小由客户端的游标决定（Last-Event-ID: 0表示整个存储；游标超前时存储层会从头重新同步），
+    // 两种情况都只补发最新的一页
+    if (since_seq > last_seq || last_seq - since_seq > CHAT_PAGE_MAX_MESSAGES) {
+        since_seq = last_seq > CHAT_PAGE_MAX_MESSAGES ? last_seq - CHAT_PAGE_MAX_MESSAGES : 0;
+    }
+
+    char *scratch = chat_pool_acquire();
+    if (!scratch) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    chat_json_writer_t writer;
+    chat_json_writer_init(&writer, scratch, CHAT_POOL_BUFFER_SIZE, sse_raw_flush, req);
+    chat_messages_query_t query = {
+        .mode = CHAT_QUERY_SINCE_SEQ,
+        .seq = since_seq,
+        .format = CHAT_FORMAT_JSON,
+        .room = CHAT_ROOM_LOBBY,
+    };
+    chat_json_write_raw(&writer, SSE_DATA_PREFIX, SSE_DATA_PREFIX_LEN);
+    esp_err_t err = chat_storage_write_messages(&query, &writer, NULL);
+    if (err == ESP_OK) {
+        char id[SSE_ID_MAX_LEN];
+        int len = snprintf(id, sizeof(id), "\nid: %" PRIu32 "\n\n", last_seq);
+        chat_json_write_raw(&writer, id, len);
+        err = chat_json_flush(&writer);
+    }
+    chat_pool_release(scratch);
+    return err;
+}
+
+/**
+ * @brief SSE端点处理函数
+ *
+ * 写入响应头后登记为订阅者并返回，连接保持打开，之后由广播工作直接向套接字发送事件。
+ * 带Last-Event-ID头（浏览器重连时自动携带）或since_seq参数时先补发错过的消息。
+ * 推送只覆盖默认房间，room参数指定其他房间时返回400
+ *
+ * @param req HTTP请求对象
+ * @return ESP_OK 处理成功
+ * @return ESP_FAIL 发送失败，关闭连接
+ */
+static esp_err_t sse_handler(httpd_req_t *req) {
+    int sse_count = 0;
+    bool slot_free = false;
+    for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++) {
+        sse_count += subscribers[i].kind == PUSH_SUB_SSE;
+        slot_free |= subscribers[i].kind == PUSH_SUB_FREE;
+    }
+    // 历史还在后台加载时补发的积压不完整，加载完成后再建立连接
+    bool warming = !chat_storage_history_ready();
+    if (warming || sse_count >= CHAT_SSE_MAX_CLIENTS || !slot_free) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", warming ? "1" : "5");
+        httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, warming ? "{\"status\":\"warming\",\"error\":\"Loading history\"}"
+                                        : "{\"status\":\"error\",\"error\":\"Too many streams\"}");
+        return ESP_OK;
+    }
+
+    char query[64] = "";
+    if (httpd_req_get_url_query_len(req) > 0 &&
+        httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
+        httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid query");
+        return ESP_OK;
+    }
+
+    // 广播只发送默认房间的消息，订阅其他房间的客户端会收到错误的消息，直接拒绝
+    char room_name[CHAT_ROOM_NAME_LENGTH + 1] = "";
+    int room = CHAT_ROOM_LOBBY;
+    esp_err_t room_err = httpd_query_key_value(query, "room", room_name, sizeof(room_name));
+    if (room_err != ESP_ERR_NOT_FOUND &&
+        (room_err != ESP_OK || chat_storage_find_room(room_name, false, &room) != ESP_OK ||
+         room != CHAT_ROOM_LOBBY)) {
+        httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Push is only available for the lobby");
+        return ESP_OK;
+    }
+
+    // 断点续传的位置：优先使用Last-Event-ID，首次连接可以用since_seq指定
+    char value[16];
+    bool resume = httpd_req_get_hdr_value_str(req, "Last-Event-ID", value, sizeof(value)) == ESP_OK;
+    if (!resume) {
+        resume = httpd_query_key_value(query, "since_seq", value, sizeof(value)) == ESP_OK;
+    }
+
+    static const char headers[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "\r\n"
+        "retry: 3000\n\n"; // 建议客户端断线3秒后重连
+    if (sse_raw_flush(req, headers, sizeof(headers) - 1) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    if (resume) {
+        esp_err_t err = sse_send_backlog(req, (uint32_t)strtoul(value, NULL, 10));
+        if (err != ESP_OK) {
+            // 响应头已发出，只能关闭连接让客户端稍后重连
+            ESP_LOGW(PUSH_TAG, "Failed to send SSE backlog: %s", esp_err_to_name(err));
+            return ESP_FAIL;
+        }
+    }
+
+    // 补发在httpd任务中完成，期间排队的广播工作在登记之后执行，不会漏掉消息
+    subscriber_register(req, PUSH_SUB_SSE, CHAT_SSE_MAX_CLIENTS);
+    ESP_LOGI(PUSH_TAG, "SSE client connected, fd=%d", httpd_req_to_sockfd(req));
+    return ESP_OK;
+}
+
+/**
+ * @brief 注册SSE端点并启动心跳定时器
+ *
+ * @param server HTTP服务器句柄
+ * @return ESP_OK 成功
+ */
+static esp_err_t sse_init(httpd_handle_t server) {
+    httpd_uri_t sse_uri = {
+        .uri = CHAT_PUSH_SSE_URI,
+        .method = HTTP_GET,
+        .handler = sse_handler,
+        .user_ctx = NULL
+    };
+    esp_err_t err = httpd_register_uri_handler(server, &sse_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(PUSH_TAG, "Failed to register SSE handler: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = sse_heartbeat_timer_cb,
+        .name = "sse_heartbeat"
+    };
+    err = esp_timer_create(&timer_args, &sse_heartbeat_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(sse_heartbeat_timer, (uint64_t)CHAT_SSE_HEARTBEAT_MS * 1000);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(PUSH_TAG, "Failed to start SSE heartbeat: %s", esp_err_to_name(err));
+    }
+
+    ESP_LOGI(PUSH_TAG, "SSE push enabled at %s (%d clients)", CHAT_PUSH_SSE_URI, CHAT_SSE_MAX_CLIENTS);
+    return ESP_OK;
+}
+#endif /* CONFIG_CHAT_SSE */
+
+/**
+ * @brief 停止并删除定时器
+ *
+ * @param timer 定时器句柄
+ */
+static void delete_timer(esp_timer_handle_t *timer) {
+    if (*timer != NULL) {
+        esp_timer_stop(*timer);
+        esp_timer_delete(*timer);
+        *timer = NULL;
+    }
+}
+
+/**
+ * @brief 初始化消息推送通道
+ *
+ * @param server HTTP服务器句柄
+ * @return ESP_OK 初始化成功
+ */
+esp_err_t chat_push_init(httpd_handle_t server) {
+    esp_err_t err;
+    memset(subscribers, 0, sizeof(subscribers));
+    for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++) {
+        subscribers[i].fd = -1;
+    }
+
+#if CONFIG_HTTPD_WS_SUPPORT
+    httpd_uri_t ws_uri = {
+        .uri = CHAT_PUSH_WS_URI,
+        .method = HTTP_GET,
+        .handler = ws_handler,
+        .user_ctx = NULL,
+        .is_websocket = true,
+        .handle_ws_control_frames = true
+    };
+    err = httpd_register_uri_handler(server, &ws_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(PUSH_TAG, "Failed to register WebSocket handler: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(PUSH_TAG, "WebSocket push enabled at %s", CHAT_PUSH_WS_URI);
+#else
+    ESP_LOGW(PUSH_TAG, "CONFIG_HTTPD_WS_SUPPORT disabled, WebSocket clients will fall back to polling");
+#endif
+
+#if CONFIG_CHAT_SSE
+    err = sse_init(server);
+    if (err != ESP_OK) {
+        return err;
+    }
+#endif
+
+    const esp_timer_create_args_t retry_args = {
+        .callback = push_retry_timer_cb,
+        .name = "push_retry"
+    };
+    err = esp_timer_create(&retry_args, &push_retry_timer);
+    if (err != ESP_OK) {
+        // 没有重试定时器时积压的内容随下一条消息或心跳继续发送
+        ESP_LOGW(PUSH_TAG, "Failed to create push retry timer: %s", esp_err_to_name(err));
+    }
+
+    push_server = server;
+    chat_storage_add_message_listener(push_on_new_message);
+    return ESP_OK;
+}
+
+/**
+ * @brief 停止消息推送通道
+ */
+void chat_push_deinit(void) {
+    chat_storage_remove_message_listener(push_on_new_message);
+#if CONFIG_CHAT_SSE
+    delete_timer(&sse_heartbeat_timer);
+#endif
+    delete_timer(&push_retry_timer);
+    push_server = NULL;
+}
+
+#else /* !CONFIG_HTTPD_WS_SUPPORT && !CONFIG_CHAT_SSE */
+
+esp_err_t chat_push_init(httpd_handle_t server) {
+    ESP_LOGW(PUSH_TAG, "WebSocket and SSE push disabled, clients will fall back to polling");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void chat_push_deinit(void) {
+}
+
+#endif /* CONFIG_HTTPD_WS_SUPPORT || CONFIG_CHAT_SSE */
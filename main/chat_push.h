@@ -0,0 +1,41 @@
+#ifndef _CHAT_PUSH_H_
+#define _CHAT_PUSH_H_
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define CHAT_PUSH_WS_URI "/api/chat/ws"      // WebSocket推送通道URI
+#define CHAT_PUSH_SSE_URI "/api/chat/stream" // SSE推送通道URI
+#define CHAT_PUSH_QUEUE_DEPTH CONFIG_CHAT_PUSH_QUEUE_DEPTH // 每个订阅者最多积压的推送内容数量
+
+#if CONFIG_HTTPD_WS_SUPPORT
+#define CHAT_WS_MAX_CLIENTS CONFIG_CHAT_WS_MAX_CLIENTS       // 同时连接的WebSocket客户端数量上限
+#endif
+
+#if CONFIG_CHAT_SSE
+#define CHAT_SSE_MAX_CLIENTS CONFIG_CHAT_SSE_MAX_CLIENTS     // 同时连接的SSE客户端数量上限
+#define CHAT_SSE_HEARTBEAT_MS CONFIG_CHAT_SSE_HEARTBEAT_MS   // SSE心跳注释的发送间隔
+#endif
+
+/**
+ * @brief 初始化消息推送通道
+ *
+ * 在HTTP服务器上注册WebSocket和SSE端点，并监听存储层的新消息。
+ * 每条新消息只编码一次，所有订阅者的发送队列共享同一个带引用计数的缓冲区；
+ * 发送不阻塞，积压超过CHAT_PUSH_QUEUE_DEPTH条的订阅者被断开，重连后从存储补发
+ *
+ * @param server HTTP服务器句柄
+ * @return ESP_OK 初始化成功
+ * @return ESP_ERR_NOT_SUPPORTED CONFIG_HTTPD_WS_SUPPORT和CONFIG_CHAT_SSE都未启用
+ */
+esp_err_t chat_push_init(httpd_handle_t server);
+
+/**
+ * @brief 停止消息推送通道
+ *
+ * 取消存储层监听，之后的新消息不再广播
+ */
+void chat_push_deinit(void);
+
+#endif /* _CHAT_PUSH_H_ */
@@ -0,0 +1,159 @@
+/*
+ * 聊天消息提交限流实现
+ * 主要功能：
+ * 1. 按客户端地址维护令牌桶，限制单个客户端发送消息的速率
+ * 2. 固定大小的哈希表，查找和替换都只探测常数个槽位，不分配内存
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "lwip/sockets.h"
+#include "chat_ratelimit.h"
+
+#if CONFIG_CHAT_RATE_LIMIT
+
+static const char *RATELIMIT_TAG = "chat-ratelimit"; // 日志标签
+
+#define TOKEN_UNIT 1000                                         // 令牌以千分之一为单位计数，补充时不需要浮点运算
+#define BUCKET_CAPACITY (CHAT_RATELIMIT_BURST * TOKEN_UNIT)     // 令牌桶容量
+#define US_PER_MINUTE 60000000LL
+
+// 单个客户端的令牌桶
+typedef struct {
+    chat_client_key_t key;  // 客户端标识
+    int64_t refill_us;      // 上次补充令牌的时间
+    int32_t tokens;         // 剩余令牌（TOKEN_UNIT为一个），可为负
+    bool used;              // 槽位是否已占用
+} ratelimit_bucket_t;
+
+static ratelimit_bucket_t buckets[CHAT_RATELIMIT_CLIENTS];
+static uint32_t hash_seed = 0; // 每次启动随机生成，避免客户端构造冲突的地址挤掉其他人的令牌桶
+
+/**
+ * @brief 初始化限流表
+ */
+void chat_ratelimit_init(void) {
+    memset(buckets, 0, sizeof(buckets));
+    hash_seed = esp_random();
+    ESP_LOGI(RATELIMIT_TAG, "Rate limit: burst %d, %d messages/min, %d clients",
+             CHAT_RATELIMIT_BURST, CHAT_RATELIMIT_PER_MINUTE, CHAT_RATELIMIT_CLIENTS);
+}
+
+/**
+ * @brief 取得请求的客户端标识
+ */
+esp_err_t chat_ratelimit_client_key(httpd_req_t *req, chat_client_key_t *key) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    int sockfd = httpd_req_to_sockfd(req);
+    if (sockfd < 0 || getpeername(sockfd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        return ESP_FAIL;
+    }
+
+    memset(key, 0, sizeof(*key));
+    if (addr.ss_family == AF_INET) {
+        // 与IPv6套接字上的IPv4映射地址取相同的标识
+        const struct sockaddr_in *in = (const struct sockaddr_in *)&addr;
+        key->bytes[10] = 0xff;
+        key->bytes[11] = 0xff;
+        memcpy(&key->bytes[12], &in->sin_addr.s_addr, 4);
+        return ESP_OK;
+    }
+#if CONFIG_LWIP_IPV6
+    if (addr.ss_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)&addr;
+        memcpy(key->bytes, &in6->sin6_addr, CHAT_RATELIMIT_KEY_LENGTH);
+        return ESP_OK;
+    }
+#endif
+    return ESP_FAIL;
+}
+
+/**
+ * @brief 计算客户端标识的哈希值（FNV-1a）
+ *
+ * @param key 客户端标识
+ * @return uint32_t 哈希值
+ */
+static uint32_t key_hash(const chat_client_key_t *key) {
+    uint32_t hash = 2166136261u ^ hash_seed;
+    for (int i = 0; i < CHAT_RATELIMIT_KEY_LENGTH; i++) {
+        hash ^= key->bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief 查找客户端的令牌桶并补充令牌
+ *
+ * 探测范围内没有该客户端时占用空槽，没有空槽则替换最久未使用的令牌桶。
+ * 被替换的客户端再次出现时得到一个满的令牌桶；长时间空闲的令牌桶本来就已补满，替换不影响限流效果
+ *
+ * @param key 客户端标识
+ * @param now_us 当前时间
+ * @return ratelimit_bucket_t* 令牌桶
+ */
+static ratelimit_bucket_t *find_bucket(const chat_client_key_t *key, int64_t now_us) {
+    uint32_t hash = key_hash(key);
+    ratelimit_bucket_t *victim = NULL;
+    for (int i = 0; i < CHAT_RATELIMIT_PROBES; i++) {
+        ratelimit_bucket_t *bucket = &buckets[(hash + i) % CHAT_RATELIMIT_CLIENTS];
+        if (bucket->used && memcmp(&bucket->key, key, sizeof(*key)) == 0) {
+            // 按经过的时间补充令牌，不超过容量
+            int64_t refill = (now_us - bucket->refill_us) * CHAT_RATELIMIT_PER_MINUTE * TOKEN_UNIT / US_PER_MINUTE;
+            if (refill > 0) {
+                int64_t tokens = bucket->tokens + refill;
+                bucket->tokens = tokens > BUCKET_CAPACITY ? BUCKET_CAPACITY : (int32_t)tokens;
+                bucket->refill_us = now_us;
+            }
+            return bucket;
+        }
+        if (victim == NULL || (victim->used && (!bucket->used || bucket->refill_us < victim->refill_us))) {
+            victim = bucket;
+        }
+    }
+
+    victim->key = *key;
+    victim->refill_us = now_us;
+    victim->tokens = BUCKET_CAPACITY;
+    victim->used = true;
+    return victim;
+}
+
+/**
+ * @brief 为一条消息取一个令牌
+ */
+bool chat_ratelimit_acquire(const chat_client_key_t *key, uint32_t *retry_after_s) {
+    int64_t now_us = esp_timer_get_time();
+    ratelimit_bucket_t *bucket = find_bucket(key, now_us);
+    if (bucket->tokens >= TOKEN_UNIT) {
+        bucket->tokens -= TOKEN_UNIT;
+        return true;
+    }
+
+    if (retry_after_s) {
+        // 补足一个令牌所需的时间，向上取整到秒
+        int64_t missing = TOKEN_UNIT - bucket->tokens;
+        int64_t wait_us = (missing * US_PER_MINUTE + (int64_t)CHAT_RATELIMIT_PER_MINUTE * TOKEN_UNIT - 1) /
+                          ((int64_t)CHAT_RATELIMIT_PER_MINUTE * TOKEN_UNIT);
+        *retry_after_s = (uint32_t)((wait_us + 999999) / 1000000);
+    }
+    return false;
+}
+
+/**
+ * @brief 扣除额外的令牌
+ */
+void chat_ratelimit_charge(const chat_client_key_t *key, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+    ratelimit_bucket_t *bucket = find_bucket(key, esp_timer_get_time());
+    int64_t tokens = (int64_t)bucket->tokens - (int64_t)count * TOKEN_UNIT;
+    bucket->tokens = tokens < -BUCKET_CAPACITY ? -BUCKET_CAPACITY : (int32_t)tokens;
+}
+
+#endif /* CONFIG_CHAT_RATE_LIMIT */
@@ -0,0 +1,76 @@
+#ifndef _CHAT_RATELIMIT_H_
+#define _CHAT_RATELIMIT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define CHAT_RATELIMIT_KEY_LENGTH 16  // 客户端标识长度（IPv6地址，IPv4映射为::ffff:a.b.c.d）
+#define CHAT_RATELIMIT_PROBES 4       // 哈希表每次查找最多探测的槽位数
+
+/* 限流的客户端标识 */
+typedef struct {
+    uint8_t bytes[CHAT_RATELIMIT_KEY_LENGTH];
+} chat_client_key_t;
+
+#if CONFIG_CHAT_RATE_LIMIT
+
+#define CHAT_RATELIMIT_BURST CONFIG_CHAT_RATE_LIMIT_BURST           // 令牌桶容量（允许连续发送的消息数）
+#define CHAT_RATELIMIT_PER_MINUTE CONFIG_CHAT_RATE_LIMIT_PER_MINUTE // 每分钟补充的令牌数
+#define CHAT_RATELIMIT_CLIENTS CONFIG_CHAT_RATE_LIMIT_CLIENTS       // 同时跟踪的客户端数量
+
+/**
+ * @brief 初始化限流表
+ *
+ * 清空所有令牌桶并生成新的哈希种子
+ */
+void chat_ratelimit_init(void);
+
+/**
+ * @brief 取得请求的客户端标识
+ *
+ * 使用连接的对端地址，在解析请求体之前即可得到；请求体中的uuid由客户端任意生成，不用于限流
+ *
+ * @param req HTTP请求对象
+ * @param key 输出参数，客户端标识
+ * @return ESP_OK 成功
+ * @return ESP_FAIL 无法取得对端地址
+ */
+esp_err_t chat_ratelimit_client_key(httpd_req_t *req, chat_client_key_t *key);
+
+/**
+ * @brief 为一条消息取一个令牌
+ *
+ * 固定大小的哈希表，每次最多探测CHAT_RATELIMIT_PROBES个槽位；表中没有该客户端且探测范围已满时，
+ * 替换其中最久未使用的令牌桶。只在httpd任务中调用，不加锁
+ *
+ * @param key 客户端标识
+ * @param retry_after_s 输出参数，被拒绝时客户端至少需要等待的秒数，可为NULL
+ * @return true 允许发送
+ * @return false 令牌已用完，应返回429
+ */
+bool chat_ratelimit_acquire(const chat_client_key_t *key, uint32_t *retry_after_s);
+
+/**
+ * @brief 扣除额外的令牌
+ *
+ * 批量提交在解析前只取一个令牌，解析出消息数后再扣除其余部分。
+ * 余额可以为负（最多欠一个桶的容量），之后的请求要等令牌补回后才被允许
+ *
+ * @param key 客户端标识
+ * @param count 扣除的令牌数
+ */
+void chat_ratelimit_charge(const chat_client_key_t *key, uint32_t count);
+
+#else
+
+static inline void chat_ratelimit_init(void) {}
+static inline esp_err_t chat_ratelimit_client_key(httpd_req_t *req, chat_client_key_t *key) { return ESP_FAIL; }
+static inline bool chat_ratelimit_acquire(const chat_client_key_t *key, uint32_t *retry_after_s) { return true; }
+static inline void chat_ratelimit_charge(const chat_client_key_t *key, uint32_t count) {}
+
+#endif /* CONFIG_CHAT_RATE_LIMIT */
+
+#endif /* _CHAT_RATELIMIT_H_ */
@@ -8,17 +8,44 @@
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <inttypes.h>
 #include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "esp_log.h"
 #include "esp_http_server.h"
-#include "cJSON.h"
 #include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
 #include "chat_storage.h"
 #include "chat_server.h"
+#include "chat_push.h"
+#include "chat_longpoll.h"
+#include "chat_parser.h"
+#include "chat_cbor.h"
+#include "chat_metrics.h"
+#include "chat_ratelimit.h"
+#include "chat_pool.h"
+#include "chat_power.h"
 
 static const char *CHAT_TAG = "chat-server"; // 日志标签
 
+#define POST_MAX_CONTENT_LEN 4096 // 单条提交请求体上限
+#define BATCH_MAX_CONTENT_LEN (CHAT_POOL_BUFFER_SIZE - 1) // 批量提交请求体上限，接收缓冲区从缓冲池借用
+#define ETAG_MAX_LENGTH 30 // "xxxxxxxx-4294967295-r15-c"加引号和结束符
+#define ROOM_PARAM_MAX_LENGTH (CHAT_ROOM_NAME_LENGTH + 1) // room查询参数缓冲区，多一个字节用于识别过长的房间名
+#define RECV_MAX_TIMEOUTS 2 // 接收请求体时最多连续超时的次数（每次recv_wait_timeout秒），之后放弃并关闭连接
+
+// JSON流式输出暂存缓冲区：httpd在单个任务中依次处理请求，可安全共用。
+// 开启CONFIG_SPIRAM_ALLOW_BSS_SEG_EXTERNAL_MEMORY时放在PSRAM中，为内部RAM腾出空间
+static EXT_RAM_BSS_ATTR char json_scratch[CHAT_JSON_SCRATCH_SIZE];
+
+// 单条提交的接收缓冲区，原地解析，同样只在httpd任务中使用
+static EXT_RAM_BSS_ATTR char post_body[POST_MAX_CONTENT_LEN + 1];
+
+// ETag的启动纪元：重启后未保存的消息丢失，序列号可能被重新使用，
+// 加上每次启动随机生成的前缀，避免客户端把新消息误判为未修改
+static uint32_t etag_epoch = 0;
+
 /**
  * @brief 设置CORS响应头
  *
@@ -29,10 +56,23 @@ static const char *CHAT_TAG = "chat-server"; // 日志标签
 static void set_cors_headers(httpd_req_t *req) {
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
     httpd_resp_set_hdr(req, "Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    httpd_resp_set_hdr(req, "Access-Control-Allow-Headers", "Content-Type");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Headers", "Content-Type, Accept, If-None-Match");
+    httpd_resp_set_hdr(req, "Access-Control-Expose-Headers", "ETag, Retry-After");
     httpd_resp_set_hdr(req, "Access-Control-Max-Age", "86400");
 }
 
+/**
+ * @brief 流式JSON输出的刷新回调，把暂存缓冲区作为一个HTTP分块发送
+ *
+ * @param ctx HTTP请求对象
+ * @param data 待发送数据
+ * @param len 数据长度
+ * @return ESP_OK 发送成功
+ */
+static esp_err_t send_chunk_flush(void *ctx, const char *data, size_t len) {
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
+
 /**
  * @brief 生成UUID v4
  *
@@ -66,22 +106,32 @@ static void generate_uuid(char *uuid_str) {
 /**
  * @brief 初始化聊天服务器
  *
- * 创建必要的互斥锁并从NVS加载历史聊天消息
+ * 创建必要的互斥锁并开始在后台加载历史聊天消息，不等加载完成就返回
  *
  * 实现细节：
- * 1. 初始化聊天消息存储系统
+ * 1. 预分配请求缓冲池，存储层批量写入也从中借用暂存区
+ * 2. 初始化聊天消息存储系统，历史由持久化任务加载
  *
  * @return ESP_OK 成功初始化
  * @return ESP_FAIL 初始化失败
  */
 esp_err_t chat_server_init(void) {
+    esp_err_t err = chat_pool_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(CHAT_TAG, "Failed to initialize buffer pool");
+        return err;
+    }
+
     // 初始化聊天消息存储系统
-    esp_err_t err = chat_storage_init();
+    err = chat_storage_init();
     if (err != ESP_OK) {
         ESP_LOGE(CHAT_TAG, "Failed to initialize chat storage");
         return err;
     }
 
+    etag_epoch = esp_random();
+    chat_ratelimit_init();
+
     ESP_LOGI(CHAT_TAG, "Chat server initialized successfully");
     return ESP_OK;
 }
@@ -106,17 +156,279 @@ esp_err_t chat_add_message_with_timestamp(const char *uuid, const char *username
     return chat_storage_add_message_with_timestamp(uuid, username, message, timestamp);
 }
 
+/**
+ * @brief 验证解析出的消息字段长度
+ *
+ * @param msg 解析出的消息
+ * @return true 长度合法
+ */
+static bool message_fields_valid(const chat_parsed_message_t *msg) {
+    return msg->uuid_len < MAX_UUID_LENGTH &&
+           msg->username_len < MAX_USERNAME_LENGTH &&
+           msg->message_len <= MAX_MESSAGE_LENGTH &&
+           msg->message_len > 0 &&
+           msg->client_id_len < MAX_CLIENT_ID_LENGTH;
+}
+
+/**
+ * @brief 接收完整的请求体
+ *
+ * httpd_req_recv每次可能只返回部分数据，循环直到收齐。httpd只有一个任务，
+ * 声明了Content-Length却不发送的客户端会阻塞所有请求，连续超时RECV_MAX_TIMEOUTS次后放弃
+ *
+ * @param req HTTP请求对象
+ * @param buf 接收缓冲区，至少content_len + 1字节，结果以'\0'结尾
+ * @return ESP_OK 接收成功
+ * @return ESP_ERR_TIMEOUT 客户端停止发送
+ * @return ESP_FAIL 连接出错或被关闭
+ */
+static esp_err_t recv_body(httpd_req_t *req, char *buf) {
+    size_t received = 0;
+    int timeouts = 0;
+    while (received < req->content_len) {
+        int ret = httpd_req_recv(req, buf + received, req->content_len - received);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            if (++timeouts >= RECV_MAX_TIMEOUTS) {
+                ESP_LOGW(CHAT_TAG, "Request body timed out after %u of %u bytes",
+                         (unsigned)received, (unsigned)req->content_len);
+                return ESP_ERR_TIMEOUT;
+            }
+            continue;
+        }
+        if (ret <= 0) {
+            return ESP_FAIL;
+        }
+        timeouts = 0;
+        received += ret;
+    }
+    buf[received] = '\0';
+    return ESP_OK;
+}
+
+/**
+ * @brief 请求体接收失败时回复错误
+ *
+ * 返回ESP_FAIL后httpd关闭连接，超时的客户端不再占用套接字
+ *
+ * @param req HTTP请求对象
+ * @param err recv_body的返回值
+ * @return esp_err_t ESP_FAIL
+ */
+static esp_err_t send_recv_error(httpd_req_t *req, esp_err_t err) {
+    if (err == ESP_ERR_TIMEOUT) {
+        httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Request body timed out");
+    } else {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to receive data");
+    }
+    return ESP_FAIL;
+}
+
+/**
+ * @brief 请求头是否包含指定的媒体类型
+ *
+ * 只做子串匹配，不解析q值；客户端明确列出CBOR即视为优先使用
+ *
+ * @param req HTTP请求对象
+ * @param field 请求头名称
+ * @param mime 媒体类型
+ * @return true 包含该媒体类型
+ */
+static bool header_has_mime(httpd_req_t *req, const char *field, const char *mime) {
+    char value[96];
+    size_t len = httpd_req_get_hdr_value_len(req, field);
+    if (len == 0 || len >= sizeof(value) ||
+        httpd_req_get_hdr_value_str(req, field, value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    return strstr(value, mime) != NULL;
+}
+
+/**
+ * @brief 按Accept头协商消息列表的响应格式
+ *
+ * @param req HTTP请求对象
+ * @return chat_format_t 客户端接受CBOR时为CHAT_FORMAT_CBOR，否则为JSON
+ */
+static chat_format_t negotiate_format(httpd_req_t *req) {
+    return header_has_mime(req, "Accept", CHAT_CBOR_MIME) ? CHAT_FORMAT_CBOR : CHAT_FORMAT_JSON;
+}
+
+/**
+ * @brief 验证CBOR解析出的消息字段长度
+ *
+ * @param msg 解析出的消息
+ * @return true 长度合法
+ */
+static bool cbor_message_fields_valid(const chat_cbor_message_t *msg) {
+    return (msg->fields.uuid_bin != NULL || msg->uuid_len < MAX_UUID_LENGTH) &&
+           msg->username_len < MAX_USERNAME_LENGTH &&
+           msg->message_len <= MAX_MESSAGE_LENGTH &&
+           msg->message_len > 0 &&
+           msg->client_id_len < MAX_CLIENT_ID_LENGTH;
+}
+
+/**
+ * @brief 解析单条提交的请求体
+ *
+ * Content-Type为application/cbor时按CBOR消息映射解析，否则按JSON解析，都在缓冲区中原地进行
+ *
+ * @param req HTTP请求对象
+ * @param body 请求体，以'\0'结尾
+ * @param len 请求体长度
+ * @param input 输出参数，解析出的消息，字符串指向请求体
+ * @return ESP_OK 解析成功
+ * @return ESP_ERR_INVALID_ARG 请求体格式错误
+ * @return ESP_ERR_NOT_FOUND 缺少字段或字段长度不合法
+ */
+static esp_err_t parse_post_body(httpd_req_t *req, char *body, size_t len, chat_message_input_t *input) {
+    esp_err_t err;
+    if (header_has_mime(req, "Content-Type", CHAT_CBOR_MIME)) {
+        chat_cbor_parser_t parser;
+        chat_cbor_message_t parsed;
+        chat_cbor_parser_init(&parser, (uint8_t *)body, len);
+        err = chat_cbor_parse_message(&parser, &parsed);
+        if (err == ESP_OK) {
+            err = chat_cbor_finish(&parser);
+        }
+        if (err == ESP_OK && !cbor_message_fields_valid(&parsed)) {
+            err = ESP_ERR_NOT_FOUND;
+        }
+        *input = parsed.fields;
+        return err;
+    }
+
+    chat_parser_t parser;
+    chat_parsed_message_t parsed;
+    chat_parser_init(&parser, body, len);
+    err = chat_parser_message(&parser, &parsed);
+    if (err == ESP_OK) {
+        err = chat_parser_finish(&parser);
+    }
+    if (err == ESP_OK && !message_fields_valid(&parsed)) {
+        err = ESP_ERR_NOT_FOUND;
+    }
+    *input = parsed.fields;
+    return err;
+}
+
+/**
+ * @brief 从查询参数中取出房间名
+ *
+ * @param query URL查询字符串
+ * @param name 输出参数，房间名，没有room参数时为空字符串
+ * @return ESP_OK 成功
+ * @return ESP_ERR_INVALID_ARG 房间名过长
+ */
+static esp_err_t query_room_name(const char *query, char name[ROOM_PARAM_MAX_LENGTH]) {
+    name[0] = '\0';
+    esp_err_t err = httpd_query_key_value(query, "room", name, ROOM_PARAM_MAX_LENGTH);
+    if (err == ESP_ERR_NOT_FOUND) {
+        name[0] = '\0';
+        return ESP_OK;
+    }
+    return err == ESP_OK && strlen(name) < CHAT_ROOM_NAME_LENGTH ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/**
+ * @brief 从提交请求的URL中解析房间，不存在时创建，出错时返回错误响应
+ *
+ * @param req HTTP请求对象
+ * @param room 输出参数，房间编号，没有room参数时为默认房间
+ * @return true 已返回错误响应，处理函数应直接结束
+ */
+static bool reject_bad_post_room(httpd_req_t *req, int *room) {
+    char query[64];
+    char name[ROOM_PARAM_MAX_LENGTH] = "";
+    esp_err_t err = ESP_OK;
+    if (httpd_req_get_url_query_len(req) > 0 &&
+        (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+         query_room_name(query, name) != ESP_OK)) {
+        err = ESP_ERR_INVALID_ARG;
+    }
+    if (err == ESP_OK) {
+        err = chat_storage_find_room(name, true, room);
+    }
+
+    if (err == ESP_OK) {
+        return false;
+    }
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                        err == ESP_ERR_NO_MEM ? "Room limit reached" : "Invalid room name");
+    return true;
+}
+
+/**
+ * @brief 检查客户端是否还有发送消息的令牌，没有时返回429
+ *
+ * 在接收和解析请求体之前调用，被拒绝的请求只花一次哈希表查找；
+ * 未读取的请求体由httpd在请求结束时丢弃，连接保持可用
+ *
+ * @param req HTTP请求对象
+ * @param key 输出参数，客户端标识，批量提交用来扣除其余令牌
+ * @param tracked 输出参数，是否取得了客户端标识（取不到对端地址时不限流）
+ * @return true 已返回429，处理函数应直接结束
+ */
+static bool reject_if_rate_limited(httpd_req_t *req, chat_client_key_t *key, bool *tracked) {
+    uint32_t retry_after_s = 0;
+    *tracked = chat_ratelimit_client_key(req, key) == ESP_OK;
+    if (!*tracked || chat_ratelimit_acquire(key, &retry_after_s)) {
+        return false;
+    }
+
+    char retry_after[12];
+    snprintf(retry_after, sizeof(retry_after), "%" PRIu32, retry_after_s);
+    httpd_resp_set_status(req, "429 Too Many Requests");
+    httpd_resp_set_hdr(req, "Retry-After", retry_after);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"status\":\"error\",\"error\":\"Too many messages\"}");
+    chat_metrics_record_rate_limited();
+    return true;
+}
+
+/**
+ * @brief 缓冲池已用完时返回503
+ *
+ * 并发的大请求超过预分配的缓冲区数量时让客户端稍后重试，而不是临时分配堆内存
+ *
+ * @param req HTTP请求对象
+ */
+static void send_server_busy(httpd_req_t *req) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"status\":\"error\",\"error\":\"Server busy\"}");
+}
+
+/**
+ * @brief 启动后历史还在加载时返回503
+ *
+ * 历史由存储层在后台加载，HTTP服务器不等它完成就开始接受连接；
+ * 加载期间读到的只是部分历史，写入会与回放的序列号冲突，所以让客户端稍后重试。
+ * 不设置CORS头：处理函数中的调用者已经设置过，重复设置会占满响应头的数量上限
+ *
+ * @param req HTTP请求对象，调用者已设置CORS头
+ */
+static void send_history_warming(httpd_req_t *req) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"status\":\"warming\",\"error\":\"Loading history\"}");
+}
+
 /**
  * @brief 处理新聊天消息的POST请求
  *
- * 接收JSON格式的聊天消息，验证后存储到内存和NVS
+ * 接收JSON或CBOR（Content-Type: application/cbor）格式的聊天消息，验证后存储到内存和NVS。
+ * 请求体收到静态缓冲区中原地解析，整个过程不分配堆内存。
+ * 超过客户端发送速率的请求在接收请求体之前返回429。
+ * 带client_id时响应为{"status":"success","seq":N}，客户端重试同一client_id得到相同的seq
  *
  * @param req HTTP请求对象，包含消息内容和客户端信息
  * @return ESP_OK 处理成功
  * @return ESP_FAIL 处理失败
  *
  * 功能说明：
- * 1. 验证请求内容长度和JSON格式
+ * 1. 检查发送速率，验证请求内容长度和JSON格式
  * 2. 检查必填字段(uuid, username, message)和长度限制
  * 3. 调用存储模块添加消息
  * 4. 返回适当的HTTP状态码和响应
@@ -125,106 +437,237 @@ static esp_err_t post_message_handler(httpd_req_t *req) {
     // 设置CORS头
     set_cors_headers(req);
 
+    chat_client_key_t client;
+    bool client_tracked;
+    if (reject_if_rate_limited(req, &client, &client_tracked)) {
+        return ESP_OK;
+    }
+
     // 检查内容长度是否超过限制
-    if (req->content_len > 4096) {
+    if (req->content_len > POST_MAX_CONTENT_LEN) {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Content too large");
         return ESP_FAIL;
     }
 
-    // 一次性分配接收缓冲区
-    char *buf = malloc(req->content_len + 1);
-    if (!buf) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No memory");
-        return ESP_FAIL;
+    esp_err_t recv_err = recv_body(req, post_body);
+    if (recv_err != ESP_OK) {
+        return send_recv_error(req, recv_err);
     }
 
-    // 一次性接收数据
-    int total_received = httpd_req_recv(req, buf, req->content_len);
-    if (total_received != req->content_len) {
-        free(buf);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to receive data");
+    // 原地解析并验证必要字段
+    chat_message_input_t parsed;
+    esp_err_t err = parse_post_body(req, post_body, req->content_len, &parsed);
+    if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
         return ESP_FAIL;
     }
-    buf[req->content_len] = '\0';
-
-    // 解析JSON
-    cJSON *root = cJSON_Parse(buf);
-    free(buf); // 立即释放接收缓冲区，减少内存占用时间
-
-    if (!root) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid message format or field length");
         return ESP_FAIL;
     }
+    const chat_message_input_t *input = &parsed;
 
-    // 提取并验证必要字段
-    const char *uuid = NULL;
-    const char *username = NULL;
-    const char *message = NULL;
-    uint32_t timestamp = 0;
-    bool is_valid = true;
-
-    cJSON *uuid_obj = cJSON_GetObjectItem(root, "uuid");
-    cJSON *username_obj = cJSON_GetObjectItem(root, "username");
-    cJSON *message_obj = cJSON_GetObjectItem(root, "message");
-    cJSON *timestamp_obj = cJSON_GetObjectItem(root, "timestamp");
-
-    if (uuid_obj && cJSON_IsString(uuid_obj)) {
-        uuid = uuid_obj->valuestring;
-    } else {
-        is_valid = false;
+    // URL中的room参数指定房间，不存在时创建
+    int room = CHAT_ROOM_LOBBY;
+    if (reject_bad_post_room(req, &room)) {
+        return ESP_FAIL;
     }
 
-    if (username_obj && cJSON_IsString(username_obj)) {
-        username = username_obj->valuestring;
+    // 添加消息到存储
+    chat_add_result_t result = { .err = ESP_OK };
+    bool has_result = input->uuid_bin != NULL || room != CHAT_ROOM_LOBBY || input->client_id != NULL;
+    if (has_result) {
+        // CBOR提交的二进制UUID不经过文本形式，直接写入；其他房间和带client_id的消息同样按批量接口写入
+        err = chat_storage_add_room_messages(room, input, 1, &result);
+        if (err == ESP_OK) {
+            err = result.err;
+        }
+    } else if (input->timestamp > 0) {
+        // 使用客户端提供的时间戳
+        err = chat_storage_add_message_with_timestamp(input->uuid, input->username, input->message, input->timestamp);
+        ESP_LOGI(CHAT_TAG, "使用客户端时间戳: %" PRIu32, input->timestamp);
     } else {
-        is_valid = false;
+        // 使用服务器时间戳
+        err = chat_storage_add_message(input->uuid, input->username, input->message);
+        ESP_LOGI(CHAT_TAG, "使用服务器时间戳");
     }
 
-    if (message_obj && cJSON_IsString(message_obj)) {
-        message = message_obj->valuestring;
+    if (err == ESP_OK && has_result) {
+        // 重试与第一次提交得到相同的响应，另外标记duplicate
+        char body[64];
+        snprintf(body, sizeof(body), "{\"status\":\"success\",\"seq\":%" PRIu32 "%s}", result.seq,
+                 result.duplicate ? ",\"duplicate\":true" : "");
+        if (result.duplicate) {
+            chat_metrics_record_duplicate();
+        }
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_set_status(req, "201 Created");
+        httpd_resp_sendstr(req, body);
+    } else if (err == ESP_OK) {
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_set_status(req, "201 Created");
+        httpd_resp_sendstr(req, "{\"status\":\"success\"}");
+    } else if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid uuid format");
+    } else if (err == ESP_ERR_TIMEOUT) {
+        send_server_busy(req);
+    } else if (err == ESP_ERR_INVALID_STATE) {
+        send_history_warming(req);
     } else {
-        is_valid = false;
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to add message");
     }
 
-    // 时间戳是可选的
-    if (timestamp_obj && cJSON_IsNumber(timestamp_obj)) {
-        timestamp = (uint32_t)timestamp_obj->valueint;
-    }
+    return ESP_OK;
+}
 
-    // 验证字段有效性和长度
-    if (!is_valid || !uuid || !username || !message ||
-        strlen(uuid) >= MAX_UUID_LENGTH ||
-        strlen(username) >= 32 ||
-        strlen(message) > MAX_MESSAGE_LENGTH ||
-        strlen(message) == 0) {
+/**
+ * @brief 处理批量提交消息的POST请求
+ *
+ * 请求体为消息对象数组（或{"messages":[...]}），格式与单条提交相同。
+ * 所有有效消息在一次持锁中写入存储，只唤醒一次持久化任务。
+ * 请求体收到从缓冲池借用的缓冲区中，缓冲区都已借出时返回503
+ *
+ * 响应: {"results":[{"status":"success","seq":N},{"status":"error","error":"..."}],"accepted":N}，
+ * results与请求中的消息一一对应；与之前提交的client_id重复的消息带"duplicate":true，seq为第一次的序列号
+ *
+ * @param req HTTP请求对象
+ * @return ESP_OK 处理成功
+ * @return ESP_FAIL 请求格式错误或处理失败
+ */
+static esp_err_t post_messages_batch_handler(httpd_req_t *req) {
+    set_cors_headers(req);
 
-        cJSON_Delete(root);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid message format or field length");
+    // 解析前先取一个令牌，解析出消息数后再扣除其余部分
+    chat_client_key_t client;
+    bool client_tracked;
+    if (reject_if_rate_limited(req, &client, &client_tracked)) {
+        return ESP_OK;
+    }
+
+    if (req->content_len == 0 || req->content_len > BATCH_MAX_CONTENT_LEN) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Content too large");
         return ESP_FAIL;
     }
 
-    // 添加消息到存储
+    char *buf = chat_pool_acquire();
+    if (!buf) {
+        send_server_busy(req);
+        return ESP_OK;
+    }
+    esp_err_t recv_err = recv_body(req, buf);
+    if (recv_err != ESP_OK) {
+        chat_pool_release(buf);
+        return send_recv_error(req, recv_err);
+    }
+
+    // 原地解析，格式不正确的消息不传给存储层，保留各自的错误信息
+    chat_message_input_t inputs[CHAT_MAX_BATCH_MESSAGES];
+    chat_add_result_t results[CHAT_MAX_BATCH_MESSAGES];
+    bool well_formed[CHAT_MAX_BATCH_MESSAGES];
+    int count = 0;
     esp_err_t err;
-    if (timestamp > 0) {
-        // 使用客户端提供的时间戳
-        err = chat_storage_add_message_with_timestamp(uuid, username, message, timestamp);
-        ESP_LOGI(CHAT_TAG, "使用客户端时间戳: %" PRIu32, timestamp);
+    if (header_has_mime(req, "Content-Type", CHAT_CBOR_MIME)) {
+        chat_cbor_parser_t parser;
+        chat_cbor_parser_init(&parser, (uint8_t *)buf, req->content_len);
+        while ((err = chat_cbor_next_item(&parser)) == ESP_OK && count < CHAT_MAX_BATCH_MESSAGES) {
+            chat_cbor_message_t parsed;
+            err = chat_cbor_parse_message(&parser, &parsed);
+            if (err == ESP_ERR_INVALID_ARG) {
+                break;
+            }
+            well_formed[count] = err == ESP_OK && cbor_message_fields_valid(&parsed);
+            if (well_formed[count]) {
+                inputs[count] = parsed.fields;
+            } else {
+                memset(&inputs[count], 0, sizeof(inputs[count]));
+            }
+            count++;
+        }
     } else {
-        // 使用服务器时间戳
-        err = chat_storage_add_message(uuid, username, message);
-        ESP_LOGI(CHAT_TAG, "使用服务器时间戳");
+        chat_parser_t parser;
+        chat_parser_init(&parser, buf, req->content_len);
+        while ((err = chat_parser_next_item(&parser)) == ESP_OK && count < CHAT_MAX_BATCH_MESSAGES) {
+            chat_parsed_message_t parsed;
+            err = chat_parser_message(&parser, &parsed);
+            if (err == ESP_ERR_INVALID_ARG) {
+                break;
+            }
+            well_formed[count] = err == ESP_OK && message_fields_valid(&parsed);
+            if (well_formed[count]) {
+                inputs[count] = parsed.fields;
+            } else {
+                memset(&inputs[count], 0, sizeof(inputs[count]));
+            }
+            count++;
+        }
+    }
+    if (err == ESP_ERR_INVALID_ARG) {
+        chat_pool_release(buf);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+    if (err == ESP_OK || count == 0) {
+        // 还有未读取的元素（超出上限）或数组为空
+        chat_pool_release(buf);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid batch size");
+        return ESP_FAIL;
+    }
+
+    int room = CHAT_ROOM_LOBBY;
+    if (reject_bad_post_room(req, &room)) {
+        chat_pool_release(buf);
+        return ESP_FAIL;
     }
 
-    cJSON_Delete(root);
+    if (client_tracked) {
+        chat_ratelimit_charge(&client, (uint32_t)(count - 1));
+    }
+    err = chat_storage_add_room_messages(room, inputs, count, results);
+    chat_pool_release(buf);
+    if (err == ESP_ERR_TIMEOUT) {
+        send_server_busy(req);
+        return ESP_OK;
+    }
+    if (err == ESP_ERR_INVALID_STATE) {
+        send_history_warming(req);
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to add messages");
+        return ESP_FAIL;
+    }
 
-    if (err == ESP_OK) {
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_set_status(req, "201 Created");
-        httpd_resp_sendstr(req, "{\"status\":\"success\"}");
-    } else {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to add message");
+    // 每条结果不超过约70字节，整个响应放得下暂存缓冲区
+    chat_json_writer_t writer;
+    chat_json_writer_init(&writer, json_scratch, sizeof(json_scratch), NULL, NULL);
+    int accepted = 0;
+    chat_json_write_str(&writer, "{\"results\":[");
+    for (int i = 0; i < count; i++) {
+        if (i > 0) {
+            chat_json_write_raw(&writer, ",", 1);
+        }
+        if (results[i].err == ESP_OK) {
+            chat_json_write_str(&writer, "{\"status\":\"success\",\"seq\":");
+            chat_json_write_u32(&writer, results[i].seq);
+            if (results[i].duplicate) {
+                chat_json_write_str(&writer, ",\"duplicate\":true");
+                chat_metrics_record_duplicate();
+            }
+            chat_json_write_raw(&writer, "}", 1);
+            accepted++;
+        } else {
+            chat_json_write_str(&writer, well_formed[i]
+                ? "{\"status\":\"error\",\"error\":\"Invalid uuid format\"}"
+                : "{\"status\":\"error\",\"error\":\"Invalid message format or field length\"}");
+        }
     }
+    chat_json_write_str(&writer, "],\"accepted\":");
+    chat_json_write_u32(&writer, accepted);
+    chat_json_write_raw(&writer, "}", 1);
 
+    ESP_LOGI(CHAT_TAG, "Batch of %d messages, %d accepted", count, accepted);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json_scratch, writer.len);
     return ESP_OK;
 }
 
@@ -255,6 +698,105 @@ static esp_err_t generate_uuid_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+/**
+ * @brief 请求的If-None-Match是否包含指定ETag
+ *
+ * @param req HTTP请求对象
+ * @param etag 带引号的ETag
+ * @return true 客户端缓存的响应仍然有效
+ */
+static bool etag_matches(httpd_req_t *req, const char *etag) {
+    char value[64];
+    size_t len = httpd_req_get_hdr_value_len(req, "If-None-Match");
+    if (len == 0 || len >= sizeof(value) ||
+        httpd_req_get_hdr_value_str(req, "If-None-Match", value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    // 可能是逗号分隔的列表或带W/前缀的弱校验值
+    return strstr(value, etag) != NULL;
+}
+
+/**
+ * @brief 发送消息轮询响应
+ *
+ * 响应带ETag，客户端通过If-None-Match重新验证，没有新消息时返回无响应体的304。
+ * 两种格式的ETag不同，并带Vary: Accept，避免中间缓存把CBOR响应返回给JSON客户端
+ *
+ * @param req HTTP请求对象（可以是异步请求）
+ * @param query 查询参数
+ * @param scratch JSON暂存缓冲区，调用者所在任务独占
+ * @param scratch_size 暂存缓冲区大小
+ * @return ESP_OK 处理成功
+ * @return ESP_FAIL 分块响应中途失败
+ */
+static esp_err_t send_messages_response(httpd_req_t *req, const chat_messages_query_t *query,
+                                        char *scratch, size_t scratch_size) {
+    // 设置CORS头，允许跨域访问
+    set_cors_headers(req);
+
+    // 同一游标（分页时为同一页）的响应只取决于房间的最新序列号，ETag不变时直接返回304，不访问任何消息。
+    // 先读取序列号再生成响应，期间若有新消息，ETag只会比响应内容旧，下次轮询照常返回新内容。
+    // 各房间的序列号独立编号，默认房间以外的ETag带房间编号
+    bool cbor = query->format == CHAT_FORMAT_CBOR;
+    char etag[ETAG_MAX_LENGTH];
+    char room_suffix[8] = "";
+    if (query->room != CHAT_ROOM_LOBBY) {
+        snprintf(room_suffix, sizeof(room_suffix), "-r%d", query->room);
+    }
+    snprintf(etag, sizeof(etag), "\"%08" PRIx32 "-%" PRIu32 "%s%s\"", etag_epoch,
+             chat_storage_get_room_last_seq(query->room), room_suffix, cbor ? "-c" : "");
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+    if (etag_matches(req, etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
+
+    // 获取匹配消息，直接从存储流式输出到HTTP分块响应
+    httpd_resp_set_type(req, cbor ? CHAT_CBOR_MIME : "application/json");
+    int64_t start = esp_timer_get_time();
+    bool has_new_messages = false;
+    chat_json_writer_t writer;
+    chat_json_writer_init(&writer, scratch, scratch_size, send_chunk_flush, req);
+
+    esp_err_t err = chat_storage_write_messages(query, &writer, &has_new_messages);
+    if (err == ESP_OK) {
+        err = chat_json_flush(&writer);
+    }
+
+    if (err == ESP_OK) {
+        // 发送空块表示响应结束
+        httpd_resp_send_chunk(req, NULL, 0);
+        chat_metrics_record_serialize(esp_timer_get_time() - start, writer.total);
+        return ESP_OK;
+    }
+
+    if (writer.total > 0) {
+        // 分块响应已经开始发送，无法再返回错误对象，只能中止连接
+        ESP_LOGE(CHAT_TAG, "Failed while streaming messages: %s", esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+
+    // 尚未发送任何数据，返回带错误信息的空消息列表；CBOR客户端不解析JSON错误对象，直接返回500
+    if (cbor) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to retrieve messages");
+        return ESP_OK;
+    }
+    httpd_resp_sendstr(req, "{\"messages\":[],\"has_new_messages\":false,\"error\":\"Failed to retrieve messages\"}");
+
+    return ESP_OK;
+}
+
+/**
+ * @brief 发送消息轮询响应
+ */
+esp_err_t chat_server_send_messages(httpd_req_t *req, const chat_messages_query_t *query,
+                                    char *scratch, size_t scratch_size) {
+    return send_messages_response(req, query, scratch, scratch_size);
+}
+
 /**
  * @brief 获取特定时间戳后的消息
  *
@@ -262,51 +804,151 @@ static esp_err_t generate_uuid_handler(httpd_req_t *req) {
  * @return ESP_OK 处理成功
  * @return ESP_FAIL 处理失败
  *
- * 该函数处理客户端的轮询请求，返回指定时间戳之后的所有消息
- * 客户端通过查询参数since_timestamp指定时间戳
+ * 该函数处理客户端的轮询请求，返回客户端游标之后的所有消息
+ * 客户端优先通过查询参数since_seq指定已收到的最新序列号；
+ * 兼容旧客户端的since_timestamp（按时间戳过滤）。
+ * 带wait_ms参数且没有新消息时转为长轮询，新消息到达或超时后再响应。
+ * 带before或limit参数时返回序列号小于before的最新limit条消息（分页加载历史），
+ * before省略或为0时返回最新的一页；before/limit与since_seq或since_timestamp同时出现时返回400。
+ * 带room参数时查询该房间（游标按房间独立编号），房间不存在时返回404。
+ * Accept包含application/cbor时以CBOR返回同样结构的响应
  */
 static esp_err_t get_messages_since_handler(httpd_req_t *req) {
-    // 设置CORS头，允许跨域访问
-    set_cors_headers(req);
-
-    // 获取since_timestamp查询参数
-    uint32_t since_timestamp = 0;
-    char param[32];
+    // 获取since_seq / since_timestamp / wait_ms / before / limit / room查询参数
+    chat_messages_query_t query = {
+        .mode = CHAT_QUERY_SINCE_TIMESTAMP,
+        .limit = CHAT_PAGE_MAX_MESSAGES,
+        .format = negotiate_format(req),
+        .room = CHAT_ROOM_LOBBY,
+    };
+    uint32_t wait_ms = 0;
+    char param[128];
+    char room_name[ROOM_PARAM_MAX_LENGTH] = "";
 
     // 如果URL有查询参数
     if (httpd_req_get_url_query_len(req) > 0) {
         if (httpd_req_get_url_query_str(req, param, sizeof(param)) == ESP_OK) {
-            // 直接提取since_timestamp参数
             char value[16];
-            if (httpd_query_key_value(param, "since_timestamp", value, sizeof(value)) == ESP_OK) {
-                since_timestamp = (uint32_t)atoi(value);
+            bool has_before = httpd_query_key_value(param, "before", value, sizeof(value)) == ESP_OK;
+            if (has_before) {
+                query.seq = (uint32_t)strtoul(value, NULL, 10);
+            }
+            if (httpd_query_key_value(param, "limit", value, sizeof(value)) == ESP_OK) {
+                long limit = strtol(value, NULL, 10);
+                query.limit = limit < 1 ? 1 : (limit > CHAT_PAGE_MAX_MESSAGES ? CHAT_PAGE_MAX_MESSAGES : (int)limit);
+                has_before = true;
+            }
+
+            bool has_since = httpd_query_key_value(param, "since_seq", value, sizeof(value)) == ESP_OK ||
+                             httpd_query_key_value(param, "since_timestamp", value, sizeof(value)) == ESP_OK;
+            if (has_before && has_since) {
+                // 分页向前读取，轮询游标向后读取，两者同时出现时无法确定返回哪一段
+                set_cors_headers(req);
+                httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "before/limit cannot be combined with since_seq or since_timestamp");
+                return ESP_OK;
+            }
+
+            if (has_before) {
+                query.mode = CHAT_QUERY_BEFORE_SEQ;
+            } else if (httpd_query_key_value(param, "since_seq", value, sizeof(value)) == ESP_OK) {
+                query.seq = (uint32_t)strtoul(value, NULL, 10);
+                query.mode = CHAT_QUERY_SINCE_SEQ;
+            } else if (httpd_query_key_value(param, "since_timestamp", value, sizeof(value)) == ESP_OK) {
+                query.since_timestamp = (uint32_t)atoi(value);
+            }
+            if (httpd_query_key_value(param, "wait_ms", value, sizeof(value)) == ESP_OK) {
+                wait_ms = (uint32_t)strtoul(value, NULL, 10);
+            }
+            if (query_room_name(param, room_name) != ESP_OK) {
+                set_cors_headers(req);
+                httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid room name");
+                return ESP_OK;
             }
         }
     }
 
-    // 获取匹配消息
-    bool has_new_messages = false;
-    char *json_str = chat_storage_get_messages_since_json(since_timestamp, &has_new_messages);
+    // 轮询不创建房间
+    if (chat_storage_find_room(room_name, false, &query.room) != ESP_OK) {
+        set_cors_headers(req);
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Room not found");
+        return ESP_OK;
+    }
 
-    if (json_str) {
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_sendstr(req, json_str);
-        free(json_str);
+    // 客户端已是最新时挂起请求；挂起失败（如等待队列已满）按普通轮询立即返回
+    if (query.mode == CHAT_QUERY_SINCE_SEQ && wait_ms > 0 &&
+        query.seq == chat_storage_get_room_last_seq(query.room) &&
+        chat_longpoll_park(req, &query, wait_ms) == ESP_OK) {
         return ESP_OK;
     }
 
-    // 如果获取消息失败，返回空JSON对象
-    httpd_resp_set_type(req, "application/json");
-    char error_response[128];
-    snprintf(error_response, sizeof(error_response),
-             "{\"messages\":[],"
-             "\"has_new_messages\":false,"
-             "\"error\":\"Failed to retrieve messages\"}");
-    httpd_resp_sendstr(req, error_response);
+    return send_messages_response(req, &query, json_scratch, sizeof(json_scratch));
+}
 
+/**
+ * @brief 获取房间列表
+ *
+ * 响应: {"rooms":[{"name":"lobby","last_seq":N,"count":N},...]}，第一项总是默认房间。
+ * 房间在第一次向其提交消息时创建
+ *
+ * @param req HTTP请求对象
+ * @return ESP_OK 处理成功
+ */
+static esp_err_t get_rooms_handler(httpd_req_t *req) {
+    set_cors_headers(req);
+
+    // 每个房间约60字节，整个列表放得下暂存缓冲区
+    chat_json_writer_t writer;
+    chat_json_writer_init(&writer, json_scratch, sizeof(json_scratch), NULL, NULL);
+    if (chat_storage_write_rooms_json(&writer) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to list rooms");
+        return ESP_OK;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_send(req, json_scratch, writer.len);
     return ESP_OK;
 }
 
+/* 统计耗时的处理函数，作为user_ctx传给metered_handler */
+typedef struct {
+    esp_err_t (*handler)(httpd_req_t *req); // 实际的处理函数
+    chat_metric_endpoint_t endpoint;        // 指标中的接口
+} metered_handler_t;
+
+static const metered_handler_t get_messages_metered = { get_messages_since_handler, CHAT_METRIC_GET_MESSAGES };
+static const metered_handler_t post_message_metered = { post_message_handler, CHAT_METRIC_POST_MESSAGE };
+static const metered_handler_t post_batch_metered = { post_messages_batch_handler, CHAT_METRIC_POST_BATCH };
+static const metered_handler_t generate_uuid_metered = { generate_uuid_handler, CHAT_METRIC_GET_UUID };
+static const metered_handler_t get_rooms_metered = { get_rooms_handler, CHAT_METRIC_GET_ROOMS };
+
+/**
+ * @brief 调用实际的处理函数并记录耗时
+ *
+ * 记录的是占用httpd任务的时间；转为长轮询的请求只计到挂起为止。
+ * 历史还在后台加载时，除UUID外的接口直接返回503
+ *
+ * @param req HTTP请求对象，user_ctx为metered_handler_t
+ * @return 实际处理函数的返回值
+ */
+static esp_err_t metered_handler(httpd_req_t *req) {
+    const metered_handler_t *metered = req->user_ctx;
+    // 轮询不算交互，挂着不动的页面不会阻止进入空闲档
+    chat_power_note_request(metered->endpoint != CHAT_METRIC_GET_MESSAGES);
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = ESP_OK;
+    if (metered->endpoint != CHAT_METRIC_GET_UUID && !chat_storage_history_ready()) {
+        // 除UUID外的接口都要读写历史；实际处理函数没有运行，CORS头在这里设置，
+        // 跨域的客户端才能读到Retry-After并重试
+        set_cors_headers(req);
+        send_history_warming(req);
+    } else {
+        err = metered->handler(req);
+    }
+    chat_metrics_record_request(metered->endpoint, esp_timer_get_time() - start);
+    return err;
+}
+
 /**
  * @brief 注册聊天服务器的URI处理函数
  *
@@ -315,8 +957,13 @@ static esp_err_t get_messages_since_handler(httpd_req_t *req) {
  * 注册的处理函数包括：
  * 1. OPTIONS请求处理函数 - 支持CORS预检请求
  * 2. 轮询API接口 - 实现客户端获取新消息
- * 3. 消息提交接口 - 处理新消息的添加
+ * 3. 消息提交接口 - 处理新消息的添加（单条和批量）
  * 4. UUID生成接口 - 为新用户生成唯一标识符
+ * 5. 房间列表接口 - 列出已创建的房间
+ * 6. WebSocket推送接口 - 新消息实时推送（轮询作为后备）
+ * 7. 长轮询 - 轮询接口带wait_ms参数时挂起等待新消息
+ *
+ * 轮询、提交、UUID和房间接口经metered_handler记录请求数和耗时
  *
  * @param server HTTP服务器句柄
  * @return ESP_OK 注册成功
@@ -336,8 +983,8 @@ esp_err_t register_chat_uri_handlers(httpd_handle_t server) {
     httpd_uri_t get_messages_since_uri = {
         .uri = "/api/chat/messages",
         .method = HTTP_GET,
-        .handler = get_messages_since_handler,
-        .user_ctx = NULL
+        .handler = metered_handler,
+        .user_ctx = (void *)&get_messages_metered
     };
     httpd_register_uri_handler(server, &get_messages_since_uri);
 
@@ -345,19 +992,43 @@ esp_err_t register_chat_uri_handlers(httpd_handle_t server) {
     httpd_uri_t post_message_uri = {
         .uri = "/api/chat/message",
         .method = HTTP_POST,
-        .handler = post_message_handler,
-        .user_ctx = NULL
+        .handler = metered_handler,
+        .user_ctx = (void *)&post_message_metered
     };
     httpd_register_uri_handler(server, &post_message_uri);
 
+    // 批量提交消息 - 客户端重连后一次提交离线期间积压的消息
+    httpd_uri_t post_messages_batch_uri = {
+        .uri = "/api/chat/messages:batch",
+        .method = HTTP_POST,
+        .handler = metered_handler,
+        .user_ctx = (void *)&post_batch_metered
+    };
+    httpd_register_uri_handler(server, &post_messages_batch_uri);
+
     // Handler for generating UUID - 用于为新用户生成唯一标识符
     httpd_uri_t generate_uuid_uri = {
         .uri = "/api/chat/uuid",
         .method = HTTP_GET,
-        .handler = generate_uuid_handler,
-        .user_ctx = NULL
+        .handler = metered_handler,
+        .user_ctx = (void *)&generate_uuid_metered
     };
     httpd_register_uri_handler(server, &generate_uuid_uri);
 
+    // 房间列表 - 客户端切换房间前查询已有的房间
+    httpd_uri_t get_rooms_uri = {
+        .uri = "/api/chat/rooms",
+        .method = HTTP_GET,
+        .handler = metered_handler,
+        .user_ctx = (void *)&get_rooms_metered
+    };
+    httpd_register_uri_handler(server, &get_rooms_uri);
+
+    // WebSocket和SSE推送通道 - 新消息主动推送给客户端，未启用时客户端退回轮询
+    chat_push_init(server);
+
+    // 长轮询 - WebSocket不可用时客户端通过wait_ms等待新消息
+    chat_longpoll_init();
+
     return ESP_OK;
 }
\ No newline at end of file
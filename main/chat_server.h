@@ -1,13 +1,16 @@
 #ifndef _CHAT_SERVER_H_
 #define _CHAT_SERVER_H_
 
+#include <stddef.h>
+#include <stdint.h>
 #include "esp_err.h"
 #include "esp_http_server.h"
+#include "chat_storage.h"
 
 /**
  * @brief 初始化聊天服务器
  *
- * 创建必要的互斥锁并从NVS加载历史聊天消息
+ * 创建必要的互斥锁，历史聊天消息在后台加载；加载完成前聊天接口返回503，见chat_storage_history_ready
  *
  * @return ESP_OK 成功初始化
  * @return ESP_FAIL 初始化失败
@@ -36,4 +39,20 @@ esp_err_t register_chat_uri_handlers(httpd_handle_t server);
  */
 esp_err_t chat_add_message_with_timestamp(const char *uuid, const char *username, const char *message, uint32_t timestamp);
 
+/**
+ * @brief 发送消息轮询响应
+ *
+ * 与/api/chat/messages的响应相同（含ETag和304处理），
+ * 供长轮询在新消息到达或超时后响应异步请求
+ *
+ * @param req HTTP请求对象（可以是异步请求）
+ * @param query 查询参数（房间、游标和响应格式）
+ * @param scratch JSON暂存缓冲区，不小于CHAT_JSON_SCRATCH_SIZE，调用者所在任务独占
+ * @param scratch_size 暂存缓冲区大小
+ * @return ESP_OK 处理成功
+ * @return ESP_FAIL 分块响应中途失败
+ */
+esp_err_t chat_server_send_messages(httpd_req_t *req, const chat_messages_query_t *query,
+                                    char *scratch, size_t scratch_size);
+
 #endif /* _CHAT_SERVER_H_ */
\ No newline at end of file
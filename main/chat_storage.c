@@ -2,14 +2,18 @@
  * ESP32聊天消息存储系统实现
  * 主要功能：
  * 1. 提供聊天消息存储和检索功能
- * 2. 使用NVS(非易失性存储)持久化聊天记录
- * 3. 线程安全的消息存储和访问机制
- * 4. 消息缓存机制，减少重复JSON序列化开销
+ * 2. 使用chatlog分区上的追加日志持久化聊天记录，没有该分区时退回NVS二进制blob
+ * 3. 写入者之间用互斥锁串行，读取者通过顺序锁(seqlock)无锁读取，读失败时重试
+ * 4. 流式JSON输出，逐条写入暂存缓冲区，不分配堆内存
+ * 5. 消息以紧凑记录存放在共享区中：二进制UUID、驻留用户名编号、
+ *    按JSON转义后的变长内容，轮询时直接拷贝，不再重复转义
+ * 6. 有PSRAM时共享区放在PSRAM中并按可用空间确定容量，槽位始终在内部RAM中
  */
 
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
@@ -17,53 +21,113 @@
 #include "cJSON.h"
 #include "nvs_flash.h"
 #include "nvs.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "chat_storage.h"
+#include "chat_log.h"
+#include "chat_cbor.h"
+#include "chat_metrics.h"
+#include "chat_pool.h"
+#include "chat_dedup.h"
+#include "chat_tasks.h"
 
 static const char *STORAGE_TAG = "chat-storage"; // 日志标签
-static SemaphoreHandle_t chat_mutex = NULL; // 聊天消息存储的互斥锁
 
-static chat_storage_t chat_storage = {
-    .count = 0,
-    .next_index = 0
+/* 单条消息JSON的最大长度：固定键名和数字字段，加上所有字符串字段最坏情况下的转义长度 */
+#define MESSAGE_JSON_MAX_LEN (72 + chat_json_escaped_max_len(MAX_UUID_LENGTH - 1) + \
+                              chat_json_escaped_max_len(MAX_USERNAME_LENGTH - 1) + \
+                              chat_json_escaped_max_len(MAX_MESSAGE_LENGTH - 1))
+
+#define PERSIST_FLUSH_INTERVAL_MS CONFIG_CHAT_PERSIST_FLUSH_INTERVAL_MS // 未保存消息的最长等待时间，0表示只按数量保存
+#define PERSIST_QUIET_MS CONFIG_CHAT_PERSIST_QUIET_MS // 到期后等待消息间隙的时长，0表示立即保存
+#define PERSIST_MAX_DEFER_MS (PERSIST_QUIET_MS * 8)   // 等待消息间隙的最长时间，持续突发时也会保存
+#define PERSIST_TASK_STACK_SIZE 4096   // 持久化任务栈大小
+#define PERSIST_TASK_PRIORITY CHAT_PERSIST_TASK_PRIORITY // 持久化任务优先级，低于httpd任务
+#define PERSIST_STOP_TIMEOUT_MS 5000   // 等待持久化任务退出的最长时间
+
+#define STORAGE_READ_SPINS 64          // 读取者忙等写入完成的次数，超过后让出CPU
+
+#if CONFIG_CHAT_STORAGE_PSRAM
+#define PSRAM_ARENA_MAX_SIZE ((size_t)CONFIG_CHAT_PSRAM_ARENA_KB * 1024) // PSRAM共享区大小上限
+#define PSRAM_MAX_MESSAGES CONFIG_CHAT_PSRAM_MAX_MESSAGES // 使用PSRAM共享区时的槽位数上限
+#define PSRAM_RECORD_ESTIMATE 64       // 按共享区大小估算槽位数时每条记录的平均大小(字节)
+#define STORAGE_INTERNAL_RESERVE (96 * 1024) // 分配槽位后内部RAM至少保留的空间，留给WiFi、httpd等
+#endif
+
+#define SAVED_ROOMS_MAX (CHAT_MAX_ROOMS > 1 ? CHAT_MAX_ROOMS - 1 : 1) // NVS房间列表的条目数（不含默认房间）
+
+#define NVS_BLOB_VERSION 1        // NVS二进制blob格式版本
+#define NVS_BLOB_MAX_SIZE 8192    // NVS blob最大大小，NVS分区只有24KB，重写时新旧两份需同时存在
+
+/* NVS二进制blob头，后面依次是[长度(1字节)][二进制消息记录] */
+typedef struct {
+    uint16_t version;               // NVS_BLOB_VERSION
+    uint16_t count;                 // 消息数量
+    uint32_t last_seq;              // 最新一条消息的序列号
+} nvs_blob_header_t;
+
+/* 批量写入的暂存区，从缓冲池借用，避免每次请求分配堆内存 */
+typedef struct {
+    chat_message_t messages[CHAT_MAX_BATCH_MESSAGES];         // 锁外准备好的消息
+    uint8_t uuids[CHAT_MAX_BATCH_MESSAGES][CHAT_UUID_BIN_LENGTH]; // 解析后的二进制UUID
+    uint64_t dedup_keys[CHAT_MAX_BATCH_MESSAGES];             // 客户端消息ID的键，0表示不去重
+} batch_staging_t;
+
+_Static_assert(sizeof(batch_staging_t) <= CHAT_POOL_BUFFER_SIZE, "batch staging must fit in a pool buffer");
+_Static_assert(NVS_BLOB_MAX_SIZE <= CHAT_POOL_BUFFER_SIZE, "NVS blob must fit in a pool buffer");
+
+/* 房间：独立的消息存储、写入互斥锁和顺序锁 */
+typedef struct {
+    chat_storage_t store;           // 消息存储
+    SemaphoreHandle_t mutex;        // 写入互斥锁，读取者不获取；不同房间的写入者互不等待
+    // 存储版本号（顺序锁）：写入者修改store前后各加一，奇数表示正在写入。
+    // 读取者前后两次读到相同的偶数版本号才认为读到的内容一致
+    uint32_t version;
+    uint32_t persisted_seq;         // 已写入日志的最新序列号，只追加比它新的消息（受save_mutex保护）
+    uint8_t id;                     // 房间编号
+    char name[CHAT_ROOM_NAME_LENGTH]; // 房间名
+} chat_room_t;
+
+static SemaphoreHandle_t save_mutex = NULL; // 持久化互斥锁，保证同一时间只有一个保存过程
+static SemaphoreHandle_t rooms_mutex = NULL; // 创建房间的互斥锁，查找房间不获取
+
+// 默认房间静态分配，其他房间创建时分配。发布后不再修改，查找时无锁读取
+static chat_room_t lobby = {
+    .id = CHAT_ROOM_LOBBY,
+    .name = CHAT_ROOM_LOBBY_NAME
 };
+static chat_room_t *rooms[CHAT_MAX_ROOMS] = { &lobby };
 
-// 缓存相关变量
-static char *cached_full_messages_json = NULL; // 缓存所有消息的JSON
-static uint32_t cached_full_messages_timestamp = 0; // 缓存生成时间戳
-static bool cache_valid = false; // 缓存是否有效
-
-// 添加消息计数器，用于批量保存
+// 所有房间合计的未保存消息计数，用于批量保存。各房间的写入者并发累加，原子访问
 static int new_messages_count = 0;
+static TickType_t first_pending_tick = 0; // 最老的未保存消息的写入时刻
+static TickType_t last_message_tick = 0;  // 最近一次写入消息的时刻，用于避开突发写闪存
 
-// 函数前向声明
-static esp_err_t save_message_to_nvs(nvs_handle_t nvs_handle, int index, const chat_message_t *message);
-static esp_err_t load_message_from_nvs(nvs_handle_t nvs_handle, int index, chat_message_t *message);
-static esp_err_t save_chat_history(void);
-static void invalidate_cache(void);
-static void save_chat_history_task(void *pvParameters);
+// 持久化任务：启动时创建一次，通过任务通知唤醒
+static TaskHandle_t persist_task_handle = NULL;
+static SemaphoreHandle_t persist_exit = NULL; // 持久化任务退出信号
+static volatile bool persist_running = false;
 
-/**
- * @brief 保存单条消息到NVS
- * @param nvs_handle NVS句柄
- * @param index 消息索引
- * @param message 要保存的消息结构体指针
- * @return ESP_OK成功，其他为错误码
- */
-static esp_err_t save_message_to_nvs(nvs_handle_t nvs_handle, int index, const chat_message_t *message) {
-    char key[16];
-    snprintf(key, sizeof(key), "%s%d", NVS_MSG_KEY_PREFIX, index);
+// 历史是否已在后台加载完成，完成前写入返回ESP_ERR_INVALID_STATE
+static bool history_ready = false;
+static int64_t history_start_us = 0; // 开始加载的时刻，用于记录加载耗时
 
-    // 使用更简单的格式保存，减少JSON开销
-    char msg_buf[MAX_UUID_LENGTH + MAX_USERNAME_LENGTH + MAX_MESSAGE_LENGTH + 32];
-    snprintf(msg_buf, sizeof(msg_buf), "%s|%s|%s|%lu",
-             message->uuid, message->username, message->message, message->timestamp);
+// 新消息监听回调（推送通道、长轮询），只在启动和停止时修改
+static chat_message_listener_t message_listeners[CHAT_MAX_MESSAGE_LISTENERS];
 
-    esp_err_t err = nvs_set_str(nvs_handle, key, msg_buf);
-    return err;
-}
+// 函数前向声明
+static esp_err_t load_message_from_nvs(nvs_handle_t nvs_handle, int index, chat_message_t *message);
+static esp_err_t save_chat_history(void);
+static esp_err_t save_room_names(void);
+static void persist_task(void *pvParameters);
+static void replay_log_message(const chat_message_t *message, void *ctx);
 
 /**
- * @brief 从NVS加载单条消息
+ * @brief 从NVS加载单条旧格式消息
+ *
+ * 旧格式为"uuid|username|message|timestamp"字符串（更早的版本为JSON），
+ * 仅用于首次启动时迁移
+ *
  * @param nvs_handle NVS句柄
  * @param index 消息索引
  * @param message 输出参数，用于存储加载的消息
@@ -134,7 +198,9 @@ static esp_err_t load_message_from_nvs(nvs_handle_t nvs_handle, int index, chat_
     cJSON *message_obj = cJSON_GetObjectItem(msg_obj, "message");
     cJSON *timestamp_obj = cJSON_GetObjectItem(msg_obj, "timestamp");
 
-    if (uuid_obj && username_obj && message_obj && timestamp_obj) {
+    // 字段类型不对时valuestring为NULL，按损坏的记录处理
+    if (cJSON_IsString(uuid_obj) && cJSON_IsString(username_obj) && cJSON_IsString(message_obj) &&
+        cJSON_IsNumber(timestamp_obj)) {
         strlcpy(message->uuid, uuid_obj->valuestring, MAX_UUID_LENGTH);
         strlcpy(message->username, username_obj->valuestring, MAX_USERNAME_LENGTH);
         strlcpy(message->message, message_obj->valuestring, MAX_MESSAGE_LENGTH);
@@ -158,543 +224,2114 @@ uint32_t chat_storage_get_current_time(void) {
 }
 
 /**
- * @brief 使缓存失效
+ * @brief 按编号取得房间
  *
- * 当添加新消息或其他改变消息状态的操作发生时调用
+ * 房间指针创建时发布一次，之后不再修改，无锁读取
+ *
+ * @param room 房间编号
+ * @return chat_room_t* 房间，不存在时返回NULL
  */
-static void invalidate_cache(void) {
-    if (cached_full_messages_json != NULL) {
-        free(cached_full_messages_json);
-        cached_full_messages_json = NULL;
+static chat_room_t *get_room(int room) {
+    if (room < 0 || room >= CHAT_MAX_ROOMS) {
+        return NULL;
     }
-    cache_valid = false;
-    ESP_LOGD(STORAGE_TAG, "Message cache invalidated");
+    return __atomic_load_n(&rooms[room], __ATOMIC_ACQUIRE);
 }
 
 /**
- * @brief 获取聊天消息的JSON数组
- *
- * 将当前存储的聊天消息转换为JSON格式字符串，使用缓存减少重复转换
- *
- * @return char* JSON字符串指针，调用者负责释放内存
- * @return NULL 获取失败
+ * @brief 获取默认房间最新一条消息的序列号
  */
-char* chat_storage_get_messages_json(void) {
-    uint32_t current_time = chat_storage_get_current_time();
-
-    // 如果缓存有效且在有效期内，直接返回缓存的副本
-    if (cache_valid && cached_full_messages_json != NULL &&
-        (current_time - cached_full_messages_timestamp) < CACHE_VALID_TIME) {
-        ESP_LOGD(STORAGE_TAG, "Using cached messages JSON");
-        return strdup(cached_full_messages_json);
-    }
-
-    // 需要重新生成JSON
-    cJSON *root = cJSON_CreateArray();
-    if (root == NULL) {
-        ESP_LOGE(STORAGE_TAG, "Failed to create JSON array");
-        return NULL;
-    }
-
-    // 使用栈上分配的临时数组来避免小消息数量时的内存分配
-    int count = 0;
-    int start_idx = 0;
-    chat_message_t stack_messages[16]; // 对于少量消息使用栈内存
-    chat_message_t *temp_messages = NULL;
-    bool using_heap = false;
-
-    if (xSemaphoreTake(chat_mutex, portMAX_DELAY) == pdTRUE) {
-        count = chat_storage.count;
-        if (count > 0) {
-            if (count > 16) {
-                // 只有当消息数量较多时才使用堆内存
-                temp_messages = malloc(count * sizeof(chat_message_t));
-                using_heap = true;
-                if (!temp_messages) {
-                    xSemaphoreGive(chat_mutex);
-                    cJSON_Delete(root);
-                    ESP_LOGE(STORAGE_TAG, "Failed to allocate memory for messages");
-                    return NULL;
-                }
-            } else {
-                // 对于少量消息，使用栈上的临时数组
-                temp_messages = stack_messages;
-            }
+uint32_t chat_storage_get_last_seq(void) {
+    return __atomic_load_n(&lobby.store.last_seq, __ATOMIC_ACQUIRE);
+}
 
-            if (count == MAX_MESSAGES) {
-                // 如果消息达到最大容量，则从next_index开始（环形缓冲区的最老消息位置）
-                start_idx = chat_storage.next_index;
-            }
+/**
+ * @brief 获取指定房间最新一条消息的序列号
+ */
+uint32_t chat_storage_get_room_last_seq(int room) {
+    chat_room_t *r = get_room(room);
+    return r ? __atomic_load_n(&r->store.last_seq, __ATOMIC_ACQUIRE) : 0;
+}
 
-            // 拷贝消息到临时数组以减少锁定时间
-            for (int i = 0; i < count; i++) {
-                int idx = (start_idx + i) % MAX_MESSAGES;
-                memcpy(&temp_messages[i], &chat_storage.messages[idx], sizeof(chat_message_t));
-            }
+/**
+ * @brief 注册新消息监听回调
+ *
+ * @param listener 回调函数
+ * @return ESP_OK 成功
+ * @return ESP_ERR_NO_MEM 监听回调数量已达上限
+ */
+esp_err_t chat_storage_add_message_listener(chat_message_listener_t listener) {
+    for (int i = 0; i < CHAT_MAX_MESSAGE_LISTENERS; i++) {
+        if (message_listeners[i] == NULL || message_listeners[i] == listener) {
+            message_listeners[i] = listener;
+            return ESP_OK;
         }
-        xSemaphoreGive(chat_mutex);
-    } else {
-        cJSON_Delete(root);
-        return NULL;
     }
+    ESP_LOGE(STORAGE_TAG, "Too many message listeners");
+    return ESP_ERR_NO_MEM;
+}
 
-    // 按时间顺序添加所有消息到JSON数组（现在不持锁）
-    for (int i = 0; i < count; i++) {
-        cJSON *message = cJSON_CreateObject();
-        if (message == NULL) {
-            ESP_LOGE(STORAGE_TAG, "Failed to create JSON message object");
-            if (using_heap && temp_messages) free(temp_messages);
-            cJSON_Delete(root);
-            return NULL;
+/**
+ * @brief 取消新消息监听回调
+ *
+ * @param listener 注册时的回调函数
+ */
+void chat_storage_remove_message_listener(chat_message_listener_t listener) {
+    for (int i = 0; i < CHAT_MAX_MESSAGE_LISTENERS; i++) {
+        if (message_listeners[i] == listener) {
+            message_listeners[i] = NULL;
         }
-
-        // 添加消息各字段到JSON对象
-        cJSON_AddStringToObject(message, "uuid", temp_messages[i].uuid);
-        cJSON_AddStringToObject(message, "username", temp_messages[i].username);
-        cJSON_AddStringToObject(message, "message", temp_messages[i].message);
-        cJSON_AddNumberToObject(message, "timestamp", temp_messages[i].timestamp);
-        cJSON_AddItemToArray(root, message);
-    }
-
-    // 释放临时消息数组（如果使用的是堆内存）
-    if (using_heap && temp_messages) {
-        free(temp_messages);
     }
+}
 
-    // 将JSON数组转换为字符串
-    char *json_str = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
+/**
+ * @brief 获取房间的互斥锁，并把等待时间计入运行指标
+ *
+ * @param room 房间
+ * @return pdTRUE 获取成功
+ */
+static BaseType_t take_room_mutex(chat_room_t *room) {
+    int64_t start = esp_timer_get_time();
+    BaseType_t taken = xSemaphoreTake(room->mutex, portMAX_DELAY);
+    chat_metrics_record_mutex_wait(esp_timer_get_time() - start);
+    return taken;
+}
 
-    if (json_str != NULL) {
-        // 更新缓存
-        invalidate_cache(); // 先清除旧缓存
-        cached_full_messages_json = strdup(json_str); // 创建独立副本用于缓存
-        if (cached_full_messages_json) {
-            cached_full_messages_timestamp = current_time;
-            cache_valid = true;
-            ESP_LOGD(STORAGE_TAG, "Updated messages JSON cache");
-        }
-        return json_str; // 返回原始字符串，调用者负责释放
-    }
+/**
+ * @brief 开始修改房间的消息存储
+ *
+ * 调用者需持有房间的互斥锁，与storage_write_end成对调用
+ */
+static void storage_write_begin(chat_room_t *room) {
+    __atomic_store_n(&room->version, room->version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
 
-    return NULL; // 如果创建失败，直接返回NULL
+/**
+ * @brief 结束修改房间的消息存储，读取者可以看到新内容
+ */
+static void storage_write_end(chat_room_t *room) {
+    __atomic_store_n(&room->version, room->version + 1, __ATOMIC_RELEASE);
 }
 
 /**
- * @brief 获取指定时间戳后的消息JSON
+ * @brief 开始一次无锁读取
  *
- * @param since_timestamp 时间戳
- * @param has_new_messages 输出参数，是否有新消息
- * @return char* JSON字符串指针，调用者负责释放内存
+ * 有写入者正在修改时等待其完成。写入者可能在同一核心上被抢占，
+ * 忙等一段时间后让出CPU，避免高优先级读取者饿死写入者
+ *
+ * @return uint32_t 读取开始时的版本号，交给storage_read_retry校验
  */
-char* chat_storage_get_messages_since_json(uint32_t since_timestamp, bool *has_new_messages) {
-    // 初始化输出变量
-    if (has_new_messages) {
-        *has_new_messages = false;
+static uint32_t storage_read_begin(chat_room_t *room) {
+    for (int spins = 0; ; spins++) {
+        uint32_t version = __atomic_load_n(&room->version, __ATOMIC_ACQUIRE);
+        if ((version & 1) == 0) {
+            return version;
+        }
+        if (spins >= STORAGE_READ_SPINS) {
+            vTaskDelay(1);
+        }
     }
+}
 
-    if (chat_mutex == NULL) {
-        ESP_LOGE(STORAGE_TAG, "Chat mutex is NULL");
-        return NULL;
-    }
+/**
+ * @brief 检查读取期间房间的消息存储是否被修改
+ *
+ * @param room 房间
+ * @param version storage_read_begin返回的版本号
+ * @return true 读取期间有写入，读到的内容可能不一致，需要重读
+ */
+static bool storage_read_retry(chat_room_t *room, uint32_t version) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&room->version, __ATOMIC_RELAXED) != version;
+}
 
-    // 创建响应对象
-    cJSON *response = cJSON_CreateObject();
-    if (!response) {
-        ESP_LOGE(STORAGE_TAG, "Failed to create JSON response");
-        return NULL;
+/**
+ * @brief 无锁读取时定位消息
+ *
+ * 调用者处于顺序锁读取中。环形缓冲区的状态各读一次，
+ * 即使与写入交错读到了不一致的组合，算出的下标也在合法范围内
+ *
+ * @param room 房间
+ * @param seq 输入输出参数，要读取的序列号；早于最老的消息时调整为最老的消息
+ * @param idx 输出参数，环形缓冲区下标
+ * @return true 找到消息
+ * @return false seq晚于最新的消息
+ */
+static bool locate_seq(chat_room_t *room, uint32_t *seq, int *idx) {
+    uint32_t last_seq = __atomic_load_n(&room->store.last_seq, __ATOMIC_RELAXED);
+    int count = __atomic_load_n(&room->store.count, __ATOMIC_RELAXED);
+    int next_index = __atomic_load_n(&room->store.next_index, __ATOMIC_RELAXED);
+
+    uint32_t oldest_seq = last_seq - (uint32_t)count + 1;
+    if (*seq < oldest_seq) {
+        *seq = oldest_seq;
     }
-
-    // 创建消息数组
-    cJSON *messages_array = cJSON_CreateArray();
-    if (!messages_array) {
-        ESP_LOGE(STORAGE_TAG, "Failed to create messages array");
-        cJSON_Delete(response);
-        return NULL;
+    if (count <= 0 || *seq > last_seq) {
+        return false;
     }
-    cJSON_AddItemToObject(response, "messages", messages_array);
-
-    // 创建临时存储
-    int count = 0;
-    int start_idx = 0;
-    int found_new_messages = 0;
-    chat_message_t *messages_copy = NULL;
+    int back = (int)(last_seq - *seq) + 1; // 1..count
+    *idx = (next_index - back + room->store.capacity) % room->store.capacity;
+    return true;
+}
 
-    // 获取互斥锁，复制所有需要的数据
-    BaseType_t mutex_result = xSemaphoreTake(chat_mutex, pdMS_TO_TICKS(1000)); // 添加超时
-    if (mutex_result != pdTRUE) {
-        ESP_LOGE(STORAGE_TAG, "Failed to take mutex within timeout");
-        cJSON_AddBoolToObject(response, "has_new_messages", false);
-        cJSON_AddStringToObject(response, "error", "Server busy, try again later");
-        char *json_str = cJSON_PrintUnformatted(response);
-        cJSON_Delete(response);
-        return json_str;
-    }
+/**
+ * @brief 十六进制字符转数值
+ *
+ * @return int 0-15，非法字符返回-1
+ */
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
 
-    // 复制必要的数据，最小化持锁时间
-    count = chat_storage.count;
-    if (count == MAX_MESSAGES) {
-        start_idx = chat_storage.next_index;
+/**
+ * @brief 解析标准格式的UUID字符串
+ *
+ * @param str UUID字符串
+ * @param out 输出参数，16字节二进制UUID
+ * @return ESP_OK 解析成功
+ * @return ESP_ERR_INVALID_ARG 格式不正确
+ */
+esp_err_t chat_storage_uuid_parse(const char *str, uint8_t out[CHAT_UUID_BIN_LENGTH]) {
+    if (!str) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    // 只有在有消息时才分配内存
-    if (count > 0) {
-        messages_copy = malloc(count * sizeof(chat_message_t));
-        if (messages_copy) {
-            // 复制所有消息
-            for (int i = 0; i < count; i++) {
-                int idx = (start_idx + i) % MAX_MESSAGES;
-                memcpy(&messages_copy[i], &chat_storage.messages[idx], sizeof(chat_message_t));
-            }
-        } else {
-            ESP_LOGE(STORAGE_TAG, "Failed to allocate memory for messages copy");
-            // 内存分配失败，立即释放互斥锁
-            xSemaphoreGive(chat_mutex);
-            cJSON_AddBoolToObject(response, "has_new_messages", false);
-            cJSON_AddStringToObject(response, "error", "Server out of memory");
-            char *json_str = cJSON_PrintUnformatted(response);
-            cJSON_Delete(response);
-            return json_str;
-        }
-    }
-
-    // 尽快释放互斥锁
-    xSemaphoreGive(chat_mutex);
-
-    // 现在处理复制的数据，不再持有互斥锁
-    if (count > 0 && messages_copy != NULL) {
-        for (int i = 0; i < count; i++) {
-            // 检查消息是否新于给定时间戳
-            if (messages_copy[i].timestamp > since_timestamp) {
-                cJSON *message = cJSON_CreateObject();
-                if (message) {
-                    cJSON_AddStringToObject(message, "uuid", messages_copy[i].uuid);
-                    cJSON_AddStringToObject(message, "username", messages_copy[i].username);
-                    cJSON_AddStringToObject(message, "message", messages_copy[i].message);
-                    cJSON_AddNumberToObject(message, "timestamp", messages_copy[i].timestamp);
-                    cJSON_AddItemToArray(messages_array, message);
-                    found_new_messages++;
-                }
+    int n = 0;
+    for (int i = 0; i < MAX_UUID_LENGTH - 1; i++) {
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            if (str[i] != '-') {
+                return ESP_ERR_INVALID_ARG;
             }
+            continue;
         }
-
-        // 释放临时内存
-        free(messages_copy);
+        int hi = hex_digit(str[i]);
+        int lo = hi >= 0 ? hex_digit(str[i + 1]) : -1;
+        if (lo < 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        out[n++] = (uint8_t)((hi << 4) | lo);
+        i++;
     }
+    return str[MAX_UUID_LENGTH - 1] == '\0' ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
 
-    // 设置是否有新消息
-    if (has_new_messages) {
-        *has_new_messages = (found_new_messages > 0);
+/**
+ * @brief 把二进制UUID格式化为小写标准格式字符串
+ *
+ * @param uuid 16字节二进制UUID
+ * @param out 输出缓冲区，至少MAX_UUID_LENGTH字节
+ */
+void chat_storage_uuid_format(const uint8_t uuid[CHAT_UUID_BIN_LENGTH], char out[MAX_UUID_LENGTH]) {
+    static const char hex[] = "0123456789abcdef";
+    char *p = out;
+    for (int i = 0; i < CHAT_UUID_BIN_LENGTH; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            *p++ = '-';
+        }
+        *p++ = hex[uuid[i] >> 4];
+        *p++ = hex[uuid[i] & 0x0F];
     }
-    cJSON_AddBoolToObject(response, "has_new_messages", found_new_messages > 0);
+    *p = '\0';
+}
 
-    // 生成JSON字符串并清理
-    char *json_str = cJSON_PrintUnformatted(response);
-    cJSON_Delete(response);
+/**
+ * @brief 读取槽位对应的消息记录头
+ *
+ * 共享区中的记录不保证对齐，通过memcpy读取
+ */
+static void read_record(chat_room_t *room, int idx, chat_record_t *record) {
+    memcpy(record, &room->store.arena[room->store.slots[idx].offset], sizeof(*record));
+}
 
-    return json_str;
+/**
+ * @brief 消息记录在共享区中占用的总长度
+ */
+static uint32_t record_length(const chat_record_t *record) {
+    return sizeof(*record) + record->name_len + record->body_len;
 }
 
 /**
- * @brief 保存聊天历史到NVS
+ * @brief 查找或分配驻留用户名
  *
- * 将当前内存中的聊天消息保存到非易失性存储(NVS)
+ * 调用者需持有房间的互斥锁。找到后引用计数加一
  *
- * @return ESP_OK 保存成功
- * @return 其他错误码 保存失败
+ * @param room 房间
+ * @param name 转义后的用户名
+ * @param len 用户名长度
+ * @return uint8_t 驻留表编号，驻留表已满或用户名太长时返回CHAT_USERNAME_INLINE
  */
-static esp_err_t save_chat_history(void) {
-    // 先获取消息数据，再打开NVS句柄，可减少NVS句柄持有时间
-    int count = 0;
-    int start_idx = 0;
-
-    // 使用栈内存优化小数据集
-    chat_message_t stack_messages[16]; // 栈上的临时缓冲区
-    chat_message_t *messages_to_save = NULL;
-    bool using_heap = false;
-
-    // 先从聊天存储结构中获取消息数据
-    if (xSemaphoreTake(chat_mutex, portMAX_DELAY) == pdTRUE) {
-        count = chat_storage.count;
-
-        // 计算开始索引
-        if (count == MAX_MESSAGES) {
-            start_idx = chat_storage.next_index;
-        }
-
-        // 如果有消息需要保存，则复制数据
-        if (count > 0) {
-            if (count > 16) {
-                // 只有当消息较多时才分配堆内存
-                messages_to_save = malloc(count * sizeof(chat_message_t));
-                using_heap = true;
-                if (!messages_to_save) {
-                    ESP_LOGE(STORAGE_TAG, "Failed to allocate memory for messages");
-                    xSemaphoreGive(chat_mutex);
-                    return ESP_ERR_NO_MEM;
-                }
-            } else {
-                // 对于少量消息使用栈内存
-                messages_to_save = stack_messages;
-            }
+static uint8_t intern_username(chat_room_t *room, const char *name, size_t len) {
+    if (len > CHAT_USERNAME_INTERN_LEN) {
+        return CHAT_USERNAME_INLINE;
+    }
 
-            // 复制消息数据到临时数组
-            for (int i = 0; i < count; i++) {
-                int msg_idx = (start_idx + i) % MAX_MESSAGES;
-                memcpy(&messages_to_save[i], &chat_storage.messages[msg_idx], sizeof(chat_message_t));
+    int free_id = -1;
+    for (int i = 0; i < CHAT_MAX_USERNAMES; i++) {
+        chat_username_t *entry = &room->store.usernames[i];
+        if (entry->refs == 0) {
+            if (free_id < 0) {
+                free_id = i;
             }
+            continue;
+        }
+        if (entry->len == len && memcmp(entry->name, name, len) == 0) {
+            entry->refs++;
+            return (uint8_t)i;
         }
-        xSemaphoreGive(chat_mutex);
-    } else {
-        return ESP_FAIL;
     }
 
-    // 如果没有消息，不需要保存
-    if (count == 0) {
-        ESP_LOGI(STORAGE_TAG, "No messages to save");
-        return ESP_OK;
+    if (free_id < 0) {
+        return CHAT_USERNAME_INLINE;
     }
+    chat_username_t *entry = &room->store.usernames[free_id];
+    memcpy(entry->name, name, len);
+    entry->len = (uint8_t)len;
+    entry->refs = 1;
+    return (uint8_t)free_id;
+}
 
-    // 打开NVS进行写入
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("chat", NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK) {
-        if (using_heap && messages_to_save) {
-            free(messages_to_save);
-        }
-        ESP_LOGE(STORAGE_TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
-        return err;
+/**
+ * @brief 淘汰最老的一条消息
+ *
+ * 调用者需持有房间的互斥锁，且count > 0
+ */
+static void evict_oldest(chat_room_t *room) {
+    int idx = (room->store.next_index - room->store.count + room->store.capacity) % room->store.capacity;
+    chat_record_t record;
+    read_record(room, idx, &record);
+    if (record.name_id != CHAT_USERNAME_INLINE) {
+        room->store.usernames[record.name_id].refs--;
     }
+    room->store.count--;
+}
 
-    // 保存消息计数
-    err = nvs_set_i32(nvs_handle, NVS_MSG_COUNT_KEY, count);
-    if (err != ESP_OK) {
-        ESP_LOGE(STORAGE_TAG, "Error saving message count: %s", esp_err_to_name(err));
-        if (using_heap && messages_to_save) {
-            free(messages_to_save);
+/**
+ * @brief 淘汰最老的消息，直到它的记录不再与[start, end)重叠
+ *
+ * 记录按写入顺序在共享区中循环分配，最老的记录总是紧跟在写入位置之后，
+ * 因此只需从最老的消息开始顺序淘汰
+ *
+ * @param room 房间
+ * @param start 区间起点
+ * @param end 区间终点（不包含）
+ */
+static void evict_overlapping(chat_room_t *room, uint32_t start, uint32_t end) {
+    while (room->store.count > 0) {
+        int idx = (room->store.next_index - room->store.count + room->store.capacity) % room->store.capacity;
+        chat_record_t record;
+        read_record(room, idx, &record);
+        uint32_t offset = room->store.slots[idx].offset;
+        if (offset >= end || offset + record_length(&record) <= start) {
+            break;
         }
-        nvs_close(nvs_handle);
-        return err;
+        evict_oldest(room);
     }
+}
 
-    // 保存每条消息
-    bool save_error = false;
-    if (count > 0 && messages_to_save != NULL) {
-        for (int i = 0; i < count; i++) {
-            err = save_message_to_nvs(nvs_handle, i, &messages_to_save[i]);
-            if (err != ESP_OK) {
-                ESP_LOGE(STORAGE_TAG, "Error saving message %d: %s", i, esp_err_to_name(err));
-                save_error = true;
-                break;
-            }
+/**
+ * @brief 把一条消息写入环形缓冲区和记录共享区
+ *
+ * 调用者需持有房间的互斥锁。槽位或共享区不足时淘汰最老的消息
+ *
+ * @param room 房间
+ * @param uuid 二进制UUID
+ * @param username 用户名（已截断到MAX_USERNAME_LENGTH - 1）
+ * @param message 消息内容（已截断到MAX_MESSAGE_LENGTH - 1）
+ * @param timestamp 时间戳
+ * @return uint32_t 分配的序列号
+ */
+static uint32_t store_message_locked(chat_room_t *room, const uint8_t uuid[CHAT_UUID_BIN_LENGTH], const char *username,
+                                     const char *message, uint32_t timestamp) {
+    // 先统计转义后的长度，再决定记录大小
+    chat_json_writer_t writer;
+    chat_json_writer_init(&writer, NULL, 0, NULL, NULL);
+    chat_json_write_escaped_content(&writer, username);
+    size_t name_len = writer.len;
+    chat_json_writer_init(&writer, NULL, 0, NULL, NULL);
+    chat_json_write_escaped_content(&writer, message);
+    size_t body_len = writer.len;
+
+    // 用户名按转义后的内容驻留，太长或驻留表已满时内联存放
+    chat_record_t record = {
+        .name_id = CHAT_USERNAME_INLINE,
+        .name_len = (uint8_t)name_len,
+        .body_len = (uint16_t)body_len
+    };
+    memcpy(record.uuid, uuid, CHAT_UUID_BIN_LENGTH);
+    if (name_len <= CHAT_USERNAME_INTERN_LEN) {
+        char escaped[CHAT_USERNAME_INTERN_LEN];
+        chat_json_writer_init(&writer, escaped, sizeof(escaped), NULL, NULL);
+        chat_json_write_escaped_content(&writer, username);
+        record.name_id = intern_username(room, escaped, name_len);
+        if (record.name_id != CHAT_USERNAME_INLINE) {
+            record.name_len = 0;
         }
     }
+    uint32_t len = record_length(&record);
 
-    // 释放临时数组（如果使用的是堆内存）
-    if (using_heap && messages_to_save) {
-        free(messages_to_save);
-    }
+    storage_write_begin(room);
 
-    // 提交更改
-    if (!save_error) {
-        err = nvs_commit(nvs_handle);
-        if (err != ESP_OK) {
-            ESP_LOGE(STORAGE_TAG, "Error committing NVS: %s", esp_err_to_name(err));
-        } else {
-            ESP_LOGI(STORAGE_TAG, "Chat history saved successfully (%d messages)", count);
-        }
+    // 槽位已满时覆盖最老的消息
+    if (room->store.count == room->store.capacity) {
+        evict_oldest(room);
     }
 
-    nvs_close(nvs_handle);
-    return err;
+    // 在共享区中分配连续空间，尾部放不下时回到开头
+    uint32_t start = room->store.count > 0 ? room->store.arena_head : 0;
+    if (start + len > room->store.arena_size) {
+        // 尾部剩余的记录都是最老的，全部淘汰后回到开头
+        evict_overlapping(room, start, room->store.arena_size);
+        start = 0;
+    }
+    evict_overlapping(room, start, start + len);
+
+    char *dst = &room->store.arena[start];
+    memcpy(dst, &record, sizeof(record));
+    dst += sizeof(record);
+    if (record.name_id == CHAT_USERNAME_INLINE) {
+        chat_json_writer_init(&writer, dst, name_len, NULL, NULL);
+        chat_json_write_escaped_content(&writer, username);
+        dst += name_len;
+    }
+    chat_json_writer_init(&writer, dst, body_len, NULL, NULL);
+    chat_json_write_escaped_content(&writer, message);
+
+    int idx = room->store.next_index;
+    room->store.slots[idx].timestamp = timestamp;
+    room->store.slots[idx].offset = start;
+    room->store.arena_head = start + len;
+    room->store.next_index = (room->store.next_index + 1) % room->store.capacity;
+    room->store.count++;
+    uint32_t seq = ++room->store.last_seq;
+
+    storage_write_end(room);
+    return seq;
 }
 
 /**
- * @brief 初始化聊天存储系统
+ * @brief 获取记录中转义后的用户名和消息内容
  *
- * 创建互斥锁并从NVS加载历史聊天消息
+ * 无锁读取时记录可能正在被覆盖，长度和编号先做边界检查，
+ * 保证读到残缺的记录也不会越界；内容是否一致由调用者通过顺序锁校验
  *
- * @return ESP_OK 成功，其他为错误码
+ * @return true 记录头在合法范围内
  */
-esp_err_t chat_storage_init(void) {
-    // 创建消息互斥锁，保证消息读写的线程安全
-    chat_mutex = xSemaphoreCreateMutex();
-    if (chat_mutex == NULL) {
-        ESP_LOGE(STORAGE_TAG, "Failed to create chat mutex");
-        return ESP_FAIL;
+static bool record_fields(chat_room_t *room, int idx, chat_record_t *record, const char **name, size_t *name_len,
+                          const char **body) {
+    uint32_t offset = room->store.slots[idx].offset;
+    if (offset > room->store.arena_size - sizeof(*record)) {
+        return false;
     }
-
-    // 从NVS加载聊天历史记录
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("chat", NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(STORAGE_TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
-        return ESP_OK; // 即使NVS打开失败，仍然继续初始化其他部分
+    memcpy(record, &room->store.arena[offset], sizeof(*record));
+    if (offset + record_length(record) > room->store.arena_size ||
+        record->body_len > chat_json_escaped_max_len(MAX_MESSAGE_LENGTH - 1)) {
+        return false;
     }
 
-    // 获取保存的消息数量
-    int32_t msg_count = 0;
-    err = nvs_get_i32(nvs_handle, NVS_MSG_COUNT_KEY, &msg_count);
-    if (err == ESP_OK && msg_count > 0) {
-        if (xSemaphoreTake(chat_mutex, portMAX_DELAY) == pdTRUE) {
-            // 逐条加载消息
-            int loaded_count = 0;
-            for (int i = 0; i < msg_count && i < MAX_MESSAGES; i++) {
-                int idx = i % MAX_MESSAGES;
-                err = load_message_from_nvs(nvs_handle, i, &chat_storage.messages[idx]);
-                if (err == ESP_OK) {
-                    loaded_count++;
-                } else {
-                    ESP_LOGW(STORAGE_TAG, "Failed to load message %d: %s", i, esp_err_to_name(err));
-                }
-            }
-
-            // 更新消息计数和下一个存储位置
-            chat_storage.count = loaded_count;
-            chat_storage.next_index = loaded_count % MAX_MESSAGES;
-            ESP_LOGI(STORAGE_TAG, "Loaded %d messages from NVS", loaded_count);
-
-            xSemaphoreGive(chat_mutex);
+    const char *p = &room->store.arena[offset + sizeof(*record)];
+    if (record->name_id == CHAT_USERNAME_INLINE) {
+        *name = p;
+        *name_len = record->name_len;
+        p += record->name_len;
+    } else if (record->name_id < CHAT_MAX_USERNAMES) {
+        *name = room->store.usernames[record->name_id].name;
+        *name_len = room->store.usernames[record->name_id].len;
+        if (*name_len > CHAT_USERNAME_INTERN_LEN) {
+            return false;
         }
+    } else {
+        return false;
     }
-
-    nvs_close(nvs_handle);
-    return ESP_OK;
+    *body = p;
+    return true;
 }
 
 /**
- * @brief 添加新的聊天消息
+ * @brief 输出环形缓冲区中一条消息的JSON对象
  *
- * 将新消息添加到环形缓冲区，并持久化存储到NVS
+ * 调用者需持有房间的互斥锁或处于顺序锁读取中。字符串已按转义形式存放，直接拷贝。
+ * 输出长度不超过MESSAGE_JSON_MAX_LEN
  *
- * @param uuid 用户唯一标识符
- * @param username 用户名
- * @param message 消息内容
- * @return ESP_OK 添加成功
- * @return ESP_FAIL 添加失败
+ * @param room 房间
+ * @param idx 槽位
+ * @param seq 消息序列号
+ * @param writer 输出器
+ * @return true 记录有效
  */
-esp_err_t chat_storage_add_message(const char *uuid, const char *username, const char *message) {
-    if (!uuid || !username || !message) {
-        ESP_LOGE(STORAGE_TAG, "Invalid parameters: NULL pointer");
-        return ESP_ERR_INVALID_ARG;
+static bool write_stored_message_json(chat_room_t *room, int idx, uint32_t seq, chat_json_writer_t *writer) {
+    chat_record_t record;
+    const char *name;
+    size_t name_len;
+    const char *body;
+    if (!record_fields(room, idx, &record, &name, &name_len, &body)) {
+        return false;
     }
 
-    if (xSemaphoreTake(chat_mutex, portMAX_DELAY) == pdTRUE) {
-        // 获取当前存储位置
-        int idx = chat_storage.next_index;
-
-        // 复制消息数据到存储结构
-        strlcpy(chat_storage.messages[idx].uuid, uuid, MAX_UUID_LENGTH);
-        strlcpy(chat_storage.messages[idx].username, username, MAX_USERNAME_LENGTH);
-        strlcpy(chat_storage.messages[idx].message, message, MAX_MESSAGE_LENGTH);
-
-        // 使用客户端提供的时间戳或当前时间戳（如果客户端未提供）
-        uint32_t server_time = chat_storage_get_current_time();
-        chat_storage.messages[idx].timestamp = server_time;
-
-        // 更新环形缓冲区指针和消息计数
-        chat_storage.next_index = (chat_storage.next_index + 1) % MAX_MESSAGES;
-        if (chat_storage.count < MAX_MESSAGES) {
-            chat_storage.count++;
-        }
-
-        // 增加新消息计数
-        new_messages_count++;
-
-        xSemaphoreGive(chat_mutex);
+    char uuid[MAX_UUID_LENGTH];
+    chat_storage_uuid_format(record.uuid, uuid);
+
+    chat_json_write_str(writer, "{\"uuid\":\"");
+    chat_json_write_raw(writer, uuid, MAX_UUID_LENGTH - 1);
+    chat_json_write_str(writer, "\",\"username\":\"");
+    chat_json_write_raw(writer, name, name_len);
+    chat_json_write_str(writer, "\",\"message\":\"");
+    chat_json_write_raw(writer, body, record.body_len);
+    chat_json_write_str(writer, "\",\"timestamp\":");
+    chat_json_write_u32(writer, room->store.slots[idx].timestamp);
+    chat_json_write_str(writer, ",\"seq\":");
+    chat_json_write_u32(writer, seq);
+    chat_json_write_raw(writer, "}", 1);
+    return true;
+}
 
-        // 使缓存失效，因为消息已更新
-        invalidate_cache();
+/**
+ * @brief 输出环形缓冲区中一条消息的CBOR映射
+ *
+ * 调用条件与write_stored_message_json相同。UUID输出16字节原始值，
+ * 字符串还原为转义前的原文，输出长度小于对应的JSON
+ *
+ * @param room 房间
+ * @param idx 槽位
+ * @param seq 消息序列号
+ * @param writer 输出器
+ * @return true 记录有效
+ */
+static bool write_stored_message_cbor(chat_room_t *room, int idx, uint32_t seq, chat_json_writer_t *writer) {
+    chat_record_t record;
+    const char *name;
+    size_t name_len;
+    const char *body;
+    if (!record_fields(room, idx, &record, &name, &name_len, &body)) {
+        return false;
+    }
 
-        // 简化持久化策略：当累积超过MIN_MESSAGES_TO_SAVE条消息时保存
-        if (new_messages_count >= MIN_MESSAGES_TO_SAVE) {
-            ESP_LOGI(STORAGE_TAG, "Saving chat history after %d new messages", new_messages_count);
-            new_messages_count = 0;
+    char username[MAX_USERNAME_LENGTH];
+    char message[MAX_MESSAGE_LENGTH];
+    size_t username_len = chat_json_unescape(username, sizeof(username), name, name_len);
+    size_t message_len = chat_json_unescape(message, sizeof(message), body, record.body_len);
+
+    chat_cbor_write_head(writer, CHAT_CBOR_MAP, 5);
+    chat_cbor_write_uint(writer, CHAT_CBOR_KEY_UUID);
+    chat_cbor_write_string(writer, CHAT_CBOR_BYTES, record.uuid, CHAT_UUID_BIN_LENGTH);
+    chat_cbor_write_uint(writer, CHAT_CBOR_KEY_USERNAME);
+    chat_cbor_write_string(writer, CHAT_CBOR_TEXT, username, username_len);
+    chat_cbor_write_uint(writer, CHAT_CBOR_KEY_MESSAGE);
+    chat_cbor_write_string(writer, CHAT_CBOR_TEXT, message, message_len);
+    chat_cbor_write_uint(writer, CHAT_CBOR_KEY_TIMESTAMP);
+    chat_cbor_write_uint(writer, room->store.slots[idx].timestamp);
+    chat_cbor_write_uint(writer, CHAT_CBOR_KEY_SEQ);
+    chat_cbor_write_uint(writer, seq);
+    return true;
+}
 
-            // 使用单独任务保存，避免阻塞主线程
-            TaskHandle_t save_task_handle = NULL;
-            if (xTaskCreate(save_chat_history_task, "save_chat", 8192, NULL, 5, &save_task_handle) != pdPASS) {
-                ESP_LOGW(STORAGE_TAG, "Failed to create save task, saving synchronously");
-                save_chat_history();
+/**
+ * @brief 无锁读取环形缓冲区中的一条消息，还原为chat_message_t
+ *
+ * 读取期间有写入时重读
+ *
+ * @param room 房间
+ * @param seq 消息序列号
+ * @param message 输出参数
+ * @param oldest_seq 输出参数，消息已被淘汰时为当前最老消息的序列号
+ * @return true 成功
+ * @return false 消息已被淘汰
+ */
+static bool read_stored_message(chat_room_t *room, uint32_t seq, chat_message_t *message, uint32_t *oldest_seq) {
+    for (;;) {
+        uint32_t version = storage_read_begin(room);
+        uint32_t located = seq;
+        int idx = 0;
+        bool found = locate_seq(room, &located, &idx) && located == seq;
+        *oldest_seq = located;
+
+        chat_record_t record;
+        const char *name;
+        size_t name_len;
+        const char *body;
+        if (found) {
+            found = record_fields(room, idx, &record, &name, &name_len, &body);
+            if (found) {
+                chat_storage_uuid_format(record.uuid, message->uuid);
+                chat_json_unescape(message->username, sizeof(message->username), name, name_len);
+                chat_json_unescape(message->message, sizeof(message->message), body, record.body_len);
+                message->timestamp = room->store.slots[idx].timestamp;
+                message->seq = seq;
+                message->room = room->id;
             }
         }
 
-        return ESP_OK;
+        if (!storage_read_retry(room, version)) {
+            return found;
+        }
     }
+}
 
-    return ESP_FAIL;
+/**
+ * @brief 输出单条消息的JSON对象
+ *
+ * @param message 消息
+ * @param writer 输出器
+ * @return ESP_OK 成功，其他为输出器错误码
+ */
+esp_err_t chat_storage_write_message_json(const chat_message_t *message, chat_json_writer_t *writer) {
+    chat_json_write_str(writer, "{\"uuid\":");
+    chat_json_write_escaped(writer, message->uuid);
+    chat_json_write_str(writer, ",\"username\":");
+    chat_json_write_escaped(writer, message->username);
+    chat_json_write_str(writer, ",\"message\":");
+    chat_json_write_escaped(writer, message->message);
+    chat_json_write_str(writer, ",\"timestamp\":");
+    chat_json_write_u32(writer, message->timestamp);
+    chat_json_write_str(writer, ",\"seq\":");
+    chat_json_write_u32(writer, message->seq);
+    return chat_json_write_raw(writer, "}", 1);
 }
 
 /**
- * @brief 添加带时间戳的聊天消息
+ * @brief 读取当前最新序列号
  *
- * @param uuid 用户唯一标识符
- * @param username 用户名
- * @param message 消息内容
- * @param timestamp 客户端提供的时间戳
- * @return ESP_OK 添加成功
- * @return ESP_FAIL 添加失败
+ * last_seq是对齐的32位数，单独读取不需要加锁
+ *
+ * @param room 房间
+ * @param last_seq 输出参数，最新序列号
+ * @return ESP_OK 成功
+ * @return ESP_ERR_INVALID_STATE 存储尚未初始化
  */
-esp_err_t chat_storage_add_message_with_timestamp(const char *uuid, const char *username, const char *message, uint32_t timestamp) {
-    if (!uuid || !username || !message) {
-        ESP_LOGE(STORAGE_TAG, "Invalid parameters: NULL pointer");
-        return ESP_ERR_INVALID_ARG;
+static esp_err_t read_last_seq(chat_room_t *room, uint32_t *last_seq) {
+    if (room->mutex == NULL) {
+        ESP_LOGE(STORAGE_TAG, "Chat mutex is NULL");
+        return ESP_ERR_INVALID_STATE;
     }
+    *last_seq = __atomic_load_n(&room->store.last_seq, __ATOMIC_ACQUIRE);
+    return ESP_OK;
+}
 
-    if (xSemaphoreTake(chat_mutex, portMAX_DELAY) == pdTRUE) {
-        // 获取当前存储位置
-        int idx = chat_storage.next_index;
-
-        // 复制消息数据到存储结构
-        strlcpy(chat_storage.messages[idx].uuid, uuid, MAX_UUID_LENGTH);
-        strlcpy(chat_storage.messages[idx].username, username, MAX_USERNAME_LENGTH);
-        strlcpy(chat_storage.messages[idx].message, message, MAX_MESSAGE_LENGTH);
-        chat_storage.messages[idx].timestamp = timestamp;
-
-        // 更新环形缓冲区指针和消息计数
-        chat_storage.next_index = (chat_storage.next_index + 1) % MAX_MESSAGES;
-        if (chat_storage.count < MAX_MESSAGES) {
-            chat_storage.count++;
+/**
+ * @brief 流式输出指定序列号范围内的消息（JSON时逗号分隔，不含数组括号）
+ *
+ * 不获取房间的互斥锁：每条消息在顺序锁保护下直接写入暂存缓冲区，
+ * 读取期间有写入时丢弃刚写入的部分并重读这一条。
+ * 暂存缓冲区剩余空间不足一条消息时刷新（网络发送）。
+ * 读取过程中被环形缓冲区覆盖的消息直接跳过
+ *
+ * @param room 房间
+ * @param writer 输出器
+ * @param format 输出格式
+ * @param first_seq 起始序列号
+ * @param end_seq 结束序列号（包含）
+ * @param filter_timestamp 是否按时间戳过滤
+ * @param since_timestamp 只输出时间戳大于该值的消息
+ * @param written 输出参数，已输出的消息数
+ * @param first_written_seq 输出参数，最先输出的消息序列号，可为NULL
+ * @param last_written_seq 输出参数，最后输出的消息序列号
+ * @return ESP_OK 成功
+ * @return 其他 输出器错误码
+ */
+static esp_err_t write_messages_range(chat_room_t *room, chat_json_writer_t *writer, chat_format_t format,
+                                      uint32_t first_seq, uint32_t end_seq,
+                                      bool filter_timestamp, uint32_t since_timestamp,
+                                      int *written, uint32_t *first_written_seq, uint32_t *last_written_seq) {
+    uint32_t cursor = first_seq;
+
+    while (cursor <= end_seq) {
+        // 暂存缓冲区至少要能容纳一条最长的消息，重读时才能整体丢弃
+        if (chat_json_writer_space(writer) < MESSAGE_JSON_MAX_LEN) {
+            if (chat_json_flush(writer) != ESP_OK) {
+                return writer->err;
+            }
+            if (chat_json_writer_space(writer) < MESSAGE_JSON_MAX_LEN) {
+                return ESP_ERR_INVALID_SIZE;
+            }
         }
 
-        // 增加新消息计数
-        new_messages_count++;
-
-        xSemaphoreGive(chat_mutex);
-
-        // 使缓存失效，因为消息已更新
-        invalidate_cache();
-
-        // 简化持久化策略：当累积超过MIN_MESSAGES_TO_SAVE条消息时保存
-        if (new_messages_count >= MIN_MESSAGES_TO_SAVE) {
-            ESP_LOGI(STORAGE_TAG, "Saving chat history after %d new messages", new_messages_count);
-            new_messages_count = 0;
-
-            // 使用单独任务保存，避免阻塞主线程
-            TaskHandle_t save_task_handle = NULL;
-            if (xTaskCreate(save_chat_history_task, "save_chat", 8192, NULL, 5, &save_task_handle) != pdPASS) {
-                ESP_LOGW(STORAGE_TAG, "Failed to create save task, saving synchronously");
-                save_chat_history();
+        size_t mark = writer->len;
+        uint32_t version = storage_read_begin(room);
+
+        // 可能有消息已被覆盖，跳到当前最老的消息
+        uint32_t seq = cursor;
+        int idx = 0;
+        bool emitted = false;
+        if (locate_seq(room, &seq, &idx) && seq <= end_seq) {
+            if (!filter_timestamp || room->store.slots[idx].timestamp > since_timestamp) {
+                if (format == CHAT_FORMAT_CBOR) {
+                    emitted = write_stored_message_cbor(room, idx, seq, writer);
+                } else {
+                    if (*written > 0) {
+                        chat_json_write_raw(writer, ",", 1);
+                    }
+                    emitted = write_stored_message_json(room, idx, seq, writer);
+                }
             }
         }
 
-        return ESP_OK;
+        if (storage_read_retry(room, version)) {
+            writer->len = mark;
+            continue;
+        }
+        if (emitted) {
+            if (*written == 0 && first_written_seq) {
+                *first_written_seq = seq;
+            }
+            (*written)++;
+            *last_written_seq = seq;
+        } else {
+            writer->len = mark;
+        }
+        cursor = seq + 1;
     }
 
-    return ESP_FAIL;
+    return writer->err;
 }
 
 /**
- * @brief 保存聊天历史的任务函数
- *
- * 在单独的任务中保存聊天历史，避免阻塞主线程
+ * @brief 开始输出消息响应对象，接着输出messages数组的元素
  *
- * @param pvParameters 任务参数（未使用）
+ * @param writer 输出器
+ * @param format 输出格式
+ * @param fields 响应对象的字段数（含messages），CBOR映射头需要
  */
-static void save_chat_history_task(void *pvParameters) {
-    ESP_LOGI(STORAGE_TAG, "Starting chat history save task");
-    save_chat_history();
-    vTaskDelete(NULL);
+static void write_response_start(chat_json_writer_t *writer, chat_format_t format, uint32_t fields) {
+    if (format == CHAT_FORMAT_CBOR) {
+        chat_cbor_write_head(writer, CHAT_CBOR_MAP, fields);
+        chat_cbor_write_uint(writer, CHAT_CBOR_KEY_MESSAGES);
+        chat_cbor_write_array_start(writer);
+    } else {
+        chat_json_write_str(writer, "{\"messages\":[");
+    }
+}
+
+/**
+ * @brief 结束messages数组
+ */
+static void write_response_messages_end(chat_json_writer_t *writer, chat_format_t format) {
+    if (format == CHAT_FORMAT_CBOR) {
+        chat_cbor_write_break(writer);
+    } else {
+        chat_json_write_raw(writer, "]", 1);
+    }
+}
+
+/**
+ * @brief 输出响应对象的布尔字段
+ *
+ * @param name JSON字段名（含引号和冒号）
+ * @param key CBOR键
+ */
+static void write_response_bool(chat_json_writer_t *writer, chat_format_t format, const char *name, uint32_t key,
+                                bool value) {
+    if (format == CHAT_FORMAT_CBOR) {
+        chat_cbor_write_uint(writer, key);
+        chat_cbor_write_bool(writer, value);
+    } else {
+        chat_json_write_raw(writer, ",", 1);
+        chat_json_write_str(writer, name);
+        chat_json_write_str(writer, value ? "true" : "false");
+    }
+}
+
+/**
+ * @brief 输出响应对象的整数字段
+ *
+ * @param name JSON字段名（含引号和冒号）
+ * @param key CBOR键
+ */
+static void write_response_u32(chat_json_writer_t *writer, chat_format_t format, const char *name, uint32_t key,
+                               uint32_t value) {
+    if (format == CHAT_FORMAT_CBOR) {
+        chat_cbor_write_uint(writer, key);
+        chat_cbor_write_uint(writer, value);
+    } else {
+        chat_json_write_raw(writer, ",", 1);
+        chat_json_write_str(writer, name);
+        chat_json_write_u32(writer, value);
+    }
+}
+
+/**
+ * @brief 结束响应对象
+ */
+static esp_err_t write_response_end(chat_json_writer_t *writer, chat_format_t format) {
+    if (format == CHAT_FORMAT_CBOR) {
+        return writer->err; // 定长映射，不需要结束标记
+    }
+    return chat_json_write_raw(writer, "}", 1);
+}
+
+/**
+ * @brief 输出消息响应对象
+ *
+ * 格式: {"messages":[...],"has_new_messages":bool,"last_seq":N}，CBOR时键见chat_cbor.h
+ */
+static esp_err_t write_messages_response(chat_room_t *room, chat_json_writer_t *writer, chat_format_t format,
+                                         uint32_t first_seq, uint32_t last_seq,
+                                         bool filter_timestamp, uint32_t since_timestamp,
+                                         bool *has_new_messages) {
+    int written = 0;
+    uint32_t last_written_seq = first_seq - 1;
+
+    write_response_start(writer, format, 3);
+    if (first_seq <= last_seq) {
+        esp_err_t err = write_messages_range(room, writer, format, first_seq, last_seq, filter_timestamp, since_timestamp,
+                                             &written, NULL, &last_written_seq);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    write_response_messages_end(writer, format);
+    write_response_bool(writer, format, "\"has_new_messages\":", CHAT_CBOR_KEY_HAS_NEW_MESSAGES, written > 0);
+    write_response_u32(writer, format, "\"last_seq\":", CHAT_CBOR_KEY_LAST_SEQ, last_seq);
+
+    if (has_new_messages) {
+        *has_new_messages = (written > 0);
+    }
+    return write_response_end(writer, format);
+}
+
+/**
+ * @brief 流式输出所有聊天消息的JSON数组
+ *
+ * @param writer 输出器
+ * @return ESP_OK 成功，其他为错误码
+ */
+esp_err_t chat_storage_write_messages_json(chat_json_writer_t *writer) {
+    chat_room_t *room = &lobby;
+    uint32_t last_seq = 0;
+    esp_err_t err = read_last_seq(room, &last_seq);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    int written = 0;
+    uint32_t last_written_seq = 0;
+    chat_json_write_raw(writer, "[", 1);
+    if (last_seq > 0) {
+        err = write_messages_range(room, writer, CHAT_FORMAT_JSON, 1, last_seq, false, 0, &written, NULL,
+                                   &last_written_seq);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return chat_json_write_raw(writer, "]", 1);
+}
+
+/**
+ * @brief 流式输出指定时间戳后的消息
+ *
+ * @param room 房间
+ * @param since_timestamp 时间戳
+ * @param format 输出格式
+ * @param writer 输出器
+ * @param has_new_messages 输出参数，是否有新消息
+ * @return ESP_OK 成功，其他为错误码
+ */
+static esp_err_t write_messages_since_timestamp(chat_room_t *room, uint32_t since_timestamp, chat_format_t format,
+                                                chat_json_writer_t *writer, bool *has_new_messages) {
+    uint32_t last_seq = 0;
+    esp_err_t err = read_last_seq(room, &last_seq);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // 时间戳不单调，只能从最老的消息开始逐条过滤
+    return write_messages_response(room, writer, format, 1, last_seq, true, since_timestamp, has_new_messages);
+}
+
+/**
+ * @brief 流式输出指定序列号之后的消息
+ *
+ * 环形缓冲区中序列号连续，起始位置由序列号直接计算，只访问需要返回的尾部消息
+ *
+ * @param room 房间
+ * @param since_seq 客户端已收到的最新序列号
+ * @param format 输出格式
+ * @param writer 输出器
+ * @param has_new_messages 输出参数，是否有新消息
+ * @return ESP_OK 成功，其他为错误码
+ */
+static esp_err_t write_messages_since_seq(chat_room_t *room, uint32_t since_seq, chat_format_t format,
+                                          chat_json_writer_t *writer, bool *has_new_messages) {
+    uint32_t last_seq = 0;
+    esp_err_t err = read_last_seq(room, &last_seq);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (since_seq > last_seq) {
+        // 客户端游标超前（服务器重启丢失了未保存的消息），重新同步全部消息
+        since_seq = 0;
+    }
+
+    // since_seq == last_seq时范围为空，不会访问任何消息
+    return write_messages_response(room, writer, format, since_seq + 1, last_seq, false, 0, has_new_messages);
+}
+
+/**
+ * @brief 读取当前最老一条消息的序列号
+ *
+ * @return uint32_t 最老消息的序列号，没有消息时为last_seq + 1
+ */
+static uint32_t read_oldest_seq(chat_room_t *room) {
+    uint32_t version;
+    uint32_t oldest_seq;
+    do {
+        version = storage_read_begin(room);
+        oldest_seq = __atomic_load_n(&room->store.last_seq, __ATOMIC_RELAXED) -
+                     (uint32_t)__atomic_load_n(&room->store.count, __ATOMIC_RELAXED) + 1;
+    } while (storage_read_retry(room, version));
+    return oldest_seq;
+}
+
+/**
+ * @brief 流式输出指定序列号之前的一页消息
+ *
+ * 与增量轮询一样由序列号直接定位，只访问本页的消息
+ *
+ * @param room 房间
+ * @param before_seq 只输出序列号小于该值的消息，0表示从最新一条开始
+ * @param limit 最多输出的消息数量
+ * @param format 输出格式
+ * @param writer 输出器
+ * @return ESP_OK 成功，其他为错误码
+ */
+static esp_err_t write_messages_before_seq(chat_room_t *room, uint32_t before_seq, int limit, chat_format_t format,
+                                           chat_json_writer_t *writer) {
+    if (limit < 1 || limit > CHAT_PAGE_MAX_MESSAGES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t last_seq = 0;
+    esp_err_t err = read_last_seq(room, &last_seq);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // 游标超前（服务器重启丢失了未保存的消息）时从最新一条开始
+    uint32_t end_seq = (before_seq == 0 || before_seq > last_seq) ? last_seq : before_seq - 1;
+    uint32_t first_seq = end_seq > (uint32_t)limit ? end_seq - (uint32_t)limit + 1 : 1;
+
+    int written = 0;
+    uint32_t first_written_seq = 0;
+    uint32_t last_written_seq = 0;
+    write_response_start(writer, format, 4);
+    if (end_seq > 0) {
+        err = write_messages_range(room, writer, format, first_seq, end_seq, false, 0, &written, &first_written_seq,
+                                   &last_written_seq);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    // 本页最老的消息之前还有没被覆盖的消息
+    bool has_more = written > 0 && first_written_seq > read_oldest_seq(room);
+    write_response_messages_end(writer, format);
+    write_response_bool(writer, format, "\"has_more\":", CHAT_CBOR_KEY_HAS_MORE, has_more);
+    write_response_u32(writer, format, "\"oldest_seq\":", CHAT_CBOR_KEY_OLDEST_SEQ, first_written_seq);
+    write_response_u32(writer, format, "\"last_seq\":", CHAT_CBOR_KEY_LAST_SEQ, last_seq);
+    return write_response_end(writer, format);
+}
+
+/**
+ * @brief 按查询参数流式输出消息列表
+ */
+esp_err_t chat_storage_write_messages(const chat_messages_query_t *query, chat_json_writer_t *writer,
+                                      bool *has_new_messages) {
+    if (has_new_messages) {
+        *has_new_messages = false;
+    }
+
+    chat_room_t *room = get_room(query->room);
+    if (room == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    switch (query->mode) {
+    case CHAT_QUERY_SINCE_SEQ:
+        return write_messages_since_seq(room, query->seq, query->format, writer, has_new_messages);
+    case CHAT_QUERY_BEFORE_SEQ:
+        return write_messages_before_seq(room, query->seq, query->limit, query->format, writer);
+    case CHAT_QUERY_SINCE_TIMESTAMP:
+        return write_messages_since_timestamp(room, query->since_timestamp, query->format, writer, has_new_messages);
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+}
+
+/**
+ * @brief 流式输出指定时间戳后的消息JSON
+ */
+esp_err_t chat_storage_write_messages_since_json(uint32_t since_timestamp, chat_json_writer_t *writer,
+                                                 bool *has_new_messages) {
+    chat_messages_query_t query = { .mode = CHAT_QUERY_SINCE_TIMESTAMP, .since_timestamp = since_timestamp };
+    return chat_storage_write_messages(&query, writer, has_new_messages);
+}
+
+/**
+ * @brief 流式输出指定序列号之后的消息JSON
+ */
+esp_err_t chat_storage_write_messages_since_seq_json(uint32_t since_seq, chat_json_writer_t *writer,
+                                                     bool *has_new_messages) {
+    chat_messages_query_t query = { .mode = CHAT_QUERY_SINCE_SEQ, .seq = since_seq };
+    return chat_storage_write_messages(&query, writer, has_new_messages);
+}
+
+/**
+ * @brief 流式输出指定序列号之前的一页消息JSON
+ */
+esp_err_t chat_storage_write_messages_before_seq_json(uint32_t before_seq, int limit, chat_json_writer_t *writer) {
+    chat_messages_query_t query = { .mode = CHAT_QUERY_BEFORE_SEQ, .seq = before_seq, .limit = limit };
+    return chat_storage_write_messages(&query, writer, NULL);
+}
+
+/**
+ * @brief 保存聊天历史到NVS二进制blob
+ *
+ * 没有chatlog分区时使用：把最新的消息编码为一个blob，一次nvs_set_blob写入。
+ * 从最新的消息往前填充，超出NVS_BLOB_MAX_SIZE或NVS_MAX_SAVED_MESSAGES的老消息不保存。
+ * NVS空间有限，只保存默认房间。编码缓冲区从缓冲池借用，定期保存不在堆上反复分配
+ *
+ * @return ESP_OK 保存成功
+ * @return ESP_ERR_TIMEOUT 缓冲池已用完，稍后重试
+ * @return 其他错误码 保存失败
+ */
+static esp_err_t save_nvs_blob(void) {
+    chat_room_t *room = &lobby;
+    uint8_t *blob = chat_pool_acquire();
+    if (!blob) {
+        ESP_LOGW(STORAGE_TAG, "No pool buffer for the NVS blob, saving later");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // 记录从缓冲区末尾向前写入，最后整体移动到头部之后
+    nvs_blob_header_t header = {
+        .version = NVS_BLOB_VERSION
+    };
+    size_t pos = NVS_BLOB_MAX_SIZE;
+    chat_message_t message;
+    uint8_t record[CHAT_LOG_MESSAGE_MAX_LEN];
+    uint32_t oldest_seq = 0;
+
+    // 无锁逐条读取，不阻塞轮询和发送
+    read_last_seq(room, &header.last_seq);
+    for (int i = 0; i < NVS_MAX_SAVED_MESSAGES && (uint32_t)i < header.last_seq; i++) {
+        if (!read_stored_message(room, header.last_seq - (uint32_t)i, &message, &oldest_seq)) {
+            break;
+        }
+        // 编不出的消息之前的老消息也不再保存，加载时序列号保持连续
+        size_t len = chat_log_encode_message(&message, record);
+        if (len == 0) {
+            break;
+        }
+        if (pos < sizeof(header) + len + 1) {
+            break;
+        }
+        pos -= len + 1;
+        blob[pos] = (uint8_t)len;
+        memcpy(blob + pos + 1, record, len);
+        header.count++;
+    }
+
+    // 如果没有消息，不需要保存
+    if (header.count == 0) {
+        chat_pool_release(blob);
+        ESP_LOGI(STORAGE_TAG, "No messages to save");
+        return ESP_OK;
+    }
+
+    size_t size = sizeof(header) + (NVS_BLOB_MAX_SIZE - pos);
+    memmove(blob + sizeof(header), blob + pos, NVS_BLOB_MAX_SIZE - pos);
+    memcpy(blob, &header, sizeof(header));
+
+    // 打开NVS进行写入
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open("chat", NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        chat_pool_release(blob);
+        ESP_LOGE(STORAGE_TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = nvs_set_blob(nvs_handle, NVS_MSG_BLOB_KEY, blob, size);
+    chat_pool_release(blob);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(STORAGE_TAG, "Error saving NVS blob: %s", esp_err_to_name(err));
+    } else {
+        ESP_LOGI(STORAGE_TAG, "Chat history saved successfully (%u messages, %u bytes)",
+                 (unsigned)header.count, (unsigned)size);
+    }
+
+    nvs_close(nvs_handle);
+    return err;
+}
+
+/**
+ * @brief 从NVS二进制blob加载聊天历史到默认房间
+ *
+ * 调用者需持有默认房间的互斥锁。一次nvs_get_blob读入缓冲池借来的缓冲区。
+ * 每条记录带着自己的序列号，最新序列号取最后一条成功加载的记录
+ *
+ * @param nvs_handle NVS句柄
+ * @return int 成功加载的消息数量，没有blob或格式不正确时返回-1
+ */
+static int load_nvs_blob(nvs_handle_t nvs_handle) {
+    chat_room_t *room = &lobby;
+    size_t size = 0;
+    if (nvs_get_blob(nvs_handle, NVS_MSG_BLOB_KEY, NULL, &size) != ESP_OK || size < sizeof(nvs_blob_header_t) ||
+        size > CHAT_POOL_BUFFER_SIZE) {
+        return -1;
+    }
+
+    uint8_t *blob = chat_pool_acquire();
+    if (!blob) {
+        ESP_LOGE(STORAGE_TAG, "No pool buffer for the NVS blob");
+        return -1;
+    }
+    if (nvs_get_blob(nvs_handle, NVS_MSG_BLOB_KEY, blob, &size) != ESP_OK) {
+        chat_pool_release(blob);
+        return -1;
+    }
+
+    nvs_blob_header_t header;
+    memcpy(&header, blob, sizeof(header));
+    if (header.version != NVS_BLOB_VERSION) {
+        ESP_LOGW(STORAGE_TAG, "Unsupported NVS blob version %u", header.version);
+        chat_pool_release(blob);
+        return -1;
+    }
+
+    chat_message_t message;
+    int loaded_count = 0;
+    size_t pos = sizeof(header);
+    for (int i = 0; i < header.count && pos < size; i++) {
+        size_t len = blob[pos];
+        uint8_t uuid[CHAT_UUID_BIN_LENGTH];
+        if (pos + 1 + len > size || !chat_log_decode_message(blob + pos + 1, len, &message) ||
+            message.room != CHAT_ROOM_LOBBY || chat_storage_uuid_parse(message.uuid, uuid) != ESP_OK) {
+            ESP_LOGW(STORAGE_TAG, "Corrupt NVS blob record %d", i);
+            break;
+        }
+        // 与日志回放相同：保留记录中的序列号，有空缺时丢弃之前的消息
+        replay_log_message(&message, &loaded_count);
+        pos += 1 + len;
+    }
+    chat_pool_release(blob);
+
+    // 一条也没加载时沿用保存时的序列号，新消息不会重复使用客户端见过的序列号
+    if (loaded_count == 0) {
+        storage_write_begin(room);
+        room->store.last_seq = header.last_seq;
+        storage_write_end(room);
+    }
+    return loaded_count;
+}
+
+/**
+ * @brief 把一个房间尚未写入日志的新消息追加到日志
+ *
+ * 只写入序列号大于persisted_seq的消息，写放大与新消息数量成正比
+ *
+ * @param room 房间
+ * @param appended 输入输出参数，累加追加的消息数
+ * @return ESP_OK 保存成功
+ * @return 其他错误码 保存失败，未写入的消息下次继续追加
+ */
+static esp_err_t append_room_log(chat_room_t *room, int *appended) {
+    uint32_t last_seq = 0;
+    read_last_seq(room, &last_seq);
+
+    chat_message_t message;
+    uint32_t seq = room->persisted_seq + 1;
+    while (seq <= last_seq) {
+        uint32_t oldest_seq = 0;
+        if (!read_stored_message(room, seq, &message, &oldest_seq)) {
+            if (oldest_seq <= seq) {
+                break;
+            }
+            // 保存积压过多时最老的未保存消息可能已被淘汰
+            ESP_LOGW(STORAGE_TAG, "Messages %" PRIu32 "-%" PRIu32 " of room %s evicted before being saved",
+                     seq, oldest_seq - 1, room->name);
+            seq = oldest_seq;
+            continue;
+        }
+
+        esp_err_t err = chat_log_append(&message);
+        if (err != ESP_OK) {
+            ESP_LOGE(STORAGE_TAG, "Error appending message %" PRIu32 " of room %s: %s", seq, room->name, esp_err_to_name(err));
+            return err;
+        }
+        room->persisted_seq = seq;
+        (*appended)++;
+        seq++;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief 把所有房间尚未写入日志的新消息追加到日志
+ *
+ * @return ESP_OK 保存成功
+ * @return 其他错误码 保存失败，未写入的消息下次继续追加
+ */
+static esp_err_t append_chat_log(void) {
+    int appended = 0;
+    for (int i = 0; i < CHAT_MAX_ROOMS; i++) {
+        chat_room_t *room = get_room(i);
+        if (room == NULL) {
+            continue;
+        }
+        esp_err_t err = append_room_log(room, &appended);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    ESP_LOGI(STORAGE_TAG, "Appended %d messages to chat log (lobby last seq %" PRIu32 ")", appended, lobby.persisted_seq);
+    return ESP_OK;
+}
+
+/**
+ * @brief 清零未保存消息计数，表示即将保存当前全部消息
+ */
+static void take_pending_messages(void) {
+    __atomic_store_n(&new_messages_count, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 保存聊天历史
+ *
+ * 有chatlog分区时只追加新消息，否则全部重写到NVS
+ *
+ * @return ESP_OK 保存成功
+ * @return 其他错误码 保存失败
+ */
+static esp_err_t save_chat_history(void) {
+    if (xSemaphoreTake(save_mutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_FAIL;
+    }
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = chat_log_is_open() ? append_chat_log() : save_nvs_blob();
+    chat_metrics_record_persist(esp_timer_get_time() - start, err == ESP_OK);
+    xSemaphoreGive(save_mutex);
+    return err;
+}
+
+/**
+ * @brief 从NVS加载旧格式的聊天历史到默认房间
+ *
+ * 调用者需持有默认房间的互斥锁
+ *
+ * @param nvs_handle NVS句柄
+ * @param msg_count NVS中保存的消息数量
+ * @return int 成功加载的消息数量
+ */
+static int load_nvs_history(nvs_handle_t nvs_handle, int32_t msg_count) {
+    chat_room_t *room = &lobby;
+    // 逐条加载消息，按成功加载的顺序写入，保证序列号与环形位置一致
+    chat_message_t message;
+    int loaded_count = 0;
+    for (int i = 0; i < msg_count && i < NVS_MAX_SAVED_MESSAGES; i++) {
+        uint8_t uuid[CHAT_UUID_BIN_LENGTH];
+        esp_err_t err = load_message_from_nvs(nvs_handle, i, &message);
+        if (err == ESP_OK) {
+            err = chat_storage_uuid_parse(message.uuid, uuid);
+        }
+        if (err == ESP_OK) {
+            store_message_locked(room, uuid, message.username, message.message, message.timestamp);
+            loaded_count++;
+        } else {
+            ESP_LOGW(STORAGE_TAG, "Failed to load message %d: %s", i, esp_err_to_name(err));
+        }
+    }
+
+    // 恢复序列号：旧版本没有保存序列号时从1开始编号
+    uint32_t saved_seq = 0;
+    if (nvs_get_u32(nvs_handle, NVS_MSG_SEQ_KEY, &saved_seq) != ESP_OK ||
+        saved_seq < (uint32_t)loaded_count) {
+        saved_seq = (uint32_t)loaded_count;
+    }
+    storage_write_begin(room);
+    room->store.last_seq = saved_seq;
+    storage_write_end(room);
+    return loaded_count;
+}
+
+/**
+ * @brief 删除NVS中旧格式的聊天历史
+ *
+ * 迁移到新格式后调用，释放NVS空间
+ *
+ * @param nvs_handle NVS句柄
+ * @param msg_count NVS中保存的消息数量
+ */
+static void erase_nvs_history(nvs_handle_t nvs_handle, int32_t msg_count) {
+    char key[16];
+    for (int i = 0; i < msg_count && i < NVS_MAX_SAVED_MESSAGES; i++) {
+        snprintf(key, sizeof(key), "%s%d", NVS_MSG_KEY_PREFIX, i);
+        nvs_erase_key(nvs_handle, key);
+    }
+    nvs_erase_key(nvs_handle, NVS_MSG_SEQ_KEY);
+    nvs_erase_key(nvs_handle, NVS_MSG_COUNT_KEY);
+    esp_err_t err = nvs_commit(nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(STORAGE_TAG, "Error erasing legacy NVS history: %s", esp_err_to_name(err));
+    }
+}
+
+/**
+ * @brief 日志回放回调，把消息写入所属房间的环形缓冲区
+ *
+ * 调用者需持有所有房间的互斥锁。房间列表没能保存时，属于未知房间的消息丢弃
+ *
+ * @param message 回放的消息
+ * @param ctx 成功加载的消息计数
+ */
+static void replay_log_message(const chat_message_t *message, void *ctx) {
+    uint8_t uuid[CHAT_UUID_BIN_LENGTH];
+    chat_room_t *room = get_room(message->room);
+    if (room == NULL || chat_storage_uuid_parse(message->uuid, uuid) != ESP_OK) {
+        return;
+    }
+    // 序列号由环形位置推算，日志中有空缺（保存前被淘汰、损坏的扇区被跳过）时
+    // 之前加载的消息无法再与序列号对应，清空后从这条重新开始
+    if (room->store.count > 0 && message->seq != room->store.last_seq + 1) {
+        ESP_LOGW(STORAGE_TAG, "Gap in chat log of room %s (%" PRIu32 " -> %" PRIu32 "), dropping %d older messages",
+                 room->name, room->store.last_seq, message->seq, room->store.count);
+        storage_write_begin(room);
+        while (room->store.count > 0) {
+            evict_oldest(room);
+        }
+        storage_write_end(room);
+    }
+    store_message_locked(room, uuid, message->username, message->message, message->timestamp);
+    // 以日志中的序列号为准，重启后继续递增
+    storage_write_begin(room);
+    room->store.last_seq = message->seq;
+    storage_write_end(room);
+    (*(int *)ctx)++;
+}
+
+/**
+ * @brief 日志整理回调：消息还在所属房间的环形缓冲区中时保留
+ *
+ * 日志绕回时最老扇区中的记录可能仍是某个房间重启后唯一的历史（例如很久没有新消息的房间），
+ * 只有已从内存中淘汰的消息才可以擦除。新旧程度按房间内的位置计算，
+ * 分区放不下时先丢弃消息多的房间的旧消息
+ *
+ * @param message 即将擦除的记录中的消息
+ * @param ctx 未使用
+ * @return uint32_t 0表示已淘汰；否则为这条消息之后房间中的消息数量加1
+ */
+static uint32_t log_record_in_memory(const chat_message_t *message, void *ctx) {
+    chat_room_t *room = get_room(message->room);
+    uint32_t last_seq = 0;
+    if (room == NULL || message->seq < read_oldest_seq(room) || read_last_seq(room, &last_seq) != ESP_OK ||
+        message->seq > last_seq) {
+        return 0;
+    }
+    return last_seq - message->seq + 1;
+}
+
+/**
+ * @brief 创建持久化任务
+ *
+ * 创建失败时不影响其他功能，新消息改为在达到数量阈值时同步保存
+ */
+static void start_persist_task(void) {
+    persist_exit = xSemaphoreCreateBinary();
+    if (persist_exit == NULL) {
+        ESP_LOGE(STORAGE_TAG, "Failed to create persist exit semaphore");
+        return;
+    }
+
+    persist_running = true;
+    if (xTaskCreatePinnedToCore(persist_task, "chat_persist", PERSIST_TASK_STACK_SIZE, NULL,
+                                PERSIST_TASK_PRIORITY, &persist_task_handle, CHAT_PERSIST_TASK_CORE) != pdPASS) {
+        ESP_LOGE(STORAGE_TAG, "Failed to create persist task, saving synchronously");
+        persist_running = false;
+        persist_task_handle = NULL;
+    }
+}
+
+/**
+ * @brief 从NVS加载聊天历史
+ *
+ * 优先加载二进制blob；没有blob时加载旧格式的逐条字符串并迁移。
+ * 有日志分区时加载到的历史写入日志后从NVS删除
+ *
+ * @return const char* 历史来源描述，没有历史时返回NULL
+ */
+static const char *load_nvs_sources(void) {
+    chat_room_t *room = &lobby;
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open("chat", NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(STORAGE_TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
+        return NULL;
+    }
+
+    const char *source = NULL;
+    int32_t msg_count = 0;
+    int loaded_count = -1;
+    if (take_room_mutex(room) == pdTRUE) {
+        loaded_count = load_nvs_blob(nvs_handle);
+        if (loaded_count >= 0) {
+            source = "NVS blob";
+        } else if (nvs_get_i32(nvs_handle, NVS_MSG_COUNT_KEY, &msg_count) == ESP_OK && msg_count > 0) {
+            loaded_count = load_nvs_history(nvs_handle, msg_count);
+            source = "legacy NVS";
+        }
+        // 迁移时保留原有序列号，日志中的记录从最老的已加载消息开始
+        room->persisted_seq = room->store.last_seq - (uint32_t)room->store.count;
+        xSemaphoreGive(room->mutex);
+    }
+
+    if (source == NULL) {
+        nvs_close(nvs_handle);
+        return NULL;
+    }
+    ESP_LOGI(STORAGE_TAG, "Loaded %d messages from %s (last seq %" PRIu32 ")", loaded_count, source,
+             room->store.last_seq);
+
+    // 旧格式或已被日志取代的blob，转存为当前格式后删除，下次启动直接加载
+    bool legacy = msg_count > 0;
+    if ((legacy || chat_log_is_open()) && save_chat_history() == ESP_OK) {
+        if (legacy) {
+            erase_nvs_history(nvs_handle, msg_count);
+        } else {
+            nvs_erase_key(nvs_handle, NVS_MSG_BLOB_KEY);
+            nvs_commit(nvs_handle);
+        }
+        ESP_LOGI(STORAGE_TAG, "Migrated %d messages from %s to %s", loaded_count, source,
+                 chat_log_is_open() ? "chat log" : "NVS blob");
+    }
+
+    nvs_close(nvs_handle);
+    return source;
+}
+
+/**
+ * @brief 分配默认房间的消息槽位和记录共享区
+ *
+ * 启用CHAT_STORAGE_PSRAM时共享区取PSRAM最大空闲块的一半（不超过配置上限），
+ * 槽位数按共享区大小估算，同时保证内部RAM在分配槽位后仍有余量。
+ * 没有PSRAM或PSRAM分配失败时，按CHAT_MAX_MESSAGES和CHAT_ARENA_SIZE从内部RAM分配
+ *
+ * @return ESP_OK 成功
+ * @return ESP_ERR_NO_MEM 内存不足
+ */
+static esp_err_t allocate_lobby_storage(void) {
+    chat_room_t *room = &lobby;
+    if (room->store.slots != NULL) {
+        return ESP_OK;
+    }
+
+    size_t capacity = MAX_MESSAGES;
+    size_t arena_size = CHAT_ARENA_SIZE;
+    char *arena = NULL;
+    const char *arena_location = "internal RAM";
+#if CONFIG_CHAT_STORAGE_PSRAM
+    size_t psram_size = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM) / 2;
+    if (psram_size > PSRAM_ARENA_MAX_SIZE) {
+        psram_size = PSRAM_ARENA_MAX_SIZE;
+    }
+    if (psram_size > CHAT_ARENA_SIZE) {
+        arena = heap_caps_malloc(psram_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (arena != NULL) {
+        arena_size = psram_size;
+        arena_location = "PSRAM";
+
+        size_t internal_free = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        size_t slot_budget = internal_free > STORAGE_INTERNAL_RESERVE ?
+                             (internal_free - STORAGE_INTERNAL_RESERVE) / sizeof(chat_slot_t) : 0;
+        size_t slots = arena_size / PSRAM_RECORD_ESTIMATE;
+        if (slots > PSRAM_MAX_MESSAGES) {
+            slots = PSRAM_MAX_MESSAGES;
+        }
+        if (slots > slot_budget) {
+            slots = slot_budget;
+        }
+        if (slots > capacity) {
+            capacity = slots;
+        }
+    } else {
+        ESP_LOGW(STORAGE_TAG, "No PSRAM for the message arena, falling back to internal RAM");
+    }
+#endif
+    if (arena == NULL) {
+        arena = heap_caps_malloc(arena_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    chat_slot_t *slots = heap_caps_malloc(capacity * sizeof(chat_slot_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (arena == NULL || slots == NULL) {
+        ESP_LOGE(STORAGE_TAG, "Failed to allocate message storage (%u slots, %u byte arena)",
+                 (unsigned)capacity, (unsigned)arena_size);
+        heap_caps_free(arena);
+        heap_caps_free(slots);
+        return ESP_ERR_NO_MEM;
+    }
+
+    room->store.slots = slots;
+    room->store.arena = arena;
+    room->store.capacity = (int)capacity;
+    room->store.arena_size = (uint32_t)arena_size;
+    ESP_LOGI(STORAGE_TAG, "Message storage: %u slots (%u bytes internal RAM), %u byte arena in %s",
+             (unsigned)capacity, (unsigned)(capacity * sizeof(chat_slot_t)), (unsigned)arena_size, arena_location);
+    return ESP_OK;
+}
+
+/**
+ * @brief 检查房间名是否合法
+ *
+ * @param name 房间名
+ * @return true 1到CHAT_ROOM_NAME_LENGTH - 1个小写字母、数字、'-'或'_'
+ */
+static bool room_name_valid(const char *name) {
+    size_t len = 0;
+    for (; name[len] != '\0'; len++) {
+        char c = name[len];
+        if (len >= CHAT_ROOM_NAME_LENGTH - 1 ||
+            !((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '_')) {
+            return false;
+        }
+    }
+    return len > 0;
+}
+
+/**
+ * @brief 按名称查找已有的房间（不含默认房间）
+ *
+ * @param name 房间名
+ * @return int 房间编号，不存在时返回-1
+ */
+static int lookup_room(const char *name) {
+    for (int i = CHAT_ROOM_LOBBY + 1; i < CHAT_MAX_ROOMS; i++) {
+        chat_room_t *room = get_room(i);
+        if (room && strcmp(room->name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 分配并发布一个房间
+ *
+ * 调用者需持有rooms_mutex，或处于启动阶段。房间结构体（含用户名驻留表）和槽位在内部RAM中，
+ * 共享区优先放在PSRAM中
+ *
+ * @param id 房间编号
+ * @param name 房间名
+ * @return ESP_OK 成功
+ * @return ESP_ERR_NO_MEM 内存不足
+ */
+static esp_err_t create_room(int id, const char *name) {
+    chat_room_t *room = heap_caps_calloc(1, sizeof(chat_room_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    chat_slot_t *slots = heap_caps_malloc(CHAT_ROOM_MAX_MESSAGES * sizeof(chat_slot_t),
+                                          MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    char *arena = heap_caps_malloc_prefer(CHAT_ROOM_ARENA_SIZE, 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT,
+                                          MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+    if (room == NULL || slots == NULL || arena == NULL || mutex == NULL) {
+        ESP_LOGE(STORAGE_TAG, "Failed to allocate room %s", name);
+        heap_caps_free(room);
+        heap_caps_free(slots);
+        heap_caps_free(arena);
+        if (mutex != NULL) {
+            vSemaphoreDelete(mutex);
+        }
+        return ESP_ERR_NO_MEM;
+    }
+
+    room->store.slots = slots;
+    room->store.arena = arena;
+    room->store.capacity = CHAT_ROOM_MAX_MESSAGES;
+    room->store.arena_size = CHAT_ROOM_ARENA_SIZE;
+    room->mutex = mutex;
+    room->id = (uint8_t)id;
+    strlcpy(room->name, name, sizeof(room->name));
+    __atomic_store_n(&rooms[id], room, __ATOMIC_RELEASE);
+    ESP_LOGI(STORAGE_TAG, "Room %d created: %s (%d slots, %d byte arena)", id, name,
+             CHAT_ROOM_MAX_MESSAGES, CHAT_ROOM_ARENA_SIZE);
+    return ESP_OK;
+}
+
+/**
+ * @brief 把房间列表保存到NVS
+ *
+ * 按房间编号依次存放房间名（每个CHAT_ROOM_NAME_LENGTH字节，空字符串表示未使用），
+ * 重启后房间编号不变，日志中按编号记录的消息回放到原来的房间。调用者需持有rooms_mutex
+ *
+ * @return ESP_OK 保存成功，其他为错误码
+ */
+static esp_err_t save_room_names(void) {
+    char names[SAVED_ROOMS_MAX][CHAT_ROOM_NAME_LENGTH];
+    memset(names, 0, sizeof(names));
+    for (int i = CHAT_ROOM_LOBBY + 1; i < CHAT_MAX_ROOMS; i++) {
+        chat_room_t *room = get_room(i);
+        if (room) {
+            strlcpy(names[i - 1], room->name, CHAT_ROOM_NAME_LENGTH);
+        }
+    }
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open("chat", NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(STORAGE_TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
+        return err;
+    }
+    err = nvs_set_blob(nvs_handle, NVS_ROOMS_KEY, names, sizeof(names));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(STORAGE_TAG, "Error saving room list: %s", esp_err_to_name(err));
+    }
+    nvs_close(nvs_handle);
+    return err;
+}
+
+/**
+ * @brief 从NVS恢复房间列表
+ *
+ * 在回放日志之前调用。CHAT_MAX_ROOMS调小后超出上限的房间不再恢复，其消息在回放时丢弃
+ */
+static void restore_rooms(void) {
+    nvs_handle_t nvs_handle;
+    if (nvs_open("chat", NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return;
+    }
+
+    char names[SAVED_ROOMS_MAX][CHAT_ROOM_NAME_LENGTH];
+    size_t size = 0;
+    if (nvs_get_blob(nvs_handle, NVS_ROOMS_KEY, NULL, &size) != ESP_OK || size % CHAT_ROOM_NAME_LENGTH != 0) {
+        nvs_close(nvs_handle);
+        return;
+    }
+    // 房间列表比当前上限长时只读取前面部分
+    char *blob = malloc(size);
+    if (blob == NULL || nvs_get_blob(nvs_handle, NVS_ROOMS_KEY, blob, &size) != ESP_OK) {
+        free(blob);
+        nvs_close(nvs_handle);
+        return;
+    }
+    nvs_close(nvs_handle);
+
+    memset(names, 0, sizeof(names));
+    memcpy(names, blob, size < sizeof(names) ? size : sizeof(names));
+    free(blob);
+
+    for (int i = CHAT_ROOM_LOBBY + 1; i < CHAT_MAX_ROOMS; i++) {
+        char *name = names[i - 1];
+        name[CHAT_ROOM_NAME_LENGTH - 1] = '\0';
+        if (room_name_valid(name) && lookup_room(name) < 0) {
+            create_room(i, name);
+        }
+    }
+}
+
+/**
+ * @brief 按名称查找房间，可选在不存在时创建
+ */
+esp_err_t chat_storage_find_room(const char *name, bool create, int *room) {
+    if (name == NULL || name[0] == '\0' || strcmp(name, CHAT_ROOM_LOBBY_NAME) == 0) {
+        *room = CHAT_ROOM_LOBBY;
+        return ESP_OK;
+    }
+    if (!room_name_valid(name)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int id = lookup_room(name);
+    if (id < 0 && !create) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (id < 0) {
+        // 房间列表随历史一起恢复，加载完成前创建可能占用已保存房间的编号
+        if (!chat_storage_history_ready() ||
+            rooms_mutex == NULL || xSemaphoreTake(rooms_mutex, portMAX_DELAY) != pdTRUE) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        // 等待锁期间可能已被其他任务创建
+        esp_err_t err = ESP_OK;
+        id = lookup_room(name);
+        if (id < 0) {
+            for (int i = CHAT_ROOM_LOBBY + 1; i < CHAT_MAX_ROOMS && id < 0; i++) {
+                if (get_room(i) == NULL) {
+                    id = i;
+                }
+            }
+            if (id < 0) {
+                ESP_LOGW(STORAGE_TAG, "Room limit reached (%d), cannot create %s", CHAT_MAX_ROOMS, name);
+                err = ESP_ERR_NO_MEM;
+            } else {
+                err = create_room(id, name);
+                if (err == ESP_OK) {
+                    // 保存失败只影响重启后的恢复，房间照常使用
+                    save_room_names();
+                }
+            }
+        }
+        xSemaphoreGive(rooms_mutex);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    *room = id;
+    return ESP_OK;
+}
+
+/**
+ * @brief 流式输出房间列表JSON
+ */
+esp_err_t chat_storage_write_rooms_json(chat_json_writer_t *writer) {
+    int written = 0;
+    chat_json_write_str(writer, "{\"rooms\":[");
+    for (int i = 0; i < CHAT_MAX_ROOMS; i++) {
+        chat_room_t *room = get_room(i);
+        if (room == NULL) {
+            continue;
+        }
+        if (written++ > 0) {
+            chat_json_write_raw(writer, ",", 1);
+        }
+        chat_json_write_str(writer, "{\"name\":");
+        chat_json_write_escaped(writer, room->name);
+        chat_json_write_str(writer, ",\"last_seq\":");
+        chat_json_write_u32(writer, __atomic_load_n(&room->store.last_seq, __ATOMIC_ACQUIRE));
+        chat_json_write_str(writer, ",\"count\":");
+        chat_json_write_u32(writer, (uint32_t)__atomic_load_n(&room->store.count, __ATOMIC_RELAXED));
+        chat_json_write_raw(writer, "}", 1);
+    }
+    return chat_json_write_str(writer, "]}");
+}
+
+/**
+ * @brief 获取所有房间的互斥锁
+ *
+ * 按房间编号顺序获取，只在启动回放日志时使用
+ */
+static void take_all_room_mutexes(void) {
+    for (int i = 0; i < CHAT_MAX_ROOMS; i++) {
+        chat_room_t *room = get_room(i);
+        if (room) {
+            take_room_mutex(room);
+        }
+    }
+}
+
+/**
+ * @brief 释放所有房间的互斥锁
+ */
+static void give_all_room_mutexes(void) {
+    for (int i = CHAT_MAX_ROOMS - 1; i >= 0; i--) {
+        chat_room_t *room = get_room(i);
+        if (room) {
+            xSemaphoreGive(room->mutex);
+        }
+    }
+}
+
+/**
+ * @brief 加载各房间的聊天历史
+ *
+ * 先从NVS恢复房间列表，再回放chatlog分区的日志；没有日志时从NVS加载并迁移。
+ * 在持久化任务开始处理保存之前运行，完成前写入接口返回ESP_ERR_INVALID_STATE
+ */
+static void load_history(void) {
+    chat_room_t *room = &lobby;
+
+    // 先恢复房间，日志中的消息按房间编号回放
+    restore_rooms();
+
+    const char *source = NULL;
+    esp_err_t err = chat_log_open();
+    if (err == ESP_OK) {
+        chat_log_set_retain_fn(log_record_in_memory, NULL);
+        int loaded_count = 0;
+        take_all_room_mutexes();
+        chat_log_replay(replay_log_message, &loaded_count);
+        for (int i = 0; i < CHAT_MAX_ROOMS; i++) {
+            chat_room_t *r = get_room(i);
+            if (r) {
+                r->persisted_seq = r->store.last_seq;
+            }
+        }
+        give_all_room_mutexes();
+        if (loaded_count > 0) {
+            source = "chat log";
+        }
+    } else {
+        ESP_LOGW(STORAGE_TAG, "Chat log partition unavailable (%s), using NVS", esp_err_to_name(err));
+    }
+
+    // 没有日志分区，或首次启动需要从NVS迁移
+    if (source == NULL) {
+        source = load_nvs_sources();
+    }
+
+    __atomic_store_n(&history_ready, true, __ATOMIC_RELEASE);
+
+    // 冷启动到历史可用的耗时
+    ESP_LOGI(STORAGE_TAG, "History ready: %d messages from %s in %lld ms (last seq %" PRIu32 ", arena %" PRIu32 "/%" PRIu32 " bytes)",
+             room->store.count, source ? source : "nowhere", (long long)((esp_timer_get_time() - history_start_us) / 1000),
+             room->store.last_seq, room->store.arena_head, room->store.arena_size);
+}
+
+/**
+ * @brief 初始化聊天存储系统
+ *
+ * 分配消息存储并创建互斥锁，然后启动持久化任务，由它在后台回放日志或从NVS加载并迁移历史。
+ * 函数返回时历史可能还没有加载完，见chat_storage_history_ready
+ *
+ * @return ESP_OK 成功，其他为错误码
+ */
+esp_err_t chat_storage_init(void) {
+    esp_err_t err = allocate_lobby_storage();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // 创建消息互斥锁，保证消息读写的线程安全
+    lobby.mutex = xSemaphoreCreateMutex();
+    save_mutex = xSemaphoreCreateMutex();
+    rooms_mutex = xSemaphoreCreateMutex();
+    if (lobby.mutex == NULL || save_mutex == NULL || rooms_mutex == NULL) {
+        ESP_LOGE(STORAGE_TAG, "Failed to create chat mutex");
+        return ESP_FAIL;
+    }
+
+    chat_dedup_init();
+
+    // 历史由持久化任务在后台加载，HTTP服务器不必等待
+    __atomic_store_n(&history_ready, false, __ATOMIC_RELAXED);
+    history_start_us = esp_timer_get_time();
+    start_persist_task();
+    if (persist_task_handle == NULL) {
+        load_history();
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief 历史是否已加载完成
+ */
+bool chat_storage_history_ready(void) {
+    return __atomic_load_n(&history_ready, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief 通知新消息已写入
+ *
+ * 依次调用监听回调，并按积压数量唤醒持久化任务（多次通知会合并）。
+ * 调用者需已释放房间的互斥锁
+ *
+ * @param messages 新写入的消息
+ * @param count 消息数量
+ * @param pending 写入后未保存的消息数量
+ */
+static void notify_new_messages(const chat_message_t *messages, int count, int pending) {
+    // 通知推送通道广播新消息，唤醒长轮询
+    for (int n = 0; n < count; n++) {
+        for (int i = 0; i < CHAT_MAX_MESSAGE_LISTENERS; i++) {
+            chat_message_listener_t listener = message_listeners[i];
+            if (listener) {
+                listener(&messages[n]);
+            }
+        }
+    }
+
+    // 达到数量阈值，或本次写入开始了新的定时周期时唤醒持久化任务
+    bool started = (pending == count);
+    if (pending >= MIN_MESSAGES_TO_SAVE || (started && PERSIST_FLUSH_INTERVAL_MS > 0)) {
+        if (persist_task_handle) {
+            xTaskNotifyGive(persist_task_handle);
+        } else if (pending >= MIN_MESSAGES_TO_SAVE) {
+            // 持久化任务创建失败时退回同步保存
+            take_pending_messages();
+            save_chat_history();
+        }
+    }
+}
+
+/**
+ * @brief 记录新写入的消息数量
+ *
+ * 各房间的写入者可能同时调用，计数原子累加
+ *
+ * @param count 新写入的消息数量
+ * @return int 所有房间未保存的消息数量
+ */
+static int add_pending(int count) {
+    int pending = __atomic_add_fetch(&new_messages_count, count, __ATOMIC_RELAXED);
+    if (count > 0) {
+        TickType_t now = xTaskGetTickCount();
+        __atomic_store_n(&last_message_tick, now, __ATOMIC_RELAXED);
+        // 第一条未保存消息开始计时
+        if (pending == count) {
+            __atomic_store_n(&first_pending_tick, now, __ATOMIC_RELAXED);
+        }
+    }
+    return pending;
+}
+
+/**
+ * @brief 添加新的聊天消息
+ *
+ * 使用服务器当前时间作为时间戳
+ *
+ * @param uuid 用户唯一标识符
+ * @param username 用户名
+ * @param message 消息内容
+ * @return ESP_OK 添加成功
+ * @return ESP_ERR_INVALID_ARG 参数为空或UUID格式不正确
+ * @return ESP_FAIL 添加失败
+ */
+esp_err_t chat_storage_add_message(const char *uuid, const char *username, const char *message) {
+    return chat_storage_add_message_with_timestamp(uuid, username, message, chat_storage_get_current_time());
+}
+
+/**
+ * @brief 添加带时间戳的聊天消息
+ *
+ * 将新消息写入默认房间的环形缓冲区并通知监听者。保存由持久化任务完成：积压达到MIN_MESSAGES_TO_SAVE条
+ * 或超过PERSIST_FLUSH_INTERVAL_MS时追加到chatlog分区的日志（没有日志分区时重写NVS中的blob）
+ *
+ * @param uuid 用户唯一标识符
+ * @param username 用户名
+ * @param message 消息内容
+ * @param timestamp 客户端提供的时间戳
+ * @return ESP_OK 添加成功
+ * @return ESP_ERR_INVALID_ARG 参数为空或UUID格式不正确
+ * @return ESP_ERR_INVALID_STATE 历史还没有加载完
+ * @return ESP_FAIL 添加失败
+ */
+esp_err_t chat_storage_add_message_with_timestamp(const char *uuid, const char *username, const char *message, uint32_t timestamp) {
+    if (!uuid || !username || !message) {
+        ESP_LOGE(STORAGE_TAG, "Invalid parameters: NULL pointer");
+        return ESP_ERR_INVALID_ARG;
+    }
+    // 历史加载完成前写入会与回放的序列号冲突
+    if (!chat_storage_history_ready()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint8_t uuid_bin[CHAT_UUID_BIN_LENGTH];
+    if (chat_storage_uuid_parse(uuid, uuid_bin) != ESP_OK) {
+        ESP_LOGW(STORAGE_TAG, "Invalid uuid format");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // 在锁外按字段上限截断，同时作为推送回调使用的副本
+    chat_room_t *room = &lobby;
+    chat_message_t pushed;
+    chat_storage_uuid_format(uuid_bin, pushed.uuid);
+    strlcpy(pushed.username, username, MAX_USERNAME_LENGTH);
+    strlcpy(pushed.message, message, MAX_MESSAGE_LENGTH);
+    pushed.timestamp = timestamp;
+    pushed.room = room->id;
+
+    if (take_room_mutex(room) == pdTRUE) {
+        // 分配序列号，与客户端时间戳无关，保证单调递增
+        pushed.seq = store_message_locked(room, uuid_bin, pushed.username, pushed.message, timestamp);
+        xSemaphoreGive(room->mutex);
+        int pending = add_pending(1);
+
+        notify_new_messages(&pushed, 1, pending);
+        return ESP_OK;
+    }
+
+    return ESP_FAIL;
+}
+
+/**
+ * @brief 批量添加聊天消息到默认房间
+ */
+esp_err_t chat_storage_add_messages(const chat_message_input_t *inputs, size_t count, chat_add_result_t *results) {
+    return chat_storage_add_room_messages(CHAT_ROOM_LOBBY, inputs, count, results);
+}
+
+/**
+ * @brief 批量添加聊天消息到指定房间
+ *
+ * 所有有效消息在一次持锁中写入，只累加一次未保存计数、唤醒一次持久化任务。
+ * 带client_id且与该房间最近的提交重复的消息不再写入，结果中标记duplicate
+ *
+ * @param room_id 房间编号
+ * @param inputs 待添加的消息
+ * @param count 消息数量，不超过CHAT_MAX_BATCH_MESSAGES
+ * @param results 输出参数，每条消息的结果
+ * @return ESP_OK 批量处理完成（单条消息的结果见results）
+ * @return ESP_ERR_INVALID_ARG 参数为空或数量超出上限
+ * @return ESP_ERR_NOT_FOUND 房间不存在
+ * @return ESP_ERR_TIMEOUT 缓冲池已用完
+ * @return ESP_ERR_INVALID_STATE 历史还没有加载完
+ * @return ESP_FAIL 获取互斥锁失败
+ */
+esp_err_t chat_storage_add_room_messages(int room_id, const chat_message_input_t *inputs, size_t count,
+                                         chat_add_result_t *results) {
+    if (!inputs || !results || count == 0 || count > CHAT_MAX_BATCH_MESSAGES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!chat_storage_history_ready()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    chat_room_t *room = get_room(room_id);
+    if (room == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // 与单条添加相同，在锁外解析UUID并截断字段，暂存区从缓冲池借用
+    batch_staging_t *staging = chat_pool_acquire();
+    if (!staging) {
+        return ESP_ERR_TIMEOUT;
+    }
+    chat_message_t *messages = staging->messages;
+    uint8_t (*uuids)[CHAT_UUID_BIN_LENGTH] = staging->uuids;
+    uint64_t *dedup_keys = staging->dedup_keys;
+
+    uint32_t now = chat_storage_get_current_time();
+    for (size_t i = 0; i < count; i++) {
+        const chat_message_input_t *in = &inputs[i];
+        results[i].err = ESP_ERR_INVALID_ARG;
+        results[i].seq = 0;
+        results[i].duplicate = false;
+        if (!in->username || !in->message) {
+            continue;
+        }
+        if (in->uuid_bin) {
+            memcpy(uuids[i], in->uuid_bin, CHAT_UUID_BIN_LENGTH);
+        } else if (!in->uuid || chat_storage_uuid_parse(in->uuid, uuids[i]) != ESP_OK) {
+            continue;
+        }
+        chat_message_t *m = &messages[i];
+        chat_storage_uuid_format(uuids[i], m->uuid);
+        strlcpy(m->username, in->username, MAX_USERNAME_LENGTH);
+        strlcpy(m->message, in->message, MAX_MESSAGE_LENGTH);
+        m->timestamp = in->timestamp > 0 ? in->timestamp : now;
+        m->room = room->id;
+        dedup_keys[i] = chat_dedup_key(uuids[i], in->client_id);
+        results[i].err = ESP_OK;
+    }
+
+    if (take_room_mutex(room) != pdTRUE) {
+        chat_pool_release(staging);
+        return ESP_FAIL;
+    }
+    int added = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (results[i].err != ESP_OK) {
+            continue;
+        }
+        // 客户端没收到响应而重试：返回第一次的序列号，不再写入、保存和推送
+        if (dedup_keys[i] != 0 && chat_dedup_find(room->id, dedup_keys[i], &results[i].seq)) {
+            results[i].duplicate = true;
+            continue;
+        }
+        chat_message_t *m = &messages[i];
+        m->seq = store_message_locked(room, uuids[i], m->username, m->message, m->timestamp);
+        results[i].seq = m->seq;
+        if (dedup_keys[i] != 0) {
+            chat_dedup_insert(room->id, dedup_keys[i], m->seq);
+        }
+        // 有效消息依次前移，作为监听回调的连续数组
+        if (added != (int)i) {
+            messages[added] = *m;
+        }
+        added++;
+    }
+    xSemaphoreGive(room->mutex);
+    int pending = add_pending(added);
+
+    if (added > 0) {
+        notify_new_messages(messages, added, pending);
+    }
+    chat_pool_release(staging);
+    return ESP_OK;
+}
+
+/**
+ * @brief 持久化任务函数
+ *
+ * 常驻任务，启动后先加载历史，之后由新消息通知唤醒。积压消息达到MIN_MESSAGES_TO_SAVE条，
+ * 或最老的未保存消息超过PERSIST_FLUSH_INTERVAL_MS时保存一次；
+ * 期间到达的多次通知合并为一次保存。到期时如果仍在连续收到消息，等PERSIST_QUIET_MS内
+ * 没有新消息再写闪存（最多推迟PERSIST_MAX_DEFER_MS），擦写闪存时两个核心都会暂停执行flash中的代码，
+ * 放在突发之间能减少对请求延迟的影响
+ *
+ * @param pvParameters 任务参数（未使用）
+ */
+static void persist_task(void *pvParameters) {
+    TickType_t wait = portMAX_DELAY;
+    bool deferring = false;    // 已到期、正在等待消息间隙
+    TickType_t due_tick = 0;   // 开始等待消息间隙的时刻
+
+    // 先在本任务中加载历史，加载完成前没有需要保存的消息
+    load_history();
+
+    while (persist_running) {
+        ulTaskNotifyTake(pdTRUE, wait);
+        if (!persist_running) {
+            break;
+        }
+
+        int pending = __atomic_load_n(&new_messages_count, __ATOMIC_RELAXED);
+        TickType_t since = __atomic_load_n(&first_pending_tick, __ATOMIC_RELAXED);
+        if (pending == 0) {
+            wait = portMAX_DELAY;
+            continue;
+        }
+
+        TickType_t now = xTaskGetTickCount();
+        TickType_t elapsed = now - since;
+        bool due = pending >= MIN_MESSAGES_TO_SAVE ||
+                   (PERSIST_FLUSH_INTERVAL_MS > 0 && elapsed >= pdMS_TO_TICKS(PERSIST_FLUSH_INTERVAL_MS));
+        if (!due) {
+            // 未到保存条件：等到定时截止，或被数量阈值提前唤醒
+            wait = PERSIST_FLUSH_INTERVAL_MS > 0 ? pdMS_TO_TICKS(PERSIST_FLUSH_INTERVAL_MS) - elapsed : portMAX_DELAY;
+            continue;
+        }
+
+        if (PERSIST_QUIET_MS > 0) {
+            TickType_t quiet = now - __atomic_load_n(&last_message_tick, __ATOMIC_RELAXED);
+            if (!deferring) {
+                due_tick = now;
+            }
+            TickType_t deferred = now - due_tick;
+            if (quiet < pdMS_TO_TICKS(PERSIST_QUIET_MS) && deferred < pdMS_TO_TICKS(PERSIST_MAX_DEFER_MS)) {
+                // 仍在突发中：等到消息间隙，或推迟到上限
+                if (!deferring) {
+                    deferring = true;
+                    chat_metrics_record_persist_deferred();
+                }
+                TickType_t until_quiet = pdMS_TO_TICKS(PERSIST_QUIET_MS) - quiet;
+                TickType_t until_limit = pdMS_TO_TICKS(PERSIST_MAX_DEFER_MS) - deferred;
+                wait = until_quiet < until_limit ? until_quiet : until_limit;
+                continue;
+            }
+            deferring = false;
+        }
+
+        ESP_LOGD(STORAGE_TAG, "Saving chat history after %d new messages", pending);
+        take_pending_messages();
+        if (save_chat_history() == ESP_ERR_TIMEOUT) {
+            // 缓冲池被请求占满，计数放回，稍后重试
+            __atomic_fetch_add(&new_messages_count, pending, __ATOMIC_RELAXED);
+            wait = pdMS_TO_TICKS(CHAT_POOL_WAIT_MS);
+            continue;
+        }
+        wait = portMAX_DELAY;
+    }
+
+    xSemaphoreGive(persist_exit);
+    vTaskDelete(NULL);
 }
 
 /**
@@ -705,21 +2342,59 @@ static void save_chat_history_task(void *pvParameters) {
 void chat_storage_deinit(void) {
     ESP_LOGI(STORAGE_TAG, "Deinitializing chat storage...");
 
-    // 确保所有消息都被保存到NVS
+    // 先停止持久化任务，再同步保存剩余消息
+    if (persist_task_handle != NULL) {
+        persist_running = false;
+        xTaskNotifyGive(persist_task_handle);
+        if (xSemaphoreTake(persist_exit, pdMS_TO_TICKS(PERSIST_STOP_TIMEOUT_MS)) != pdTRUE) {
+            ESP_LOGW(STORAGE_TAG, "Persist task did not stop in time");
+        }
+        persist_task_handle = NULL;
+    }
+
+    // 确保所有消息都被持久化
     if (new_messages_count > 0) {
         ESP_LOGI(STORAGE_TAG, "Saving %d pending messages before shutdown", new_messages_count);
-        save_chat_history();
         new_messages_count = 0;
+        save_chat_history();
     }
-
-    // 释放缓存
-    invalidate_cache();
+    // 房间即将释放，之后的日志写入不再整理
+    chat_log_set_retain_fn(NULL, NULL);
 
     // 释放互斥锁
-    if (chat_mutex != NULL) {
-        vSemaphoreDelete(chat_mutex);
-        chat_mutex = NULL;
+    if (save_mutex != NULL) {
+        vSemaphoreDelete(save_mutex);
+        save_mutex = NULL;
+    }
+    if (persist_exit != NULL) {
+        vSemaphoreDelete(persist_exit);
+        persist_exit = NULL;
+    }
+    if (rooms_mutex != NULL) {
+        vSemaphoreDelete(rooms_mutex);
+        rooms_mutex = NULL;
+    }
+
+    // 调用者已停止所有读取者（HTTP服务器、推送通道），可以安全释放
+    for (int i = 0; i < CHAT_MAX_ROOMS; i++) {
+        chat_room_t *room = rooms[i];
+        if (room == NULL) {
+            continue;
+        }
+        if (room->mutex != NULL) {
+            vSemaphoreDelete(room->mutex);
+        }
+        heap_caps_free(room->store.slots);
+        heap_caps_free(room->store.arena);
+        if (room == &lobby) {
+            memset(&room->store, 0, sizeof(room->store));
+            room->mutex = NULL;
+        } else {
+            heap_caps_free(room);
+            rooms[i] = NULL;
+        }
     }
+    __atomic_store_n(&history_ready, false, __ATOMIC_RELAXED);
 
     ESP_LOGI(STORAGE_TAG, "Chat storage deinitialized successfully");
 }
\ No newline at end of file
@@ -1,44 +1,189 @@
 #ifndef _CHAT_STORAGE_H_
 #define _CHAT_STORAGE_H_
 
+#include "sdkconfig.h"
 #include "esp_err.h"
 #include "freertos/semphr.h"
 #include "nvs.h"
+#include "chat_json.h"
 
 /* 系统配置常量 */
-#define MAX_MESSAGES 100       // 最大存储消息数量
+#define MAX_MESSAGES CONFIG_CHAT_MAX_MESSAGES // 内部RAM中的最大存储消息数量，使用PSRAM共享区时为下限
 #define MAX_MESSAGE_LENGTH 150  // 单条消息最大长度
 #define MAX_UUID_LENGTH 37      // UUID最大长度(36字符+空终止符)
 #define MAX_USERNAME_LENGTH 32  // 用户名最大长度
+#define MAX_CLIENT_ID_LENGTH 65 // 客户端消息ID最大长度(64字符+空终止符)
 #define NVS_MSG_KEY_PREFIX "msg_" // NVS存储消息的键前缀
 #define NVS_MSG_COUNT_KEY "msg_count" // NVS存储消息总数的键
-#define CACHE_VALID_TIME 30    // 缓存有效时间(秒)
-#define MIN_MESSAGES_TO_SAVE 5 // 最少累积消息数量触发保存
+#define NVS_MSG_SEQ_KEY "msg_seq"     // NVS存储最新消息序列号的键
+#define NVS_MSG_BLOB_KEY "msg_blob"   // NVS二进制blob格式历史的键
+#define NVS_MAX_SAVED_MESSAGES 100    // 保存到NVS的最新消息数量上限(受NVS分区大小限制)
+#define MIN_MESSAGES_TO_SAVE CONFIG_CHAT_PERSIST_FLUSH_COUNT // 最少累积消息数量触发保存
+#define CHAT_ARENA_SIZE CONFIG_CHAT_ARENA_SIZE       // 内部RAM中的消息记录共享区大小(字节)
+#define CHAT_MAX_USERNAMES CONFIG_CHAT_MAX_USERNAMES // 用户名驻留表大小
+#define CHAT_UUID_BIN_LENGTH 16       // 二进制UUID长度
+#define CHAT_USERNAME_INTERN_LEN 64   // 可驻留的用户名转义后最大长度，更长的直接存入消息记录
+#define CHAT_USERNAME_INLINE 0xFF     // 消息记录中表示用户名内联存放的编号
+#define CHAT_MAX_MESSAGE_LISTENERS 4  // 新消息监听回调数量上限
+#define CHAT_MAX_BATCH_MESSAGES 32    // 批量添加的消息数量上限
+#define CHAT_PAGE_MAX_MESSAGES 100    // 分页读取时单页消息数量上限，也是默认页大小
+#define CHAT_MAX_ROOMS CONFIG_CHAT_MAX_ROOMS                 // 房间数量上限（含默认房间）
+#define CHAT_ROOM_MAX_MESSAGES CONFIG_CHAT_ROOM_MAX_MESSAGES // 默认房间以外每个房间的槽位数
+#define CHAT_ROOM_ARENA_SIZE CONFIG_CHAT_ROOM_ARENA_SIZE     // 默认房间以外每个房间的记录共享区大小(字节)
+#define CHAT_ROOM_NAME_LENGTH 17      // 房间名最大长度(16字符+空终止符)，只允许小写字母、数字、'-'和'_'
+#define CHAT_ROOM_LOBBY 0             // 默认房间编号，不指定房间的请求都使用它
+#define CHAT_ROOM_LOBBY_NAME "lobby"  // 默认房间名
+#define NVS_ROOMS_KEY "rooms"         // NVS存储房间名列表的键
 
-/* 聊天消息结构体 */
+/* 聊天消息结构体（解码后的形式，用于推送回调和NVS读写） */
 typedef struct {
     char uuid[MAX_UUID_LENGTH];      // 消息唯一标识符
     char username[MAX_USERNAME_LENGTH]; // 用户名
     char message[MAX_MESSAGE_LENGTH]; // 消息内容
     uint32_t timestamp;             // 时间戳
+    uint32_t seq;                   // 服务器分配的单调递增序列号(从1开始)，每个房间独立编号
+    uint8_t room;                   // 房间编号
 } chat_message_t;
 
-/* 聊天消息存储结构体 */
+/*
+ * 消息记录头，存放在共享区中，后面依次紧跟内联用户名和消息内容。
+ * 字符串按JSON转义后的形式存放，输出时直接拷贝
+ */
+typedef struct {
+    uint8_t uuid[CHAT_UUID_BIN_LENGTH]; // 二进制UUID
+    uint8_t name_id;                // 用户名驻留表编号，CHAT_USERNAME_INLINE表示内联
+    uint8_t name_len;               // 内联用户名长度，驻留时为0
+    uint16_t body_len;              // 消息内容长度
+} chat_record_t;
+
+/* 消息槽位 */
 typedef struct {
-    chat_message_t messages[MAX_MESSAGES]; // 消息环形缓冲区
+    uint32_t timestamp;             // 时间戳
+    uint32_t offset;                // 消息记录在共享区中的偏移
+} chat_slot_t;
+
+/* 驻留的用户名（JSON转义后） */
+typedef struct {
+    uint16_t refs;                  // 引用该用户名的消息数，0表示空闲
+    uint8_t len;                    // 用户名长度
+    char name[CHAT_USERNAME_INTERN_LEN]; // 用户名内容
+} chat_username_t;
+
+/* 聊天消息存储结构体，每个房间一个 */
+typedef struct {
+    chat_slot_t *slots;                    // 消息槽位环形缓冲区，始终在内部RAM中，扫描历史时频繁访问
+    char *arena;                           // 消息记录共享区，按写入顺序循环使用，可位于PSRAM
+    int capacity;                          // 槽位数量，启动时按可用内存确定
+    uint32_t arena_size;                   // 共享区大小(字节)
+    chat_username_t usernames[CHAT_MAX_USERNAMES]; // 用户名驻留表
     int count;                             // 当前存储的消息数量
     int next_index;                        // 下一条消息的存储位置
+    uint32_t last_seq;                     // 最新一条消息的序列号，0表示没有消息
+    uint32_t arena_head;                   // 共享区的下一个写入位置
 } chat_storage_t;
 
+/**
+ * @brief 新消息监听回调
+ *
+ * 每条消息写入环形缓冲区后调用一次（不持有chat_mutex），
+ * 用于推送通道把新消息广播给订阅者
+ *
+ * @param message 刚写入的消息（仅在回调期间有效）
+ */
+typedef void (*chat_message_listener_t)(const chat_message_t *message);
+
+// 批量添加的一条消息
+typedef struct {
+    const char *uuid;       // 用户唯一标识符
+    const char *username;   // 用户名
+    const char *message;    // 消息内容
+    uint32_t timestamp;     // 客户端时间戳，0表示使用服务器时间
+    const uint8_t *uuid_bin; // 二进制UUID（CHAT_UUID_BIN_LENGTH字节），非NULL时代替uuid
+    const char *client_id;  // 客户端生成的消息ID，重试时不变，用于识别重复提交；可为NULL
+} chat_message_input_t;
+
+// 批量添加中一条消息的结果
+typedef struct {
+    esp_err_t err;          // ESP_OK 或 ESP_ERR_INVALID_ARG（UUID格式不正确等）
+    uint32_t seq;           // 分配的序列号，失败时为0
+    bool duplicate;         // 与最近一次提交的client_id相同，没有再次写入，seq为第一次分配的序列号
+} chat_add_result_t;
+
+/* 消息列表的输出格式 */
+typedef enum {
+    CHAT_FORMAT_JSON = 0,   // JSON文本
+    CHAT_FORMAT_CBOR,       // CBOR，整数键、16字节二进制UUID，键定义见chat_cbor.h
+} chat_format_t;
+
+/* 消息列表的查询方式 */
+typedef enum {
+    CHAT_QUERY_SINCE_SEQ = 0,       // 序列号之后的消息（增量轮询）
+    CHAT_QUERY_SINCE_TIMESTAMP,     // 时间戳之后的消息（旧客户端）
+    CHAT_QUERY_BEFORE_SEQ,          // 序列号之前的一页消息（分页加载历史）
+} chat_query_mode_t;
+
+/* 消息列表查询参数 */
+typedef struct {
+    chat_query_mode_t mode;     // 查询方式
+    uint32_t seq;               // CHAT_QUERY_SINCE_SEQ为since_seq，CHAT_QUERY_BEFORE_SEQ为before_seq
+    uint32_t since_timestamp;   // CHAT_QUERY_SINCE_TIMESTAMP的时间戳
+    int limit;                  // CHAT_QUERY_BEFORE_SEQ的页大小，1到CHAT_PAGE_MAX_MESSAGES
+    chat_format_t format;       // 输出格式
+    int room;                   // 房间编号，默认CHAT_ROOM_LOBBY
+} chat_messages_query_t;
+
 /**
  * @brief 初始化聊天存储系统
  *
- * 创建互斥锁并从NVS加载历史聊天消息
+ * 按可用内存分配默认房间的消息存储（有PSRAM时共享区放在PSRAM中），创建互斥锁，
+ * 然后由持久化任务在后台从NVS恢复房间列表，并从chatlog分区的日志回放各房间的历史聊天消息，
+ * 首次启动时把NVS中的旧格式历史迁移到日志；没有该分区时仍使用NVS（只保存默认房间）。
+ * 不等历史加载完就返回，加载期间写入接口返回ESP_ERR_INVALID_STATE。
+ * 加载和保存历史时从缓冲池借用缓冲区，调用前需已执行chat_pool_init
  *
- * @return ESP_OK 成功，其他为错误码
+ * @return ESP_OK 成功
+ * @return ESP_ERR_NO_MEM 消息存储分配失败
+ * @return ESP_FAIL 创建互斥锁失败
  */
 esp_err_t chat_storage_init(void);
 
+/**
+ * @brief 历史是否已加载完成
+ *
+ * 加载期间读取只能读到部分历史，调用者应让客户端稍后重试
+ *
+ * @return true 已加载完成，可以读写
+ * @return false 仍在后台加载
+ */
+bool chat_storage_history_ready(void);
+
+/**
+ * @brief 按名称查找房间，可选在不存在时创建
+ *
+ * 查找不加锁；创建时分配该房间的槽位和共享区（CHAT_ROOM_MAX_MESSAGES、CHAT_ROOM_ARENA_SIZE），
+ * 并把房间列表写入NVS，重启后房间编号不变。房间创建后一直存在到chat_storage_deinit
+ *
+ * @param name 房间名，NULL、空字符串或CHAT_ROOM_LOBBY_NAME表示默认房间
+ * @param create 不存在时是否创建
+ * @param room 输出参数，房间编号
+ * @return ESP_OK 成功
+ * @return ESP_ERR_INVALID_ARG 房间名不合法
+ * @return ESP_ERR_NOT_FOUND 房间不存在且create为false
+ * @return ESP_ERR_NO_MEM 房间数量已达CHAT_MAX_ROOMS或内存不足
+ * @return ESP_ERR_INVALID_STATE 需要创建房间，但历史还没有加载完
+ */
+esp_err_t chat_storage_find_room(const char *name, bool create, int *room);
+
+/**
+ * @brief 流式输出房间列表JSON
+ *
+ * 格式: {"rooms":[{"name":"lobby","last_seq":N,"count":N},...]}
+ *
+ * @param writer 输出器
+ * @return ESP_OK 成功，其他为输出器错误码
+ */
+esp_err_t chat_storage_write_rooms_json(chat_json_writer_t *writer);
+
 /**
  * @brief 添加新的聊天消息
  *
@@ -46,6 +191,7 @@ esp_err_t chat_storage_init(void);
  * @param username 用户名
  * @param message 消息内容
  * @return ESP_OK 添加成功
+ * @return ESP_ERR_INVALID_ARG 参数为空或UUID格式不正确
  * @return ESP_FAIL 添加失败
  */
 esp_err_t chat_storage_add_message(const char *uuid, const char *username, const char *message);
@@ -58,27 +204,193 @@ esp_err_t chat_storage_add_message(const char *uuid, const char *username, const
  * @param message 消息内容
  * @param timestamp 客户端提供的时间戳
  * @return ESP_OK 添加成功
+ * @return ESP_ERR_INVALID_ARG 参数为空或UUID格式不正确
+ * @return ESP_ERR_INVALID_STATE 历史还没有加载完
  * @return ESP_FAIL 添加失败
  */
 esp_err_t chat_storage_add_message_with_timestamp(const char *uuid, const char *username, const char *message, uint32_t timestamp);
 
 /**
- * @brief 获取所有聊天消息的JSON字符串
+ * @brief 批量添加聊天消息
+ *
+ * 所有有效消息在一次持锁中按顺序写入，只唤醒一次持久化任务；
+ * 无效的消息跳过，不影响其他消息
+ *
+ * @param inputs 待添加的消息
+ * @param count 消息数量，1到CHAT_MAX_BATCH_MESSAGES
+ * @param results 输出参数，与inputs一一对应的结果
+ * @return ESP_OK 批量处理完成（单条消息的结果见results）
+ * @return ESP_ERR_INVALID_ARG 参数为空或数量超出上限
+ * @return ESP_ERR_TIMEOUT 缓冲池已用完，调用者应让客户端稍后重试
+ * @return ESP_ERR_INVALID_STATE 历史还没有加载完
+ * @return ESP_FAIL 添加失败
+ */
+esp_err_t chat_storage_add_messages(const chat_message_input_t *inputs, size_t count, chat_add_result_t *results);
+
+/**
+ * @brief 批量添加聊天消息到指定房间
+ *
+ * 与chat_storage_add_messages相同，只获取该房间的互斥锁，不同房间的写入者互不等待。
+ * 启用CONFIG_CHAT_DEDUP时，client_id与该房间最近的提交相同的消息视为重试：
+ * 不再写入，结果为ESP_OK并标记duplicate，seq为第一次分配的序列号
+ *
+ * @param room 房间编号
+ * @param inputs 待添加的消息
+ * @param count 消息数量，1到CHAT_MAX_BATCH_MESSAGES
+ * @param results 输出参数，与inputs一一对应的结果
+ * @return ESP_OK 批量处理完成（单条消息的结果见results）
+ * @return ESP_ERR_INVALID_ARG 参数为空或数量超出上限
+ * @return ESP_ERR_NOT_FOUND 房间不存在
+ * @return ESP_ERR_TIMEOUT 缓冲池已用完，调用者应让客户端稍后重试
+ * @return ESP_ERR_INVALID_STATE 历史还没有加载完
+ * @return ESP_FAIL 添加失败
+ */
+esp_err_t chat_storage_add_room_messages(int room, const chat_message_input_t *inputs, size_t count,
+                                         chat_add_result_t *results);
+
+/**
+ * @brief 输出单条消息的JSON对象
+ *
+ * 格式: {"uuid":"...","username":"...","message":"...","timestamp":N,"seq":N}
  *
- * @return char* JSON字符串指针，调用者负责释放内存
- * @return NULL 获取失败
+ * @param message 消息
+ * @param writer 输出器
+ * @return ESP_OK 成功，其他为输出器错误码
  */
-char* chat_storage_get_messages_json(void);
+esp_err_t chat_storage_write_message_json(const chat_message_t *message, chat_json_writer_t *writer);
 
 /**
- * @brief 获取指定时间戳后的消息JSON
+ * @brief 流式输出所有聊天消息的JSON数组
+ *
+ * 不获取互斥锁，通过顺序锁逐条读取消息写入输出器的暂存缓冲区，
+ * 不构建cJSON树也不生成完整响应字符串
+ *
+ * @param writer 输出器，暂存缓冲区不小于CHAT_JSON_SCRATCH_SIZE
+ * @return ESP_OK 成功
+ * @return 其他 输出器错误码
+ */
+esp_err_t chat_storage_write_messages_json(chat_json_writer_t *writer);
+
+/**
+ * @brief 流式输出指定时间戳后的消息JSON
+ *
+ * 格式: {"messages":[...],"has_new_messages":bool,"last_seq":N}
  *
  * @param since_timestamp 时间戳
+ * @param writer 输出器，暂存缓冲区不小于CHAT_JSON_SCRATCH_SIZE
+ * @param has_new_messages 输出参数，是否有新消息
+ * @return ESP_OK 成功
+ * @return 其他 输出器错误码
+ */
+esp_err_t chat_storage_write_messages_since_json(uint32_t since_timestamp, chat_json_writer_t *writer,
+                                                 bool *has_new_messages);
+
+/**
+ * @brief 流式输出指定序列号之后的消息JSON
+ *
+ * 环形缓冲区中的消息按序列号连续存放，起始位置可直接计算(O(1))，
+ * 只访问新增的尾部消息；没有新消息时不访问任何消息内容。
+ * 若since_seq大于当前最新序列号（例如设备重启丢失了未保存消息），
+ * 按since_seq=0处理，返回全部消息
+ *
+ * @param since_seq 客户端已收到的最新序列号，0表示获取全部
+ * @param writer 输出器，暂存缓冲区不小于CHAT_JSON_SCRATCH_SIZE
  * @param has_new_messages 输出参数，是否有新消息
- * @return char* JSON字符串指针，调用者负责释放内存
- * @return NULL 获取失败
+ * @return ESP_OK 成功
+ * @return 其他 输出器错误码
+ */
+esp_err_t chat_storage_write_messages_since_seq_json(uint32_t since_seq, chat_json_writer_t *writer,
+                                                     bool *has_new_messages);
+
+/**
+ * @brief 流式输出指定序列号之前的一页消息JSON
+ *
+ * 格式: {"messages":[...],"has_more":bool,"oldest_seq":N,"last_seq":N}
+ * messages是序列号小于before_seq的最新limit条消息，按序列号升序；
+ * oldest_seq为本页最老一条消息的序列号，作为下一页的before_seq，本页为空时为0；
+ * has_more表示存储中还有更老的消息。每页只访问本页的消息，
+ * 耗时和响应大小与历史总长度无关
+ *
+ * @param before_seq 只输出序列号小于该值的消息，0或大于最新序列号时从最新一条开始
+ * @param limit 最多输出的消息数量，1到CHAT_PAGE_MAX_MESSAGES
+ * @param writer 输出器，暂存缓冲区不小于CHAT_JSON_SCRATCH_SIZE
+ * @return ESP_OK 成功
+ * @return ESP_ERR_INVALID_ARG limit超出范围
+ * @return 其他 输出器错误码
+ */
+esp_err_t chat_storage_write_messages_before_seq_json(uint32_t before_seq, int limit, chat_json_writer_t *writer);
+
+/**
+ * @brief 按查询参数流式输出消息列表
+ *
+ * 三种查询方式的响应字段与对应的*_json函数相同；CHAT_FORMAT_CBOR时输出同样结构的CBOR映射，
+ * messages为不定长数组，可与JSON一样边读取边分块发送
+ *
+ * @param query 查询参数
+ * @param writer 输出器，暂存缓冲区不小于CHAT_JSON_SCRATCH_SIZE
+ * @param has_new_messages 输出参数，是否有新消息（分页查询时总为false），可为NULL
+ * @return ESP_OK 成功
+ * @return ESP_ERR_INVALID_ARG 查询方式或页大小不合法
+ * @return ESP_ERR_NOT_FOUND 房间不存在
+ * @return 其他 输出器错误码
+ */
+esp_err_t chat_storage_write_messages(const chat_messages_query_t *query, chat_json_writer_t *writer,
+                                      bool *has_new_messages);
+
+/**
+ * @brief 注册新消息监听回调
+ *
+ * 回调在添加消息的任务中、释放互斥锁后依次调用，应尽快返回；所有房间的消息都会回调，
+ * 由message->room区分。
+ * 只应在启动和停止时注册和取消
+ *
+ * @param listener 回调函数，重复注册同一回调只生效一次
+ * @return ESP_OK 成功
+ * @return ESP_ERR_NO_MEM 监听回调数量已达CHAT_MAX_MESSAGE_LISTENERS
+ */
+esp_err_t chat_storage_add_message_listener(chat_message_listener_t listener);
+
+/**
+ * @brief 取消新消息监听回调
+ *
+ * @param listener 注册时的回调函数
+ */
+void chat_storage_remove_message_listener(chat_message_listener_t listener);
+
+/**
+ * @brief 解析标准格式的UUID字符串(8-4-4-4-12，十六进制不区分大小写)
+ *
+ * @param str UUID字符串
+ * @param out 输出参数，16字节二进制UUID
+ * @return ESP_OK 解析成功
+ * @return ESP_ERR_INVALID_ARG 格式不正确
+ */
+esp_err_t chat_storage_uuid_parse(const char *str, uint8_t out[CHAT_UUID_BIN_LENGTH]);
+
+/**
+ * @brief 把二进制UUID格式化为小写标准格式字符串
+ *
+ * @param uuid 16字节二进制UUID
+ * @param out 输出缓冲区，至少MAX_UUID_LENGTH字节
+ */
+void chat_storage_uuid_format(const uint8_t uuid[CHAT_UUID_BIN_LENGTH], char out[MAX_UUID_LENGTH]);
+
+/**
+ * @brief 获取默认房间最新一条消息的序列号
+ *
+ * 不加锁，可在处理请求时随时调用
+ *
+ * @return uint32_t 序列号，没有消息时为0
+ */
+uint32_t chat_storage_get_last_seq(void);
+
+/**
+ * @brief 获取指定房间最新一条消息的序列号
+ *
+ * @param room 房间编号
+ * @return uint32_t 序列号，没有消息或房间不存在时为0
  */
-char* chat_storage_get_messages_since_json(uint32_t since_timestamp, bool *has_new_messages);
+uint32_t chat_storage_get_room_last_seq(int room);
 
 /**
  * @brief 获取当前时间戳
@@ -90,7 +402,7 @@ uint32_t chat_storage_get_current_time(void);
 /**
  * @brief 释放聊天存储系统资源
  *
- * 保存所有未保存的消息并释放资源
+ * 保存所有未保存的消息并释放资源，需在所有读取者停止后调用
  */
 void chat_storage_deinit(void);
 
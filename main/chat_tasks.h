@@ -0,0 +1,28 @@
+#ifndef _CHAT_TASKS_H_
+#define _CHAT_TASKS_H_
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+
+/*
+ * 聊天服务各任务的核心和优先级
+ *
+ * 默认布局（双核）：Wi-Fi和lwIP协议栈在核心0；httpd任务（含WebSocket/SSE推送）、
+ * 长轮询任务和静态资源发送任务在核心1；持久化任务在核心0上以较低优先级运行，
+ * 保存历史时不占用处理请求的核心。单核芯片上所有任务都不绑定核心
+ */
+
+#if CONFIG_FREERTOS_UNICORE
+#define CHAT_HTTPD_TASK_CORE tskNO_AFFINITY
+#define CHAT_PERSIST_TASK_CORE tskNO_AFFINITY
+#else
+#define CHAT_TASK_CORE(core) ((core) < 0 ? tskNO_AFFINITY : (BaseType_t)(core)) // Kconfig中的-1表示不绑定
+#define CHAT_HTTPD_TASK_CORE CHAT_TASK_CORE(CONFIG_CHAT_HTTPD_TASK_CORE)     // httpd及跟随它的任务所在核心
+#define CHAT_PERSIST_TASK_CORE CHAT_TASK_CORE(CONFIG_CHAT_PERSIST_TASK_CORE) // 持久化任务所在核心
+#endif
+
+#define CHAT_HTTPD_TASK_PRIORITY CONFIG_CHAT_HTTPD_TASK_PRIORITY     // httpd和长轮询任务优先级
+#define CHAT_ASSET_TASK_PRIORITY (CHAT_HTTPD_TASK_PRIORITY - 1)      // 静态资源发送任务优先级，API请求优先
+#define CHAT_PERSIST_TASK_PRIORITY CONFIG_CHAT_PERSIST_TASK_PRIORITY // 持久化任务优先级
+
+#endif /* _CHAT_TASKS_H_ */
@@ -16,10 +16,13 @@
 #include "esp_netif.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "mdns.h"
 #include "lwip/apps/netbiosns.h"
 #include "protocol_examples_common.h" // 包含网络连接相关的通用函数，ESP-IDF提供的网络连接框架
 #include "chat_server.h" // 包含聊天服务器相关的函数声明
+#include "chat_bench.h"  // 包含存储层压测的函数声明
+#include "chat_power.h"  // 包含功耗调节器的函数声明
 #if CONFIG_EXAMPLE_WEB_DEPLOY_SD
 #include "driver/sdmmc_host.h" // 如果配置为从SD卡部署Web，则包含SDMMC主机驱动
 #endif
@@ -194,28 +197,55 @@ esp_err_t init_fs(void)
 static void shutdown_handler(void)
 {
     ESP_LOGI(TAG, "System shutdown initiated, cleaning up resources...");
+    // 停止功耗调节器，恢复默认的Wi-Fi省电设置
+    chat_power_deinit();
     // 停止REST服务器（会同时清理聊天存储）
     stop_rest_server();
     // 断开网络连接
     example_disconnect();
 }
 
+/**
+ * @brief 记录一个启动阶段完成的时刻
+ *
+ * @param phase 阶段名称
+ */
+static void log_boot_phase(const char *phase)
+{
+    static int64_t last_us = 0;
+    int64_t now_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Boot phase %s: %lld ms (+%lld ms)", phase,
+             (long long)(now_us / 1000), (long long)((now_us - last_us) / 1000));
+    last_us = now_us;
+}
+
 /**
  * @brief 应用程序主入口函数
  *
- * 初始化NVS、网络、mDNS、NetBIOS、文件系统，连接网络，
- * 初始化聊天服务器，并启动RESTful API服务器。
+ * 初始化NVS和聊天服务器（历史在后台加载），挂载文件系统，初始化网络、mDNS、NetBIOS，
+ * 连接网络后立即启动RESTful API服务器。
  *
  * 实现细节：
- * 1. 初始化各种系统组件
- * 2. 建立网络连接
- * 3. 初始化聊天服务器
- * 4. 启动RESTful服务器提供Web接口
+ * 1. 初始化NVS，启动聊天服务器，历史加载与之后的步骤并行
+ * 2. 初始化文件系统和网络组件，建立网络连接
+ * 3. 网络可用后立即启动RESTful服务器提供Web接口，不等历史加载完
+ * 4. 启动功耗调节器
+ * 每个阶段完成时记录启动以来的时间
  */
 void app_main(void)
 {
     // 初始化NVS（非易失性存储），用于存储配置和聊天历史
     ESP_ERROR_CHECK(nvs_flash_init());
+    log_boot_phase("nvs");
+
+    // 初始化聊天服务器：分配消息存储后立即返回，历史由后台任务加载，与连接网络同时进行
+    ESP_ERROR_CHECK(chat_server_init());
+    log_boot_phase("chat server");
+
+    // 初始化文件系统（根据配置选择Semihost、SD卡或SPIFFS），不依赖网络，先于连接完成
+    ESP_ERROR_CHECK(init_fs());
+    log_boot_phase("filesystem");
+
     // 初始化TCP/IP协议栈，建立网络环境
     ESP_ERROR_CHECK(esp_netif_init());
     // 创建默认事件循环，用于处理系统事件
@@ -233,13 +263,21 @@ void app_main(void)
     // 连接到网络（Wi-Fi或以太网，根据menuconfig配置）
     // protocol_examples_common中的函数，处理Wi-Fi/以太网连接细节
     ESP_ERROR_CHECK(example_connect());
-    // 初始化文件系统（根据配置选择Semihost、SD卡或SPIFFS）
-    ESP_ERROR_CHECK(init_fs());
+    log_boot_phase("network");
 
-    // 初始化聊天服务器，设置消息存储和管理机制
-    ESP_ERROR_CHECK(chat_server_init());
+#if CONFIG_CHAT_BENCH
+    // 压测固件：启动HTTP服务器之前先压测存储层，结果输出到日志
+    chat_bench_run();
+#endif
 
     // 启动RESTful API服务器，Web根目录从menuconfig配置中读取
-    // 该服务器提供API接口和静态文件服务
+    // 该服务器提供API接口和静态文件服务；历史加载完成前聊天接口返回503
     ESP_ERROR_CHECK(start_rest_server(CONFIG_EXAMPLE_WEB_MOUNT_POINT));
+    log_boot_phase("http server");
+
+    // 按聊天活跃程度调节Wi-Fi省电和CPU频率，失败时保持默认设置继续运行
+    esp_err_t err = chat_power_init();
+    if (err != ESP_OK && err != ESP_ERR_NOT_SUPPORTED) {
+        ESP_LOGW(TAG, "Power governor not started (%s)", esp_err_to_name(err));
+    }
 }
@@ -7,15 +7,27 @@
    CONDITIONS OF ANY KIND, either express or implied.
 */
 #include <string.h>          // 提供字符串操作函数，如strcpy、strcmp等
+#include <inttypes.h>        // 提供PRIx32等格式化宏
 #include <fcntl.h>           // 提供文件控制选项，用于文件操作的标志如O_RDONLY
+#include "freertos/FreeRTOS.h" // FreeRTOS任务和队列，用于静态资源发送任务
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_http_server.h" // ESP32的HTTP服务器库，提供创建和管理HTTP服务器的功能
 #include "esp_chip_info.h"   // 提供获取ESP32芯片信息的功能，如芯片型号、核心数等
 #include "esp_random.h"      // 提供随机数生成功能
 #include "esp_log.h"         // ESP32的日志系统，用于输出调试和信息日志
 #include "esp_vfs.h"         // 虚拟文件系统接口，用于文件操作
+#include "esp_rom_crc.h"     // ROM中的CRC32实现，用于计算嵌入资源的ETag
 #include "cJSON.h"           // 轻量级JSON解析和生成库，用于处理JSON数据
 #include "chat_server.h"     // 包含聊天服务器相关的函数声明
 #include "chat_storage.h"    // 包含聊天存储相关的函数声明
+#include "chat_push.h"       // 包含消息推送通道相关的函数声明
+#include "chat_longpoll.h"   // 包含长轮询相关的函数声明
+#include "chat_metrics.h"    // 包含运行指标相关的函数声明
+#include "chat_pool.h"       // 包含请求缓冲池相关的函数声明
+#include "chat_power.h"      // 包含功耗调节器相关的函数声明
+#include "chat_tasks.h"      // 各任务的核心和优先级分配
 
 static const char *REST_TAG = "esp-rest"; // 定义日志标签，用于ESP日志系统
 static httpd_handle_t server_instance = NULL; // 存储服务器实例句柄
@@ -23,6 +35,41 @@ static httpd_handle_t server_instance = NULL; // 存储服务器实例句柄
 #define FILE_PATH_MAX (ESP_VFS_PATH_MAX + 128) // 定义文件路径最大长度，ESP_VFS_PATH_MAX是ESP-IDF定义的文件系统路径最大长度
 #define SCRATCH_BUFSIZE (10240)                // 定义临时缓冲区大小，用于读写文件和处理HTTP请求
 
+#define HTTPD_MAX_SOCKETS CONFIG_CHAT_HTTPD_MAX_SOCKETS   // 同时打开的客户端连接上限
+#define ASSET_WORKERS CONFIG_CHAT_HTTPD_ASSET_WORKERS     // 发送静态资源的任务数量，0表示在httpd任务中发送
+#define ASSET_QUEUE_LENGTH (HTTPD_MAX_SOCKETS)            // 等待发送的静态资源请求上限
+#define ASSET_WORKER_STACK_SIZE 4096                      // 静态资源发送任务栈大小
+#define ASSET_WORKER_PRIORITY CHAT_ASSET_TASK_PRIORITY    // 低于httpd任务，API请求优先
+#define ASSET_WORKER_SCRATCH_SIZE 4096                    // 发送任务读取文件的缓冲区大小
+#define ASSET_STOP_TIMEOUT_MS 5000                        // 等待发送任务退出的最长时间
+
+// httpd自己占用3个套接字（监听、控制和一个备用），其余才能分给客户端
+#if HTTPD_MAX_SOCKETS > CONFIG_LWIP_MAX_SOCKETS - 3
+#error "CONFIG_CHAT_HTTPD_MAX_SOCKETS must be at most CONFIG_LWIP_MAX_SOCKETS - 3; raise LWIP_MAX_SOCKETS too"
+#endif
+
+// 推送连接和挂起的长轮询一直占着套接字，至少留出HTTPD_REQUEST_SOCKETS个给普通请求，
+// 否则它们占满后只能靠LRU清理互相挤掉，客户端在高峰时反复重连
+#define HTTPD_REQUEST_SOCKETS 2
+#if CONFIG_HTTPD_WS_SUPPORT
+#define HTTPD_WS_SOCKETS CONFIG_CHAT_WS_MAX_CLIENTS
+#else
+#define HTTPD_WS_SOCKETS 0
+#endif
+#if CONFIG_CHAT_SSE
+#define HTTPD_SSE_SOCKETS CONFIG_CHAT_SSE_MAX_CLIENTS
+#else
+#define HTTPD_SSE_SOCKETS 0
+#endif
+#if CONFIG_CHAT_LONG_POLL_MAX_WAIT_MS > 0
+#define HTTPD_LONGPOLL_SOCKETS CONFIG_CHAT_LONG_POLL_MAX_WAITERS
+#else
+#define HTTPD_LONGPOLL_SOCKETS 0
+#endif
+#if HTTPD_WS_SOCKETS + HTTPD_SSE_SOCKETS + HTTPD_LONGPOLL_SOCKETS + HTTPD_REQUEST_SOCKETS > HTTPD_MAX_SOCKETS
+#error "CHAT_WS_MAX_CLIENTS + CHAT_SSE_MAX_CLIENTS + CHAT_LONG_POLL_MAX_WAITERS must leave 2 of CONFIG_CHAT_HTTPD_MAX_SOCKETS free"
+#endif
+
 // REST服务器上下文结构体，存储服务器运行时需要的状态和数据
 typedef struct rest_server_context {
     char base_path[ESP_VFS_PATH_MAX + 1]; // Web服务器根目录路径，存储静态文件的位置
@@ -43,6 +90,52 @@ static rest_server_context_t *rest_context = NULL; // 存储REST上下文
         }                                                                              \
     } while (0)
 
+#if CONFIG_CHAT_WEB_EMBEDDED
+// 嵌入固件的前端资源（main/CMakeLists.txt中的EMBED_FILES），直接从闪存映射地址发送
+extern const uint8_t index_html_start[] asm("_binary_index_html_start");
+extern const uint8_t index_html_end[] asm("_binary_index_html_end");
+extern const uint8_t icon_png_start[] asm("_binary_icon_png_start");
+extern const uint8_t icon_png_end[] asm("_binary_icon_png_end");
+extern const uint8_t index_js_start[] asm("_binary_index_js_start");
+extern const uint8_t index_js_end[] asm("_binary_index_js_end");
+extern const uint8_t index_css_start[] asm("_binary_index_css_start");
+extern const uint8_t index_css_end[] asm("_binary_index_css_end");
+#if CONFIG_CHAT_WEB_GZIP
+// 构建时生成的gzip版本
+extern const uint8_t index_html_gz_start[] asm("_binary_index_html_gz_start");
+extern const uint8_t index_html_gz_end[] asm("_binary_index_html_gz_end");
+extern const uint8_t index_js_gz_start[] asm("_binary_index_js_gz_start");
+extern const uint8_t index_js_gz_end[] asm("_binary_index_js_gz_end");
+extern const uint8_t index_css_gz_start[] asm("_binary_index_css_gz_start");
+extern const uint8_t index_css_gz_end[] asm("_binary_index_css_gz_end");
+#define WEB_ASSET_GZ(name) name##_gz_start, name##_gz_end
+#else
+#define WEB_ASSET_GZ(name) NULL, NULL
+#endif
+
+#define WEB_ETAG_LENGTH 16 // "xxxxxxxx-gz"加引号和结束符
+
+// 嵌入的前端资源描述
+typedef struct {
+    const char *uri;                 // 请求路径
+    const char *type;                // Content-Type
+    const uint8_t *start;            // 原始内容
+    const uint8_t *end;
+    const uint8_t *gz_start;         // gzip内容，没有时为NULL
+    const uint8_t *gz_end;
+    char etag[WEB_ETAG_LENGTH];      // 原始内容的ETag，启动时按内容CRC32计算
+    char gz_etag[WEB_ETAG_LENGTH];   // gzip内容的ETag
+} web_asset_t;
+
+static web_asset_t web_assets[] = {
+    { "/index.html", "text/html", index_html_start, index_html_end, WEB_ASSET_GZ(index_html) },
+    { "/assets/index.js", "application/javascript", index_js_start, index_js_end, WEB_ASSET_GZ(index_js) },
+    { "/assets/index.css", "text/css", index_css_start, index_css_end, WEB_ASSET_GZ(index_css) },
+    { "/icon.png", "image/png", icon_png_start, icon_png_end, NULL, NULL },
+};
+
+#endif /* CONFIG_CHAT_WEB_EMBEDDED */
+
 // 检查文件扩展名的宏，忽略大小写，用于根据文件类型设置正确的Content-Type
 #define CHECK_FILE_EXTENSION(filename, ext) (strcasecmp(&filename[strlen(filename) - strlen(ext)], ext) == 0)
 
@@ -74,21 +167,121 @@ static esp_err_t set_content_type_from_file(httpd_req_t *req, const char *filepa
     return httpd_resp_set_type(req, type);
 }
 
+#if CONFIG_CHAT_WEB_EMBEDDED
+/**
+ * @brief 计算嵌入资源的ETag
+ *
+ * 每个资源按内容计算一次CRC32，固件不变时ETag也不变
+ */
+static void web_assets_init(void)
+{
+    for (size_t i = 0; i < sizeof(web_assets) / sizeof(web_assets[0]); i++) {
+        web_asset_t *asset = &web_assets[i];
+        uint32_t crc = esp_rom_crc32_le(0, asset->start, asset->end - asset->start);
+        snprintf(asset->etag, sizeof(asset->etag), "\"%08" PRIx32 "\"", crc);
+        // gzip是另一种表示，ETag需要区分
+        snprintf(asset->gz_etag, sizeof(asset->gz_etag), "\"%08" PRIx32 "-gz\"", crc);
+    }
+}
+
+/**
+ * @brief 请求头中是否包含指定内容
+ *
+ * @param req HTTP请求对象指针
+ * @param field 请求头名称
+ * @param token 要查找的内容
+ * @return true 请求头存在且包含token
+ */
+static bool request_header_contains(httpd_req_t *req, const char *field, const char *token)
+{
+    char value[128];
+    size_t len = httpd_req_get_hdr_value_len(req, field);
+    if (len == 0 || len >= sizeof(value) ||
+        httpd_req_get_hdr_value_str(req, field, value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    return strstr(value, token) != NULL;
+}
+
 /**
- * @brief 通用GET请求处理函数，用于发送文件内容
+ * @brief 发送嵌入固件的前端资源
+ *
+ * 直接把闪存映射的资源内容交给httpd_resp_send，不经过文件系统和临时缓冲区。
+ * 浏览器支持gzip时发送构建时压缩好的版本；If-None-Match匹配时返回304。
+ * 资源文件名在各版本间不变，全部以no-cache发送，每次按ETag重新验证，固件更新后立即生效
+ *
+ * @param req HTTP请求对象指针
+ * @return esp_err_t ESP_OK表示已处理，ESP_ERR_NOT_FOUND表示不是嵌入资源
+ */
+static esp_err_t send_embedded_asset(httpd_req_t *req)
+{
+    // 忽略查询参数，'/'对应index.html
+    size_t uri_len = strcspn(req->uri, "?");
+    const char *uri = req->uri;
+    if (uri_len == 1 && uri[0] == '/') {
+        uri = "/index.html";
+        uri_len = strlen(uri);
+    }
+
+    web_asset_t *asset = NULL;
+    for (size_t i = 0; i < sizeof(web_assets) / sizeof(web_assets[0]); i++) {
+        if (strlen(web_assets[i].uri) == uri_len && strncmp(uri, web_assets[i].uri, uri_len) == 0) {
+            asset = &web_assets[i];
+            break;
+        }
+    }
+    if (asset == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    bool gzip = asset->gz_start != NULL && request_header_contains(req, "Accept-Encoding", "gzip");
+    const char *etag = gzip ? asset->gz_etag : asset->etag;
+
+    httpd_resp_set_type(req, asset->type);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    if (asset->gz_start != NULL) {
+        httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    }
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    if (request_header_contains(req, "If-None-Match", etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    if (gzip) {
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+        return httpd_resp_send(req, (const char *)asset->gz_start, asset->gz_end - asset->gz_start);
+    }
+    return httpd_resp_send(req, (const char *)asset->start, asset->end - asset->start);
+}
+#endif /* CONFIG_CHAT_WEB_EMBEDDED */
+
+/**
+ * @brief 发送静态文件内容
  *
  * 处理对Web服务器根目录下文件的GET请求，读取文件内容并作为HTTP响应发送。
  * 如果请求URI是'/'，则默认发送index.html。
+ * 启用CONFIG_CHAT_WEB_EMBEDDED时优先发送嵌入固件的资源，其他路径再从文件系统读取
  *
  * @param req HTTP请求对象指针
+ * @param chunk 读取文件用的缓冲区
+ * @param chunk_size 缓冲区大小
  * @return esp_err_t ESP_OK表示成功，ESP_FAIL表示失败
  *
  * 该函数是一个通用的静态文件服务器实现，适用于HTML/CSS/JS等网页资源
  */
-static esp_err_t rest_common_get_handler(httpd_req_t *req)
+static esp_err_t send_static_content(httpd_req_t *req, char *chunk, size_t chunk_size)
 {
     char filepath[FILE_PATH_MAX];
 
+#if CONFIG_CHAT_WEB_EMBEDDED
+    esp_err_t err = send_embedded_asset(req);
+    if (err != ESP_ERR_NOT_FOUND) {
+        return err;
+    }
+#endif
+
     // 获取REST服务器上下文，包含了服务器配置和临时缓冲区
     rest_server_context_t *rest_context = (rest_server_context_t *)req->user_ctx;
     // 构建完整的文件路径，组合基础路径和URI
@@ -111,11 +304,10 @@ static esp_err_t rest_common_get_handler(httpd_req_t *req)
     set_content_type_from_file(req, filepath);
 
     // 使用临时缓冲区读取和发送文件内容
-    char *chunk = rest_context->scratch;
     ssize_t read_bytes;
     do {
         // 分块读取文件，提高内存使用效率
-        read_bytes = read(fd, chunk, SCRATCH_BUFSIZE);
+        read_bytes = read(fd, chunk, chunk_size);
         if (read_bytes == -1) {
             ESP_LOGE(REST_TAG, "Failed to read file : %s", filepath);
         } else if (read_bytes > 0) {
@@ -138,6 +330,144 @@ static esp_err_t rest_common_get_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+#if ASSET_WORKERS > 0
+static QueueHandle_t asset_queue = NULL;        // 转为异步的静态资源请求，NULL表示停止
+static SemaphoreHandle_t asset_workers_exit = NULL; // 每个发送任务退出时释放一次
+static int asset_workers_running = 0;           // 已启动的发送任务数量
+
+/**
+ * @brief 静态资源发送任务
+ *
+ * 慢速客户端下载脚本或图片时阻塞的是这里，httpd任务继续处理API请求。
+ * 收到NULL时退出
+ *
+ * @param pvParameters 未使用
+ */
+static void asset_worker_task(void *pvParameters)
+{
+    char *chunk = malloc(ASSET_WORKER_SCRATCH_SIZE);
+    httpd_req_t *req;
+    while (xQueueReceive(asset_queue, &req, portMAX_DELAY) == pdTRUE && req != NULL) {
+        if (chunk != NULL) {
+            send_static_content(req, chunk, ASSET_WORKER_SCRATCH_SIZE);
+        } else {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No memory");
+        }
+        httpd_req_async_handler_complete(req);
+    }
+    free(chunk);
+    xSemaphoreGive(asset_workers_exit);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief 启动静态资源发送任务
+ *
+ * 创建失败时不影响服务，静态资源改为在httpd任务中发送
+ */
+static void asset_workers_init(void)
+{
+    asset_queue = xQueueCreate(ASSET_QUEUE_LENGTH, sizeof(httpd_req_t *));
+    asset_workers_exit = xSemaphoreCreateCounting(ASSET_WORKERS, 0);
+    if (asset_queue == NULL || asset_workers_exit == NULL) {
+        ESP_LOGW(REST_TAG, "No memory for asset workers, serving assets on the httpd task");
+        if (asset_queue != NULL) {
+            vQueueDelete(asset_queue);
+            asset_queue = NULL;
+        }
+        if (asset_workers_exit != NULL) {
+            vSemaphoreDelete(asset_workers_exit);
+            asset_workers_exit = NULL;
+        }
+        return;
+    }
+
+    for (int i = 0; i < ASSET_WORKERS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "asset_worker%d", i);
+        if (xTaskCreatePinnedToCore(asset_worker_task, name, ASSET_WORKER_STACK_SIZE, NULL,
+                                    ASSET_WORKER_PRIORITY, NULL, CHAT_HTTPD_TASK_CORE) != pdPASS) {
+            ESP_LOGW(REST_TAG, "Failed to create %s", name);
+            break;
+        }
+        asset_workers_running++;
+    }
+    ESP_LOGI(REST_TAG, "%d asset workers started", asset_workers_running);
+}
+
+/**
+ * @brief 停止静态资源发送任务
+ *
+ * 已排队的请求先发送完，需在停止httpd之前调用
+ */
+static void asset_workers_deinit(void)
+{
+    if (asset_queue == NULL) {
+        return;
+    }
+    QueueHandle_t queue = asset_queue;
+    for (int i = 0; i < asset_workers_running; i++) {
+        httpd_req_t *stop = NULL;
+        xQueueSend(queue, &stop, portMAX_DELAY);
+    }
+    for (int i = 0; i < asset_workers_running; i++) {
+        if (xSemaphoreTake(asset_workers_exit, pdMS_TO_TICKS(ASSET_STOP_TIMEOUT_MS)) != pdTRUE) {
+            ESP_LOGW(REST_TAG, "Asset worker did not exit in time");
+            break;
+        }
+    }
+    asset_queue = NULL;
+    asset_workers_running = 0;
+    vQueueDelete(queue);
+    vSemaphoreDelete(asset_workers_exit);
+    asset_workers_exit = NULL;
+}
+
+/**
+ * @brief 把静态资源请求交给发送任务
+ *
+ * @param req HTTP请求对象指针
+ * @return true 已转为异步请求并排队，httpd任务可以立即返回
+ */
+static bool queue_asset_request(httpd_req_t *req)
+{
+    if (asset_queue == NULL || asset_workers_running == 0 || uxQueueSpacesAvailable(asset_queue) == 0) {
+        return false;
+    }
+    httpd_req_t *async_req = NULL;
+    if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+        return false;
+    }
+    if (xQueueSend(asset_queue, &async_req, 0) != pdTRUE) {
+        httpd_req_async_handler_complete(async_req);
+        return false;
+    }
+    return true;
+}
+#endif /* ASSET_WORKERS > 0 */
+
+/**
+ * @brief 静态资源的GET请求处理函数
+ *
+ * 有发送任务时把请求转为异步请求交给发送任务，httpd任务立即返回处理其他请求；
+ * 发送任务繁忙（队列已满）或未启用时直接在httpd任务中发送
+ *
+ * @param req HTTP请求对象指针
+ * @return esp_err_t ESP_OK表示成功，ESP_FAIL表示失败
+ */
+static esp_err_t rest_common_get_handler(httpd_req_t *req)
+{
+    // 打开页面算作交互，空闲时立即切回活跃档
+    chat_power_note_request(true);
+#if ASSET_WORKERS > 0
+    if (queue_asset_request(req)) {
+        return ESP_OK;
+    }
+#endif
+    rest_server_context_t *ctx = (rest_server_context_t *)req->user_ctx;
+    return send_static_content(req, ctx->scratch, SCRATCH_BUFSIZE);
+}
+
 /**
  * @brief 处理获取系统信息的GET请求
  *
@@ -185,6 +515,51 @@ static esp_err_t temperature_data_get_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+#if CONFIG_CHAT_METRICS
+/**
+ * @brief 指标输出的刷新回调，把暂存缓冲区作为一个HTTP分块发送
+ *
+ * @param ctx HTTP请求对象
+ * @param data 待发送数据
+ * @param len 数据长度
+ * @return ESP_OK 发送成功
+ */
+static esp_err_t metrics_chunk_flush(void *ctx, const char *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
+
+/**
+ * @brief 处理获取运行指标的GET请求
+ *
+ * 以Prometheus文本格式返回各接口的请求数和耗时分布、存储互斥锁等待时间、
+ * 序列化和持久化统计以及堆内存状态，可直接由Prometheus抓取
+ *
+ * @param req HTTP请求对象指针
+ * @return esp_err_t ESP_OK表示成功
+ */
+static esp_err_t metrics_get_handler(httpd_req_t *req)
+{
+    rest_server_context_t *ctx = (rest_server_context_t *)req->user_ctx;
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    // 借用上下文的临时缓冲区，写满后分块发送
+    chat_json_writer_t writer;
+    chat_json_writer_init(&writer, ctx->scratch, SCRATCH_BUFSIZE, metrics_chunk_flush, req);
+    esp_err_t err = chat_metrics_write_prometheus(&writer);
+    if (err == ESP_OK) {
+        err = chat_json_flush(&writer);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(REST_TAG, "Failed to send metrics: %s", esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+#endif
+
 /**
  * @brief 启动RESTful API服务器
  *
@@ -203,19 +578,32 @@ esp_err_t start_rest_server(const char *base_path)
     REST_CHECK(rest_context, "No memory for rest context", err);
     // 复制根目录路径到上下文
     strlcpy(rest_context->base_path, base_path, sizeof(rest_context->base_path));
+#if CONFIG_CHAT_WEB_EMBEDDED
+    web_assets_init();
+#endif
 
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG(); // 获取默认HTTP服务器配置
-    config.max_open_sockets = 7; // 将最大并发连接数从16修改为7，以符合系统限制
+    config.max_open_sockets = HTTPD_MAX_SOCKETS; // 受LWIP_MAX_SOCKETS限制，见文件开头的检查
+    // 连接数已满时关闭最久未收到数据的连接，接受新连接。只下行的SSE流最先被关闭，客户端按Last-Event-ID重连
+    config.lru_purge_enable = CONFIG_CHAT_HTTPD_LRU_PURGE;
+    config.max_uri_handlers = 16; // 默认8个处理函数不够用（聊天API、推送通道、静态文件等）
     config.uri_match_fn = httpd_uri_match_wildcard; // 启用通配符URI匹配，支持模式如/api/*
+    config.core_id = CHAT_HTTPD_TASK_CORE; // 与Wi-Fi任务分开，推送也在httpd任务中发送
+    config.task_priority = CHAT_HTTPD_TASK_PRIORITY;
 
-    ESP_LOGI(REST_TAG, "Starting HTTP Server");
+    ESP_LOGI(REST_TAG, "Starting HTTP Server (core %d, priority %d)",
+             config.core_id == tskNO_AFFINITY ? -1 : (int)config.core_id, (int)config.task_priority);
     // 启动HTTP服务器
     REST_CHECK(httpd_start(&server, &config) == ESP_OK, "Start server failed", err_start);
 
     // 保存服务器实例句柄以便于后续停止服务器
     server_instance = server;
 
+#if ASSET_WORKERS > 0
+    asset_workers_init();
+#endif
+
     /* 注册系统信息API路由 */
     httpd_uri_t system_info_get_uri = {
         .uri = "/api/v1/system/info", // URI路径
@@ -234,6 +622,17 @@ esp_err_t start_rest_server(const char *base_path)
     };
     httpd_register_uri_handler(server, &temperature_data_get_uri);
 
+#if CONFIG_CHAT_METRICS
+    /* 注册运行指标API路由 */
+    httpd_uri_t metrics_get_uri = {
+        .uri = CHAT_METRICS_URI,
+        .method = HTTP_GET,
+        .handler = metrics_get_handler,
+        .user_ctx = rest_context
+    };
+    httpd_register_uri_handler(server, &metrics_get_uri);
+#endif
+
     // 注册聊天服务器相关的URI处理函数
     register_chat_uri_handlers(server);
 
@@ -265,6 +664,15 @@ esp_err_t stop_rest_server(void)
 {
     esp_err_t err = ESP_OK;
 
+    // 先停止推送通道，避免停止过程中继续向连接排队发送
+    chat_push_deinit();
+    // 响应所有挂起的长轮询请求，必须在httpd停止之前
+    chat_longpoll_deinit();
+#if ASSET_WORKERS > 0
+    // 发送完已排队的静态资源请求
+    asset_workers_deinit();
+#endif
+
     // 如果服务器实例存在，停止它
     if (server_instance != NULL) {
         ESP_LOGI(REST_TAG, "Stopping HTTP Server");
@@ -283,6 +691,8 @@ esp_err_t stop_rest_server(void)
 
     // 清理聊天存储系统，确保所有消息都被保存
     chat_storage_deinit();
+    // 所有请求已结束，缓冲区都已归还
+    chat_pool_deinit();
 
     ESP_LOGI(REST_TAG, "HTTP Server stopped and resources released");
     return err;
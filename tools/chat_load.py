@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+"""Simulate browser clients polling and posting against the chat API.
+
+Usage: chat_load.py [--url http://chat.local] [--pollers 10] [--posters 1]
+                    [--duration 30] [--interval 1.0] [--wait-ms 0] ...
+
+Each poller mimics the front-end: it keeps its own since_seq cursor, sends
+If-None-Match with the last ETag and, with --wait-ms, long-polls. Posters
+send a message every --post-interval seconds carrying their send time, so
+pollers can also report end-to-end delivery latency. Only the standard
+library is used. Point it at a board built with CONFIG_CHAT_METRICS to get
+the device-side view from /api/v1/system/metrics at the end.
+"""
+
+import argparse
+import http.client
+import json
+import re
+import sys
+import threading
+import time
+import urllib.parse
+
+MARKER = 'chat_load t='
+
+
+class Stats:
+    """Thread-safe latency and status counters for one kind of request."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latencies = []
+        self.statuses = {}
+        self.errors = 0
+        self.bytes = 0
+
+    def record(self, latency, status, size):
+        with self.lock:
+            self.latencies.append(latency)
+            self.statuses[status] = self.statuses.get(status, 0) + 1
+            self.bytes += size
+
+    def error(self):
+        with self.lock:
+            self.errors += 1
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def report(name, stats, duration):
+    lat = stats.latencies
+    statuses = ' '.join('%s:%d' % (k, v) for k, v in sorted(stats.statuses.items()))
+    print('%-10s %6d req %7.1f/s  p50 %6.1f ms  p90 %6.1f ms  p99 %6.1f ms  max %6.1f ms  '
+          '%8.1f KB  errors %d  [%s]' % (
+              name, len(lat), len(lat) / duration,
+              percentile(lat, 50) * 1000, percentile(lat, 90) * 1000,
+              percentile(lat, 99) * 1000, max(lat, default=0) * 1000,
+              stats.bytes / 1024, stats.errors, statuses))
+
+
+def connect(url, timeout):
+    cls = http.client.HTTPSConnection if url.scheme == 'https' else http.client.HTTPConnection
+    return cls(url.hostname, url.port, timeout=timeout)
+
+
+def request(conn, method, path, body=None, headers=None):
+    start = time.monotonic()
+    conn.request(method, path, body=body, headers=headers or {})
+    resp = conn.getresponse()
+    data = resp.read()
+    return resp, data, time.monotonic() - start
+
+
+def poller(args, url, deadline, stats, delivery):
+    since_seq = 0
+    etag = None
+    conn = None
+    params = '&wait_ms=%d' % args.wait_ms if args.wait_ms else ''
+    while time.monotonic() < deadline:
+        started = time.monotonic()
+        try:
+            if conn is None:
+                conn = connect(url, args.wait_ms / 1000 + 10)
+            headers = {'If-None-Match': etag} if etag and not args.no_etag else {}
+            resp, data, latency = request(conn, 'GET', '/api/chat/messages?since_seq=%d%s' % (since_seq, params),
+                                          headers=headers)
+            stats.record(latency, resp.status, len(data))
+            etag = resp.getheader('ETag') or etag
+            if resp.status == 200:
+                body = json.loads(data)
+                # The first poll returns the whole history, including earlier runs
+                first = since_seq == 0
+                since_seq = body.get('last_seq', since_seq)
+                now = time.time()
+                for message in [] if first else body.get('messages', []):
+                    match = re.search(re.escape(MARKER) + r'([0-9.]+)', message.get('message', ''))
+                    if match:
+                        delivery.record(now - float(match.group(1)), 'delivered', 0)
+        except (OSError, http.client.HTTPException, ValueError):
+            stats.error()
+            if conn is not None:
+                conn.close()
+            conn = None
+            time.sleep(0.5)
+            continue
+        # Like the front-end: wait out the rest of the interval before the next poll
+        time.sleep(max(0.0, args.interval - (time.monotonic() - started)))
+    if conn is not None:
+        conn.close()
+
+
+def poster(args, url, deadline, stats, index):
+    conn = connect(url, 10)
+    try:
+        _, data, _ = request(conn, 'GET', '/api/chat/uuid')
+        uuid = json.loads(data)['uuid']
+    except (OSError, http.client.HTTPException, ValueError, KeyError):
+        stats.error()
+        return
+    count = 0
+    while time.monotonic() < deadline:
+        started = time.monotonic()
+        messages = []
+        for _ in range(args.batch or 1):
+            count += 1
+            messages.append({'uuid': uuid, 'username': 'load-%d' % index,
+                             'message': '%s%.6f #%d' % (MARKER, time.time(), count)})
+        try:
+            if args.batch:
+                path, body = '/api/chat/messages:batch', messages
+            else:
+                path, body = '/api/chat/message', messages[0]
+            resp, data, latency = request(conn, 'POST', path, json.dumps(body),
+                                          {'Content-Type': 'application/json'})
+            stats.record(latency, resp.status, len(data))
+        except (OSError, http.client.HTTPException):
+            stats.error()
+            conn.close()
+            conn = connect(url, 10)
+        time.sleep(max(0.0, args.post_interval - (time.monotonic() - started)))
+    conn.close()
+
+
+def print_device_metrics(url):
+    try:
+        conn = connect(url, 10)
+        resp, data, _ = request(conn, 'GET', '/api/v1/system/metrics')
+        conn.close()
+    except (OSError, http.client.HTTPException):
+        return
+    if resp.status != 200:
+        return
+    print('device metrics:')
+    for line in data.decode().splitlines():
+        if re.match(r'chat_(heap|persist_(failures|deferred|duration_seconds_(p|count))|'
+                    r'storage_mutex_wait_seconds_(p|count)|http_request_duration_seconds_(p|count))', line):
+            print('  ' + line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--url', default='http://chat.local', help='server base URL')
+    parser.add_argument('--pollers', type=int, default=10, help='number of polling clients')
+    parser.add_argument('--posters', type=int, default=1, help='number of posting clients')
+    parser.add_argument('--duration', type=float, default=30, help='test duration in seconds')
+    parser.add_argument('--interval', type=float, default=1.0, help='poll interval in seconds')
+    parser.add_argument('--wait-ms', type=int, default=0, help='long-poll wait_ms (0 disables)')
+    parser.add_argument('--no-etag', action='store_true', help='do not send If-None-Match')
+    parser.add_argument('--post-interval', type=float, default=2.0, help='seconds between posts per poster')
+    parser.add_argument('--batch', type=int, default=0, help='post N messages per request to messages:batch')
+    args = parser.parse_args()
+
+    url = urllib.parse.urlsplit(args.url)
+    deadline = time.monotonic() + args.duration
+    polls, posts, delivery = Stats(), Stats(), Stats()
+    threads = [threading.Thread(target=poller, args=(args, url, deadline, polls, delivery), daemon=True)
+               for _ in range(args.pollers)]
+    threads += [threading.Thread(target=poster, args=(args, url, deadline, posts, i), daemon=True)
+                for i in range(args.posters)]
+
+    start = time.monotonic()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join(args.duration + args.wait_ms / 1000 + 15)
+    elapsed = time.monotonic() - start
+
+    print('%d pollers, %d posters, %.1f s' % (args.pollers, args.posters, elapsed))
+    report('poll', polls, elapsed)
+    report('post', posts, elapsed)
+    report('delivery', delivery, elapsed)
+    print_device_metrics(url)
+    return 1 if polls.errors or posts.errors else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,27 @@
+#!/usr/bin/env python3
+"""Compress a front-end asset for embedding in the firmware.
+
+Usage: gzip_asset.py <input> <output>
+
+The gzip header carries no file name or timestamp, so the output (and the
+ETag derived from it) only changes when the input does.
+"""
+
+import gzip
+import sys
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write('usage: gzip_asset.py <input> <output>\n')
+        return 1
+
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+    with open(sys.argv[2], 'wb') as f:
+        f.write(gzip.compress(data, compresslevel=9, mtime=0))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())